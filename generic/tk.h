@@ -1093,6 +1093,13 @@ typedef struct Tk_ItemType {
 
 #endif /* __NO_OLD_CONFIG */
 
+/*
+ * Flag for Tk_CanvasSetCoords: add the points to the end of the item's
+ * coordinates instead of replacing them.
+ */
+
+#define TK_CANVAS_COORDS_APPEND	1
+
 /*
  * The following structure provides information about the selection and the
  * insertion cursor. It is needed by only a few items, such as those that
@@ -1296,6 +1303,13 @@ typedef struct Tk_PhotoImageBlock {
 #define TK_PHOTO_COMPOSITE_OVERLAY	0
 #define TK_PHOTO_COMPOSITE_SET		1
 
+/*
+ * Flag for Tk_PhotoCommitBuffer: the pixels written are all fully opaque, so
+ * their alpha values needn't be examined.
+ */
+
+#define TK_PHOTO_BUFFER_OPAQUE		1
+
 /*
  * Procedure prototypes and structures used in reading and writing photo
  * images:
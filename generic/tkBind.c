@@ -242,6 +242,51 @@ typedef struct {
 
 TK_PTR_ARRAY_DEFINE(VirtOwners, Tcl_HashEntry); /* define array of hash entries */
 
+/*
+ * A binding script is pre-parsed into a BindTemplate the first time its
+ * binding fires, so that most scripts need not be substituted and parsed
+ * again for every event:
+ *
+ * BIND_STATIC - The script contains no % sequences. It is evaluated as a
+ *		 shared Tcl_Obj, which keeps its compiled bytecode.
+ * BIND_WORDS -	 Every % sequence in the script is a whole bare word, and
+ *		 all other words are literal. Each event builds the commands
+ *		 as pure lists of the cached literal words and the values of
+ *		 the % sequences, which Tcl runs without parsing.
+ * BIND_EXPAND - Anything else; expanded by ExpandPercents for each event.
+ *
+ * The BIND_WORDS form runs the same commands as the textual substitution
+ * would, because ExpandPercents quotes each value as a single list element.
+ */
+
+typedef enum {
+    BIND_STATIC, BIND_WORDS, BIND_EXPAND
+} BindTemplateKind;
+
+typedef struct {
+    Tcl_Obj *literalObj;	/* Literal word, or NULL for a % sequence. */
+    char field;			/* Character following the % of a % sequence. */
+    char lastInCmd;		/* Non-zero for the last word of a command. */
+} BindWord;
+
+typedef struct BindTemplate {
+    BindTemplateKind kind;
+    Tcl_Obj *scriptObj;		/* BIND_STATIC: the script. */
+    Tcl_Size numWords;		/* BIND_WORDS: number of entries in words. */
+    BindWord words[TKFLEXARRAY];/* BIND_WORDS: the words of all commands. */
+} BindTemplate;
+
+/*
+ * A script that Tk_BindEvent has found for an event, ready to be evaluated.
+ */
+
+typedef struct {
+    BindTemplateKind kind;	/* Form of the template it was made from. */
+    Tcl_Obj *objPtr;		/* BIND_STATIC: the script. BIND_WORDS: list of
+				 * commands, each a list of words. BIND_EXPAND:
+				 * the expanded script. */
+} BoundScript;
+
 /*
  * The following structure defines a pattern sequence, which consists of one
  * or more patterns. In order to trigger, a pattern sequence must match the
@@ -270,6 +315,8 @@ typedef struct PatSeq {
     unsigned modMaskUsed:1;	/* Does at least one pattern contain a non-zero modifier mask? */
     DEBUG(unsigned owned:1;)	/* For debugging purposes. */
     char *script;		/* Binding script to evaluate when sequence matches (ckalloc()ed) */
+    BindTemplate *templPtr;	/* Pre-parsed form of script, built when the binding first fires;
+				 * NULL until then, and whenever the script changes. */
     Tcl_Obj* object;		/* Token for object with which binding is associated. For virtual
 				 * event table this is NULL. */
     struct PatSeq *nextSeqPtr;	/* Next in list of all pattern sequences that have the same initial
@@ -697,6 +744,14 @@ static int		DeleteVirtualEvent(Tcl_Interp *interp, VirtualEventTable *vetPtr,
 static void		DeleteVirtualEventTable(VirtualEventTable *vetPtr);
 static void		ExpandPercents(TkWindow *winPtr, const char *before, Event *eventPtr,
 			    unsigned scriptCount, Tcl_DString *dsPtr);
+static void		FreeBindTemplate(BindTemplate *templPtr);
+static const char *	GetPercentValue(TkWindow *winPtr, int c, Event *eventPtr,
+			    unsigned scriptCount, char *numStorage, Tcl_DString *bufPtr);
+static Tcl_Obj *	InstantiateBindTemplate(const BindTemplate *templPtr,
+			    TkWindow *winPtr, Event *eventPtr, unsigned scriptCount);
+static BindTemplate *	MakeBindTemplate(const char *script);
+static Tcl_Size		ParseBindWords(const char *script, Tcl_Size numPercents,
+			    BindWord *wordPtr);
 static PatSeq *		FindSequence(Tcl_Interp *interp, LookupTables *lookupTables,
 			    void *object, const char *eventString, int create,
 			    int allowVirtual, unsigned *maskPtr);
@@ -889,6 +944,9 @@ FreePatSeq(
     assert(!psPtr->owned);
     DEBUG(MARK_PSENTRY(psPtr);)
     ckfree(psPtr->script);
+    if (psPtr->templPtr) {
+	FreeBindTemplate(psPtr->templPtr);
+    }
     if (!psPtr->object) {
 	VirtOwners_Free(&psPtr->ptr.owners);
     }
@@ -1691,6 +1749,10 @@ Tk_CreateBinding(
     }
     ckfree(oldStr);
     psPtr->script = newStr;
+    if (psPtr->templPtr) {
+	FreeBindTemplate(psPtr->templPtr);
+	psPtr->templPtr = NULL;
+    }
     return eventMask;
 }
 
@@ -2157,9 +2219,9 @@ Tk_BindEvent(
     PatSeq *matchPtrBuf[32];
     PatSeq **matchPtrArr = matchPtrBuf;
     PSList *psl[2];
-    Tcl_DString scripts;
-    const char *p;
-    const char *end;
+    BoundScript scriptBuf[32];
+    BoundScript *scriptArr = scriptBuf;
+    Tcl_Size numScripts;
     unsigned scriptCount;
     int oldScreen;
     unsigned flags;
@@ -2339,12 +2401,13 @@ Tk_BindEvent(
     bindPtr->curEvent = curEvent;
     physTables = &bindPtr->lookupTables;
     scriptCount = 0;
+    numScripts = 0;
     arraySize = 0;
-    Tcl_DStringInit(&scripts);
 
     if ((size_t) numObjects > SIZE_OF_ARRAY(matchPtrBuf)) {
 	/* It's unrealistic that the buffer size is too small, but who knows? */
 	matchPtrArr = (PatSeq **)ckalloc(numObjects*sizeof(matchPtrArr[0]));
+	scriptArr = (BoundScript *)ckalloc(numObjects*sizeof(scriptArr[0]));
     }
     memset(matchPtrArr, 0, numObjects*sizeof(matchPtrArr[0]));
 
@@ -2446,9 +2509,37 @@ Tk_BindEvent(
 	}
 
 	if (matchPtrArr[k]) {
-	    ExpandPercents(winPtr, matchPtrArr[k]->script, curEvent, scriptCount++, &scripts);
-	    /* Null is added to the scripts string to separate the various scripts. */
-	    Tcl_DStringAppend(&scripts, "", 1);
+	    PatSeq *matchPtr = matchPtrArr[k];
+	    BoundScript *bsPtr = &scriptArr[numScripts++];
+
+	    /*
+	     * The % sequences are substituted now, before any script runs, as
+	     * the event data may change while the scripts are evaluated.
+	     */
+
+	    if (!matchPtr->templPtr) {
+		matchPtr->templPtr = MakeBindTemplate(matchPtr->script);
+	    }
+	    bsPtr->kind = matchPtr->templPtr->kind;
+	    switch (bsPtr->kind) {
+	    case BIND_STATIC:
+		bsPtr->objPtr = matchPtr->templPtr->scriptObj;
+		scriptCount++;
+		break;
+	    case BIND_WORDS:
+		bsPtr->objPtr = InstantiateBindTemplate(matchPtr->templPtr, winPtr,
+			curEvent, scriptCount++);
+		break;
+	    default: {
+		Tcl_DString script;
+
+		Tcl_DStringInit(&script);
+		ExpandPercents(winPtr, matchPtr->script, curEvent, scriptCount++, &script);
+		bsPtr->objPtr = Tcl_DStringToObj(&script);
+		break;
+	    }
+	    }
+	    Tcl_IncrRefCount(bsPtr->objPtr);
 	}
     }
 
@@ -2523,7 +2614,10 @@ Tk_BindEvent(
 	ckfree(matchPtrArr);
     }
 
-    if (Tcl_DStringLength(&scripts) == 0) {
+    if (numScripts == 0) {
+	if (scriptArr != scriptBuf) {
+	    ckfree(scriptArr);
+	}
 	return; /* Nothing to do. */
     }
 
@@ -2570,17 +2664,33 @@ Tk_BindEvent(
 
     Tcl_Preserve(bindInfoPtr);
 
-    for (p = Tcl_DStringValue(&scripts), end = p + Tcl_DStringLength(&scripts); p < end; ) {
-	Tcl_Size len = strlen(p);
-	int code;
+    for (k = 0; k < numScripts; ++k) {
+	BoundScript *bsPtr = &scriptArr[k];
+	int code = TCL_OK;
 
 	if (!bindInfoPtr->deleted) {
 	    ++screenPtr->bindingDepth;
 	}
-	Tcl_AllowExceptions(interp);
 
-	code = Tcl_EvalEx(interp, p, len, TCL_EVAL_GLOBAL);
-	p += len + 1;
+	if (bsPtr->kind == BIND_WORDS) {
+	    Tcl_Size numCmds;
+	    Tcl_Obj **cmds;
+
+	    Tcl_ListObjGetElements(NULL, bsPtr->objPtr, &numCmds, &cmds);
+	    for (i = 0; i < numCmds && code == TCL_OK; ++i) {
+		Tcl_AllowExceptions(interp);
+		code = Tcl_EvalObjEx(interp, cmds[i], TCL_EVAL_GLOBAL);
+	    }
+	} else {
+	    /*
+	     * Static scripts are compiled and keep their bytecode; expanded
+	     * scripts are only used once, so they are not worth compiling.
+	     */
+
+	    Tcl_AllowExceptions(interp);
+	    code = Tcl_EvalObjEx(interp, bsPtr->objPtr, TCL_EVAL_GLOBAL
+		    | (bsPtr->kind == BIND_EXPAND ? TCL_EVAL_DIRECT : 0));
+	}
 
 	if (!bindInfoPtr->deleted) {
 	    --screenPtr->bindingDepth;
@@ -2606,7 +2716,12 @@ Tk_BindEvent(
 	ChangeScreen(interp, oldDispPtr->name, oldScreen);
     }
     Tcl_RestoreInterpState(interp, interpState);
-    Tcl_DStringFree(&scripts);
+    for (k = 0; k < numScripts; ++k) {
+	Tcl_DecrRefCount(scriptArr[k].objPtr);
+    }
+    if (scriptArr != scriptBuf) {
+	ckfree(scriptArr);
+    }
     Tcl_Release(bindInfoPtr);
 }
 
@@ -2936,6 +3051,298 @@ MatchPatterns(
     return bestPtr;
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * GetPercentValue --
+ *
+ *	Compute the value that the % sequence made of '%' and the character c
+ *	stands for in a binding script, given the event.
+ *
+ * Results:
+ *	The value, not quoted. It may be stored in numStorage or bufPtr, so it
+ *	is only valid until these are next used.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static const char *
+GetPercentValue(
+    TkWindow *winPtr,		/* Window where event occurred: needed to get input context. */
+    int c,			/* Character following the %. */
+    Event *eventPtr,		/* Event containing information to be used in % replacements. */
+    unsigned scriptCount,	/* The number of script-based binding patterns matched so far for
+				 * this event. */
+    char *numStorage,		/* Room for TCL_INTEGER_SPACE characters. */
+    Tcl_DString *bufPtr)	/* Initialized dynamic string, used for %A. */
+{
+    unsigned flags;
+    XEvent *evPtr;
+    const char *string;
+    long long number;     /* signed */
+    unsigned long long unumber;   /* unsigned */
+
+    evPtr = &eventPtr->xev;
+    flags = (evPtr->type < TK_LASTEVENT) ? flagArray[evPtr->type] : 0;
+
+#define SET_NUMBER(value)   { number = (value);			     \
+    snprintf(numStorage, TCL_INTEGER_SPACE, "%" TCL_LL_MODIFIER "d", number);	     \
+    string = numStorage;					     \
+    }
+
+#define SET_UNUMBER(value)  { unumber = (value);				\
+	snprintf(numStorage, TCL_INTEGER_SPACE, "%" TCL_LL_MODIFIER "u", unumber);	\
+	string = numStorage;						\
+    }
+
+    string = "??";
+    switch (c) {
+    case '#':
+	SET_UNUMBER(evPtr->xany.serial);
+	break;
+    case 'a':
+	if (flags & CONFIG) {
+	    TkpPrintWindowId(numStorage, evPtr->xconfigure.above);
+	    string = numStorage;
+	}
+	break;
+    case 'b':
+	if (flags & BUTTON) {
+	    SET_UNUMBER(evPtr->xbutton.button);
+	}
+	break;
+    case 'c':
+	if (flags & EXPOSE) {
+	    SET_NUMBER(evPtr->xexpose.count);
+	}
+	break;
+    case 'd':
+	if (flags & (CROSSING|FOCUS)) {
+	    int detail = (flags & FOCUS) ? evPtr->xfocus.detail : evPtr->xcrossing.detail;
+	    string = TkFindStateString(notifyDetail, detail);
+	} else if (flags & CONFIGREQ) {
+	    if (evPtr->xconfigurerequest.value_mask & CWStackMode) {
+		string = TkFindStateString(configureRequestDetail, evPtr->xconfigurerequest.detail);
+	    } else {
+		string = "";
+	    }
+	} else if (flags & VIRTUAL) {
+	    XVirtualEvent *vePtr = (XVirtualEvent *) evPtr;
+	    string = vePtr->user_data ? Tcl_GetString(vePtr->user_data) : "";
+	}
+	break;
+    case 'f':
+	if (flags & CROSSING) {
+	    SET_NUMBER(evPtr->xcrossing.focus != 0);
+	}
+	break;
+    case 'h':
+	if (flags & EXPOSE) {
+	    SET_NUMBER(evPtr->xexpose.height);
+	} else if (flags & CONFIG) {
+	    SET_NUMBER(evPtr->xconfigure.height);
+	} else if (flags & CREATE) {
+	    SET_NUMBER(evPtr->xcreatewindow.height);
+	} else if (flags & CONFIGREQ) {
+	    SET_NUMBER(evPtr->xconfigurerequest.height);
+	} else if (flags & RESIZEREQ) {
+	    SET_NUMBER(evPtr->xresizerequest.height);
+	}
+	break;
+    case 'i':
+	if (flags & CREATE) {
+	    TkpPrintWindowId(numStorage, evPtr->xcreatewindow.window);
+	} else if (flags & CONFIGREQ) {
+	    TkpPrintWindowId(numStorage, evPtr->xconfigurerequest.window);
+	} else if (flags & MAPREQ) {
+	    TkpPrintWindowId(numStorage, evPtr->xmaprequest.window);
+	} else {
+	    TkpPrintWindowId(numStorage, evPtr->xany.window);
+	}
+	string = numStorage;
+	break;
+    case 'k':
+	if (flags & KEY) {
+	    SET_UNUMBER(evPtr->xkey.keycode);
+	}
+	break;
+    case 'm':
+	if (flags & CROSSING) {
+	    string = TkFindStateString(notifyMode, evPtr->xcrossing.mode);
+	} else if (flags & FOCUS) {
+	    string = TkFindStateString(notifyMode, evPtr->xfocus.mode);
+	}
+	break;
+    case 'o':
+	if (flags & CREATE) {
+	    SET_NUMBER(evPtr->xcreatewindow.override_redirect != 0);
+	} else if (flags & MAP) {
+	    SET_NUMBER(evPtr->xmap.override_redirect != 0);
+	} else if (flags & REPARENT) {
+	    SET_NUMBER(evPtr->xreparent.override_redirect != 0);
+	} else if (flags & CONFIG) {
+	    SET_NUMBER(evPtr->xconfigure.override_redirect != 0);
+	}
+	break;
+    case 'p':
+	if (flags & CIRC) {
+	    string = TkFindStateString(circPlace, evPtr->xcirculate.place);
+	} else if (flags & CIRCREQ) {
+	    string = TkFindStateString(circPlace, evPtr->xcirculaterequest.place);
+	}
+	break;
+    case 's':
+	if (flags & HAS_XKEY_HEAD_AND_STATE) {
+	    SET_UNUMBER(evPtr->xkey.state);
+	} else if (flags & CROSSING) {
+	    SET_UNUMBER(evPtr->xcrossing.state);
+	} else if (flags & PROP) {
+	    string = TkFindStateString(propNotify, evPtr->xproperty.state);
+	} else if (flags & VISIBILITY) {
+	    string = TkFindStateString(visNotify, evPtr->xvisibility.state);
+	}
+	break;
+    case 't':
+	if (flags & HAS_XKEY_HEAD) {
+	    SET_UNUMBER(evPtr->xkey.time);
+	} else if (flags & PROP) {
+	    SET_UNUMBER(evPtr->xproperty.time);
+	}
+	break;
+    case 'v':
+	SET_UNUMBER(evPtr->xconfigurerequest.value_mask);
+	break;
+    case 'w':
+	if (flags & EXPOSE) {
+	    SET_NUMBER(evPtr->xexpose.width);
+	} else if (flags & CONFIG) {
+	    SET_NUMBER(evPtr->xconfigure.width);
+	} else if (flags & CREATE) {
+	    SET_NUMBER(evPtr->xcreatewindow.width);
+	} else if (flags & CONFIGREQ) {
+	    SET_NUMBER(evPtr->xconfigurerequest.width);
+	} else if (flags & RESIZEREQ) {
+	    SET_NUMBER(evPtr->xresizerequest.width);
+	}
+	break;
+    case 'x':
+	if (flags & HAS_XKEY_HEAD) {
+	    SET_NUMBER(evPtr->xkey.x);
+	} else if (flags & EXPOSE) {
+	    SET_NUMBER(evPtr->xexpose.x);
+	} else if (flags & (CREATE|CONFIG|GRAVITY)) {
+	    SET_NUMBER(evPtr->xcreatewindow.x);
+	} else if (flags & REPARENT) {
+	    SET_NUMBER(evPtr->xreparent.x);
+	} else if (flags & CONFIGREQ) {
+	    SET_NUMBER(evPtr->xconfigurerequest.x);
+	}
+	break;
+    case 'y':
+	if (flags & HAS_XKEY_HEAD) {
+	    SET_NUMBER(evPtr->xkey.y);
+	} else if (flags & EXPOSE) {
+	    SET_NUMBER(evPtr->xexpose.y);
+	} else if (flags & (CREATE|CONFIG|GRAVITY)) {
+	    SET_NUMBER(evPtr->xcreatewindow.y);
+	} else if (flags & REPARENT) {
+	    SET_NUMBER(evPtr->xreparent.y);
+	} else if (flags & CONFIGREQ) {
+	    SET_NUMBER(evPtr->xconfigurerequest.y);
+	}
+	break;
+    case 'A':
+	if (flags & KEY) {
+	    Tcl_DStringFree(bufPtr);
+	    string = TkpGetString(winPtr, evPtr, bufPtr);
+	}
+	break;
+    case 'B':
+	if (flags & CREATE) {
+	    SET_NUMBER(evPtr->xcreatewindow.border_width);
+	} else if (flags & CONFIGREQ) {
+	    SET_NUMBER(evPtr->xconfigurerequest.border_width);
+	} else if (flags & CONFIG) {
+	    SET_NUMBER(evPtr->xconfigure.border_width);
+	}
+	break;
+    case 'D':
+	if (flags & WHEEL) {
+	    SET_NUMBER((int)evPtr->xbutton.button); /* mis-use button field for this */
+	}
+	break;
+    case 'E':
+	SET_NUMBER(evPtr->xany.send_event != 0);
+	break;
+    case 'K':
+	if (flags & KEY) {
+	    const char *name = TkKeysymToString(eventPtr->detail.info);
+	    if (name) {
+		string = name;
+	    }
+	}
+	break;
+    case 'M':
+	SET_UNUMBER(scriptCount);
+	break;
+    case 'N':
+	if (flags & KEY) {
+	    SET_UNUMBER(eventPtr->detail.info);
+	}
+	break;
+    case 'P':
+	if (flags & PROP) {
+	    string = Tk_GetAtomName((Tk_Window) winPtr, evPtr->xproperty.atom);
+	}
+	break;
+    case 'R':
+	if (flags & HAS_XKEY_HEAD) {
+	    TkpPrintWindowId(numStorage, evPtr->xkey.root);
+	    string = numStorage;
+	}
+	break;
+    case 'S':
+	if (flags & HAS_XKEY_HEAD) {
+	    TkpPrintWindowId(numStorage, evPtr->xkey.subwindow);
+	    string = numStorage;
+	}
+	break;
+    case 'T':
+	SET_NUMBER(evPtr->type);
+	break;
+    case 'W': {
+	Tk_Window tkwin = Tk_IdToWindow(evPtr->xany.display, evPtr->xany.window);
+	if (tkwin) {
+	    string = Tk_PathName(tkwin);
+	}
+	break;
+    }
+    case 'X':
+	if (flags & HAS_XKEY_HEAD) {
+	    SET_NUMBER(evPtr->xkey.x_root);
+	}
+	break;
+    case 'Y':
+	if (flags & HAS_XKEY_HEAD) {
+	    SET_NUMBER(evPtr->xkey.y_root);
+	}
+	break;
+    default:
+	numStorage[0] = (char) c;
+	numStorage[1] = '\0';
+	string = numStorage;
+	break;
+    }
+
+#undef SET_NUMBER
+#undef SET_UNUMBER
+
+    return string;
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -2963,9 +3370,7 @@ ExpandPercents(
 				 * this event. */
     Tcl_DString *dsPtr)		/* Dynamic string in which to append new command. */
 {
-    unsigned flags;
     Tcl_DString buf;
-    XEvent *evPtr;
 
     assert(winPtr);
     assert(before);
@@ -2973,24 +3378,10 @@ ExpandPercents(
     assert(dsPtr);
 
     Tcl_DStringInit(&buf);
-    evPtr = &eventPtr->xev;
-    flags = (evPtr->type < TK_LASTEVENT) ? flagArray[evPtr->type] : 0;
-
-#define SET_NUMBER(value)   { number = (value);			     \
-    snprintf(numStorage, sizeof(numStorage), "%" TCL_LL_MODIFIER "d", number);	     \
-    string = numStorage;					     \
-    }
-
-#define SET_UNUMBER(value)  { unumber = (value);				\
-	snprintf(numStorage, sizeof(numStorage), "%" TCL_LL_MODIFIER "u", unumber);	\
-	string = numStorage;						\
-    }
 
     while (1) {
 	char numStorage[TCL_INTEGER_SPACE];
 	const char *string;
-	long long number;     /* signed */
-	unsigned long long unumber;   /* unsigned */
 
 	/*
 	 * Find everything up to the next % character and append it to the
@@ -3011,244 +3402,8 @@ ExpandPercents(
 	 * There's a percent sequence here. Process it.
 	 */
 
-	string = "??";
-	switch (before[1]) {
-	case '#':
-	    SET_UNUMBER(evPtr->xany.serial);
-	    break;
-	case 'a':
-	    if (flags & CONFIG) {
-		TkpPrintWindowId(numStorage, evPtr->xconfigure.above);
-		string = numStorage;
-	    }
-	    break;
-	case 'b':
-	    if (flags & BUTTON) {
-		SET_UNUMBER(evPtr->xbutton.button);
-	    }
-	    break;
-	case 'c':
-	    if (flags & EXPOSE) {
-		SET_NUMBER(evPtr->xexpose.count);
-	    }
-	    break;
-	case 'd':
-	    if (flags & (CROSSING|FOCUS)) {
-		int detail = (flags & FOCUS) ? evPtr->xfocus.detail : evPtr->xcrossing.detail;
-		string = TkFindStateString(notifyDetail, detail);
-	    } else if (flags & CONFIGREQ) {
-		if (evPtr->xconfigurerequest.value_mask & CWStackMode) {
-		    string = TkFindStateString(configureRequestDetail, evPtr->xconfigurerequest.detail);
-		} else {
-		    string = "";
-		}
-	    } else if (flags & VIRTUAL) {
-		XVirtualEvent *vePtr = (XVirtualEvent *) evPtr;
-		string = vePtr->user_data ? Tcl_GetString(vePtr->user_data) : "";
-	    }
-	    break;
-	case 'f':
-	    if (flags & CROSSING) {
-		SET_NUMBER(evPtr->xcrossing.focus != 0);
-	    }
-	    break;
-	case 'h':
-	    if (flags & EXPOSE) {
-		SET_NUMBER(evPtr->xexpose.height);
-	    } else if (flags & CONFIG) {
-		SET_NUMBER(evPtr->xconfigure.height);
-	    } else if (flags & CREATE) {
-		SET_NUMBER(evPtr->xcreatewindow.height);
-	    } else if (flags & CONFIGREQ) {
-		SET_NUMBER(evPtr->xconfigurerequest.height);
-	    } else if (flags & RESIZEREQ) {
-		SET_NUMBER(evPtr->xresizerequest.height);
-	    }
-	    break;
-	case 'i':
-	    if (flags & CREATE) {
-		TkpPrintWindowId(numStorage, evPtr->xcreatewindow.window);
-	    } else if (flags & CONFIGREQ) {
-		TkpPrintWindowId(numStorage, evPtr->xconfigurerequest.window);
-	    } else if (flags & MAPREQ) {
-		TkpPrintWindowId(numStorage, evPtr->xmaprequest.window);
-	    } else {
-		TkpPrintWindowId(numStorage, evPtr->xany.window);
-	    }
-	    string = numStorage;
-	    break;
-	case 'k':
-	    if (flags & KEY) {
-		SET_UNUMBER(evPtr->xkey.keycode);
-	    }
-	    break;
-	case 'm':
-	    if (flags & CROSSING) {
-		string = TkFindStateString(notifyMode, evPtr->xcrossing.mode);
-	    } else if (flags & FOCUS) {
-		string = TkFindStateString(notifyMode, evPtr->xfocus.mode);
-	    }
-	    break;
-	case 'o':
-	    if (flags & CREATE) {
-		SET_NUMBER(evPtr->xcreatewindow.override_redirect != 0);
-	    } else if (flags & MAP) {
-		SET_NUMBER(evPtr->xmap.override_redirect != 0);
-	    } else if (flags & REPARENT) {
-		SET_NUMBER(evPtr->xreparent.override_redirect != 0);
-	    } else if (flags & CONFIG) {
-		SET_NUMBER(evPtr->xconfigure.override_redirect != 0);
-	    }
-	    break;
-	case 'p':
-	    if (flags & CIRC) {
-		string = TkFindStateString(circPlace, evPtr->xcirculate.place);
-	    } else if (flags & CIRCREQ) {
-		string = TkFindStateString(circPlace, evPtr->xcirculaterequest.place);
-	    }
-	    break;
-	case 's':
-	    if (flags & HAS_XKEY_HEAD_AND_STATE) {
-		SET_UNUMBER(evPtr->xkey.state);
-	    } else if (flags & CROSSING) {
-		SET_UNUMBER(evPtr->xcrossing.state);
-	    } else if (flags & PROP) {
-		string = TkFindStateString(propNotify, evPtr->xproperty.state);
-	    } else if (flags & VISIBILITY) {
-		string = TkFindStateString(visNotify, evPtr->xvisibility.state);
-	    }
-	    break;
-	case 't':
-	    if (flags & HAS_XKEY_HEAD) {
-		SET_UNUMBER(evPtr->xkey.time);
-	    } else if (flags & PROP) {
-		SET_UNUMBER(evPtr->xproperty.time);
-	    }
-	    break;
-	case 'v':
-	    SET_UNUMBER(evPtr->xconfigurerequest.value_mask);
-	    break;
-	case 'w':
-	    if (flags & EXPOSE) {
-		SET_NUMBER(evPtr->xexpose.width);
-	    } else if (flags & CONFIG) {
-		SET_NUMBER(evPtr->xconfigure.width);
-	    } else if (flags & CREATE) {
-		SET_NUMBER(evPtr->xcreatewindow.width);
-	    } else if (flags & CONFIGREQ) {
-		SET_NUMBER(evPtr->xconfigurerequest.width);
-	    } else if (flags & RESIZEREQ) {
-		SET_NUMBER(evPtr->xresizerequest.width);
-	    }
-	    break;
-	case 'x':
-	    if (flags & HAS_XKEY_HEAD) {
-		SET_NUMBER(evPtr->xkey.x);
-	    } else if (flags & EXPOSE) {
-		SET_NUMBER(evPtr->xexpose.x);
-	    } else if (flags & (CREATE|CONFIG|GRAVITY)) {
-		SET_NUMBER(evPtr->xcreatewindow.x);
-	    } else if (flags & REPARENT) {
-		SET_NUMBER(evPtr->xreparent.x);
-	    } else if (flags & CONFIGREQ) {
-		SET_NUMBER(evPtr->xconfigurerequest.x);
-	    }
-	    break;
-	case 'y':
-	    if (flags & HAS_XKEY_HEAD) {
-		SET_NUMBER(evPtr->xkey.y);
-	    } else if (flags & EXPOSE) {
-		SET_NUMBER(evPtr->xexpose.y);
-	    } else if (flags & (CREATE|CONFIG|GRAVITY)) {
-		SET_NUMBER(evPtr->xcreatewindow.y);
-	    } else if (flags & REPARENT) {
-		SET_NUMBER(evPtr->xreparent.y);
-	    } else if (flags & CONFIGREQ) {
-		SET_NUMBER(evPtr->xconfigurerequest.y);
-	    }
-	    break;
-	case 'A':
-	    if (flags & KEY) {
-		Tcl_DStringFree(&buf);
-		string = TkpGetString(winPtr, evPtr, &buf);
-	    }
-	    break;
-	case 'B':
-	    if (flags & CREATE) {
-		SET_NUMBER(evPtr->xcreatewindow.border_width);
-	    } else if (flags & CONFIGREQ) {
-		SET_NUMBER(evPtr->xconfigurerequest.border_width);
-	    } else if (flags & CONFIG) {
-		SET_NUMBER(evPtr->xconfigure.border_width);
-	    }
-	    break;
-	case 'D':
-	    if (flags & WHEEL) {
-		SET_NUMBER((int)evPtr->xbutton.button); /* mis-use button field for this */
-	    }
-	    break;
-	case 'E':
-	    SET_NUMBER(evPtr->xany.send_event != 0);
-	    break;
-	case 'K':
-	    if (flags & KEY) {
-		const char *name = TkKeysymToString(eventPtr->detail.info);
-		if (name) {
-		    string = name;
-		}
-	    }
-	    break;
-	case 'M':
-	    SET_UNUMBER(scriptCount);
-	    break;
-	case 'N':
-	    if (flags & KEY) {
-		SET_UNUMBER(eventPtr->detail.info);
-	    }
-	    break;
-	case 'P':
-	    if (flags & PROP) {
-		string = Tk_GetAtomName((Tk_Window) winPtr, evPtr->xproperty.atom);
-	    }
-	    break;
-	case 'R':
-	    if (flags & HAS_XKEY_HEAD) {
-		TkpPrintWindowId(numStorage, evPtr->xkey.root);
-		string = numStorage;
-	    }
-	    break;
-	case 'S':
-	    if (flags & HAS_XKEY_HEAD) {
-		TkpPrintWindowId(numStorage, evPtr->xkey.subwindow);
-		string = numStorage;
-	    }
-	    break;
-	case 'T':
-	    SET_NUMBER(evPtr->type);
-	    break;
-	case 'W': {
-	    Tk_Window tkwin = Tk_IdToWindow(evPtr->xany.display, evPtr->xany.window);
-	    if (tkwin) {
-		string = Tk_PathName(tkwin);
-	    }
-	    break;
-	}
-	case 'X':
-	    if (flags & HAS_XKEY_HEAD) {
-		SET_NUMBER(evPtr->xkey.x_root);
-	    }
-	    break;
-	case 'Y':
-	    if (flags & HAS_XKEY_HEAD) {
-		SET_NUMBER(evPtr->xkey.y_root);
-	    }
-	    break;
-	default:
-	    numStorage[0] = before[1];
-	    numStorage[1] = '\0';
-	    string = numStorage;
-	    break;
-	}
+	string = GetPercentValue(winPtr, UCHAR(before[1]), eventPtr, scriptCount,
+		numStorage, &buf);
 	{   /* local scope */
 	    int cvtFlags;
 	    Tcl_Size spaceNeeded = Tcl_ScanElement(string, &cvtFlags);
@@ -3262,10 +3417,231 @@ ExpandPercents(
 	}
     }
 
-#undef SET_NUMBER
-#undef SET_UNUMBER
+    Tcl_DStringFree(&buf);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * MakeBindTemplate --
+ *
+ *	Pre-parse a binding script into the form in which Tk_BindEvent runs
+ *	it, see the description of BindTemplate.
+ *
+ * Results:
+ *	A newly allocated template, to be freed with FreeBindTemplate.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static BindTemplate *
+MakeBindTemplate(
+    const char *script)		/* Binding script. */
+{
+    BindTemplate *templPtr;
+    Tcl_Size numPercents = 0, numWords;
+    const char *p;
+
+    assert(script);
+
+    for (p = strchr(script, '%'); p; p = strchr(p + 1, '%')) {
+	++numPercents;
+    }
+
+    if (numPercents == 0) {
+	templPtr = (BindTemplate *)ckalloc(sizeof(BindTemplate));
+	templPtr->kind = BIND_STATIC;
+	templPtr->scriptObj = Tcl_NewStringObj(script, TCL_INDEX_NONE);
+	Tcl_IncrRefCount(templPtr->scriptObj);
+	templPtr->numWords = 0;
+	return templPtr;
+    }
 
+    numWords = ParseBindWords(script, numPercents, NULL);
+    if (numWords <= 0) {
+	templPtr = (BindTemplate *)ckalloc(sizeof(BindTemplate));
+	templPtr->kind = BIND_EXPAND;
+	templPtr->scriptObj = NULL;
+	templPtr->numWords = 0;
+	return templPtr;
+    }
+
+    templPtr = (BindTemplate *)ckalloc(
+	    offsetof(BindTemplate, words) + numWords * sizeof(BindWord));
+    templPtr->kind = BIND_WORDS;
+    templPtr->scriptObj = NULL;
+    templPtr->numWords = ParseBindWords(script, numPercents, templPtr->words);
+    assert(templPtr->numWords == numWords);
+    return templPtr;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ParseBindWords --
+ *
+ *	Check whether a binding script has the BIND_WORDS form: it parses
+ *	without error, each word of each command is a simple word, and each of
+ *	the numPercents % characters of the script belongs to a bare word of
+ *	the form %c. Comments containing % characters, or % sequences inside
+ *	braces, quotes or longer words do not qualify.
+ *
+ * Results:
+ *	The number of words in all commands of the script, or -1 if it does
+ *	not have the BIND_WORDS form. If wordPtr is not NULL, the words are
+ *	stored there, each literal word holding a reference to a new Tcl_Obj.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static Tcl_Size
+ParseBindWords(
+    const char *script,		/* Binding script. */
+    Tcl_Size numPercents,	/* Number of % characters in the script. */
+    BindWord *wordPtr)		/* Where to store the words, or NULL to only
+				 * count them. */
+{
+    Tcl_Parse parse;
+    const char *p = script;
+    Tcl_Size numLeft = strlen(script), numWords = 0;
+
+    while (numLeft > 0) {
+	Tcl_Token *tokenPtr;
+	Tcl_Size i;
+
+	if (Tcl_ParseCommand(NULL, p, numLeft, 0, &parse) != TCL_OK) {
+	    return -1;
+	}
+	for (i = 0, tokenPtr = parse.tokenPtr; i < parse.numWords;
+		++i, tokenPtr += tokenPtr->numComponents + 1) {
+	    if (tokenPtr->type != TCL_TOKEN_SIMPLE_WORD) {
+		Tcl_FreeParse(&parse);
+		return -1;
+	    }
+	    if (tokenPtr->size == 2 && tokenPtr->start[0] == '%') {
+		numPercents -= (tokenPtr->start[1] == '%') ? 2 : 1;
+		if (wordPtr) {
+		    wordPtr->literalObj = NULL;
+		    wordPtr->field = tokenPtr->start[1];
+		}
+	    } else if (memchr(tokenPtr->start, '%', tokenPtr->size)) {
+		Tcl_FreeParse(&parse);
+		return -1;
+	    } else if (wordPtr) {
+		wordPtr->literalObj = Tcl_NewStringObj(tokenPtr[1].start,
+			tokenPtr[1].size);
+		Tcl_IncrRefCount(wordPtr->literalObj);
+		wordPtr->field = '\0';
+	    }
+	    if (wordPtr) {
+		wordPtr->lastInCmd = (i == parse.numWords - 1);
+		++wordPtr;
+	    }
+	    ++numWords;
+	}
+	numLeft -= parse.commandStart + parse.commandSize - p;
+	p = parse.commandStart + parse.commandSize;
+	Tcl_FreeParse(&parse);
+    }
+
+    return numPercents == 0 ? numWords : -1;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * FreeBindTemplate --
+ *
+ *	Free a template made by MakeBindTemplate.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory and Tcl_Obj references are released.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+FreeBindTemplate(
+    BindTemplate *templPtr)
+{
+    Tcl_Size i;
+
+    if (templPtr->scriptObj) {
+	Tcl_DecrRefCount(templPtr->scriptObj);
+    }
+    for (i = 0; i < templPtr->numWords; ++i) {
+	if (templPtr->words[i].literalObj) {
+	    Tcl_DecrRefCount(templPtr->words[i].literalObj);
+	}
+    }
+    ckfree(templPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * InstantiateBindTemplate --
+ *
+ *	Substitute the values of the % sequences of an event into a template
+ *	of the BIND_WORDS form.
+ *
+ * Results:
+ *	A list with one element per command of the script, each a pure list
+ *	of the words of the command. Its refCount is zero.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static Tcl_Obj *
+InstantiateBindTemplate(
+    const BindTemplate *templPtr,
+				/* Template of the BIND_WORDS form. */
+    TkWindow *winPtr,		/* Window where event occurred: needed to get input context. */
+    Event *eventPtr,		/* Event containing information to be used in % replacements. */
+    unsigned scriptCount)	/* The number of script-based binding patterns matched so far for
+				 * this event. */
+{
+    Tcl_Obj *cmdsObj = Tcl_NewObj();
+    Tcl_Obj *cmdObj = NULL;
+    Tcl_DString buf;
+    Tcl_Size i;
+
+    assert(templPtr->kind == BIND_WORDS);
+
+    Tcl_DStringInit(&buf);
+    for (i = 0; i < templPtr->numWords; ++i) {
+	const BindWord *wordPtr = &templPtr->words[i];
+	Tcl_Obj *wordObj = wordPtr->literalObj;
+
+	if (!wordObj) {
+	    char numStorage[TCL_INTEGER_SPACE];
+
+	    wordObj = Tcl_NewStringObj(GetPercentValue(winPtr, UCHAR(wordPtr->field),
+		    eventPtr, scriptCount, numStorage, &buf), TCL_INDEX_NONE);
+	}
+	if (!cmdObj) {
+	    cmdObj = Tcl_NewObj();
+	}
+	Tcl_ListObjAppendElement(NULL, cmdObj, wordObj);
+	if (wordPtr->lastInCmd) {
+	    Tcl_ListObjAppendElement(NULL, cmdsObj, cmdObj);
+	    cmdObj = NULL;
+	}
+    }
     Tcl_DStringFree(&buf);
+    return cmdsObj;
 }
 
 /*
@@ -4786,6 +5162,7 @@ FindSequence(
     psPtr->added = 0;
     psPtr->modMaskUsed = (modMask != 0);
     psPtr->script = NULL;
+    psPtr->templPtr = NULL;
     psPtr->nextSeqPtr = (PatSeq *)Tcl_GetHashValue(hPtr);
     psPtr->hPtr = hPtr;
     psPtr->ptr.nextObj = NULL;
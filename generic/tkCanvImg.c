@@ -904,6 +904,7 @@ ImageChangedProc(
 		imgPtr->header.y1, imgPtr->header.x2, imgPtr->header.y2);
     }
     ComputeImageBbox(imgPtr->canvas, imgPtr);
+    TkCanvIndexUpdateItem(Canvas(imgPtr->canvas), &imgPtr->header);
     Tk_CanvasEventuallyRedraw(imgPtr->canvas, imgPtr->header.x1 + x,
 	    imgPtr->header.y1 + y, (int) (imgPtr->header.x1 + x + width),
 	    (int) (imgPtr->header.y1 + y + height));
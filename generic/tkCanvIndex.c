@@ -0,0 +1,1168 @@
+/*
+ * tkCanvIndex.c --
+ *
+ *	This file implements a spatial index over the bounding boxes of the
+ *	items in a canvas. The index is a uniform grid of cells, each of which
+ *	knows the items whose bounding box touches it, so that area searches,
+ *	picking and redisplay only have to look at the items near the area of
+ *	interest instead of walking the whole display list.
+ *
+ *	The index also gives every item an ordering key that increases along
+ *	the display list, so that the items found through the grid can be put
+ *	back into stacking order without consulting the list itself, and it
+ *	keeps the list of items whose final bounding box still has to be
+ *	registered for redisplay (the FORCE_REDRAW items).
+ *
+ *	Finally, it maps each tag to the items carrying it, so that searches
+ *	for a tag or a tag expression only have to look at those items.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "tkInt.h"
+#include "tkCanvas.h"
+
+/*
+ * Cells are square areas of 2^CELL_SHIFT canvas units. Items whose bounding
+ * box covers more than MAX_ITEM_CELLS cells are not filed in the grid but on
+ * a separate "wide" list that every search looks at; the same goes for items
+ * that must always be redrawn (window items), for items with an inverted
+ * bounding box, and for items of types that are not built into Tk (such
+ * types are free to change their bounding box at any time without telling
+ * the canvas).
+ */
+
+#define CELL_SHIFT	7
+#define MAX_ITEM_CELLS	64
+
+/*
+ * Spacing between the ordering keys of adjacent items right after the keys
+ * have been (re)assigned. Leaves room for many relinks before the whole list
+ * has to be renumbered.
+ */
+
+#define ORDER_SPACING	((Tcl_WideUInt) 1 << 20)
+#define ORDER_LIMIT	((Tcl_WideUInt) 1 << 62)
+
+/*
+ * One of the following structures is attached to each item, through the
+ * reserved1 field of its Tk_Item header.
+ */
+
+typedef struct IndexEntry {
+    Tk_Item *itemPtr;		/* Item described by this entry. */
+    Tcl_WideUInt order;		/* Ordering key: strictly increasing along
+				 * the display list of the canvas. */
+    int cx1, cy1, cx2, cy2;	/* Range of cells the item is filed in. Only
+				 * valid if wideIndex is TCL_INDEX_NONE. */
+    int x1, y1, x2, y2;		/* Bounding box the item was filed under. */
+    Tcl_Size wideIndex;		/* Position in the wide list, or
+				 * TCL_INDEX_NONE if filed in the grid. */
+    Tcl_Size pendingIndex;	/* Position in the pending list, or
+				 * TCL_INDEX_NONE. */
+    unsigned int stamp;		/* Search generation in which the entry was
+				 * last reported; used to report items
+				 * spanning several cells only once. */
+    struct TagSlot *tags;	/* Distinct tags the entry is filed under. */
+    Tcl_Size numTags, tagSpace;
+} IndexEntry;
+
+/*
+ * Each distinct tag of an item is recorded in a TagSlot of its entry, which
+ * remembers where the entry sits in the TagSet of that tag so that it can be
+ * removed in constant time.
+ */
+
+typedef struct TagSlot {
+    Tk_Uid tag;			/* The tag. */
+    Tcl_Size pos;		/* Position of the entry in the tag's set. */
+} TagSlot;
+
+typedef struct TagSet {
+    Tcl_Size numEntries;	/* Number of entries in use. */
+    Tcl_Size space;		/* Number of entries allocated. */
+    IndexEntry **entries;	/* Entries of the items carrying the tag, in
+				 * no particular order. */
+} TagSet;
+
+typedef struct IndexCell {
+    Tcl_Size numEntries;	/* Number of entries in use. */
+    Tcl_Size space;		/* Number of entries allocated. */
+    IndexEntry **entries;	/* Entries of the items touching this cell. */
+} IndexCell;
+
+struct TkCanvIndex {
+    Tcl_HashTable cellTable;	/* Maps cell coordinates (two ints) to
+				 * IndexCell records. */
+    Tcl_HashTable tagTable;	/* Maps tag Uids to TagSet records. */
+    IndexEntry **wide;		/* Entries not filed in the grid. */
+    Tcl_Size numWide, wideSpace;
+    Tk_Item **pending;		/* Items with FORCE_REDRAW set. */
+    Tcl_Size numPending, pendingSpace;
+    int minCx, minCy, maxCx, maxCy;
+				/* Range of cells that have ever held items.
+				 * Only valid if haveCells is set. */
+    int haveCells;
+    unsigned int stamp;		/* Current search generation. */
+};
+
+#define ENTRY(itemPtr) ((IndexEntry *) (itemPtr)->reserved1)
+
+/*
+ * Prototypes for functions defined in this file:
+ */
+
+static void		AddTag(TkCanvIndex *indexPtr, IndexEntry *entryPtr,
+			    Tk_Uid tag);
+static void		AddToCells(TkCanvIndex *indexPtr, IndexEntry *entryPtr);
+static int		CompareItemOrder(const void *first,
+			    const void *second);
+static void		FileEntry(TkCanvIndex *indexPtr, Tk_Item *itemPtr,
+			    IndexEntry *entryPtr);
+static int		IsIndexableType(const Tk_ItemType *typePtr);
+static unsigned int	NextStamp(TkCanvas *canvasPtr);
+static void		RemoveFromCells(TkCanvIndex *indexPtr,
+			    IndexEntry *entryPtr);
+static void		RemoveTag(TkCanvIndex *indexPtr,
+			    IndexEntry *entryPtr, Tcl_Size slot);
+static void		RenumberItems(TkCanvas *canvasPtr);
+static void		ResultAppend(TkCanvIndexResult *resultPtr,
+			    IndexEntry *entryPtr, unsigned int stamp);
+static void		UnfileEntry(TkCanvIndex *indexPtr,
+			    IndexEntry *entryPtr);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CellOf --
+ *
+ *	Returns the cell coordinate containing the given canvas coordinate,
+ *	rounding towards negative infinity.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static inline int
+CellOf(
+    int coord)
+{
+    if (coord >= 0) {
+	return coord >> CELL_SHIFT;
+    }
+    return -((-(coord + 1)) >> CELL_SHIFT) - 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexCreate, TkCanvIndexFree --
+ *
+ *	Create and destroy the spatial index of a canvas. TkCanvIndexFree
+ *	must be called while the items of the canvas still exist, as it
+ *	releases the entries hanging off them.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is allocated or freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvIndexCreate(
+    TkCanvas *canvasPtr)	/* Canvas that is being created. */
+{
+    TkCanvIndex *indexPtr = (TkCanvIndex *)ckalloc(sizeof(TkCanvIndex));
+
+    Tcl_InitHashTable(&indexPtr->cellTable, 2);
+    Tcl_InitHashTable(&indexPtr->tagTable, TCL_ONE_WORD_KEYS);
+    indexPtr->wide = NULL;
+    indexPtr->numWide = indexPtr->wideSpace = 0;
+    indexPtr->pending = NULL;
+    indexPtr->numPending = indexPtr->pendingSpace = 0;
+    indexPtr->minCx = indexPtr->minCy = 0;
+    indexPtr->maxCx = indexPtr->maxCy = 0;
+    indexPtr->haveCells = 0;
+    indexPtr->stamp = 0;
+    canvasPtr->indexPtr = indexPtr;
+}
+
+void
+TkCanvIndexFree(
+    TkCanvas *canvasPtr)	/* Canvas that is being destroyed. */
+{
+    TkCanvIndex *indexPtr = canvasPtr->indexPtr;
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    Tk_Item *itemPtr;
+
+    if (indexPtr == NULL) {
+	return;
+    }
+    for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
+	    itemPtr = itemPtr->nextPtr) {
+	IndexEntry *entryPtr = ENTRY(itemPtr);
+
+	if (entryPtr != NULL) {
+	    if (entryPtr->tags != NULL) {
+		ckfree(entryPtr->tags);
+	    }
+	    ckfree(entryPtr);
+	    itemPtr->reserved1 = NULL;
+	}
+    }
+    for (hPtr = Tcl_FirstHashEntry(&indexPtr->cellTable, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	IndexCell *cellPtr = (IndexCell *)Tcl_GetHashValue(hPtr);
+
+	ckfree(cellPtr->entries);
+	ckfree(cellPtr);
+    }
+    Tcl_DeleteHashTable(&indexPtr->cellTable);
+    for (hPtr = Tcl_FirstHashEntry(&indexPtr->tagTable, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	TagSet *setPtr = (TagSet *)Tcl_GetHashValue(hPtr);
+
+	ckfree(setPtr->entries);
+	ckfree(setPtr);
+    }
+    Tcl_DeleteHashTable(&indexPtr->tagTable);
+    if (indexPtr->wide != NULL) {
+	ckfree(indexPtr->wide);
+    }
+    if (indexPtr->pending != NULL) {
+	ckfree(indexPtr->pending);
+    }
+    ckfree(indexPtr);
+    canvasPtr->indexPtr = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IsIndexableType --
+ *
+ *	Tells whether items of the given type can be filed in the grid. Only
+ *	the built-in types qualify: their bounding boxes change only through
+ *	the canvas widget command or through paths that notify the index.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+IsIndexableType(
+    const Tk_ItemType *typePtr)
+{
+    if (typePtr->flags & TK_ALWAYS_REDRAW) {
+	return 0;
+    }
+    return (typePtr == &tkArcType) || (typePtr == &tkBitmapType)
+	    || (typePtr == &tkImageType) || (typePtr == &tkLineType)
+	    || (typePtr == &tkOvalType) || (typePtr == &tkPolygonType)
+	    || (typePtr == &tkRectangleType) || (typePtr == &tkTextType);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddToCells, RemoveFromCells --
+ *
+ *	Add an entry to, or remove it from, all the cells in its cell range.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AddToCells(
+    TkCanvIndex *indexPtr,
+    IndexEntry *entryPtr)
+{
+    int key[2], isNew;
+
+    for (key[1] = entryPtr->cy1; key[1] <= entryPtr->cy2; key[1]++) {
+	for (key[0] = entryPtr->cx1; key[0] <= entryPtr->cx2; key[0]++) {
+	    Tcl_HashEntry *hPtr = Tcl_CreateHashEntry(&indexPtr->cellTable,
+		    (char *) key, &isNew);
+	    IndexCell *cellPtr;
+
+	    if (isNew) {
+		cellPtr = (IndexCell *)ckalloc(sizeof(IndexCell));
+		cellPtr->numEntries = 0;
+		cellPtr->space = 4;
+		cellPtr->entries = (IndexEntry **)
+			ckalloc(cellPtr->space * sizeof(IndexEntry *));
+		Tcl_SetHashValue(hPtr, cellPtr);
+	    } else {
+		cellPtr = (IndexCell *)Tcl_GetHashValue(hPtr);
+		if (cellPtr->numEntries == cellPtr->space) {
+		    cellPtr->space *= 2;
+		    cellPtr->entries = (IndexEntry **)ckrealloc(
+			    cellPtr->entries,
+			    cellPtr->space * sizeof(IndexEntry *));
+		}
+	    }
+	    cellPtr->entries[cellPtr->numEntries++] = entryPtr;
+	}
+    }
+
+    if (!indexPtr->haveCells) {
+	indexPtr->minCx = entryPtr->cx1;
+	indexPtr->minCy = entryPtr->cy1;
+	indexPtr->maxCx = entryPtr->cx2;
+	indexPtr->maxCy = entryPtr->cy2;
+	indexPtr->haveCells = 1;
+    } else {
+	if (entryPtr->cx1 < indexPtr->minCx) {
+	    indexPtr->minCx = entryPtr->cx1;
+	}
+	if (entryPtr->cy1 < indexPtr->minCy) {
+	    indexPtr->minCy = entryPtr->cy1;
+	}
+	if (entryPtr->cx2 > indexPtr->maxCx) {
+	    indexPtr->maxCx = entryPtr->cx2;
+	}
+	if (entryPtr->cy2 > indexPtr->maxCy) {
+	    indexPtr->maxCy = entryPtr->cy2;
+	}
+    }
+}
+
+static void
+RemoveFromCells(
+    TkCanvIndex *indexPtr,
+    IndexEntry *entryPtr)
+{
+    int key[2];
+    Tcl_Size i;
+
+    for (key[1] = entryPtr->cy1; key[1] <= entryPtr->cy2; key[1]++) {
+	for (key[0] = entryPtr->cx1; key[0] <= entryPtr->cx2; key[0]++) {
+	    Tcl_HashEntry *hPtr = Tcl_FindHashEntry(&indexPtr->cellTable,
+		    (char *) key);
+	    IndexCell *cellPtr;
+
+	    if (hPtr == NULL) {
+		continue;
+	    }
+	    cellPtr = (IndexCell *)Tcl_GetHashValue(hPtr);
+	    for (i = 0; i < cellPtr->numEntries; i++) {
+		if (cellPtr->entries[i] == entryPtr) {
+		    cellPtr->entries[i] =
+			    cellPtr->entries[--cellPtr->numEntries];
+		    break;
+		}
+	    }
+	    if (cellPtr->numEntries == 0) {
+		ckfree(cellPtr->entries);
+		ckfree(cellPtr);
+		Tcl_DeleteHashEntry(hPtr);
+	    }
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FileEntry, UnfileEntry --
+ *
+ *	FileEntry records the current bounding box of an item in its entry
+ *	and files the entry either in the grid or on the wide list.
+ *	UnfileEntry undoes that.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FileEntry(
+    TkCanvIndex *indexPtr,
+    Tk_Item *itemPtr,
+    IndexEntry *entryPtr)
+{
+    entryPtr->x1 = itemPtr->x1;
+    entryPtr->y1 = itemPtr->y1;
+    entryPtr->x2 = itemPtr->x2;
+    entryPtr->y2 = itemPtr->y2;
+
+    if (IsIndexableType(itemPtr->typePtr)
+	    && (itemPtr->x1 <= itemPtr->x2) && (itemPtr->y1 <= itemPtr->y2)) {
+	Tcl_WideInt numCells;
+
+	entryPtr->cx1 = CellOf(itemPtr->x1);
+	entryPtr->cy1 = CellOf(itemPtr->y1);
+	entryPtr->cx2 = CellOf(itemPtr->x2);
+	entryPtr->cy2 = CellOf(itemPtr->y2);
+	numCells = (Tcl_WideInt) (entryPtr->cx2 - entryPtr->cx1 + 1)
+		* (entryPtr->cy2 - entryPtr->cy1 + 1);
+	if (numCells <= MAX_ITEM_CELLS) {
+	    entryPtr->wideIndex = TCL_INDEX_NONE;
+	    AddToCells(indexPtr, entryPtr);
+	    return;
+	}
+    }
+
+    if (indexPtr->numWide == indexPtr->wideSpace) {
+	indexPtr->wideSpace = indexPtr->wideSpace ? 2*indexPtr->wideSpace : 8;
+	indexPtr->wide = (IndexEntry **)ckrealloc(indexPtr->wide,
+		indexPtr->wideSpace * sizeof(IndexEntry *));
+    }
+    entryPtr->wideIndex = indexPtr->numWide;
+    indexPtr->wide[indexPtr->numWide++] = entryPtr;
+}
+
+static void
+UnfileEntry(
+    TkCanvIndex *indexPtr,
+    IndexEntry *entryPtr)
+{
+    if (entryPtr->wideIndex == TCL_INDEX_NONE) {
+	RemoveFromCells(indexPtr, entryPtr);
+    } else {
+	IndexEntry *lastPtr = indexPtr->wide[--indexPtr->numWide];
+
+	indexPtr->wide[entryPtr->wideIndex] = lastPtr;
+	lastPtr->wideIndex = entryPtr->wideIndex;
+	entryPtr->wideIndex = TCL_INDEX_NONE;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexAddItem --
+ *
+ *	Adds a newly created item to the index. The item must already be
+ *	linked into the display list of the canvas.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The item gets an index entry and an ordering key, and is filed under
+ *	its tags.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvIndexAddItem(
+    TkCanvas *canvasPtr,	/* Canvas containing the item. */
+    Tk_Item *itemPtr)		/* Item to add. */
+{
+    IndexEntry *entryPtr = (IndexEntry *)ckalloc(sizeof(IndexEntry));
+
+    entryPtr->itemPtr = itemPtr;
+    entryPtr->order = 0;
+    entryPtr->pendingIndex = TCL_INDEX_NONE;
+    entryPtr->stamp = canvasPtr->indexPtr->stamp;
+    entryPtr->tags = NULL;
+    entryPtr->numTags = entryPtr->tagSpace = 0;
+    itemPtr->reserved1 = entryPtr;
+    FileEntry(canvasPtr->indexPtr, itemPtr, entryPtr);
+    TkCanvIndexRelinkItems(canvasPtr, itemPtr, itemPtr);
+    TkCanvIndexSyncTags(canvasPtr, itemPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexRemoveItem --
+ *
+ *	Removes an item that is about to be deleted from the index.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The item's index entry is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvIndexRemoveItem(
+    TkCanvas *canvasPtr,	/* Canvas containing the item. */
+    Tk_Item *itemPtr)		/* Item to remove. */
+{
+    TkCanvIndex *indexPtr = canvasPtr->indexPtr;
+    IndexEntry *entryPtr = ENTRY(itemPtr);
+
+    if (entryPtr == NULL) {
+	return;
+    }
+    UnfileEntry(indexPtr, entryPtr);
+    if (entryPtr->pendingIndex != TCL_INDEX_NONE) {
+	Tk_Item *lastPtr = indexPtr->pending[--indexPtr->numPending];
+
+	indexPtr->pending[entryPtr->pendingIndex] = lastPtr;
+	ENTRY(lastPtr)->pendingIndex = entryPtr->pendingIndex;
+    }
+    while (entryPtr->numTags > 0) {
+	RemoveTag(indexPtr, entryPtr, entryPtr->numTags - 1);
+    }
+    if (entryPtr->tags != NULL) {
+	ckfree(entryPtr->tags);
+    }
+    ckfree(entryPtr);
+    itemPtr->reserved1 = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexUpdateItem --
+ *
+ *	Must be called whenever the bounding box of an item may have changed.
+ *	It is cheap to call when nothing changed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The item is refiled under its current bounding box.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvIndexUpdateItem(
+    TkCanvas *canvasPtr,	/* Canvas containing the item. */
+    Tk_Item *itemPtr)		/* Item whose bbox may have changed. */
+{
+    IndexEntry *entryPtr;
+
+    if ((itemPtr == NULL) || (canvasPtr->indexPtr == NULL)) {
+	return;
+    }
+    entryPtr = ENTRY(itemPtr);
+    if ((entryPtr == NULL) || ((entryPtr->x1 == itemPtr->x1)
+	    && (entryPtr->y1 == itemPtr->y1) && (entryPtr->x2 == itemPtr->x2)
+	    && (entryPtr->y2 == itemPtr->y2))) {
+	return;
+    }
+    if ((entryPtr->wideIndex == TCL_INDEX_NONE)
+	    && (itemPtr->x1 <= itemPtr->x2) && (itemPtr->y1 <= itemPtr->y2)
+	    && (CellOf(itemPtr->x1) == entryPtr->cx1)
+	    && (CellOf(itemPtr->y1) == entryPtr->cy1)
+	    && (CellOf(itemPtr->x2) == entryPtr->cx2)
+	    && (CellOf(itemPtr->y2) == entryPtr->cy2)) {
+	/*
+	 * Still in the same cells: nothing to move.
+	 */
+
+	entryPtr->x1 = itemPtr->x1;
+	entryPtr->y1 = itemPtr->y1;
+	entryPtr->x2 = itemPtr->x2;
+	entryPtr->y2 = itemPtr->y2;
+	return;
+    }
+    UnfileEntry(canvasPtr->indexPtr, entryPtr);
+    FileEntry(canvasPtr->indexPtr, itemPtr, entryPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexRelinkItems --
+ *
+ *	Must be called after a run of items has been (re)inserted into the
+ *	display list, to give them ordering keys that fit between their new
+ *	neighbours.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The ordering keys of the items from firstPtr to lastPtr, and possibly
+ *	of all other items, are changed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvIndexRelinkItems(
+    TkCanvas *canvasPtr,	/* Canvas containing the items. */
+    Tk_Item *firstPtr,		/* First item of the run. */
+    Tk_Item *lastPtr)		/* Last item of the run. */
+{
+    Tk_Item *itemPtr;
+    Tcl_WideUInt low, high, step;
+    Tcl_WideUInt count = 0;
+
+    for (itemPtr = firstPtr; ; itemPtr = itemPtr->nextPtr) {
+	count++;
+	if (itemPtr == lastPtr) {
+	    break;
+	}
+    }
+    low = (firstPtr->prevPtr != NULL) ? ENTRY(firstPtr->prevPtr)->order : 0;
+    if (lastPtr->nextPtr != NULL) {
+	high = ENTRY(lastPtr->nextPtr)->order;
+    } else {
+	high = low + (count + 1) * ORDER_SPACING;
+    }
+    if ((high <= low) || (high - low <= count) || (high >= ORDER_LIMIT)) {
+	RenumberItems(canvasPtr);
+	return;
+    }
+    step = (high - low) / (count + 1);
+    for (itemPtr = firstPtr; ; itemPtr = itemPtr->nextPtr) {
+	low += step;
+	ENTRY(itemPtr)->order = low;
+	if (itemPtr == lastPtr) {
+	    break;
+	}
+    }
+}
+
+static void
+RenumberItems(
+    TkCanvas *canvasPtr)
+{
+    Tk_Item *itemPtr;
+    Tcl_WideUInt order = 0;
+
+    for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
+	    itemPtr = itemPtr->nextPtr) {
+	order += ORDER_SPACING;
+	ENTRY(itemPtr)->order = order;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexItemOrder --
+ *
+ *	Returns the ordering key of an item: items later in the display list
+ *	have larger keys.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_WideUInt
+TkCanvIndexItemOrder(
+    Tk_Item *itemPtr)
+{
+    return ENTRY(itemPtr)->order;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexAddPending, TkCanvIndexGetPending, TkCanvIndexClearPending --
+ *
+ *	Maintain the list of items that have the FORCE_REDRAW flag set, so
+ *	that DisplayCanvas doesn't have to look at every item to find them.
+ *	TkCanvIndexAddPending must be called when the flag gets set. The list
+ *	returned by TkCanvIndexGetPending stays valid until the next call to
+ *	TkCanvIndexClearPending, which empties it.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvIndexAddPending(
+    TkCanvas *canvasPtr,
+    Tk_Item *itemPtr)
+{
+    TkCanvIndex *indexPtr = canvasPtr->indexPtr;
+    IndexEntry *entryPtr = ENTRY(itemPtr);
+
+    if ((entryPtr == NULL) || (entryPtr->pendingIndex != TCL_INDEX_NONE)) {
+	return;
+    }
+    if (indexPtr->numPending == indexPtr->pendingSpace) {
+	indexPtr->pendingSpace = indexPtr->pendingSpace
+		? 2 * indexPtr->pendingSpace : 16;
+	indexPtr->pending = (Tk_Item **)ckrealloc(indexPtr->pending,
+		indexPtr->pendingSpace * sizeof(Tk_Item *));
+    }
+    entryPtr->pendingIndex = indexPtr->numPending;
+    indexPtr->pending[indexPtr->numPending++] = itemPtr;
+}
+
+Tcl_Size
+TkCanvIndexGetPending(
+    TkCanvas *canvasPtr,
+    Tk_Item ***itemsPtr)
+{
+    *itemsPtr = canvasPtr->indexPtr->pending;
+    return canvasPtr->indexPtr->numPending;
+}
+
+void
+TkCanvIndexClearPending(
+    TkCanvas *canvasPtr)
+{
+    TkCanvIndex *indexPtr = canvasPtr->indexPtr;
+    Tcl_Size i;
+
+    for (i = 0; i < indexPtr->numPending; i++) {
+	ENTRY(indexPtr->pending[i])->pendingIndex = TCL_INDEX_NONE;
+    }
+    indexPtr->numPending = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexSearch --
+ *
+ *	Finds the items whose bounding box might intersect the given area.
+ *	The result is a superset: callers still have to apply their own exact
+ *	overlap test. Hidden items are included.
+ *
+ * Results:
+ *	The number of candidate items. The items themselves are stored in
+ *	resultPtr->items in display list order (bottom-most first). The caller
+ *	must release the result with TkCanvIndexFreeResult.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ResultAppend(
+    TkCanvIndexResult *resultPtr,
+    IndexEntry *entryPtr,
+    unsigned int stamp)
+{
+    if (entryPtr->stamp == stamp) {
+	return;
+    }
+    entryPtr->stamp = stamp;
+    if (resultPtr->numItems == resultPtr->space) {
+	Tk_Item **newPtr;
+
+	resultPtr->space *= 2;
+	newPtr = (Tk_Item **)ckalloc(resultPtr->space * sizeof(Tk_Item *));
+	memcpy(newPtr, resultPtr->items,
+		resultPtr->numItems * sizeof(Tk_Item *));
+	if (resultPtr->items != resultPtr->staticSpace) {
+	    ckfree(resultPtr->items);
+	}
+	resultPtr->items = newPtr;
+    }
+    resultPtr->items[resultPtr->numItems++] = entryPtr->itemPtr;
+}
+
+static unsigned int
+NextStamp(
+    TkCanvas *canvasPtr)
+{
+    TkCanvIndex *indexPtr = canvasPtr->indexPtr;
+
+    if (++indexPtr->stamp == 0) {
+	Tk_Item *itemPtr;
+
+	/*
+	 * The generation counter wrapped around; make sure no entry is
+	 * mistaken for one that has already been reported.
+	 */
+
+	for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
+		itemPtr = itemPtr->nextPtr) {
+	    ENTRY(itemPtr)->stamp = 0;
+	}
+	indexPtr->stamp = 1;
+    }
+    return indexPtr->stamp;
+}
+
+static int
+CompareItemOrder(
+    const void *first,
+    const void *second)
+{
+    Tcl_WideUInt order1 = ENTRY(*(Tk_Item *const *) first)->order;
+    Tcl_WideUInt order2 = ENTRY(*(Tk_Item *const *) second)->order;
+
+    return (order1 < order2) ? -1 : (order1 > order2);
+}
+
+Tcl_Size
+TkCanvIndexSearch(
+    TkCanvas *canvasPtr,	/* Canvas to search. */
+    int x1, int y1,		/* Upper left corner of area, inclusive. */
+    int x2, int y2,		/* Lower right corner of area, inclusive. */
+    TkCanvIndexResult *resultPtr)
+				/* Where to store the candidates. */
+{
+    TkCanvIndex *indexPtr = canvasPtr->indexPtr;
+    int cx1, cy1, cx2, cy2;
+    unsigned int stamp;
+    Tcl_Size i;
+
+    resultPtr->items = resultPtr->staticSpace;
+    resultPtr->numItems = 0;
+    resultPtr->space = TK_CANV_INDEX_STATIC_RESULT;
+    stamp = NextStamp(canvasPtr);
+
+    for (i = 0; i < indexPtr->numWide; i++) {
+	ResultAppend(resultPtr, indexPtr->wide[i], stamp);
+    }
+
+    if (indexPtr->haveCells && (x1 <= x2) && (y1 <= y2)) {
+	cx1 = CellOf(x1);
+	cy1 = CellOf(y1);
+	cx2 = CellOf(x2);
+	cy2 = CellOf(y2);
+	if (cx1 < indexPtr->minCx) {
+	    cx1 = indexPtr->minCx;
+	}
+	if (cy1 < indexPtr->minCy) {
+	    cy1 = indexPtr->minCy;
+	}
+	if (cx2 > indexPtr->maxCx) {
+	    cx2 = indexPtr->maxCx;
+	}
+	if (cy2 > indexPtr->maxCy) {
+	    cy2 = indexPtr->maxCy;
+	}
+
+	if ((cx1 <= cx2) && (cy1 <= cy2)) {
+	    Tcl_WideInt numCells = (Tcl_WideInt) (cx2 - cx1 + 1)
+		    * (cy2 - cy1 + 1);
+	    Tcl_HashEntry *hPtr;
+	    IndexCell *cellPtr;
+	    Tcl_Size j;
+
+	    if (numCells > indexPtr->cellTable.numEntries) {
+		/*
+		 * The area covers more cells than are in use; it's cheaper
+		 * to look at the cells that exist.
+		 */
+
+		Tcl_HashSearch search;
+
+		for (hPtr = Tcl_FirstHashEntry(&indexPtr->cellTable, &search);
+			hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+		    const int *key = (const int *)
+			    Tcl_GetHashKey(&indexPtr->cellTable, hPtr);
+
+		    if ((key[0] < cx1) || (key[0] > cx2)
+			    || (key[1] < cy1) || (key[1] > cy2)) {
+			continue;
+		    }
+		    cellPtr = (IndexCell *)Tcl_GetHashValue(hPtr);
+		    for (j = 0; j < cellPtr->numEntries; j++) {
+			ResultAppend(resultPtr, cellPtr->entries[j], stamp);
+		    }
+		}
+	    } else {
+		int key[2];
+
+		for (key[1] = cy1; key[1] <= cy2; key[1]++) {
+		    for (key[0] = cx1; key[0] <= cx2; key[0]++) {
+			hPtr = Tcl_FindHashEntry(&indexPtr->cellTable,
+				(char *) key);
+			if (hPtr == NULL) {
+			    continue;
+			}
+			cellPtr = (IndexCell *)Tcl_GetHashValue(hPtr);
+			for (j = 0; j < cellPtr->numEntries; j++) {
+			    ResultAppend(resultPtr, cellPtr->entries[j],
+				    stamp);
+			}
+		    }
+		}
+	    }
+	}
+    }
+
+    if (resultPtr->numItems > 1) {
+	qsort(resultPtr->items, resultPtr->numItems, sizeof(Tk_Item *),
+		CompareItemOrder);
+    }
+    return resultPtr->numItems;
+}
+
+void
+TkCanvIndexFreeResult(
+    TkCanvIndexResult *resultPtr)
+{
+    if (resultPtr->items != resultPtr->staticSpace) {
+	ckfree(resultPtr->items);
+    }
+    resultPtr->items = resultPtr->staticSpace;
+    resultPtr->numItems = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddTag, RemoveTag --
+ *
+ *	AddTag files an entry under a tag it isn't filed under yet. RemoveTag
+ *	removes the entry from the set of the tag in the given slot of the
+ *	entry, and drops the slot.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AddTag(
+    TkCanvIndex *indexPtr,
+    IndexEntry *entryPtr,
+    Tk_Uid tag)
+{
+    Tcl_HashEntry *hPtr;
+    TagSet *setPtr;
+    TagSlot *slotPtr;
+    int isNew;
+
+    hPtr = Tcl_CreateHashEntry(&indexPtr->tagTable, tag, &isNew);
+    if (isNew) {
+	setPtr = (TagSet *)ckalloc(sizeof(TagSet));
+	setPtr->numEntries = 0;
+	setPtr->space = 4;
+	setPtr->entries = (IndexEntry **)
+		ckalloc(setPtr->space * sizeof(IndexEntry *));
+	Tcl_SetHashValue(hPtr, setPtr);
+    } else {
+	setPtr = (TagSet *)Tcl_GetHashValue(hPtr);
+	if (setPtr->numEntries == setPtr->space) {
+	    setPtr->space *= 2;
+	    setPtr->entries = (IndexEntry **)ckrealloc(setPtr->entries,
+		    setPtr->space * sizeof(IndexEntry *));
+	}
+    }
+
+    if (entryPtr->numTags == entryPtr->tagSpace) {
+	entryPtr->tagSpace = entryPtr->tagSpace ? 2 * entryPtr->tagSpace : 4;
+	entryPtr->tags = (TagSlot *)ckrealloc(entryPtr->tags,
+		entryPtr->tagSpace * sizeof(TagSlot));
+    }
+    slotPtr = &entryPtr->tags[entryPtr->numTags++];
+    slotPtr->tag = tag;
+    slotPtr->pos = setPtr->numEntries;
+    setPtr->entries[setPtr->numEntries++] = entryPtr;
+}
+
+static void
+RemoveTag(
+    TkCanvIndex *indexPtr,
+    IndexEntry *entryPtr,
+    Tcl_Size slot)
+{
+    Tk_Uid tag = entryPtr->tags[slot].tag;
+    Tcl_Size pos = entryPtr->tags[slot].pos;
+    Tcl_HashEntry *hPtr = Tcl_FindHashEntry(&indexPtr->tagTable, tag);
+    TagSet *setPtr = (TagSet *)Tcl_GetHashValue(hPtr);
+    IndexEntry *lastPtr = setPtr->entries[--setPtr->numEntries];
+    Tcl_Size i;
+
+    /*
+     * Move the last entry of the set into the hole, and tell it where it
+     * went.
+     */
+
+    if (lastPtr != entryPtr) {
+	setPtr->entries[pos] = lastPtr;
+	for (i = 0; i < lastPtr->numTags; i++) {
+	    if (lastPtr->tags[i].tag == tag) {
+		lastPtr->tags[i].pos = pos;
+		break;
+	    }
+	}
+    }
+    if (setPtr->numEntries == 0) {
+	ckfree(setPtr->entries);
+	ckfree(setPtr);
+	Tcl_DeleteHashEntry(hPtr);
+    }
+    entryPtr->tags[slot] = entryPtr->tags[--entryPtr->numTags];
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexSyncTags --
+ *
+ *	Must be called whenever the tags of an item may have changed. Brings
+ *	the tag sets up to date with the tag array of the item.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The item is filed under its current tags only.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvIndexSyncTags(
+    TkCanvas *canvasPtr,	/* Canvas containing the item. */
+    Tk_Item *itemPtr)		/* Item whose tags may have changed. */
+{
+    TkCanvIndex *indexPtr = canvasPtr->indexPtr;
+    IndexEntry *entryPtr;
+    Tcl_Size i, j;
+
+    if ((itemPtr == NULL) || (indexPtr == NULL)) {
+	return;
+    }
+    entryPtr = ENTRY(itemPtr);
+    if (entryPtr == NULL) {
+	return;
+    }
+
+    /*
+     * Quick check for the common case that nothing changed: the item has
+     * distinct tags, recorded in the same order.
+     */
+
+    if (entryPtr->numTags == itemPtr->numTags) {
+	for (i = 0; i < entryPtr->numTags; i++) {
+	    if (entryPtr->tags[i].tag != itemPtr->tagPtr[i]) {
+		break;
+	    }
+	}
+	if (i == entryPtr->numTags) {
+	    return;
+	}
+    }
+
+    /*
+     * Drop the tags the item no longer has, then add the new ones. Items
+     * are allowed to carry the same tag more than once; it is filed only
+     * once.
+     */
+
+    for (i = entryPtr->numTags - 1; i >= 0; i--) {
+	for (j = 0; j < itemPtr->numTags; j++) {
+	    if (itemPtr->tagPtr[j] == entryPtr->tags[i].tag) {
+		break;
+	    }
+	}
+	if (j == itemPtr->numTags) {
+	    RemoveTag(indexPtr, entryPtr, i);
+	}
+    }
+    for (j = 0; j < itemPtr->numTags; j++) {
+	for (i = 0; i < entryPtr->numTags; i++) {
+	    if (entryPtr->tags[i].tag == itemPtr->tagPtr[j]) {
+		break;
+	    }
+	}
+	if (i == entryPtr->numTags) {
+	    AddTag(indexPtr, entryPtr, itemPtr->tagPtr[j]);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexCountTags, TkCanvIndexFindTags --
+ *
+ *	TkCanvIndexCountTags returns the number of items carrying each of the
+ *	given tags, summed over the tags; it is an upper bound of the number
+ *	of items TkCanvIndexFindTags would report. TkCanvIndexFindTags finds
+ *	the items carrying at least one of the given tags.
+ *
+ * Results:
+ *	The number of items. TkCanvIndexFindTags stores the items themselves
+ *	in resultPtr->items in display list order, each one only once. The
+ *	caller must release the result with TkCanvIndexFreeResult.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_Size
+TkCanvIndexCountTags(
+    TkCanvas *canvasPtr,	/* Canvas to search. */
+    Tcl_Size numTags,		/* Number of tags. */
+    const Tk_Uid *tags)		/* Tags to look for. */
+{
+    Tcl_HashEntry *hPtr;
+    Tcl_Size i, count = 0;
+
+    for (i = 0; i < numTags; i++) {
+	hPtr = Tcl_FindHashEntry(&canvasPtr->indexPtr->tagTable, tags[i]);
+	if (hPtr != NULL) {
+	    count += ((TagSet *)Tcl_GetHashValue(hPtr))->numEntries;
+	}
+    }
+    return count;
+}
+
+Tcl_Size
+TkCanvIndexFindTags(
+    TkCanvas *canvasPtr,	/* Canvas to search. */
+    Tcl_Size numTags,		/* Number of tags. */
+    const Tk_Uid *tags,		/* Tags to look for. */
+    TkCanvIndexResult *resultPtr)
+				/* Where to store the items. */
+{
+    Tcl_HashEntry *hPtr;
+    TagSet *setPtr;
+    unsigned int stamp;
+    Tcl_Size i, j;
+
+    resultPtr->items = resultPtr->staticSpace;
+    resultPtr->numItems = 0;
+    resultPtr->space = TK_CANV_INDEX_STATIC_RESULT;
+    stamp = NextStamp(canvasPtr);
+
+    for (i = 0; i < numTags; i++) {
+	hPtr = Tcl_FindHashEntry(&canvasPtr->indexPtr->tagTable, tags[i]);
+	if (hPtr == NULL) {
+	    continue;
+	}
+	setPtr = (TagSet *)Tcl_GetHashValue(hPtr);
+	for (j = 0; j < setPtr->numEntries; j++) {
+	    ResultAppend(resultPtr, setPtr->entries[j], stamp);
+	}
+    }
+    if (resultPtr->numItems > 1) {
+	qsort(resultPtr->items, resultPtr->numItems, sizeof(Tk_Item *),
+		CompareItemOrder);
+    }
+    return resultPtr->numItems;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvIndexCoversAll --
+ *
+ *	Tells whether a search over the given area is guaranteed to report
+ *	every item of the canvas.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TkCanvIndexCoversAll(
+    TkCanvas *canvasPtr,
+    int x1, int y1,
+    int x2, int y2)
+{
+    TkCanvIndex *indexPtr = canvasPtr->indexPtr;
+
+    if (!indexPtr->haveCells) {
+	return 1;
+    }
+    return (CellOf(x1) <= indexPtr->minCx) && (CellOf(y1) <= indexPtr->minCy)
+	    && (CellOf(x2) >= indexPtr->maxCx)
+	    && (CellOf(y2) >= indexPtr->maxCy);
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * End:
+ */
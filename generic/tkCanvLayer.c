@@ -0,0 +1,672 @@
+/*
+ * tkCanvLayer.c --
+ *
+ *	This file implements the layer cache of canvas widgets. When the
+ *	-layertag option is set, the items at the bottom of the display list
+ *	that carry that tag form a layer whose rendering, together with the
+ *	canvas background, is kept in an offscreen pixmap covering the window.
+ *	Redisplay then copies the damaged areas from that pixmap and only runs
+ *	the display procedures of the items above the layer, so that complex
+ *	static content isn't rasterized again each time something moves on
+ *	top of it. The "cache" widget command reports how well this works.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "tkInt.h"
+#include "tkCanvas.h"
+
+/*
+ * The layer of a canvas is described by the following structure.
+ */
+
+struct TkCanvLayer {
+    Tk_Uid tag;			/* Tag of the layer items, or NULL if the
+				 * cache is disabled. */
+    Tk_Item *boundPtr;		/* First item above the layer, or NULL if all
+				 * items belong to the layer. Only valid if
+				 * LAYER_RESCAN isn't set. */
+    Tcl_Size numItems;		/* Number of items in the layer. */
+    Pixmap pixmap;		/* Rendering of the layer over the window
+				 * area, or None. */
+    int x, y;			/* Canvas coordinates of the upper left
+				 * corner of pixmap. */
+    int width, height, depth;	/* Geometry of pixmap. */
+    unsigned long background;	/* Background pixel the pixmap was drawn
+				 * with. */
+    Tk_State state;		/* Canvas state the pixmap was drawn with. */
+    int flags;			/* Various flags; see below. */
+    TkCanvDamage stale;		/* Area of the pixmap that no longer matches
+				 * the items, in canvas coordinates. Only
+				 * valid if LAYER_STALE is set. */
+    Tcl_WideInt hits;		/* Number of areas redrawn from the cache. */
+    Tcl_WideInt updates;	/* Number of partial renderings. */
+    Tcl_WideInt rebuilds;	/* Number of full renderings. */
+    Tcl_WideInt pixels;		/* Number of pixels rendered. */
+};
+
+/*
+ * Flag bits for the layer:
+ *
+ * LAYER_VALID -		1 means the pixmap holds the rendering of the
+ *				layer, except for the stale area.
+ * LAYER_STALE -		1 means the stale area is not empty.
+ * LAYER_RESCAN -		1 means the set of items in the layer may have
+ *				changed and must be determined again.
+ */
+
+#define LAYER_VALID		1
+#define LAYER_STALE		2
+#define LAYER_RESCAN		4
+
+/*
+ * Prototypes for functions defined in this file:
+ */
+
+static int		HasTag(Tk_Item *itemPtr, Tk_Uid tag);
+static void		RenderArea(TkCanvas *canvasPtr,
+			    TkCanvLayer *layerPtr, int x1, int y1, int x2,
+			    int y2);
+static void		Rescan(TkCanvas *canvasPtr, TkCanvLayer *layerPtr);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvLayerCreate, TkCanvLayerFree --
+ *
+ *	Create and destroy the layer cache of a canvas.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory and pixmaps are allocated or freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvLayerCreate(
+    TkCanvas *canvasPtr)	/* Canvas that is being created. */
+{
+    TkCanvLayer *layerPtr = (TkCanvLayer *)ckalloc(sizeof(TkCanvLayer));
+
+    memset(layerPtr, 0, sizeof(TkCanvLayer));
+    layerPtr->tag = NULL;
+    layerPtr->boundPtr = NULL;
+    layerPtr->pixmap = None;
+    layerPtr->state = TK_STATE_NULL;
+    layerPtr->flags = LAYER_RESCAN;
+    canvasPtr->layerPtr = layerPtr;
+}
+
+void
+TkCanvLayerFree(
+    TkCanvas *canvasPtr)	/* Canvas that is being destroyed. */
+{
+    TkCanvLayer *layerPtr = canvasPtr->layerPtr;
+
+    if (layerPtr == NULL) {
+	return;
+    }
+    if (layerPtr->pixmap != None) {
+	Tk_FreePixmap(canvasPtr->display, layerPtr->pixmap);
+    }
+    ckfree(layerPtr);
+    canvasPtr->layerPtr = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvLayerConfigure --
+ *
+ *	Called after the options of a canvas have been (re)configured, and
+ *	when its world changed. Picks up the -layertag option and throws the
+ *	cached rendering away if it can no longer be used.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The layer may have to be rendered again.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvLayerConfigure(
+    TkCanvas *canvasPtr,	/* Canvas whose options changed. */
+    int worldChanged)		/* Non-zero means the rendering of the items
+				 * may have changed too. */
+{
+    TkCanvLayer *layerPtr = canvasPtr->layerPtr;
+    Tk_Uid tag = NULL;
+    unsigned long background;
+
+    if ((canvasPtr->layerTagObj != NULL)
+	    && (Tcl_GetString(canvasPtr->layerTagObj)[0] != '\0')) {
+	tag = Tk_GetUid(Tcl_GetString(canvasPtr->layerTagObj));
+    }
+    background = Tk_3DBorderColor(canvasPtr->bgBorder)->pixel;
+    if (worldChanged || (tag != layerPtr->tag)
+	    || (background != layerPtr->background)
+	    || (canvasPtr->canvas_state != layerPtr->state)) {
+	layerPtr->tag = tag;
+	layerPtr->background = background;
+	layerPtr->state = canvasPtr->canvas_state;
+	layerPtr->flags = LAYER_RESCAN;
+    }
+    if ((tag == NULL) && (layerPtr->pixmap != None)) {
+	Tk_FreePixmap(canvasPtr->display, layerPtr->pixmap);
+	layerPtr->pixmap = None;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvLayerIsMember --
+ *
+ *	Tells whether an item belongs to the layer. When in doubt, that is
+ *	while the layer must be determined again, every item is considered a
+ *	member, so that callers err on the side of redrawing too much.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TkCanvLayerIsMember(
+    TkCanvas *canvasPtr,
+    Tk_Item *itemPtr)
+{
+    TkCanvLayer *layerPtr = canvasPtr->layerPtr;
+
+    if (layerPtr->tag == NULL) {
+	return 0;
+    }
+    if (layerPtr->flags & LAYER_RESCAN) {
+	return 1;
+    }
+    if (layerPtr->numItems == 0) {
+	return 0;
+    }
+    if (layerPtr->boundPtr == NULL) {
+	return 1;
+    }
+    return TkCanvIndexItemOrder(itemPtr)
+	    < TkCanvIndexItemOrder(layerPtr->boundPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvLayerCheckItem --
+ *
+ *	Must be called whenever an item is created, is about to be deleted, or
+ *	may have had its tags changed, and (with a NULL item) before items are
+ *	moved in the display list. Notes that the set of layer items may have
+ *	changed if the item can affect it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The layer may be determined again at the next redisplay.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvLayerCheckItem(
+    TkCanvas *canvasPtr,	/* Canvas containing the item. */
+    Tk_Item *itemPtr)		/* Item concerned, or NULL for any. */
+{
+    TkCanvLayer *layerPtr = canvasPtr->layerPtr;
+
+    if ((layerPtr->tag == NULL) || (layerPtr->flags & LAYER_RESCAN)) {
+	return;
+    }
+    if ((itemPtr == NULL) || (layerPtr->boundPtr == NULL)
+	    || (itemPtr == layerPtr->boundPtr)
+	    || TkCanvLayerIsMember(canvasPtr, itemPtr)) {
+	layerPtr->flags |= LAYER_RESCAN;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvLayerStale --
+ *
+ *	Notes that the rendering of the layer may have changed in the given
+ *	area.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The area will be rendered again before the cache is next used.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvLayerStale(
+    TkCanvas *canvasPtr,	/* Canvas whose layer changed. */
+    int x1, int y1,		/* Upper left corner of area, included. */
+    int x2, int y2)		/* Lower right corner of area, excluded. */
+{
+    TkCanvLayer *layerPtr = canvasPtr->layerPtr;
+
+    if ((layerPtr->tag == NULL) || !(layerPtr->flags & LAYER_VALID)
+	    || (x1 >= x2) || (y1 >= y2)) {
+	return;
+    }
+    if (!(layerPtr->flags & LAYER_STALE)) {
+	layerPtr->stale.x1 = x1;
+	layerPtr->stale.y1 = y1;
+	layerPtr->stale.x2 = x2;
+	layerPtr->stale.y2 = y2;
+	layerPtr->flags |= LAYER_STALE;
+	return;
+    }
+    if (x1 < layerPtr->stale.x1) {
+	layerPtr->stale.x1 = x1;
+    }
+    if (y1 < layerPtr->stale.y1) {
+	layerPtr->stale.y1 = y1;
+    }
+    if (x2 > layerPtr->stale.x2) {
+	layerPtr->stale.x2 = x2;
+    }
+    if (y2 > layerPtr->stale.y2) {
+	layerPtr->stale.y2 = y2;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HasTag, Rescan --
+ *
+ *	Rescan determines the items of the layer: the run of items at the
+ *	bottom of the display list that carry the layer tag. Window items and
+ *	other items that must always be redrawn end the run. If the set
+ *	changed, the whole layer must be rendered again.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+HasTag(
+    Tk_Item *itemPtr,
+    Tk_Uid tag)
+{
+    Tcl_Size i;
+
+    for (i = 0; i < itemPtr->numTags; i++) {
+	if (itemPtr->tagPtr[i] == tag) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+static void
+Rescan(
+    TkCanvas *canvasPtr,
+    TkCanvLayer *layerPtr)
+{
+    Tk_Item *itemPtr;
+    Tcl_Size numItems = 0;
+
+    for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
+	    itemPtr = itemPtr->nextPtr) {
+	if ((itemPtr->typePtr->flags & TK_ALWAYS_REDRAW)
+		|| !HasTag(itemPtr, layerPtr->tag)) {
+	    break;
+	}
+	numItems++;
+    }
+    if ((numItems != layerPtr->numItems) || (itemPtr != layerPtr->boundPtr)) {
+	layerPtr->flags &= ~(LAYER_VALID|LAYER_STALE);
+    }
+    layerPtr->numItems = numItems;
+    layerPtr->boundPtr = itemPtr;
+    layerPtr->flags &= ~LAYER_RESCAN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RenderArea --
+ *
+ *	Renders the background and the layer items in part of the layer
+ *	pixmap. As in DisplayCanvas, drawing goes through a temporary pixmap
+ *	so that items sticking out of the area don't overwrite the rest of
+ *	the cache.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RenderArea(
+    TkCanvas *canvasPtr,
+    TkCanvLayer *layerPtr,
+    int x1, int y1,		/* Upper left corner of area, included. */
+    int x2, int y2)		/* Lower right corner of area, excluded. */
+{
+    Tk_Window tkwin = canvasPtr->tkwin;
+    TkCanvIndexResult found;
+    Tk_Item *itemPtr;
+    Pixmap pixmap;
+    Tcl_Size i;
+    int width, height;
+
+    if (x1 < layerPtr->x) {
+	x1 = layerPtr->x;
+    }
+    if (y1 < layerPtr->y) {
+	y1 = layerPtr->y;
+    }
+    if (x2 > layerPtr->x + layerPtr->width) {
+	x2 = layerPtr->x + layerPtr->width;
+    }
+    if (y2 > layerPtr->y + layerPtr->height) {
+	y2 = layerPtr->y + layerPtr->height;
+    }
+    if ((x1 >= x2) || (y1 >= y2)) {
+	return;
+    }
+    width = x2 - x1;
+    height = y2 - y1;
+
+    canvasPtr->drawableXOrigin = x1 - 30;
+    canvasPtr->drawableYOrigin = y1 - 30;
+    pixmap = TkGetBufferPixmap(tkwin, width + 60, height + 60);
+    XFillRectangle(Tk_Display(tkwin), pixmap, canvasPtr->pixmapGC, 30, 30,
+	    (unsigned int) width, (unsigned int) height);
+
+    /*
+     * The layer items come first in display list order, so the scan can
+     * stop at the first item that isn't part of it.
+     */
+
+    TkCanvIndexSearch(canvasPtr, x1, y1, x2, y2, &found);
+    for (i = 0; i < found.numItems; i++) {
+	itemPtr = found.items[i];
+	if (!TkCanvLayerIsMember(canvasPtr, itemPtr)) {
+	    break;
+	}
+	if ((itemPtr->x1 >= x2) || (itemPtr->y1 >= y2)
+		|| (itemPtr->x2 < x1) || (itemPtr->y2 < y1)) {
+	    continue;
+	}
+	if (itemPtr->state == TK_STATE_HIDDEN ||
+		(itemPtr->state == TK_STATE_NULL &&
+		canvasPtr->canvas_state == TK_STATE_HIDDEN)) {
+	    continue;
+	}
+	itemPtr->typePtr->displayProc((Tk_Canvas) canvasPtr, itemPtr,
+		canvasPtr->display, pixmap, x1, y1, width, height);
+    }
+    TkCanvIndexFreeResult(&found);
+
+    XCopyArea(Tk_Display(tkwin), pixmap, layerPtr->pixmap,
+	    canvasPtr->pixmapGC, 30, 30, (unsigned int) width,
+	    (unsigned int) height, x1 - layerPtr->x, y1 - layerPtr->y);
+    TkFreeBufferPixmap(tkwin, pixmap);
+    layerPtr->pixels += (Tcl_WideInt) width * height;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvLayerPrepare --
+ *
+ *	Called by DisplayCanvas before anything is drawn. Brings the layer
+ *	pixmap up to date with the items and the current view, rendering only
+ *	what changed: the stale area, or the strips uncovered by scrolling.
+ *
+ * Results:
+ *	Returns 1 if the layer cache is to be used for this redisplay, 0
+ *	otherwise.
+ *
+ * Side effects:
+ *	Parts of the layer may be rendered. The drawable origin of the canvas
+ *	is changed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TkCanvLayerPrepare(
+    TkCanvas *canvasPtr)	/* Canvas about to be redisplayed. */
+{
+    TkCanvLayer *layerPtr = canvasPtr->layerPtr;
+    Tk_Window tkwin = canvasPtr->tkwin;
+    int width, height, dx, dy;
+
+#ifdef TK_NO_DOUBLE_BUFFERING
+    return 0;
+#endif /* TK_NO_DOUBLE_BUFFERING */
+
+    if (layerPtr->tag == NULL) {
+	return 0;
+    }
+    if (layerPtr->flags & LAYER_RESCAN) {
+	Rescan(canvasPtr, layerPtr);
+    }
+    if (layerPtr->numItems == 0) {
+	if (layerPtr->pixmap != None) {
+	    Tk_FreePixmap(canvasPtr->display, layerPtr->pixmap);
+	    layerPtr->pixmap = None;
+	}
+	return 0;
+    }
+
+    width = Tk_Width(tkwin);
+    height = Tk_Height(tkwin);
+    if ((layerPtr->pixmap == None) || (width != layerPtr->width)
+	    || (height != layerPtr->height)
+	    || (Tk_Depth(tkwin) != layerPtr->depth)) {
+	if (layerPtr->pixmap != None) {
+	    Tk_FreePixmap(canvasPtr->display, layerPtr->pixmap);
+	}
+	layerPtr->pixmap = Tk_GetPixmap(Tk_Display(tkwin),
+		Tk_WindowId(tkwin), width, height, Tk_Depth(tkwin));
+	layerPtr->width = width;
+	layerPtr->height = height;
+	layerPtr->depth = Tk_Depth(tkwin);
+	layerPtr->flags &= ~(LAYER_VALID|LAYER_STALE);
+    }
+
+    dx = canvasPtr->xOrigin - layerPtr->x;
+    dy = canvasPtr->yOrigin - layerPtr->y;
+    if (!(layerPtr->flags & LAYER_VALID) || (dx <= -width) || (dx >= width)
+	    || (dy <= -height) || (dy >= height)) {
+	layerPtr->x = canvasPtr->xOrigin;
+	layerPtr->y = canvasPtr->yOrigin;
+	layerPtr->flags &= ~LAYER_STALE;
+	RenderArea(canvasPtr, layerPtr, layerPtr->x, layerPtr->y,
+		layerPtr->x + width, layerPtr->y + height);
+	layerPtr->flags |= LAYER_VALID;
+	layerPtr->rebuilds++;
+	return 1;
+    }
+
+    if ((dx != 0) || (dy != 0)) {
+	/*
+	 * The view was scrolled: shift the part that is still visible and
+	 * render the strips that came into view.
+	 */
+
+	XCopyArea(Tk_Display(tkwin), layerPtr->pixmap, layerPtr->pixmap,
+		canvasPtr->pixmapGC, (dx > 0) ? dx : 0, (dy > 0) ? dy : 0,
+		(unsigned int) (width - abs(dx)),
+		(unsigned int) (height - abs(dy)),
+		(dx < 0) ? -dx : 0, (dy < 0) ? -dy : 0);
+	layerPtr->x = canvasPtr->xOrigin;
+	layerPtr->y = canvasPtr->yOrigin;
+	if (dx > 0) {
+	    RenderArea(canvasPtr, layerPtr, layerPtr->x + width - dx,
+		    layerPtr->y, layerPtr->x + width, layerPtr->y + height);
+	} else if (dx < 0) {
+	    RenderArea(canvasPtr, layerPtr, layerPtr->x, layerPtr->y,
+		    layerPtr->x - dx, layerPtr->y + height);
+	}
+	if (dy > 0) {
+	    RenderArea(canvasPtr, layerPtr, layerPtr->x,
+		    layerPtr->y + height - dy, layerPtr->x + width,
+		    layerPtr->y + height);
+	} else if (dy < 0) {
+	    RenderArea(canvasPtr, layerPtr, layerPtr->x, layerPtr->y,
+		    layerPtr->x + width, layerPtr->y - dy);
+	}
+	layerPtr->updates++;
+    }
+
+    if (layerPtr->flags & LAYER_STALE) {
+	layerPtr->flags &= ~LAYER_STALE;
+	RenderArea(canvasPtr, layerPtr, layerPtr->stale.x1,
+		layerPtr->stale.y1, layerPtr->stale.x2, layerPtr->stale.y2);
+	layerPtr->updates++;
+    }
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvLayerComposite --
+ *
+ *	Copies part of the layer pixmap, which must have been brought up to
+ *	date by TkCanvLayerPrepare, into the drawable used by DisplayCanvas.
+ *	This replaces clearing the area to the background.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The area of the drawable is overwritten.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkCanvLayerComposite(
+    TkCanvas *canvasPtr,	/* Canvas being redisplayed. */
+    Drawable drawable,		/* Where to copy the layer. */
+    int x1, int y1,		/* Upper left corner of area, in canvas
+				 * coordinates. */
+    int width, int height)	/* Size of area. */
+{
+    TkCanvLayer *layerPtr = canvasPtr->layerPtr;
+
+    XCopyArea(canvasPtr->display, layerPtr->pixmap, drawable,
+	    canvasPtr->pixmapGC, x1 - layerPtr->x, y1 - layerPtr->y,
+	    (unsigned int) width, (unsigned int) height,
+	    x1 - canvasPtr->drawableXOrigin, y1 - canvasPtr->drawableYOrigin);
+    layerPtr->hits++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkCanvLayerObjCmd --
+ *
+ *	This function implements the "cache" widget command of canvases.
+ *	Without arguments it returns a dictionary describing the layer cache;
+ *	"cache invalidate" throws the cached rendering away and "cache reset"
+ *	clears the counters.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	See above.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TkCanvLayerObjCmd(
+    TkCanvas *canvasPtr,	/* Canvas whose layer is queried. */
+    Tcl_Interp *interp,		/* Current interpreter. */
+    Tcl_Size objc,		/* Number of arguments. */
+    Tcl_Obj *const objv[])	/* Argument objects. */
+{
+    TkCanvLayer *layerPtr = canvasPtr->layerPtr;
+    static const char *const layerOptions[] = {
+	"invalidate", "reset", NULL
+    };
+    enum layerOptionsEnum {
+	LAYER_INVALIDATE, LAYER_RESET
+    };
+    Tcl_Obj *resultObj;
+    Tcl_WideInt bytes = 0;
+    int index;
+
+    if (objc > 3) {
+	Tcl_WrongNumArgs(interp, 2, objv, "?option?");
+	return TCL_ERROR;
+    }
+    if (objc == 3) {
+	if (Tcl_GetIndexFromObj(interp, objv[2], layerOptions, "option", 0,
+		&index) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	switch ((enum layerOptionsEnum) index) {
+	case LAYER_INVALIDATE:
+	    if (layerPtr->pixmap != None) {
+		Tk_FreePixmap(canvasPtr->display, layerPtr->pixmap);
+		layerPtr->pixmap = None;
+	    }
+	    layerPtr->flags = LAYER_RESCAN;
+	    break;
+	case LAYER_RESET:
+	    layerPtr->hits = layerPtr->updates = 0;
+	    layerPtr->rebuilds = layerPtr->pixels = 0;
+	    break;
+	}
+	return TCL_OK;
+    }
+
+    if ((layerPtr->tag != NULL) && (layerPtr->flags & LAYER_RESCAN)) {
+	Rescan(canvasPtr, layerPtr);
+    }
+    if (layerPtr->pixmap != None) {
+	bytes = (Tcl_WideInt) layerPtr->width * layerPtr->height
+		* ((layerPtr->depth > 16) ? 4 : (layerPtr->depth + 7) / 8);
+    }
+    resultObj = Tcl_NewObj();
+    Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("tag", -1),
+	    Tcl_NewStringObj(layerPtr->tag ? layerPtr->tag : "", -1));
+    Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("items", -1),
+	    Tcl_NewWideIntObj(layerPtr->tag ? layerPtr->numItems : 0));
+    Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("cached", -1),
+	    Tcl_NewBooleanObj((layerPtr->pixmap != None)
+		    && (layerPtr->flags & LAYER_VALID)));
+    Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("bytes", -1),
+	    Tcl_NewWideIntObj(bytes));
+    Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("hits", -1),
+	    Tcl_NewWideIntObj(layerPtr->hits));
+    Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("updates", -1),
+	    Tcl_NewWideIntObj(layerPtr->updates));
+    Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("rebuilds", -1),
+	    Tcl_NewWideIntObj(layerPtr->rebuilds));
+    Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("pixels", -1),
+	    Tcl_NewWideIntObj(layerPtr->pixels));
+    Tcl_SetObjResult(interp, resultObj);
+    return TCL_OK;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * End:
+ */
@@ -27,6 +27,49 @@ typedef enum {
     ARROWS_NONE, ARROWS_FIRST, ARROWS_LAST, ARROWS_BOTH
 } Arrows;
 
+typedef enum {
+    DECIMATE_NONE, DECIMATE_MINMAX
+} Decimation;
+
+/*
+ * When a line is decimated, the points that fall in the same pixel column
+ * are reduced to the first and last of them and to the ones with the
+ * smallest and largest y coordinate, which draws the same pixels. The
+ * reduced path is described by the structure below. It is computed the
+ * first time it is needed after the coordinates of the line change, and is
+ * split into blocks whose bounding boxes let redisplay skip the parts of
+ * the line outside the area being redrawn. When points are only appended,
+ * the reduced path is extended from the start of its last pixel column
+ * instead of being computed again.
+ */
+
+#define LINE_BLOCK_POINTS 64
+
+typedef struct LineSummary {
+    Tcl_Size numLinePoints;	/* Number of points of the line that the
+				 * reduced path was computed from. */
+    Tcl_Size lastRun;		/* Index of the first point of the line in
+				 * the last pixel column. */
+    Tcl_Size lastRunStart;	/* Number of points of the reduced path that
+				 * come before that column. */
+    Tcl_Size numPoints;		/* Number of points in the reduced
+				 * path. */
+    Tcl_Size indexSpace;	/* Number of entries allocated for
+				 * indexPtr. */
+    Tcl_Size *indexPtr;		/* Indices of these points in the coordPtr
+				 * array of the line, in increasing order.
+				 * The first and last point of the line are
+				 * always included. */
+    Tcl_Size numBlocks;		/* Number of blocks. Block i consists of
+				 * the points i*LINE_BLOCK_POINTS up to and
+				 * including (i+1)*LINE_BLOCK_POINTS of the
+				 * reduced path, so that consecutive blocks
+				 * share a point. */
+    Tcl_Size blockSpace;	/* Number of blocks allocated for boxPtr. */
+    double *boxPtr;		/* Bounding box of each block: x1, y1, x2, y2
+				 * in canvas coordinates. */
+} LineSummary;
+
 typedef struct LineItem {
     Tk_Item header;		/* Generic stuff that's the same for all
 				 * types. MUST BE FIRST IN STRUCTURE. */
@@ -44,6 +87,9 @@ typedef struct LineItem {
 				 * their tips. The actual endpoints are stored
 				 * in the *firstArrowPtr and *lastArrowPtr, if
 				 * they exist. */
+    Tcl_Size coordSpace;	/* Number of doubles allocated at *coordPtr;
+				 * may exceed 2*numPoints after points have
+				 * been appended. */
     int capStyle;		/* Cap style for line. */
     int joinStyle;		/* Join style for line. */
     GC arrowGC;			/* Graphics context for drawing arrowheads. */
@@ -66,6 +112,11 @@ typedef struct LineItem {
     const Tk_SmoothMethod *smooth; /* Non-zero means draw line smoothed (i.e.
 				 * with Bezier splines). */
     int splineSteps;		/* Number of steps in each spline segment. */
+    Decimation decimate;	/* Indicates whether to draw and hit test the
+				 * line through its reduced path. */
+    LineSummary *summaryPtr;	/* Reduced path of the line, or NULL if it
+				 * hasn't been computed since the coordinates
+				 * last changed. */
 } LineItem;
 
 /*
@@ -89,14 +140,29 @@ static int		ConfigureArrows(Tk_Canvas canvas, LineItem *linePtr);
 static int		CreateLine(Tcl_Interp *interp,
 			    Tk_Canvas canvas, struct Tk_Item *itemPtr,
 			    Tcl_Size objc, Tcl_Obj *const objv[]);
+static int		DecimateParseProc(void *clientData,
+			    Tcl_Interp *interp, Tk_Window tkwin,
+			    const char *value, char *recordPtr,
+			    Tcl_Size offset);
+static const char * DecimatePrintProc(void *clientData,
+			    Tk_Window tkwin, char *recordPtr, Tcl_Size offset,
+			    Tcl_FreeProc **freeProcPtr);
+static void		DiscardLineSummary(LineItem *linePtr);
+static void		DisplayDecimatedLine(Tk_Canvas canvas,
+			    LineItem *linePtr, Display *display,
+			    Drawable drawable, double linewidth, int x, int y,
+			    int width, int height);
 static void		DeleteLine(Tk_Canvas canvas,
 			    Tk_Item *itemPtr, Display *display);
 static void		DisplayLine(Tk_Canvas canvas,
 			    Tk_Item *itemPtr, Display *display, Drawable dst,
 			    int x, int y, int width, int height);
+static double *		GetDecimatedPath(LineItem *linePtr,
+			    double *staticSpace, int *numPointsPtr);
 static int		GetLineIndex(Tcl_Interp *interp,
 			    Tk_Canvas canvas, Tk_Item *itemPtr,
 			    Tcl_Obj *obj, Tcl_Size *indexPtr);
+static LineSummary *	GetLineSummary(LineItem *linePtr);
 static int		LineCoords(Tcl_Interp *interp,
 			    Tk_Canvas canvas, Tk_Item *itemPtr,
 			    Tcl_Size objc, Tcl_Obj *const objv[]);
@@ -142,6 +208,9 @@ static const Tk_CustomOption arrowShapeOption = {
 static const Tk_CustomOption arrowOption = {
     ArrowParseProc, ArrowPrintProc, NULL
 };
+static const Tk_CustomOption decimateOption = {
+    DecimateParseProc, DecimatePrintProc, NULL
+};
 static const Tk_CustomOption smoothOption = {
     TkSmoothParseProc, TkSmoothPrintProc, NULL
 };
@@ -188,6 +257,9 @@ static const Tk_ConfigSpec configSpecs[] = {
 	TK_CONFIG_NULL_OK, &dashOption},
     {TK_CONFIG_PIXELS, "-dashoffset", NULL, NULL,
 	"0", offsetof(LineItem, outline.offsetObj), TK_CONFIG_OBJS, NULL},
+    {TK_CONFIG_CUSTOM, "-decimate", NULL, NULL,
+	"none", offsetof(LineItem, decimate),
+	TK_CONFIG_DONT_SET_DEFAULT, &decimateOption},
     {TK_CONFIG_CUSTOM, "-disableddash", NULL, NULL,
 	NULL, offsetof(LineItem, outline.disabledDash),
 	TK_CONFIG_NULL_OK, &dashOption},
@@ -302,6 +374,7 @@ CreateLine(
     linePtr->canvas = canvas;
     linePtr->numPoints = 0;
     linePtr->coordPtr = NULL;
+    linePtr->coordSpace = 0;
     linePtr->capStyle = CapButt;
     linePtr->joinStyle = JoinRound;
     linePtr->arrowGC = NULL;
@@ -313,6 +386,8 @@ CreateLine(
     linePtr->lastArrowPtr = NULL;
     linePtr->smooth = NULL;
     linePtr->splineSteps = 12;
+    linePtr->decimate = DECIMATE_NONE;
+    linePtr->summaryPtr = NULL;
 
     /*
      * Count the number of points and then parse them into a point array.
@@ -411,6 +486,7 @@ LineCoords(
 	return TCL_ERROR;
     }
 
+    DiscardLineSummary(linePtr);
     numPoints = objc/2;
     if (linePtr->numPoints != numPoints) {
 	coordPtr = (double *)ckalloc(sizeof(double) * objc);
@@ -418,6 +494,7 @@ LineCoords(
 	    ckfree(linePtr->coordPtr);
 	}
 	linePtr->coordPtr = coordPtr;
+	linePtr->coordSpace = objc;
 	linePtr->numPoints = numPoints;
     }
     coordPtr = linePtr->coordPtr;
@@ -482,6 +559,8 @@ ConfigureLine(
     unsigned long mask;
     Tk_Window tkwin;
     Tk_State state;
+    Tcl_Size i;
+    double firstPoint[2], lastPoint[2];
 
     tkwin = Tk_CanvasTkwin(canvas);
     if (TCL_OK != Tk_ConfigureWidget(interp, tkwin, configSpecs, objc,
@@ -550,6 +629,10 @@ ConfigureLine(
 	linePtr->splineSteps = 100;
     }
 
+    if (linePtr->decimate == DECIMATE_NONE) {
+	DiscardLineSummary(linePtr);
+    }
+
     if ((!linePtr->numPoints) || (state == TK_STATE_HIDDEN)) {
 	ComputeLineBbox(canvas, linePtr);
 	return TCL_OK;
@@ -560,6 +643,11 @@ ConfigureLine(
      * line's endpoints (they were shortened when the arrowheads were added).
      */
 
+    i = 2*(linePtr->numPoints-1);
+    firstPoint[0] = linePtr->coordPtr[0];
+    firstPoint[1] = linePtr->coordPtr[1];
+    lastPoint[0] = linePtr->coordPtr[i];
+    lastPoint[1] = linePtr->coordPtr[i+1];
     if ((linePtr->firstArrowPtr != NULL) && (linePtr->arrow != ARROWS_FIRST)
 	    && (linePtr->arrow != ARROWS_BOTH)) {
 	linePtr->coordPtr[0] = linePtr->firstArrowPtr[0];
@@ -569,9 +657,6 @@ ConfigureLine(
     }
     if ((linePtr->lastArrowPtr != NULL) && (linePtr->arrow != ARROWS_LAST)
 	    && (linePtr->arrow != ARROWS_BOTH)) {
-	int i;
-
-	i = 2*(linePtr->numPoints-1);
 	linePtr->coordPtr[i] = linePtr->lastArrowPtr[0];
 	linePtr->coordPtr[i+1] = linePtr->lastArrowPtr[1];
 	ckfree(linePtr->lastArrowPtr);
@@ -581,6 +666,17 @@ ConfigureLine(
 	ConfigureArrows(canvas, linePtr);
     }
 
+    /*
+     * If the end points moved, the reduced path is out of date.
+     */
+
+    if ((linePtr->coordPtr[0] != firstPoint[0])
+	    || (linePtr->coordPtr[1] != firstPoint[1])
+	    || (linePtr->coordPtr[i] != lastPoint[0])
+	    || (linePtr->coordPtr[i+1] != lastPoint[1])) {
+	DiscardLineSummary(linePtr);
+    }
+
     /*
      * Recompute bounding box for line.
      */
@@ -628,6 +724,7 @@ DeleteLine(
     if (linePtr->lastArrowPtr != NULL) {
 	ckfree(linePtr->lastArrowPtr);
     }
+    DiscardLineSummary(linePtr);
 }
 
 /*
@@ -815,6 +912,209 @@ ComputeLineBbox(
     linePtr->header.y2 += 1;
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * DiscardLineSummary --
+ *
+ *	Frees the reduced path of a line, so that it gets recomputed from the
+ *	current coordinates the next time it is needed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+DiscardLineSummary(
+    LineItem *linePtr)		/* Line whose coordinates changed. */
+{
+    LineSummary *sumPtr = linePtr->summaryPtr;
+
+    if (sumPtr != NULL) {
+	ckfree(sumPtr->indexPtr);
+	ckfree(sumPtr->boxPtr);
+	ckfree(sumPtr);
+	linePtr->summaryPtr = NULL;
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * GetLineSummary --
+ *
+ *	Returns the reduced path of a line with at least one point, computing
+ *	it if necessary. Runs of consecutive points that are in the same pixel
+ *	column are replaced by their first and last point and the points with
+ *	the smallest and largest y coordinate among them, in their original
+ *	order. If points were appended to the line since the reduced path was
+ *	computed, only the last column and the new points are reduced.
+ *
+ * Results:
+ *	A pointer to the reduced path, owned by the line.
+ *
+ * Side effects:
+ *	The reduced path is cached in linePtr->summaryPtr.
+ *
+ *--------------------------------------------------------------
+ */
+
+static LineSummary *
+GetLineSummary(
+    LineItem *linePtr)		/* Line to get the reduced path of. */
+{
+    LineSummary *sumPtr = linePtr->summaryPtr;
+    double *coordPtr = linePtr->coordPtr, *boxPtr, column;
+    Tcl_Size i, j, k, first, last, minIndex, maxIndex, numPoints, changed;
+
+    if (sumPtr == NULL) {
+	sumPtr = (LineSummary *)ckalloc(sizeof(LineSummary));
+	memset(sumPtr, 0, sizeof(LineSummary));
+	linePtr->summaryPtr = sumPtr;
+    } else if (sumPtr->numLinePoints == linePtr->numPoints) {
+	return sumPtr;
+    }
+
+    /*
+     * Everything before the last pixel column is final: the new points can
+     * only add to that column or start new ones.
+     */
+
+    numPoints = changed = sumPtr->lastRunStart;
+    for (first = sumPtr->lastRun; first < linePtr->numPoints;
+	    first = last + 1) {
+	sumPtr->lastRun = first;
+	sumPtr->lastRunStart = numPoints;
+	if (numPoints + 4 > sumPtr->indexSpace) {
+	    sumPtr->indexSpace = 2 * sumPtr->indexSpace + 4;
+	    if (sumPtr->indexSpace > linePtr->numPoints + 4) {
+		sumPtr->indexSpace = linePtr->numPoints + 4;
+	    }
+	    sumPtr->indexPtr = (Tcl_Size *)ckrealloc(sumPtr->indexPtr,
+		    sumPtr->indexSpace * sizeof(Tcl_Size));
+	}
+	column = floor(coordPtr[2*first] + 0.5);
+	minIndex = maxIndex = last = first;
+	while ((last + 1 < linePtr->numPoints)
+		&& (floor(coordPtr[2*(last+1)] + 0.5) == column)) {
+	    last++;
+	    if (coordPtr[2*last+1] < coordPtr[2*minIndex+1]) {
+		minIndex = last;
+	    } else if (coordPtr[2*last+1] > coordPtr[2*maxIndex+1]) {
+		maxIndex = last;
+	    }
+	}
+	if (minIndex > maxIndex) {
+	    i = minIndex;
+	    minIndex = maxIndex;
+	    maxIndex = i;
+	}
+	sumPtr->indexPtr[numPoints++] = first;
+	if ((minIndex != first) && (minIndex != last)) {
+	    sumPtr->indexPtr[numPoints++] = minIndex;
+	}
+	if ((maxIndex != first) && (maxIndex != last)
+		&& (maxIndex != minIndex)) {
+	    sumPtr->indexPtr[numPoints++] = maxIndex;
+	}
+	if (last != first) {
+	    sumPtr->indexPtr[numPoints++] = last;
+	}
+    }
+
+    /*
+     * Recompute the bounding boxes of the blocks that contain changed
+     * points, that is the points from the start of the last column on.
+     */
+
+    k = (changed == 0) ? 0 : (changed - 1) / LINE_BLOCK_POINTS;
+    sumPtr->numLinePoints = linePtr->numPoints;
+    sumPtr->numPoints = numPoints;
+    sumPtr->numBlocks = (numPoints < 2) ? 1
+	    : (numPoints - 2) / LINE_BLOCK_POINTS + 1;
+    if (sumPtr->numBlocks > sumPtr->blockSpace) {
+	sumPtr->blockSpace = sumPtr->numBlocks + sumPtr->blockSpace / 2;
+	sumPtr->boxPtr = (double *)ckrealloc(sumPtr->boxPtr,
+		4 * sumPtr->blockSpace * sizeof(double));
+    }
+    for (boxPtr = sumPtr->boxPtr + 4*k; k < sumPtr->numBlocks;
+	    k++, boxPtr += 4) {
+	first = k * LINE_BLOCK_POINTS;
+	last = first + LINE_BLOCK_POINTS;
+	if (last >= numPoints) {
+	    last = numPoints - 1;
+	}
+	j = 2 * sumPtr->indexPtr[first];
+	boxPtr[0] = boxPtr[2] = coordPtr[j];
+	boxPtr[1] = boxPtr[3] = coordPtr[j+1];
+	for (i = first + 1; i <= last; i++) {
+	    j = 2 * sumPtr->indexPtr[i];
+	    if (coordPtr[j] < boxPtr[0]) {
+		boxPtr[0] = coordPtr[j];
+	    } else if (coordPtr[j] > boxPtr[2]) {
+		boxPtr[2] = coordPtr[j];
+	    }
+	    if (coordPtr[j+1] < boxPtr[1]) {
+		boxPtr[1] = coordPtr[j+1];
+	    } else if (coordPtr[j+1] > boxPtr[3]) {
+		boxPtr[3] = coordPtr[j+1];
+	    }
+	}
+    }
+    return sumPtr;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * GetDecimatedPath --
+ *
+ *	Returns the coordinates of the reduced path of a line, for hit
+ *	testing.
+ *
+ * Results:
+ *	A pointer to the coordinates, which is staticSpace (which has room for
+ *	MAX_STATIC_POINTS points), the coordPtr array of the line if nothing
+ *	was reduced, or else a new array that the caller must free with
+ *	ckfree. The number of points is stored in *numPointsPtr.
+ *
+ * Side effects:
+ *	The reduced path may be computed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static double *
+GetDecimatedPath(
+    LineItem *linePtr,		/* Line with at least one point. */
+    double *staticSpace,	/* Space for MAX_STATIC_POINTS points. */
+    int *numPointsPtr)		/* Number of points is stored here. */
+{
+    LineSummary *sumPtr = GetLineSummary(linePtr);
+    double *linePoints;
+    Tcl_Size i;
+
+    *numPointsPtr = (int) sumPtr->numPoints;
+    if (sumPtr->numPoints == linePtr->numPoints) {
+	return linePtr->coordPtr;
+    }
+    if (sumPtr->numPoints <= MAX_STATIC_POINTS) {
+	linePoints = staticSpace;
+    } else {
+	linePoints = (double *)ckalloc(2 * sumPtr->numPoints * sizeof(double));
+    }
+    for (i = 0; i < sumPtr->numPoints; i++) {
+	linePoints[2*i] = linePtr->coordPtr[2*sumPtr->indexPtr[i]];
+	linePoints[2*i+1] = linePtr->coordPtr[2*sumPtr->indexPtr[i]+1];
+    }
+    return linePoints;
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -838,10 +1138,9 @@ DisplayLine(
     Tk_Item *itemPtr,		/* Item to be displayed. */
     Display *display,		/* Display on which to draw item. */
     Drawable drawable,		/* Pixmap or window in which to draw item. */
-    TCL_UNUSED(int),		/* Describes region of canvas that must be */
-    TCL_UNUSED(int),		/* redisplayed (not used). */
-    TCL_UNUSED(int),
-    TCL_UNUSED(int))
+    int x, int y,		/* Describes region of canvas that must be */
+    int width, int height)	/* redisplayed (only used for decimated
+				 * lines). */
 {
     LineItem *linePtr = (LineItem *)itemPtr;
     XPoint staticPoints[MAX_STATIC_POINTS*3];
@@ -867,6 +1166,18 @@ DisplayLine(
 	    linewidth = linePtr->outline.disabledWidth;
 	}
     }
+
+    if ((linePtr->decimate != DECIMATE_NONE) && (linePtr->numPoints > 2)
+	    && !linePtr->smooth) {
+	if (Tk_ChangeOutlineGC(canvas, itemPtr, &linePtr->outline)) {
+	    Tk_CanvasSetOffset(canvas, linePtr->arrowGC,
+		    &linePtr->outline.tsoffset);
+	}
+	DisplayDecimatedLine(canvas, linePtr, display, drawable, linewidth,
+		x, y, width, height);
+	goto arrowheads;
+    }
+
     /*
      * Build up an array of points in screen coordinates. Use a static array
      * unless the line has an enormous number of points; in this case,
@@ -927,6 +1238,7 @@ DisplayLine(
      * Display arrowheads, if they are wanted.
      */
 
+  arrowheads:
     if (linePtr->firstArrowPtr != NULL) {
 	TkFillPolygon(canvas, linePtr->firstArrowPtr, PTS_IN_ARROW,
 		display, drawable, linePtr->arrowGC, NULL);
@@ -940,6 +1252,109 @@ DisplayLine(
     }
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * DisplayDecimatedLine --
+ *
+ *	Draws the reduced path of a line. Only the runs of blocks whose
+ *	bounding box, grown by the line width, meets the area being redrawn
+ *	are translated and drawn.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The line is drawn in drawable with the GC of its outline, which must
+ *	already be set up.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+DisplayDecimatedLine(
+    Tk_Canvas canvas,		/* Canvas that contains the line. */
+    LineItem *linePtr,		/* Line with more than two points. */
+    Display *display,		/* Display on which to draw. */
+    Drawable drawable,		/* Pixmap or window in which to draw. */
+    double linewidth,		/* Width the line is drawn with. */
+    int x, int y,		/* Region of the canvas that must be */
+    int width, int height)	/* redisplayed. */
+{
+    LineSummary *sumPtr = GetLineSummary(linePtr);
+    double staticCoords[2*MAX_STATIC_POINTS];
+    XPoint staticPoints[MAX_STATIC_POINTS*3];
+    double *coords = staticCoords, *boxPtr, margin;
+    XPoint *pointPtr = staticPoints;
+    Tcl_Size k, first, last, i, j, space = MAX_STATIC_POINTS;
+    int numPoints;
+
+    /*
+     * Mitered joins can stick out several line widths beyond the points;
+     * TkGetMiterPoints turns joins sharper than 11 degrees into bevels,
+     * which bounds that at about 5.3 line widths.
+     */
+
+    margin = linewidth / 2.0 + 2.0;
+    if (linePtr->joinStyle == JoinMiter) {
+	margin += 5.0 * linewidth;
+    }
+
+#define BLOCK_HIDDEN(boxPtr) \
+    (((boxPtr)[0] - margin > x + width) || ((boxPtr)[2] + margin < x) \
+	    || ((boxPtr)[1] - margin > y + height) \
+	    || ((boxPtr)[3] + margin < y))
+
+    for (k = 0; k < sumPtr->numBlocks; ) {
+	if (BLOCK_HIDDEN(sumPtr->boxPtr + 4*k)) {
+	    k++;
+	    continue;
+	}
+
+	/*
+	 * Extend the run over the following visible blocks, then draw the
+	 * points they cover in one go.
+	 */
+
+	first = k * LINE_BLOCK_POINTS;
+	for (k++, boxPtr = sumPtr->boxPtr + 4*k; k < sumPtr->numBlocks;
+		k++, boxPtr += 4) {
+	    if (BLOCK_HIDDEN(boxPtr)) {
+		break;
+	    }
+	}
+	last = k * LINE_BLOCK_POINTS;
+	if (last >= sumPtr->numPoints) {
+	    last = sumPtr->numPoints - 1;
+	}
+	if (last - first + 1 > space) {
+	    if (coords != staticCoords) {
+		ckfree(coords);
+		ckfree(pointPtr);
+	    }
+	    space = last - first + 1;
+	    coords = (double *)ckalloc(2 * space * sizeof(double));
+	    pointPtr = (XPoint *)ckalloc(3 * space * sizeof(XPoint));
+	}
+	for (i = first, j = 0; i <= last; i++, j += 2) {
+	    coords[j] = linePtr->coordPtr[2*sumPtr->indexPtr[i]];
+	    coords[j+1] = linePtr->coordPtr[2*sumPtr->indexPtr[i]+1];
+	}
+	numPoints = TkCanvTranslatePath((TkCanvas *) canvas,
+		(int) (last - first + 1), coords, 0, pointPtr);
+	if (numPoints > 1) {
+	    XDrawLines(display, drawable, linePtr->outline.gc, pointPtr,
+		    numPoints, CoordModeOrigin);
+	}
+    }
+#undef BLOCK_HIDDEN
+
+    if (coords != staticCoords) {
+	ckfree(coords);
+	ckfree(pointPtr);
+    }
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -1021,6 +1436,8 @@ LineInsert(
 	ckfree(linePtr->coordPtr);
     }
     linePtr->coordPtr = newCoordPtr;
+    linePtr->coordSpace = length + objc;
+    DiscardLineSummary(linePtr);
     length += objc ;
     linePtr->numPoints = length / 2;
 
@@ -1193,6 +1610,242 @@ LineInsert(
 
     ComputeLineBbox(canvas, linePtr);
 }
+
+/*
+ *--------------------------------------------------------------
+ *
+ * TkLineSetCoords --
+ *
+ *	Replaces the coordinates of a line item, or appends points to it, from
+ *	an array of doubles. This is the path taken by the binary and -append
+ *	forms of the "coords" widget command and by Tk_CanvasSetCoords; it
+ *	avoids converting each value through a Tcl_Obj.
+ *
+ * Results:
+ *	Returns TCL_OK or TCL_ERROR, in which case an error message is left
+ *	in the interp's result.
+ *
+ * Side effects:
+ *	The coordinates of the line are changed. Storage grows geometrically
+ *	when points are appended. When points are appended to a line without
+ *	arrowheads or smoothing, the bounding box is extended and only the new
+ *	tail is scheduled for redisplay; the TK_ITEM_DONT_REDRAW flag is set
+ *	to tell the generic canvas code so.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+TkLineSetCoords(
+    Tcl_Interp *interp,		/* Used for error reporting. */
+    Tk_Canvas canvas,		/* Canvas containing item. */
+    Tk_Item *itemPtr,		/* Line item to be modified. */
+    const double *coords,	/* New coordinates: x1, y1, x2, y2, ... */
+    Tcl_Size numCoords,		/* Number of values in coords. */
+    int flags)			/* TK_CANVAS_COORDS_APPEND means add the
+				 * points to the end of the line instead of
+				 * replacing its coordinates. */
+{
+    LineItem *linePtr = (LineItem *) itemPtr;
+    Tk_State state = itemPtr->state;
+    Tcl_Size i, first, length, oldNumPoints;
+    int x1, y1, x2, y2, intWidth;
+    double width;
+
+    if (state == TK_STATE_NULL) {
+	state = Canvas(canvas)->canvas_state;
+    }
+    length = 0;
+    if (flags & TK_CANVAS_COORDS_APPEND) {
+	length = 2*linePtr->numPoints;
+    }
+    if (numCoords & 1) {
+	Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+		"wrong # coordinates: expected an even number, got %" TCL_SIZE_MODIFIER "d",
+		numCoords));
+	Tcl_SetErrorCode(interp, "TK", "CANVAS", "COORDS", "LINE", (char *)NULL);
+	return TCL_ERROR;
+    } else if (length + numCoords < 4) {
+	Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+		"wrong # coordinates: expected at least 4, got %" TCL_SIZE_MODIFIER "d",
+		length + numCoords));
+	Tcl_SetErrorCode(interp, "TK", "CANVAS", "COORDS", "LINE", (char *)NULL);
+	return TCL_ERROR;
+    } else if (numCoords == 0) {
+	return TCL_OK;
+    }
+
+    /*
+     * Put back the real endpoints before extending the line, as LineInsert
+     * does; ConfigureArrows pulls them in again below.
+     */
+
+    if (length > 0) {
+	if (linePtr->firstArrowPtr != NULL) {
+	    linePtr->coordPtr[0] = linePtr->firstArrowPtr[0];
+	    linePtr->coordPtr[1] = linePtr->firstArrowPtr[1];
+	}
+	if (linePtr->lastArrowPtr != NULL) {
+	    linePtr->coordPtr[length-2] = linePtr->lastArrowPtr[0];
+	    linePtr->coordPtr[length-1] = linePtr->lastArrowPtr[1];
+	}
+    }
+    if (length + numCoords > linePtr->coordSpace) {
+	Tcl_Size space = length + numCoords;
+
+	if (length > 0) {
+	    space += space/2;
+	}
+	linePtr->coordPtr = (double *)ckrealloc(linePtr->coordPtr,
+		sizeof(double) * space);
+	linePtr->coordSpace = space;
+    }
+    memcpy(linePtr->coordPtr + length, coords, sizeof(double) * numCoords);
+    oldNumPoints = length/2;
+    linePtr->numPoints = (length + numCoords)/2;
+
+    /*
+     * The old points keep their values (the first one is pulled in by the
+     * same amount again, and the last one is in the column that the reduced
+     * path is extended from), so the reduced path only needs extending.
+     */
+
+    if (length == 0) {
+	DiscardLineSummary(linePtr);
+    }
+
+    if (linePtr->firstArrowPtr != NULL) {
+	ckfree(linePtr->firstArrowPtr);
+	linePtr->firstArrowPtr = NULL;
+    }
+    if (linePtr->lastArrowPtr != NULL) {
+	ckfree(linePtr->lastArrowPtr);
+	linePtr->lastArrowPtr = NULL;
+    }
+    if (linePtr->arrow != ARROWS_NONE) {
+	ConfigureArrows(canvas, linePtr);
+    }
+
+    /*
+     * Appending to a plain line leaves everything before the old last point
+     * as it was, so the bounding box only needs to grow by the new tail.
+     * Arrowheads, smoothing and stipple offsets that follow the bounding box
+     * depend on the line as a whole, so those take the full path.
+     */
+
+    if (oldNumPoints == 0 || linePtr->arrow != ARROWS_NONE
+	    || linePtr->smooth != NULL || state == TK_STATE_HIDDEN
+	    || (linePtr->outline.tsoffset.flags & ~TK_OFFSET_RELATIVE)
+	    || itemPtr->x1 >= itemPtr->x2 || itemPtr->y1 >= itemPtr->y2) {
+	ComputeLineBbox(canvas, linePtr);
+	return TCL_OK;
+    }
+
+    /*
+     * The tail starts at the old last point, whose cap becomes a join. With
+     * decimation, the reduced path changes throughout the pixel column that
+     * point falls in, so start at the first point of that column.
+     */
+
+    first = oldNumPoints - 1;
+    if (linePtr->decimate != DECIMATE_NONE) {
+	double column = floor(linePtr->coordPtr[2*first] + 0.5);
+
+	while (first > 0
+		&& floor(linePtr->coordPtr[2*first - 2] + 0.5) == column) {
+	    first--;
+	}
+    }
+
+    x1 = itemPtr->x1; y1 = itemPtr->y1;
+    x2 = itemPtr->x2; y2 = itemPtr->y2;
+    itemPtr->x1 = itemPtr->x2 = (int) linePtr->coordPtr[2*first];
+    itemPtr->y1 = itemPtr->y2 = (int) linePtr->coordPtr[2*first + 1];
+    for (i = first + 1; i < linePtr->numPoints; i++) {
+	TkIncludePoint(itemPtr, linePtr->coordPtr + 2*i);
+    }
+    width = linePtr->outline.width;
+    if (width < 1.0) {
+	width = 1.0;
+    }
+    if (linePtr->joinStyle == JoinMiter) {
+	for (i = (first > 0) ? first - 1 : 0; i + 2 < linePtr->numPoints;
+		i++) {
+	    double miter[4], *coordPtr = linePtr->coordPtr + 2*i;
+
+	    if (TkGetMiterPoints(coordPtr, coordPtr+2, coordPtr+4, width,
+		    miter, miter+2)) {
+		TkIncludePoint(itemPtr, miter);
+		TkIncludePoint(itemPtr, miter+2);
+	    }
+	}
+    }
+    intWidth = (int) (width + 0.5) + 1;
+    itemPtr->x1 -= intWidth;
+    itemPtr->y1 -= intWidth;
+    itemPtr->x2 += intWidth;
+    itemPtr->y2 += intWidth;
+    Tk_CanvasEventuallyRedraw(canvas, itemPtr->x1, itemPtr->y1,
+	    itemPtr->x2, itemPtr->y2);
+    itemPtr->redraw_flags |= TK_ITEM_DONT_REDRAW;
+
+    if (x1 < itemPtr->x1) {
+	itemPtr->x1 = x1;
+    }
+    if (y1 < itemPtr->y1) {
+	itemPtr->y1 = y1;
+    }
+    if (x2 > itemPtr->x2) {
+	itemPtr->x2 = x2;
+    }
+    if (y2 > itemPtr->y2) {
+	itemPtr->y2 = y2;
+    }
+    return TCL_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * TkLineGetCoords --
+ *
+ *	Copies the coordinates of a line item, as the "coords" widget command
+ *	would report them, into an array of doubles.
+ *
+ * Results:
+ *	The number of values in the line's coordinates. If coords is not
+ *	NULL, it must have room for that many values and is filled in.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+Tcl_Size
+TkLineGetCoords(
+    Tk_Item *itemPtr,		/* Line item to be read. */
+    double *coords)		/* Where to store x1, y1, x2, y2, ..., or
+				 * NULL. */
+{
+    LineItem *linePtr = (LineItem *) itemPtr;
+    Tcl_Size numCoords = 2*linePtr->numPoints;
+
+    if (coords == NULL || numCoords == 0) {
+	return numCoords;
+    }
+    memcpy(coords, linePtr->coordPtr, sizeof(double) * numCoords);
+    if (linePtr->firstArrowPtr != NULL) {
+	coords[0] = linePtr->firstArrowPtr[0];
+	coords[1] = linePtr->firstArrowPtr[1];
+    }
+    if (linePtr->lastArrowPtr != NULL) {
+	coords[numCoords-2] = linePtr->lastArrowPtr[0];
+	coords[numCoords-1] = linePtr->lastArrowPtr[1];
+    }
+    return numCoords;
+}
+
 
 /*
  *--------------------------------------------------------------
@@ -1256,6 +1909,7 @@ LineDeleteCoords(
 	linePtr->coordPtr[length-2] = linePtr->lastArrowPtr[0];
 	linePtr->coordPtr[length-1] = linePtr->lastArrowPtr[1];
     }
+    DiscardLineSummary(linePtr);
     first1 = first;
     last1 = last;
     nbDelPoints = (last - first) / 2 + 1;
@@ -1500,6 +2154,9 @@ LineToPoint(
 	}
 	numPoints = linePtr->smooth->coordProc(canvas, linePtr->coordPtr,
 		linePtr->numPoints, linePtr->splineSteps, NULL, linePoints);
+    } else if ((linePtr->decimate != DECIMATE_NONE)
+	    && (linePtr->numPoints > 2)) {
+	linePoints = GetDecimatedPath(linePtr, staticSpace, &numPoints);
     } else {
 	numPoints = linePtr->numPoints;
 	linePoints = linePtr->coordPtr;
@@ -1734,6 +2391,9 @@ LineToArea(
 	}
 	numPoints = linePtr->smooth->coordProc(canvas, linePtr->coordPtr,
 		linePtr->numPoints, linePtr->splineSteps, NULL, linePoints);
+    } else if ((linePtr->decimate != DECIMATE_NONE)
+	    && (linePtr->numPoints > 2)) {
+	linePoints = GetDecimatedPath(linePtr, staticSpace, &numPoints);
     } else {
 	numPoints = linePtr->numPoints;
 	linePoints = linePtr->coordPtr;
@@ -1831,6 +2491,7 @@ ScaleLine(
 	ckfree(linePtr->lastArrowPtr);
 	linePtr->lastArrowPtr = NULL;
     }
+    DiscardLineSummary(linePtr);
     for (i = 0, coordPtr = linePtr->coordPtr; i < linePtr->numPoints;
 	    i++, coordPtr += 2) {
 	coordPtr[0] = originX + scaleX*(*coordPtr - originX);
@@ -1960,6 +2621,7 @@ TranslateLine(
     double *coordPtr;
     Tcl_Size i;
 
+    DiscardLineSummary(linePtr);
     for (i = 0, coordPtr = linePtr->coordPtr; i < linePtr->numPoints;
 	    i++, coordPtr += 2) {
 	coordPtr[0] += deltaX;
@@ -2013,6 +2675,7 @@ RotateLine(
     Tcl_Size i;
     double s = sin(angleRad), c = cos(angleRad);
 
+    DiscardLineSummary(linePtr);
     for (i = 0, coordPtr = linePtr->coordPtr; i < linePtr->numPoints;
 	    i++, coordPtr += 2) {
 	TkRotatePoint(originX, originY, s, c, &coordPtr[0], &coordPtr[1]);
@@ -2247,6 +2910,90 @@ ArrowPrintProc(
     }
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * DecimateParseProc --
+ *
+ *	This function is invoked during option processing to handle the
+ *	"-decimate" option.
+ *
+ * Results:
+ *	A standard Tcl return value.
+ *
+ * Side effects:
+ *	The decimation mode of the item is set.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+DecimateParseProc(
+    TCL_UNUSED(void *),
+    Tcl_Interp *interp,		/* Used for reporting errors. */
+    TCL_UNUSED(Tk_Window),		/* Window containing canvas widget. */
+    const char *value,		/* Value of option. */
+    char *widgRec,		/* Pointer to record for item. */
+    Tcl_Size offset)			/* Offset into item. */
+{
+    size_t length;
+    Decimation *decimatePtr = (Decimation *) (widgRec + offset);
+
+    if (value == NULL || *value == 0) {
+	*decimatePtr = DECIMATE_NONE;
+	return TCL_OK;
+    }
+
+    length = strlen(value);
+    if ((value[0] == 'n') && (strncmp(value, "none", length) == 0)) {
+	*decimatePtr = DECIMATE_NONE;
+	return TCL_OK;
+    }
+    if ((value[0] == 'm') && (strncmp(value, "minmax", length) == 0)) {
+	*decimatePtr = DECIMATE_MINMAX;
+	return TCL_OK;
+    }
+
+    Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+	    "bad decimate mode \"%s\": must be none or minmax", value));
+    Tcl_SetErrorCode(interp, "TK", "CANVAS", "DECIMATE", (char *)NULL);
+    *decimatePtr = DECIMATE_NONE;
+    return TCL_ERROR;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * DecimatePrintProc --
+ *
+ *	This function is invoked by the Tk configuration code to produce a
+ *	printable string for the "-decimate" configuration option.
+ *
+ * Results:
+ *	The return value is a static string describing the decimation mode
+ *	of the item referred to by "widgRec".
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static const char *
+DecimatePrintProc(
+    TCL_UNUSED(void *),	/* Ignored. */
+    TCL_UNUSED(Tk_Window),		/* Window containing canvas widget. */
+    char *widgRec,		/* Pointer to record for item. */
+    Tcl_Size offset,			/* Offset into item. */
+    TCL_UNUSED(Tcl_FreeProc **))	/* Pointer to variable to fill in with
+				 * information about how to reclaim storage
+				 * for return string. */
+{
+    Decimation *decimatePtr = (Decimation *) (widgRec + offset);
+
+    return (*decimatePtr == DECIMATE_MINMAX) ? "minmax" : "none";
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -62,6 +62,14 @@ typedef struct TagSearch {
     unsigned int rewritebufferAllocated;
 				/* Available space for rewrites. */
     TagSearchExpr *expr;	/* Compiled tag expression. */
+    int useIds;			/* Non-zero means the items to return were
+				 * looked up in the tag index, and are listed
+				 * in ids. */
+    Tcl_Size *ids;		/* Ids of the items to return, in display
+				 * list order. */
+    Tcl_Size numIds;		/* Number of valid entries in ids. */
+    Tcl_Size idsSpace;		/* Number of entries allocated for ids. */
+    Tcl_Size nextId;		/* Next entry of ids to return. */
 } TagSearch;
 
 /*
@@ -132,6 +140,9 @@ static const Tk_ConfigSpec configSpecs[] = {
 	DEF_CANVAS_INSERT_ON_TIME, offsetof(TkCanvas, insertOnTime), 0, NULL},
     {TK_CONFIG_PIXELS, "-insertwidth", "insertWidth", "InsertWidth",
 	DEF_CANVAS_INSERT_WIDTH, offsetof(TkCanvas, textInfo.reserved2), TK_CONFIG_OBJS, NULL},
+    {TK_CONFIG_STRING, "-layertag", "layerTag", "LayerTag",
+	DEF_CANVAS_LAYER_TAG, offsetof(TkCanvas, layerTagObj),
+	TK_CONFIG_OBJS|TK_CONFIG_NULL_OK, NULL},
     {TK_CONFIG_CUSTOM, "-offset", "offset", "Offset", "0,0",
 	offsetof(TkCanvas, tsoffset),TK_CONFIG_DONT_SET_DEFAULT,
 	&offsetOption},
@@ -218,6 +229,8 @@ static SearchUids *	GetStaticUids(void);
  * Prototypes for functions defined later in this file:
  */
 
+static void		AddDamage(TkCanvas *canvasPtr, int x1, int y1,
+			    int x2, int y2);
 static void		CanvasBindProc(void *clientData,
 			    XEvent *eventPtr);
 static void		CanvasBlinkProc(void *clientData);
@@ -240,32 +253,52 @@ static int		CanvasWidgetCmd(void *clientData,
 			    Tcl_Interp *interp, int objc,
 			    Tcl_Obj *const *objv);
 static void		CanvasWorldChanged(void *instanceData);
+static int		CoordsOptionsCmd(TkCanvas *canvasPtr,
+			    Tk_Item *itemPtr, Tcl_Size objc,
+			    Tcl_Obj *const objv[]);
+static int		CheckCoordsFinite(Tcl_Interp *interp,
+			    const double *coords, Tcl_Size numCoords);
 static int		ConfigureCanvas(Tcl_Interp *interp,
 			    TkCanvas *canvasPtr, Tcl_Size objc,
 			    Tcl_Obj *const *objv, int flags);
 static void		DefaultRotateImplementation(TkCanvas *canvasPtr,
 			    Tk_Item *itemPtr, double x, double y,
 			    double angleRadians);
+static Tcl_WideInt	DamageWaste(const TkCanvDamage *aPtr,
+			    const TkCanvDamage *bPtr, Tcl_WideInt *areaPtr);
 static Tcl_FreeProc	DestroyCanvas;
 static int		DrawCanvas(Tcl_Interp *interp, void *clientData, Tk_PhotoHandle photohandle, int subsample, int zoom);
 static void		DisplayCanvas(void *clientData);
-static void		DoItem(Tcl_Obj *accumObj,
+static void		DoItem(TkCanvas *canvasPtr, Tcl_Obj *accumObj,
 			    Tk_Item *itemPtr, Tk_Uid tag);
+static void		EventuallyRedrawArea(TkCanvas *canvasPtr,
+			    int x1, int y1, int x2, int y2,
+			    int contentChanged);
 static void		EventuallyRedrawItem(TkCanvas *canvasPtr,
 			    Tk_Item *itemPtr);
 static int		FindItems(Tcl_Interp *interp, TkCanvas *canvasPtr,
 			    Tcl_Size objc, Tcl_Obj *const *objv,
 			    Tcl_Obj *newTagObj, Tcl_Size first,
 			    TagSearch **searchPtrPtr);
+static Tk_Item *	FindClosestFrom(TkCanvas *canvasPtr,
+			    double coords[2], double halo, Tk_Item *startPtr);
 static int		FindArea(Tcl_Interp *interp, TkCanvas *canvasPtr,
 			    Tcl_Obj *const *objv, Tk_Uid uid, int enclosed);
+static TkCanvas *	GetCanvasFromWindow(Tcl_Interp *interp,
+			    Tk_Window tkwin);
+static int		GetItemCoords(TkCanvas *canvasPtr, Tk_Item *itemPtr,
+			    Tcl_Size *numCoordsPtr, double **coordsPtr);
 static double		GridAlign(double coord, double spacing);
 static void		InitCanvas(void);
+static int		IsCoordsOption(Tcl_Obj *objPtr);
 static void		PickCurrentItem(TkCanvas *canvasPtr, XEvent *eventPtr);
 static Tcl_Obj *	ScrollFractions(int screen1,
 			    int screen2, int object1, int object2);
 static int		RelinkItems(TkCanvas *canvasPtr, Tcl_Obj *tag,
 			    Tk_Item *prevPtr, TagSearch **searchPtrPtr);
+static int		SetItemCoords(TkCanvas *canvasPtr, Tk_Item *itemPtr,
+			    const double *coords, Tcl_Size numCoords,
+			    int flags);
 static void		TagSearchExprInit(TagSearchExpr **exprPtrPtr);
 static void		TagSearchExprDestroy(TagSearchExpr *expr);
 static void		TagSearchDestroy(TagSearch *searchPtr);
@@ -277,6 +310,8 @@ static int		TagSearchEvalExpr(TagSearchExpr *expr,
 			    Tk_Item *itemPtr);
 static Tk_Item *	TagSearchFirst(TagSearch *searchPtr);
 static Tk_Item *	TagSearchNext(TagSearch *searchPtr);
+static Tk_Item *	TagSearchNextId(TagSearch *searchPtr);
+static int		TagSearchUseIndex(TagSearch *searchPtr);
 
 /*
  * The structure below defines canvas class behavior by means of functions
@@ -336,9 +371,13 @@ ItemConfigure(
     Tcl_Obj *const objv[])
 {
     Tcl_Interp *interp = canvasPtr->interp;
+    int result;
 
-    return itemPtr->typePtr->configProc(interp, (Tk_Canvas) canvasPtr,
+    result = itemPtr->typePtr->configProc(interp, (Tk_Canvas) canvasPtr,
 	    itemPtr, objc, objv, TK_CONFIG_ARGV_ONLY);
+    TkCanvIndexSyncTags(canvasPtr, itemPtr);
+    TkCanvLayerCheckItem(canvasPtr, itemPtr);
+    return result;
 }
 
 static inline int
@@ -746,7 +785,12 @@ Tk_CanvasObjCmd(
     canvasPtr->tsoffset.xoffset = 0;
     canvasPtr->tsoffset.yoffset = 0;
     canvasPtr->bindTagExprs = NULL;
+    canvasPtr->numDamage = 0;
+    memset(&canvasPtr->redrawStats, 0, sizeof(TkCanvRedrawStats));
     Tcl_InitHashTable(&canvasPtr->idTable, TCL_ONE_WORD_KEYS);
+    TkCanvIndexCreate(canvasPtr);
+    canvasPtr->layerTagObj = NULL;
+    TkCanvLayerCreate(canvasPtr);
 
     Tk_SetClass(canvasPtr->tkwin, "Canvas");
     Tk_SetClassProcs(canvasPtr->tkwin, &canvasClass, canvasPtr);
@@ -805,24 +849,24 @@ CanvasWidgetCmd(
 
     int idx;
     static const char *const canvasOptionStrings[] = {
-	"addtag",	"bbox",		"bind",		"canvasx",
-	"canvasy",	"cget",		"configure",	"coords",
-	"create",	"dchars",	"delete",	"dtag",
-	"find",		"focus",	"gettags",	"icursor",
-	"image",	"imove",	"index",	"insert",
-	"itemcget",	"itemconfigure",
+	"addtag",	"bbox",		"bind",		"cache",
+	"canvasx",	"canvasy",	"cget",		"configure",
+	"coords",	"create",	"damage",	"dchars",
+	"delete",	"dtag",		"find",		"focus",
+	"gettags",	"icursor",	"image",	"imove",
+	"index",	"insert",	"itemcget",	"itemconfigure",
 	"lower",	"move",		"moveto",	"postscript",
 	"raise",	"rchars",	"rotate",	"scale",
 	"scan",		"select",	"type",		"xview",
 	"yview",	NULL
     };
     enum canvasOptionStringsEnum {
-	CANV_ADDTAG,	CANV_BBOX,	CANV_BIND,	CANV_CANVASX,
-	CANV_CANVASY,	CANV_CGET,	CANV_CONFIGURE,	CANV_COORDS,
-	CANV_CREATE,	CANV_DCHARS,	CANV_DELETE,	CANV_DTAG,
-	CANV_FIND,	CANV_FOCUS,	CANV_GETTAGS,	CANV_ICURSOR,
-	CANV_IMAGE,	CANV_IMOVE,	CANV_INDEX,	CANV_INSERT,
-	CANV_ITEMCGET,	CANV_ITEMCONFIGURE,
+	CANV_ADDTAG,	CANV_BBOX,	CANV_BIND,	CANV_CACHE,
+	CANV_CANVASX,	CANV_CANVASY,	CANV_CGET,	CANV_CONFIGURE,
+	CANV_COORDS,	CANV_CREATE,	CANV_DAMAGE,	CANV_DCHARS,
+	CANV_DELETE,	CANV_DTAG,	CANV_FIND,	CANV_FOCUS,
+	CANV_GETTAGS,	CANV_ICURSOR,	CANV_IMAGE,	CANV_IMOVE,
+	CANV_INDEX,	CANV_INSERT,	CANV_ITEMCGET,	CANV_ITEMCONFIGURE,
 	CANV_LOWER,	CANV_MOVE,	CANV_MOVETO,	CANV_POSTSCRIPT,
 	CANV_RAISE,	CANV_RCHARS,	CANV_ROTATE,	CANV_SCALE,
 	CANV_SCAN,	CANV_SELECT,	CANV_TYPE,	CANV_XVIEW,
@@ -1042,6 +1086,9 @@ CanvasWidgetCmd(
 	}
 	break;
     }
+    case CANV_CACHE:
+	result = TkCanvLayerObjCmd(canvasPtr, interp, objc, objv);
+	break;
     case CANV_CANVASX: {
 	int x;
 	double grid;
@@ -1124,6 +1171,10 @@ CanvasWidgetCmd(
 	    goto done;
 	}
 	FIRST_CANVAS_ITEM_MATCHING(objv[2], &searchPtr, goto done);
+	if ((objc > 3) && IsCoordsOption(objv[3])) {
+	    result = CoordsOptionsCmd(canvasPtr, itemPtr, objc, objv);
+	    break;
+	}
 	if (itemPtr != NULL) {
 	    if (objc != 3) {
 		EventuallyRedrawItem(canvasPtr, itemPtr);
@@ -1196,6 +1247,7 @@ CanvasWidgetCmd(
 	    itemPtr->redraw_flags &= ~TK_ITEM_DONT_REDRAW;
 	    ItemInsert(canvasPtr, itemPtr, index, tmpObj);
 	    dontRedraw2 = itemPtr->redraw_flags & TK_ITEM_DONT_REDRAW;
+	    TkCanvIndexUpdateItem(canvasPtr, itemPtr);
 
 	    if (!(dontRedraw1 && dontRedraw2)) {
 		Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr,
@@ -1276,6 +1328,7 @@ CanvasWidgetCmd(
 	itemPtr->numTags = 0;
 	itemPtr->typePtr = typePtr;
 	itemPtr->state = TK_STATE_NULL;
+	itemPtr->reserved1 = NULL;
 	itemPtr->redraw_flags = 0;
 
 	if (ItemCreate(canvasPtr, itemPtr, objc, objv) != TCL_OK) {
@@ -1297,12 +1350,70 @@ CanvasWidgetCmd(
 	    canvasPtr->lastItemPtr->nextPtr = itemPtr;
 	}
 	canvasPtr->lastItemPtr = itemPtr;
+	TkCanvIndexAddItem(canvasPtr, itemPtr);
+	TkCanvLayerCheckItem(canvasPtr, itemPtr);
 	itemPtr->redraw_flags |= FORCE_REDRAW;
+	TkCanvIndexAddPending(canvasPtr, itemPtr);
 	EventuallyRedrawItem(canvasPtr, itemPtr);
 	canvasPtr->flags |= REPICK_NEEDED;
 	Tcl_SetObjResult(interp, Tcl_NewWideIntObj(itemPtr->id));
 	break;
     }
+    case CANV_DAMAGE: {
+	Tcl_Obj *resultObj, *rectsObj, *coordObjs[4];
+	TkCanvRedrawStats *statsPtr = &canvasPtr->redrawStats;
+	int i, idx;
+	static const char *const optionStrings[] = {
+	    "reset", NULL
+	};
+
+	if ((objc != 2) && (objc != 3)) {
+	    Tcl_WrongNumArgs(interp, 2, objv, "?reset?");
+	    result = TCL_ERROR;
+	    goto done;
+	}
+	if (objc == 3) {
+	    if (Tcl_GetIndexFromObj(interp, objv[2], optionStrings,
+		    "option", 0, &idx) != TCL_OK) {
+		result = TCL_ERROR;
+		goto done;
+	    }
+	    memset(statsPtr, 0, sizeof(TkCanvRedrawStats));
+	    goto done;
+	}
+
+	/*
+	 * Report the areas waiting to be redrawn, followed by the counters
+	 * accumulated since the canvas was created or last reset.
+	 */
+
+	rectsObj = Tcl_NewObj();
+	if (canvasPtr->flags & BBOX_NOT_EMPTY) {
+	    for (i = 0; i < canvasPtr->numDamage; i++) {
+		coordObjs[0] = Tcl_NewWideIntObj(canvasPtr->damage[i].x1);
+		coordObjs[1] = Tcl_NewWideIntObj(canvasPtr->damage[i].y1);
+		coordObjs[2] = Tcl_NewWideIntObj(canvasPtr->damage[i].x2);
+		coordObjs[3] = Tcl_NewWideIntObj(canvasPtr->damage[i].y2);
+		Tcl_ListObjAppendElement(NULL, rectsObj,
+			Tcl_NewListObj(4, coordObjs));
+	    }
+	}
+	resultObj = Tcl_NewObj();
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("pending", -1),
+		rectsObj);
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("redraws", -1),
+		Tcl_NewWideIntObj(statsPtr->redraws));
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("rectangles", -1),
+		Tcl_NewWideIntObj(statsPtr->rects));
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("pixels", -1),
+		Tcl_NewWideIntObj(statsPtr->pixels));
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("unionpixels", -1),
+		Tcl_NewWideIntObj(statsPtr->unionPixels));
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("merges", -1),
+		Tcl_NewWideIntObj(statsPtr->merges));
+	Tcl_SetObjResult(interp, resultObj);
+	break;
+    }
     case CANV_DCHARS: {
 	Tcl_Size first, last;
 	int x1, x2, y1, y2;
@@ -1341,6 +1452,7 @@ CanvasWidgetCmd(
 	    x2 = itemPtr->x2; y2 = itemPtr->y2;
 	    itemPtr->redraw_flags &= ~TK_ITEM_DONT_REDRAW;
 	    ItemDelChars(canvasPtr, itemPtr, first, last);
+	    TkCanvIndexUpdateItem(canvasPtr, itemPtr);
 	    if (!(itemPtr->redraw_flags & TK_ITEM_DONT_REDRAW)) {
 		Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr,
 			x1, y1, x2, y2);
@@ -1356,11 +1468,13 @@ CanvasWidgetCmd(
 
 	for (i = 2; i < objc; i++) {
 	    FOR_EVERY_CANVAS_ITEM_MATCHING(objv[i], &searchPtr, goto done) {
+		TkCanvLayerCheckItem(canvasPtr, itemPtr);
 		EventuallyRedrawItem(canvasPtr, itemPtr);
 		if (canvasPtr->bindingTable != NULL) {
 		    Tk_DeleteAllBindings(canvasPtr->bindingTable, itemPtr);
 		}
 		ItemDelete(canvasPtr, itemPtr);
+		TkCanvIndexRemoveItem(canvasPtr, itemPtr);
 		if (itemPtr->tagPtr != itemPtr->staticTagSpace) {
 		    ckfree(itemPtr->tagPtr);
 		}
@@ -1439,6 +1553,8 @@ CanvasWidgetCmd(
 
 		}
 	    }
+	    TkCanvIndexSyncTags(canvasPtr, itemPtr);
+	    TkCanvLayerCheckItem(canvasPtr, itemPtr);
 	}
 	break;
     }
@@ -1584,6 +1700,7 @@ CanvasWidgetCmd(
 	    x2 = itemPtr->x2; y2 = itemPtr->y2;
 	    itemPtr->redraw_flags &= ~TK_ITEM_DONT_REDRAW;
 	    ItemInsert(canvasPtr, itemPtr, beforeThis, objv[4]);
+	    TkCanvIndexUpdateItem(canvasPtr, itemPtr);
 	    if (!(itemPtr->redraw_flags & TK_ITEM_DONT_REDRAW)) {
 		Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr,
 			x1, y1, x2, y2);
@@ -1808,6 +1925,7 @@ CanvasWidgetCmd(
 	    itemPtr->redraw_flags &= ~TK_ITEM_DONT_REDRAW;
 	    ItemInsert(canvasPtr, itemPtr, first, objv[5]);
 	    dontRedraw2 = itemPtr->redraw_flags & TK_ITEM_DONT_REDRAW;
+	    TkCanvIndexUpdateItem(canvasPtr, itemPtr);
 
 	    if (!(dontRedraw1 && dontRedraw2)) {
 		Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr,
@@ -2198,6 +2316,7 @@ DestroyCanvas(
      * Free up all of the items in the canvas.
      */
 
+    TkCanvIndexFree(canvasPtr);
     for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
 	    itemPtr = canvasPtr->firstItemPtr) {
 	canvasPtr->firstItemPtr = itemPtr->nextPtr;
@@ -2214,6 +2333,7 @@ DestroyCanvas(
      */
 
     Tcl_DeleteHashTable(&canvasPtr->idTable);
+    TkCanvLayerFree(canvasPtr);
     if (canvasPtr->pixmapGC != NULL) {
 	Tk_FreeGC(canvasPtr->display, canvasPtr->pixmapGC);
     }
@@ -2453,6 +2573,7 @@ ConfigureCanvas(
      */
 
     CanvasSetOrigin(canvasPtr, canvasPtr->xOrigin, canvasPtr->yOrigin);
+    TkCanvLayerConfigure(canvasPtr, 0);
     canvasPtr->flags |= UPDATE_SCROLLBARS|REDRAW_BORDERS;
     Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr,
 	    canvasPtr->xOrigin, canvasPtr->yOrigin,
@@ -2497,8 +2618,10 @@ CanvasWorldChanged(
 	if (ItemConfigure(canvasPtr, itemPtr, 0, NULL) != TCL_OK) {
 	    Tcl_ResetResult(canvasPtr->interp);
 	}
+	TkCanvIndexUpdateItem(canvasPtr, itemPtr);
     }
     canvasPtr->flags |= REPICK_NEEDED;
+    TkCanvLayerConfigure(canvasPtr, 1);
     Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr,
 	    canvasPtr->xOrigin, canvasPtr->yOrigin,
 	    canvasPtr->xOrigin + Tk_Width(canvasPtr->tkwin),
@@ -3060,10 +3183,16 @@ DisplayCanvas(
 {
     TkCanvas *canvasPtr = (TkCanvas *)clientData;
     Tk_Window tkwin = canvasPtr->tkwin;
-    Tk_Item *itemPtr;
+    Tk_Item *itemPtr, **pendingPtr;
     Pixmap pixmap;
     int screenX1, screenX2, screenY1, screenY2, width, height;
     int borderWidth, highlightWidth;
+    Tcl_Size i, numPending;
+    TkCanvIndexResult found;
+    TkCanvDamage rects[TK_CANV_MAX_DAMAGE], *rectPtr;
+    int n, numRects, visX1, visY1, visX2, visY2, maxWidth, maxHeight;
+    int useLayer;
+    Tcl_WideInt pixels;
 
     if (canvasPtr->tkwin == NULL) {
 	return;
@@ -3090,49 +3219,87 @@ DisplayCanvas(
     }
 
     /*
-     * Scan through the item list, registering the bounding box for all items
-     * that didn't do that for the final coordinates yet. This can be
-     * determined by the FORCE_REDRAW flag.
+     * Register the bounding box for all items that didn't do that for the
+     * final coordinates yet. These are the items with the FORCE_REDRAW flag
+     * set, which the spatial index keeps track of.
      */
 
-    for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
-	    itemPtr = itemPtr->nextPtr) {
+    numPending = TkCanvIndexGetPending(canvasPtr, &pendingPtr);
+    for (i = 0; i < numPending; i++) {
+	itemPtr = pendingPtr[i];
 	if (itemPtr->redraw_flags & FORCE_REDRAW) {
 	    itemPtr->redraw_flags &= ~FORCE_REDRAW;
 	    EventuallyRedrawItem(canvasPtr, itemPtr);
 	    itemPtr->redraw_flags &= ~FORCE_REDRAW;
 	}
     }
+    TkCanvIndexClearPending(canvasPtr);
 
     /*
-     * Compute the intersection between the area that needs redrawing and the
-     * area that's visible on the screen.
+     * Clip each damaged area against the area that's visible on the screen
+     * and drop the ones that end up empty.
      */
 
-    if ((canvasPtr->redrawX1 < canvasPtr->redrawX2)
-	    && (canvasPtr->redrawY1 < canvasPtr->redrawY2)) {
-	screenX1 = canvasPtr->xOrigin + canvasPtr->inset;
-	screenY1 = canvasPtr->yOrigin + canvasPtr->inset;
-	screenX2 = canvasPtr->xOrigin + Tk_Width(tkwin) - canvasPtr->inset;
-	screenY2 = canvasPtr->yOrigin + Tk_Height(tkwin) - canvasPtr->inset;
-	if (canvasPtr->redrawX1 > screenX1) {
-	    screenX1 = canvasPtr->redrawX1;
-	}
-	if (canvasPtr->redrawY1 > screenY1) {
-	    screenY1 = canvasPtr->redrawY1;
-	}
-	if (canvasPtr->redrawX2 < screenX2) {
-	    screenX2 = canvasPtr->redrawX2;
-	}
-	if (canvasPtr->redrawY2 < screenY2) {
-	    screenY2 = canvasPtr->redrawY2;
-	}
-	if ((screenX1 >= screenX2) || (screenY1 >= screenY2)) {
-	    goto borders;
+    visX1 = canvasPtr->xOrigin + canvasPtr->inset;
+    visY1 = canvasPtr->yOrigin + canvasPtr->inset;
+    visX2 = canvasPtr->xOrigin + Tk_Width(tkwin) - canvasPtr->inset;
+    visY2 = canvasPtr->yOrigin + Tk_Height(tkwin) - canvasPtr->inset;
+    numRects = maxWidth = maxHeight = 0;
+    pixels = 0;
+    if (canvasPtr->flags & BBOX_NOT_EMPTY) {
+	for (n = 0; n < canvasPtr->numDamage; n++) {
+	    rectPtr = &rects[numRects];
+	    *rectPtr = canvasPtr->damage[n];
+	    if (rectPtr->x1 < visX1) {
+		rectPtr->x1 = visX1;
+	    }
+	    if (rectPtr->y1 < visY1) {
+		rectPtr->y1 = visY1;
+	    }
+	    if (rectPtr->x2 > visX2) {
+		rectPtr->x2 = visX2;
+	    }
+	    if (rectPtr->y2 > visY2) {
+		rectPtr->y2 = visY2;
+	    }
+	    if ((rectPtr->x1 >= rectPtr->x2) || (rectPtr->y1 >= rectPtr->y2)) {
+		continue;
+	    }
+	    width = rectPtr->x2 - rectPtr->x1;
+	    height = rectPtr->y2 - rectPtr->y1;
+	    if (width > maxWidth) {
+		maxWidth = width;
+	    }
+	    if (height > maxHeight) {
+		maxHeight = height;
+	    }
+	    pixels += (Tcl_WideInt) width * height;
+	    numRects++;
 	}
+    }
+    if (numRects > 0) {
+	/*
+	 * The intersection of the union of all damage with the screen is only
+	 * used for the statistics and for items that must always be redrawn.
+	 */
 
-	width = screenX2 - screenX1;
-	height = screenY2 - screenY1;
+	screenX1 = (canvasPtr->redrawX1 > visX1) ? canvasPtr->redrawX1 : visX1;
+	screenY1 = (canvasPtr->redrawY1 > visY1) ? canvasPtr->redrawY1 : visY1;
+	screenX2 = (canvasPtr->redrawX2 < visX2) ? canvasPtr->redrawX2 : visX2;
+	screenY2 = (canvasPtr->redrawY2 < visY2) ? canvasPtr->redrawY2 : visY2;
+	canvasPtr->redrawStats.redraws++;
+	canvasPtr->redrawStats.rects += numRects;
+	canvasPtr->redrawStats.pixels += pixels;
+	canvasPtr->redrawStats.unionPixels +=
+		(Tcl_WideInt) (screenX2 - screenX1) * (screenY2 - screenY1);
+
+	/*
+	 * If the canvas has a layer cache, bring it up to date. The damaged
+	 * areas are then started from a copy of the layer instead of the
+	 * background, and the items of the layer are skipped below.
+	 */
+
+	useLayer = TkCanvLayerPrepare(canvasPtr);
 
 #ifndef TK_NO_DOUBLE_BUFFERING
 	/*
@@ -3150,8 +3317,9 @@ DisplayCanvas(
 	 *
 	 * Some tricky points about the pixmap:
 	 *
-	 * 1. We only allocate a large enough pixmap to hold the area that has
-	 *    to be redisplayed. This saves time in in the X server for large
+	 * 1. We only allocate a large enough pixmap to hold the largest area
+	 *    that has to be redisplayed; the same pixmap is reused for each
+	 *    damaged area. This saves time in in the X server for large
 	 *    objects that cover much more than the area being redisplayed:
 	 *    only the area of the pixmap will actually have to be redrawn.
 	 * 2. Some X servers (e.g. the one for DECstations) have troubles with
@@ -3163,19 +3331,12 @@ DisplayCanvas(
 	 *    outside the area we care about.
 	 */
 
-	canvasPtr->drawableXOrigin = screenX1 - 30;
-	canvasPtr->drawableYOrigin = screenY1 - 30;
-	pixmap = Tk_GetPixmap(Tk_Display(tkwin), Tk_WindowId(tkwin),
-	    (screenX2 + 30 - canvasPtr->drawableXOrigin),
-	    (screenY2 + 30 - canvasPtr->drawableYOrigin),
-	    Tk_Depth(tkwin));
+	pixmap = TkGetBufferPixmap(tkwin, maxWidth + 60, maxHeight + 60);
 #else
 	canvasPtr->drawableXOrigin = canvasPtr->xOrigin;
 	canvasPtr->drawableYOrigin = canvasPtr->yOrigin;
 	pixmap = Tk_WindowId(tkwin);
-	Tk_ClipDrawableToRect(Tk_Display(tkwin), pixmap,
-		screenX1 - canvasPtr->xOrigin, screenY1 - canvasPtr->yOrigin,
-		width, height);
+
 	/*
 	 * Call ItemDisplay for all window items.  This does not redraw the
 	 * windows, but sets their position within the canvas, which ensures
@@ -3193,66 +3354,99 @@ DisplayCanvas(
 	for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
 		itemPtr = itemPtr->nextPtr) {
 	    if (AlwaysRedraw(itemPtr)) {
-		ItemDisplay(canvasPtr, itemPtr, pixmap,
-			    screenX1, screenY1, width, height);
+		ItemDisplay(canvasPtr, itemPtr, pixmap, screenX1, screenY1,
+			screenX2 - screenX1, screenY2 - screenY1);
 	    }
 	}
+#endif /* TK_NO_DOUBLE_BUFFERING */
 
+	for (n = 0; n < numRects; n++) {
+	    screenX1 = rects[n].x1;
+	    screenY1 = rects[n].y1;
+	    screenX2 = rects[n].x2;
+	    screenY2 = rects[n].y2;
+	    width = screenX2 - screenX1;
+	    height = screenY2 - screenY1;
+
+#ifndef TK_NO_DOUBLE_BUFFERING
+	    canvasPtr->drawableXOrigin = screenX1 - 30;
+	    canvasPtr->drawableYOrigin = screenY1 - 30;
+#else
+	    Tk_ClipDrawableToRect(Tk_Display(tkwin), pixmap,
+		    screenX1 - canvasPtr->xOrigin,
+		    screenY1 - canvasPtr->yOrigin, width, height);
 #endif /* TK_NO_DOUBLE_BUFFERING */
 
-	/*
-	 * Clear the area to be redrawn.
-	 */
+	    /*
+	     * Clear the area to be redrawn.
+	     */
 
-	XFillRectangle(Tk_Display(tkwin), pixmap, canvasPtr->pixmapGC,
-		screenX1 - canvasPtr->drawableXOrigin,
-		screenY1 - canvasPtr->drawableYOrigin, (unsigned int) width,
-		(unsigned int) height);
+	    if (useLayer) {
+		TkCanvLayerComposite(canvasPtr, pixmap, screenX1, screenY1,
+			width, height);
+	    } else {
+		XFillRectangle(Tk_Display(tkwin), pixmap, canvasPtr->pixmapGC,
+			screenX1 - canvasPtr->drawableXOrigin,
+			screenY1 - canvasPtr->drawableYOrigin,
+			(unsigned int) width, (unsigned int) height);
+	    }
 
-	/*
-	 * Scan through the item list, redrawing those items that need it. An
-	 * item must be redraw if either (a) it intersects the smaller
-	 * on-screen area or (b) it intersects the full canvas area and its
-	 * type requests that it be redrawn always (e.g. so subwindows can be
-	 * unmapped when they move off-screen).
-	 */
+	    /*
+	     * Scan through the items near the on-screen area, redrawing those
+	     * items that need it. An item must be redraw if either (a) it
+	     * intersects the smaller on-screen area or (b) it intersects the
+	     * full area to redraw and its type requests that it be redrawn
+	     * always (e.g. so subwindows can be unmapped when they move
+	     * off-screen). Items of the latter kind are always reported by
+	     * the spatial index, and only need to be handled once.
+	     */
 
-	for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
-		itemPtr = itemPtr->nextPtr) {
-	    if ((itemPtr->x1 >= screenX2)
-		    || (itemPtr->y1 >= screenY2)
-		    || (itemPtr->x2 < screenX1)
-		    || (itemPtr->y2 < screenY1)) {
-		if (!AlwaysRedraw(itemPtr)
-			|| (itemPtr->x1 >= canvasPtr->redrawX2)
-			|| (itemPtr->y1 >= canvasPtr->redrawY2)
-			|| (itemPtr->x2 < canvasPtr->redrawX1)
-			|| (itemPtr->y2 < canvasPtr->redrawY1)) {
+	    TkCanvIndexSearch(canvasPtr, screenX1, screenY1, screenX2,
+		    screenY2, &found);
+	    for (i = 0; i < found.numItems; i++) {
+		itemPtr = found.items[i];
+		if ((itemPtr->x1 >= screenX2)
+			|| (itemPtr->y1 >= screenY2)
+			|| (itemPtr->x2 < screenX1)
+			|| (itemPtr->y2 < screenY1)) {
+		    if ((n > 0) || !AlwaysRedraw(itemPtr)
+			    || (itemPtr->x1 >= canvasPtr->redrawX2)
+			    || (itemPtr->y1 >= canvasPtr->redrawY2)
+			    || (itemPtr->x2 < canvasPtr->redrawX1)
+			    || (itemPtr->y2 < canvasPtr->redrawY1)) {
+			continue;
+		    }
+		}
+		if (itemPtr->state == TK_STATE_HIDDEN ||
+			(itemPtr->state == TK_STATE_NULL &&
+			canvasPtr->canvas_state == TK_STATE_HIDDEN)) {
 		    continue;
 		}
+		if (useLayer && TkCanvLayerIsMember(canvasPtr, itemPtr)) {
+		    continue;
+		}
+		ItemDisplay(canvasPtr, itemPtr, pixmap, screenX1, screenY1,
+			width, height);
 	    }
-	    if (itemPtr->state == TK_STATE_HIDDEN ||
-		    (itemPtr->state == TK_STATE_NULL &&
-		    canvasPtr->canvas_state == TK_STATE_HIDDEN)) {
-		continue;
-	    }
-	    ItemDisplay(canvasPtr, itemPtr, pixmap, screenX1, screenY1, width,
-		    height);
-	}
+	    TkCanvIndexFreeResult(&found);
 
 #ifndef TK_NO_DOUBLE_BUFFERING
-	/*
-	 * Copy from the temporary pixmap to the screen, then free up the
-	 * temporary pixmap.
-	 */
+	    /*
+	     * Copy from the temporary pixmap to the screen.
+	     */
 
-	XCopyArea(Tk_Display(tkwin), pixmap, Tk_WindowId(tkwin),
-		canvasPtr->pixmapGC,
-		screenX1 - canvasPtr->drawableXOrigin,
-		screenY1 - canvasPtr->drawableYOrigin,
-		(unsigned int) width, (unsigned int) height,
-		screenX1 - canvasPtr->xOrigin, screenY1 - canvasPtr->yOrigin);
-	Tk_FreePixmap(Tk_Display(tkwin), pixmap);
+	    XCopyArea(Tk_Display(tkwin), pixmap, Tk_WindowId(tkwin),
+		    canvasPtr->pixmapGC,
+		    screenX1 - canvasPtr->drawableXOrigin,
+		    screenY1 - canvasPtr->drawableYOrigin,
+		    (unsigned int) width, (unsigned int) height,
+		    screenX1 - canvasPtr->xOrigin,
+		    screenY1 - canvasPtr->yOrigin);
+#endif /* TK_NO_DOUBLE_BUFFERING */
+	}
+
+#ifndef TK_NO_DOUBLE_BUFFERING
+	TkFreeBufferPixmap(tkwin, pixmap);
 #else
 	Tk_ClipDrawableToRect(Tk_Display(tkwin), pixmap, 0, 0, -1, -1);
 #endif /* TK_NO_DOUBLE_BUFFERING */
@@ -3262,7 +3456,6 @@ DisplayCanvas(
      * Draw the window borders, if needed.
      */
 
-  borders:
     Tk_GetPixelsFromObj(NULL, canvasPtr->tkwin, canvasPtr->borderWidthObj, &borderWidth);
     Tk_GetPixelsFromObj(NULL, canvasPtr->tkwin, canvasPtr->highlightWidthObj, &highlightWidth);
     if (canvasPtr->flags & REDRAW_BORDERS) {
@@ -3295,6 +3488,7 @@ DisplayCanvas(
     canvasPtr->flags &= ~(REDRAW_PENDING|BBOX_NOT_EMPTY);
     canvasPtr->redrawX1 = canvasPtr->redrawX2 = 0;
     canvasPtr->redrawY1 = canvasPtr->redrawY2 = 0;
+    canvasPtr->numDamage = 0;
     if (canvasPtr->flags & UPDATE_SCROLLBARS) {
 	CanvasUpdateScrollbars(canvasPtr);
     }
@@ -3330,9 +3524,8 @@ CanvasEventProc(
 
 	x = eventPtr->xexpose.x + canvasPtr->xOrigin;
 	y = eventPtr->xexpose.y + canvasPtr->yOrigin;
-	Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr, x, y,
-		x + eventPtr->xexpose.width,
-		y + eventPtr->xexpose.height);
+	EventuallyRedrawArea(canvasPtr, x, y, x + eventPtr->xexpose.width,
+		y + eventPtr->xexpose.height, 0);
 	if ((eventPtr->xexpose.x < canvasPtr->inset)
 		|| (eventPtr->xexpose.y < canvasPtr->inset)
 		|| ((eventPtr->xexpose.x + eventPtr->xexpose.width)
@@ -3360,10 +3553,10 @@ CanvasEventProc(
 	 */
 
 	CanvasSetOrigin(canvasPtr, canvasPtr->xOrigin, canvasPtr->yOrigin);
-	Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr, canvasPtr->xOrigin,
+	EventuallyRedrawArea(canvasPtr, canvasPtr->xOrigin,
 		canvasPtr->yOrigin,
 		canvasPtr->xOrigin + Tk_Width(canvasPtr->tkwin),
-		canvasPtr->yOrigin + Tk_Height(canvasPtr->tkwin));
+		canvasPtr->yOrigin + Tk_Height(canvasPtr->tkwin), 0);
 	canvasPtr->flags |= REDRAW_BORDERS;
     } else if (eventPtr->type == FocusIn) {
 	if (eventPtr->xfocus.detail != NotifyInferior) {
@@ -3454,8 +3647,38 @@ Tk_CanvasEventuallyRedraw(
     int x2, int y2)		/* Lower right corner of area to redraw.
 				 * Pixels on edge are not redrawn. */
 {
-    TkCanvas *canvasPtr = Canvas(canvas);
+    EventuallyRedrawArea(Canvas(canvas), x1, y1, x2, y2, 1);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EventuallyRedrawArea --
+ *
+ *	Does the work of Tk_CanvasEventuallyRedraw. Areas that are only
+ *	redrawn because they were exposed or scrolled into view are told apart
+ *	from areas where items changed, so that the layer cache can be reused
+ *	for the former.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The screen will eventually be refreshed.
+ *
+ *----------------------------------------------------------------------
+ */
 
+static void
+EventuallyRedrawArea(
+    TkCanvas *canvasPtr,	/* Information about widget. */
+    int x1, int y1,		/* Upper left corner of area to redraw. Pixels
+				 * on edge are redrawn. */
+    int x2, int y2,		/* Lower right corner of area to redraw.
+				 * Pixels on edge are not redrawn. */
+    int contentChanged)		/* Non-zero means the items drawn in the
+				 * area may have changed. */
+{
     /*
      * If tkwin is NULL, the canvas has been destroyed, so we can't really
      * redraw it.
@@ -3471,26 +3694,10 @@ Tk_CanvasEventuallyRedraw(
 	    (y1 >= canvasPtr->yOrigin + Tk_Height(canvasPtr->tkwin))) {
 	return;
     }
-    if (canvasPtr->flags & BBOX_NOT_EMPTY) {
-	if (x1 <= canvasPtr->redrawX1) {
-	    canvasPtr->redrawX1 = x1;
-	}
-	if (y1 <= canvasPtr->redrawY1) {
-	    canvasPtr->redrawY1 = y1;
-	}
-	if (x2 >= canvasPtr->redrawX2) {
-	    canvasPtr->redrawX2 = x2;
-	}
-	if (y2 >= canvasPtr->redrawY2) {
-	    canvasPtr->redrawY2 = y2;
-	}
-    } else {
-	canvasPtr->redrawX1 = x1;
-	canvasPtr->redrawY1 = y1;
-	canvasPtr->redrawX2 = x2;
-	canvasPtr->redrawY2 = y2;
-	canvasPtr->flags |= BBOX_NOT_EMPTY;
+    if (contentChanged) {
+	TkCanvLayerStale(canvasPtr, x1, y1, x2, y2);
     }
+    AddDamage(canvasPtr, x1, y1, x2, y2);
     if (!(canvasPtr->flags & REDRAW_PENDING)) {
 	Tcl_DoWhenIdle(DisplayCanvas, canvasPtr);
 	canvasPtr->flags |= REDRAW_PENDING;
@@ -3523,6 +3730,7 @@ EventuallyRedrawItem(
     if (itemPtr == NULL || canvasPtr->tkwin == NULL) {
 	return;
     }
+    TkCanvIndexUpdateItem(canvasPtr, itemPtr);
     if ((itemPtr->x1 >= itemPtr->x2) || (itemPtr->y1 >= itemPtr->y2) ||
 	    (itemPtr->x2 < canvasPtr->xOrigin) ||
 	    (itemPtr->y2 < canvasPtr->yOrigin) ||
@@ -3533,27 +3741,14 @@ EventuallyRedrawItem(
 	}
     }
     if (!(itemPtr->redraw_flags & FORCE_REDRAW)) {
-	if (canvasPtr->flags & BBOX_NOT_EMPTY) {
-	    if (itemPtr->x1 <= canvasPtr->redrawX1) {
-		canvasPtr->redrawX1 = itemPtr->x1;
-	    }
-	    if (itemPtr->y1 <= canvasPtr->redrawY1) {
-		canvasPtr->redrawY1 = itemPtr->y1;
-	    }
-	    if (itemPtr->x2 >= canvasPtr->redrawX2) {
-		canvasPtr->redrawX2 = itemPtr->x2;
-	    }
-	    if (itemPtr->y2 >= canvasPtr->redrawY2) {
-		canvasPtr->redrawY2 = itemPtr->y2;
-	    }
-	} else {
-	    canvasPtr->redrawX1 = itemPtr->x1;
-	    canvasPtr->redrawY1 = itemPtr->y1;
-	    canvasPtr->redrawX2 = itemPtr->x2;
-	    canvasPtr->redrawY2 = itemPtr->y2;
-	    canvasPtr->flags |= BBOX_NOT_EMPTY;
+	AddDamage(canvasPtr, itemPtr->x1, itemPtr->y1, itemPtr->x2,
+		itemPtr->y2);
+	if (TkCanvLayerIsMember(canvasPtr, itemPtr)) {
+	    TkCanvLayerStale(canvasPtr, itemPtr->x1, itemPtr->y1,
+		    itemPtr->x2, itemPtr->y2);
 	}
 	itemPtr->redraw_flags |= FORCE_REDRAW;
+	TkCanvIndexAddPending(canvasPtr, itemPtr);
     }
     if (!(canvasPtr->flags & REDRAW_PENDING)) {
 	Tcl_DoWhenIdle(DisplayCanvas, canvasPtr);
@@ -3564,69 +3759,45 @@ EventuallyRedrawItem(
 /*
  *----------------------------------------------------------------------
  *
- * Tk_CreateItemType --
+ * IsCoordsOption --
  *
- *	This function may be invoked to add a new kind of canvas element to
- *	the core item types supported by Tk.
+ *	Decides whether an argument of the "coords" widget command is one of
+ *	its options rather than the first coordinate. Options start with a
+ *	dash and a letter; words such as "-inf" that parse as numbers are
+ *	left to the coordinate parser.
  *
  * Results:
- *	None.
+ *	1 if objPtr should be parsed as an option, 0 otherwise.
  *
  * Side effects:
- *	From now on, the new item type will be useable in canvas widgets
- *	(e.g. typePtr->name can be used as the item type in "create" widget
- *	commands). If there was already a type with the same name as in
- *	typePtr, it is replaced with the new type.
+ *	None.
  *
  *----------------------------------------------------------------------
  */
 
-void
-Tk_CreateItemType(
-    Tk_ItemType *typePtr)	/* Information about item type; storage must
-				 * be statically allocated (must live
-				 * forever). */
+static int
+IsCoordsOption(
+    Tcl_Obj *objPtr)		/* Argument to check. */
 {
-    Tk_ItemType *typePtr2, *prevPtr;
-
-    if (typeList == NULL) {
-	InitCanvas();
-    }
-
-    /*
-     * If there's already an item type with the given name, remove it.
-     */
+    const char *arg = Tcl_GetString(objPtr);
+    double ignored;
 
-    Tcl_MutexLock(&typeListMutex);
-    for (typePtr2 = typeList, prevPtr = NULL; typePtr2 != NULL;
-	    prevPtr = typePtr2, typePtr2 = typePtr2->nextPtr) {
-	if (strcmp(typePtr2->name, typePtr->name) == 0) {
-	    if (prevPtr == NULL) {
-		typeList = typePtr2->nextPtr;
-	    } else {
-		prevPtr->nextPtr = typePtr2->nextPtr;
-	    }
-	    break;
-	}
-    }
-    typePtr->nextPtr = typeList;
-    typeList = typePtr;
-    Tcl_MutexUnlock(&typeListMutex);
+    return (arg[0] == '-') && isalpha(UCHAR(arg[1]))
+	    && (Tcl_GetDoubleFromObj(NULL, objPtr, &ignored) != TCL_OK);
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * Tk_GetItemTypes --
+ * CheckCoordsFinite --
  *
- *	This function returns a pointer to the list of all item types. Note
- *	that this is inherently thread-unsafe, but since item types are only
- *	ever registered very rarely this is unlikely to be a problem in
- *	practice.
+ *	Makes sure that coordinates passed in binary form are finite. The
+ *	list forms reject bad values while parsing them, but packed doubles
+ *	can hold NaN or infinities, which items cannot convert to pixels.
  *
  * Results:
- *	The return value is a pointer to the first in the list of item types
- *	currently supported by canvases.
+ *	A standard Tcl result. If a value isn't finite, an error message is
+ *	left in interp's result if interp isn't NULL.
  *
  * Side effects:
  *	None.
@@ -3634,83 +3805,753 @@ Tk_CreateItemType(
  *----------------------------------------------------------------------
  */
 
-Tk_ItemType *
-Tk_GetItemTypes(void)
+static int
+CheckCoordsFinite(
+    Tcl_Interp *interp,		/* Used for error reporting, if not NULL. */
+    const double *coords,	/* Values to check. */
+    Tcl_Size numCoords)		/* Number of values in coords. */
 {
-    if (typeList == NULL) {
-	InitCanvas();
+    Tcl_Size i;
+
+    for (i = 0; i < numCoords; i++) {
+	if (!isfinite(coords[i])) {
+	    if (interp != NULL) {
+		Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+			"coordinate %" TCL_SIZE_MODIFIER "d isn't a finite"
+			" number", i));
+		Tcl_SetErrorCode(interp, "TK", "CANVAS", "COORDS", "BINARY",
+			(char *)NULL);
+	    }
+	    return TCL_ERROR;
+	}
     }
-    return typeList;
+    return TCL_OK;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * InitCanvas --
- *
- *	This function is invoked to perform once-only-ever initialization for
- *	the module, such as setting up the type table.
- *
- * Results:
- *	None.
- *
- * Side effects:
- *	None.
+ * CoordsOptionsCmd --
  *
- *----------------------------------------------------------------------
- */
-
-static void
-InitCanvas(void)
-{
-    Tcl_MutexLock(&typeListMutex);
-    if (typeList != NULL) {
-	Tcl_MutexUnlock(&typeListMutex);
-	return;
-    }
-    typeList = &tkRectangleType;
-    tkRectangleType.nextPtr = &tkTextType;
-    tkTextType.nextPtr = &tkLineType;
-    tkLineType.nextPtr = &tkPolygonType;
-    tkPolygonType.nextPtr = &tkImageType;
-    tkImageType.nextPtr = &tkOvalType;
-    tkOvalType.nextPtr = &tkBitmapType;
-    tkBitmapType.nextPtr = &tkArcType;
-    tkArcType.nextPtr = &tkWindowType;
-    tkWindowType.nextPtr = NULL;
-    Tcl_MutexUnlock(&typeListMutex);
-}
-
-/*
- *----------------------------------------------------------------------
+ *	Processes the forms of the "coords" widget command that take options:
  *
- * GetStaticUids --
+ *	    pathName coords tagOrId ?-append? ?-binary format? ?coordinates?
  *
- *	This function is invoked to return a structure filled with the Uids
- *	used when doing tag searching. If it was never before called in the
- *	current thread, it initializes the structure for that thread (uids are
- *	only ever local to one thread [Bug 1114977]).
+ *	With -binary, coordinates are read from or returned as a byte array
+ *	of packed native-order values of the given format ("double" or
+ *	"float"). With -append, the coordinates are added to the end of the
+ *	item's existing ones.
  *
  * Results:
- *	None.
+ *	A standard Tcl result.
  *
  * Side effects:
- *	None.
+ *	The coordinates of itemPtr may be changed.
  *
  *----------------------------------------------------------------------
  */
 
-static SearchUids *
-GetStaticUids(void)
+static int
+CoordsOptionsCmd(
+    TkCanvas *canvasPtr,	/* Canvas containing the item. */
+    Tk_Item *itemPtr,		/* First item matching tagOrId, or NULL. */
+    Tcl_Size objc,		/* Number of arguments. */
+    Tcl_Obj *const objv[])	/* Argument objects, starting with the
+				 * command name. */
 {
-    SearchUids *searchUids = (SearchUids *)
-	    Tcl_GetThreadData(&dataKey, sizeof(SearchUids));
-
-    if (searchUids->allUid == NULL) {
-	searchUids->allUid       = Tk_GetUid("all");
-	searchUids->currentUid   = Tk_GetUid("current");
-	searchUids->andUid       = Tk_GetUid("&&");
-	searchUids->orUid        = Tk_GetUid("||");
+    static const char *const optionStrings[] = {
+	"-append", "-binary", NULL
+    };
+    enum options {
+	COORDS_APPEND, COORDS_BINARY
+    };
+    static const char *const formatStrings[] = {
+	"double", "float", NULL
+    };
+    enum formats {
+	FORMAT_DOUBLE, FORMAT_FLOAT
+    };
+    Tcl_Interp *interp = canvasPtr->interp;
+    int index, format = -1, flags = 0, result;
+    Tcl_Size i, numCoords, size;
+    Tcl_Obj **elemv;
+    double *coords;
+
+    for (i = 3; (i < objc) && IsCoordsOption(objv[i]); i++) {
+	if (Tcl_GetIndexFromObj(interp, objv[i], optionStrings, "option", 0,
+		&index) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	if (index == COORDS_APPEND) {
+	    flags |= TK_CANVAS_COORDS_APPEND;
+	} else if (++i == objc) {
+	    Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		    "value for \"-binary\" missing", TCL_INDEX_NONE));
+	    Tcl_SetErrorCode(interp, "TK", "CANVAS", "COORDS", "VALUE",
+		    (char *)NULL);
+	    return TCL_ERROR;
+	} else if (Tcl_GetIndexFromObj(interp, objv[i], formatStrings,
+		"format", 0, &format) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+    }
+    if ((i == objc) ? (flags || format < 0)
+	    : (format >= 0 && i + 1 != objc)) {
+	Tcl_WrongNumArgs(interp, 2, objv,
+		"tagOrId ?-append? ?-binary format? ?coordinates?");
+	return TCL_ERROR;
+    }
+    size = (format == FORMAT_FLOAT) ? sizeof(float) : sizeof(double);
+
+    if (i == objc) {
+	unsigned char *bytes;
+	Tcl_Obj *resultObj;
+
+	if (itemPtr == NULL) {
+	    return TCL_OK;
+	}
+	if (GetItemCoords(canvasPtr, itemPtr, &numCoords,
+		&coords) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+	resultObj = Tcl_NewByteArrayObj(NULL, 0);
+	bytes = Tcl_SetByteArrayLength(resultObj, numCoords * size);
+	if (format == FORMAT_DOUBLE) {
+	    memcpy(bytes, coords, numCoords * size);
+	} else {
+	    for (i = 0; i < numCoords; i++) {
+		float value = (float) coords[i];
+
+		memcpy(bytes + i*size, &value, size);
+	    }
+	}
+	ckfree(coords);
+	Tcl_SetObjResult(interp, resultObj);
+	return TCL_OK;
+    }
+
+    if (format >= 0) {
+	const unsigned char *bytes;
+	Tcl_Size length;
+
+	bytes = Tcl_GetBytesFromObj(interp, objv[i], &length);
+	if (bytes == NULL) {
+	    return TCL_ERROR;
+	}
+	if (length % size) {
+	    Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+		    "binary coordinates must be a multiple of %"
+		    TCL_SIZE_MODIFIER "d bytes long, got %"
+		    TCL_SIZE_MODIFIER "d", size, length));
+	    Tcl_SetErrorCode(interp, "TK", "CANVAS", "COORDS", "BINARY",
+		    (char *)NULL);
+	    return TCL_ERROR;
+	}
+	numCoords = length / size;
+	coords = (double *)ckalloc(sizeof(double) * (numCoords + 1));
+	if (format == FORMAT_DOUBLE) {
+	    memcpy(coords, bytes, length);
+	} else {
+	    for (i = 0; i < numCoords; i++) {
+		float value;
+
+		memcpy(&value, bytes + i*size, size);
+		coords[i] = value;
+	    }
+	}
+	if (CheckCoordsFinite(interp, coords, numCoords) != TCL_OK) {
+	    ckfree(coords);
+	    return TCL_ERROR;
+	}
+    } else {
+	numCoords = objc - i;
+	elemv = (Tcl_Obj **) (objv + i);
+	if ((numCoords == 1) && (Tcl_ListObjGetElements(interp, objv[i],
+		&numCoords, &elemv) != TCL_OK)) {
+	    return TCL_ERROR;
+	}
+	coords = (double *)ckalloc(sizeof(double) * (numCoords + 1));
+	for (i = 0; i < numCoords; i++) {
+	    if (Tk_CanvasGetCoordFromObj(interp, (Tk_Canvas) canvasPtr,
+		    elemv[i], &coords[i]) != TCL_OK) {
+		ckfree(coords);
+		return TCL_ERROR;
+	    }
+	}
+    }
+
+    result = TCL_OK;
+    if (itemPtr != NULL) {
+	result = SetItemCoords(canvasPtr, itemPtr, coords, numCoords, flags);
+    }
+    ckfree(coords);
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetItemCoords --
+ *
+ *	Replaces the coordinates of an item, or appends to them, from an
+ *	array of doubles. Line items take the values directly; other item
+ *	types get them through their coordProc, or their insertProc when
+ *	appending.
+ *
+ * Results:
+ *	A standard Tcl result; errors are left in the canvas's interpreter.
+ *
+ * Side effects:
+ *	The item's coordinates change and the affected area is scheduled for
+ *	redisplay.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SetItemCoords(
+    TkCanvas *canvasPtr,	/* Canvas containing the item. */
+    Tk_Item *itemPtr,		/* Item to modify. */
+    const double *coords,	/* New coordinates. */
+    Tcl_Size numCoords,		/* Number of values in coords. */
+    int flags)			/* TK_CANVAS_COORDS_APPEND or 0. */
+{
+    Tcl_Interp *interp = canvasPtr->interp;
+    int x1, y1, x2, y2, result = TCL_OK;
+
+    x1 = itemPtr->x1; y1 = itemPtr->y1;
+    x2 = itemPtr->x2; y2 = itemPtr->y2;
+    itemPtr->redraw_flags &= ~TK_ITEM_DONT_REDRAW;
+    if (itemPtr->typePtr == &tkLineType) {
+	result = TkLineSetCoords(interp, (Tk_Canvas) canvasPtr, itemPtr,
+		coords, numCoords, flags);
+    } else {
+	Tcl_Obj *listObj = Tcl_NewListObj(0, NULL);
+	Tcl_Size i, index;
+
+	for (i = 0; i < numCoords; i++) {
+	    Tcl_ListObjAppendElement(NULL, listObj,
+		    Tcl_NewDoubleObj(coords[i]));
+	}
+	Tcl_IncrRefCount(listObj);
+	if (!(flags & TK_CANVAS_COORDS_APPEND)) {
+	    result = ItemCoords(canvasPtr, itemPtr, 1, &listObj);
+	} else if (!(itemPtr->typePtr->flags & TK_MOVABLE_POINTS)
+		|| (itemPtr->typePtr->insertProc == NULL)) {
+	    Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+		    "can't append coordinates to %s items",
+		    itemPtr->typePtr->name));
+	    Tcl_SetErrorCode(interp, "TK", "CANVAS", "COORDS", "APPEND",
+		    (char *)NULL);
+	    result = TCL_ERROR;
+	} else {
+	    Tcl_Obj *endObj = Tcl_NewStringObj("end", 3);
+
+	    Tcl_IncrRefCount(endObj);
+	    result = ItemIndex(canvasPtr, itemPtr, endObj, &index);
+	    Tcl_DecrRefCount(endObj);
+	    if (result == TCL_OK) {
+		ItemInsert(canvasPtr, itemPtr, index, listObj);
+	    }
+	}
+	Tcl_DecrRefCount(listObj);
+    }
+    TkCanvIndexUpdateItem(canvasPtr, itemPtr);
+    if (!(itemPtr->redraw_flags & TK_ITEM_DONT_REDRAW)) {
+	Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr, x1, y1, x2, y2);
+	EventuallyRedrawItem(canvasPtr, itemPtr);
+    }
+    itemPtr->redraw_flags &= ~TK_ITEM_DONT_REDRAW;
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetItemCoords --
+ *
+ *	Retrieves the coordinates of an item as an array of doubles.
+ *
+ * Results:
+ *	A standard Tcl result. On success *coordsPtr points to a ckalloc'ed
+ *	array of *numCoordsPtr values that the caller must free.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+GetItemCoords(
+    TkCanvas *canvasPtr,	/* Canvas containing the item. */
+    Tk_Item *itemPtr,		/* Item to read. */
+    Tcl_Size *numCoordsPtr,	/* Where to store the number of values. */
+    double **coordsPtr)		/* Where to store the values. */
+{
+    Tcl_Interp *interp = canvasPtr->interp;
+    Tcl_Size i, numCoords;
+    Tcl_Obj **elemv;
+    double *coords;
+
+    if (itemPtr->typePtr == &tkLineType) {
+	numCoords = TkLineGetCoords(itemPtr, NULL);
+	coords = (double *)ckalloc(sizeof(double) * (numCoords + 1));
+	TkLineGetCoords(itemPtr, coords);
+    } else {
+	Tcl_ResetResult(interp);
+	if ((ItemCoords(canvasPtr, itemPtr, 0, NULL) != TCL_OK)
+		|| (Tcl_ListObjGetElements(interp, Tcl_GetObjResult(interp),
+		&numCoords, &elemv) != TCL_OK)) {
+	    return TCL_ERROR;
+	}
+	coords = (double *)ckalloc(sizeof(double) * (numCoords + 1));
+	for (i = 0; i < numCoords; i++) {
+	    if (Tcl_GetDoubleFromObj(interp, elemv[i],
+		    &coords[i]) != TCL_OK) {
+		ckfree(coords);
+		return TCL_ERROR;
+	    }
+	}
+	Tcl_ResetResult(interp);
+    }
+    *numCoordsPtr = numCoords;
+    *coordsPtr = coords;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetCanvasFromWindow --
+ *
+ *	Returns the canvas widget record of a window.
+ *
+ * Results:
+ *	The record, or NULL if tkwin isn't a live canvas, in which case an
+ *	error message is left in interp's result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TkCanvas *
+GetCanvasFromWindow(
+    Tcl_Interp *interp,		/* Used for error reporting, if not NULL. */
+    Tk_Window tkwin)		/* Window that should be a canvas. */
+{
+    TkWindow *winPtr = (TkWindow *) tkwin;
+
+    if ((winPtr->classProcsPtr != &canvasClass)
+	    || (((TkCanvas *) winPtr->instanceData)->tkwin == NULL)) {
+	if (interp != NULL) {
+	    Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+		    "window \"%s\" isn't a canvas", Tk_PathName(tkwin)));
+	    Tcl_SetErrorCode(interp, "TK", "LOOKUP", "CANVAS",
+		    Tk_PathName(tkwin), (char *)NULL);
+	}
+	return NULL;
+    }
+    return (TkCanvas *) winPtr->instanceData;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Tk_CanvasSetCoords --
+ *
+ *	Replaces the coordinates of the first item in a canvas that matches
+ *	tagOrIdObj, or appends points to them if flags includes
+ *	TK_CANVAS_COORDS_APPEND. This is the C equivalent of the "coords"
+ *	widget command without the cost of converting each value.
+ *
+ * Results:
+ *	A standard Tcl result. If an error occurs, a message is left in
+ *	interp's result if interp isn't NULL.
+ *
+ * Side effects:
+ *	The item's coordinates change and it is scheduled for redisplay.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Tk_CanvasSetCoords(
+    Tcl_Interp *interp,		/* Used for error reporting, if not NULL. */
+    Tk_Window tkwin,		/* The canvas widget. */
+    Tcl_Obj *tagOrIdObj,	/* Tag or id of the item to modify. */
+    const double *coords,	/* New coordinates: x1, y1, x2, y2, ... */
+    Tcl_Size numCoords,		/* Number of values in coords. */
+    int flags)			/* OR-ed combination of flags; only
+				 * TK_CANVAS_COORDS_APPEND is defined. */
+{
+    TkCanvas *canvasPtr = GetCanvasFromWindow(interp, tkwin);
+    TagSearch *searchPtr = NULL;
+    Tk_Item *itemPtr;
+    int result;
+
+    if ((canvasPtr == NULL)
+	    || (CheckCoordsFinite(interp, coords, numCoords) != TCL_OK)) {
+	return TCL_ERROR;
+    }
+    result = TagSearchScan(canvasPtr, tagOrIdObj, &searchPtr);
+    if (result == TCL_OK) {
+	itemPtr = TagSearchFirst(searchPtr);
+	if (itemPtr != NULL) {
+	    result = SetItemCoords(canvasPtr, itemPtr, coords, numCoords,
+		    flags);
+	}
+    }
+    TagSearchDestroy(searchPtr);
+    if ((result != TCL_OK) && (interp != NULL)
+	    && (interp != canvasPtr->interp)) {
+	Tcl_SetObjResult(interp, Tcl_GetObjResult(canvasPtr->interp));
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Tk_CanvasGetCoords --
+ *
+ *	Retrieves the coordinates of the first item in a canvas that matches
+ *	tagOrIdObj.
+ *
+ * Results:
+ *	A standard Tcl result. On success, *coordsPtr is set to a ckalloc'ed
+ *	array holding *numCoordsPtr values, which the caller must ckfree, or
+ *	to NULL (with *numCoordsPtr set to 0) if no item matches.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Tk_CanvasGetCoords(
+    Tcl_Interp *interp,		/* Used for error reporting, if not NULL. */
+    Tk_Window tkwin,		/* The canvas widget. */
+    Tcl_Obj *tagOrIdObj,	/* Tag or id of the item to read. */
+    Tcl_Size *numCoordsPtr,	/* Where to store the number of values. */
+    double **coordsPtr)		/* Where to store the values. */
+{
+    TkCanvas *canvasPtr = GetCanvasFromWindow(interp, tkwin);
+    TagSearch *searchPtr = NULL;
+    Tk_Item *itemPtr;
+    int result;
+
+    *numCoordsPtr = 0;
+    *coordsPtr = NULL;
+    if (canvasPtr == NULL) {
+	return TCL_ERROR;
+    }
+    result = TagSearchScan(canvasPtr, tagOrIdObj, &searchPtr);
+    if (result == TCL_OK) {
+	itemPtr = TagSearchFirst(searchPtr);
+	if (itemPtr != NULL) {
+	    result = GetItemCoords(canvasPtr, itemPtr, numCoordsPtr,
+		    coordsPtr);
+	}
+    }
+    TagSearchDestroy(searchPtr);
+    if ((result != TCL_OK) && (interp != NULL)
+	    && (interp != canvasPtr->interp)) {
+	Tcl_SetObjResult(interp, Tcl_GetObjResult(canvasPtr->interp));
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddDamage --
+ *
+ *	Add an area to the list of damaged areas of a canvas, that will be
+ *	redrawn by the next call to DisplayCanvas. The new area is merged with
+ *	the areas it overlaps or nearly touches, so that overlapping regions
+ *	are not drawn twice; areas far apart are kept separate so that the
+ *	space between them needn't be redrawn. When the list is full, the new
+ *	area is merged with the one whose union with it wastes the least
+ *	space.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The damage list and its bounding box (redrawX1..redrawY2) are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+/*
+ * Two areas are merged when the part of their bounding box that is covered
+ * by neither of them is at most DAMAGE_MERGE_SLACK pixels, or at most a
+ * quarter of their combined area.
+ */
+
+#define DAMAGE_MERGE_SLACK	4096
+
+static Tcl_WideInt
+DamageWaste(
+    const TkCanvDamage *aPtr,	/* First area. */
+    const TkCanvDamage *bPtr,	/* Second area. */
+    Tcl_WideInt *areaPtr)	/* Filled with the combined area of both. */
+{
+    Tcl_WideInt areaA, areaB, areaUnion, overlap;
+    int ix1, iy1, ix2, iy2;
+
+    areaA = (Tcl_WideInt) (aPtr->x2 - aPtr->x1) * (aPtr->y2 - aPtr->y1);
+    areaB = (Tcl_WideInt) (bPtr->x2 - bPtr->x1) * (bPtr->y2 - bPtr->y1);
+    areaUnion = (Tcl_WideInt)
+	    ((aPtr->x2 > bPtr->x2 ? aPtr->x2 : bPtr->x2)
+	    - (aPtr->x1 < bPtr->x1 ? aPtr->x1 : bPtr->x1))
+	    * ((aPtr->y2 > bPtr->y2 ? aPtr->y2 : bPtr->y2)
+	    - (aPtr->y1 < bPtr->y1 ? aPtr->y1 : bPtr->y1));
+    ix1 = (aPtr->x1 > bPtr->x1) ? aPtr->x1 : bPtr->x1;
+    iy1 = (aPtr->y1 > bPtr->y1) ? aPtr->y1 : bPtr->y1;
+    ix2 = (aPtr->x2 < bPtr->x2) ? aPtr->x2 : bPtr->x2;
+    iy2 = (aPtr->y2 < bPtr->y2) ? aPtr->y2 : bPtr->y2;
+    overlap = 0;
+    if ((ix1 < ix2) && (iy1 < iy2)) {
+	overlap = (Tcl_WideInt) (ix2 - ix1) * (iy2 - iy1);
+    }
+    *areaPtr = areaA + areaB;
+    return areaUnion - areaA - areaB + overlap;
+}
+
+static void
+AddDamage(
+    TkCanvas *canvasPtr,	/* Information about widget. */
+    int x1, int y1,		/* Upper left corner of area to redraw. */
+    int x2, int y2)		/* Lower right corner of area to redraw. */
+{
+    TkCanvDamage newRect, *rectPtr;
+    Tcl_WideInt waste, area, bestWaste = 0;
+    int i, best;
+
+    if (!(canvasPtr->flags & BBOX_NOT_EMPTY)) {
+	canvasPtr->redrawX1 = x1;
+	canvasPtr->redrawY1 = y1;
+	canvasPtr->redrawX2 = x2;
+	canvasPtr->redrawY2 = y2;
+	canvasPtr->numDamage = 0;
+	canvasPtr->flags |= BBOX_NOT_EMPTY;
+    } else {
+	if (x1 <= canvasPtr->redrawX1) {
+	    canvasPtr->redrawX1 = x1;
+	}
+	if (y1 <= canvasPtr->redrawY1) {
+	    canvasPtr->redrawY1 = y1;
+	}
+	if (x2 >= canvasPtr->redrawX2) {
+	    canvasPtr->redrawX2 = x2;
+	}
+	if (y2 >= canvasPtr->redrawY2) {
+	    canvasPtr->redrawY2 = y2;
+	}
+    }
+
+    newRect.x1 = x1;
+    newRect.y1 = y1;
+    newRect.x2 = x2;
+    newRect.y2 = y2;
+
+    /*
+     * Absorb every area that is cheap to merge with the new one. Each merge
+     * grows the new area, so start over until nothing more can be merged.
+     */
+
+  again:
+    best = -1;
+    for (i = 0; i < canvasPtr->numDamage; i++) {
+	rectPtr = &canvasPtr->damage[i];
+	waste = DamageWaste(rectPtr, &newRect, &area);
+	if ((waste <= DAMAGE_MERGE_SLACK) || (waste * 4 <= area)) {
+	    best = i;
+	    break;
+	}
+	if ((best < 0) || (waste < bestWaste)) {
+	    best = i;
+	    bestWaste = waste;
+	}
+    }
+    if ((best >= 0) && ((i < canvasPtr->numDamage)
+	    || (canvasPtr->numDamage == TK_CANV_MAX_DAMAGE))) {
+	rectPtr = &canvasPtr->damage[best];
+	if (rectPtr->x1 < newRect.x1) {
+	    newRect.x1 = rectPtr->x1;
+	}
+	if (rectPtr->y1 < newRect.y1) {
+	    newRect.y1 = rectPtr->y1;
+	}
+	if (rectPtr->x2 > newRect.x2) {
+	    newRect.x2 = rectPtr->x2;
+	}
+	if (rectPtr->y2 > newRect.y2) {
+	    newRect.y2 = rectPtr->y2;
+	}
+	canvasPtr->numDamage--;
+	*rectPtr = canvasPtr->damage[canvasPtr->numDamage];
+	canvasPtr->redrawStats.merges++;
+	goto again;
+    }
+    canvasPtr->damage[canvasPtr->numDamage++] = newRect;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Tk_CreateItemType --
+ *
+ *	This function may be invoked to add a new kind of canvas element to
+ *	the core item types supported by Tk.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	From now on, the new item type will be useable in canvas widgets
+ *	(e.g. typePtr->name can be used as the item type in "create" widget
+ *	commands). If there was already a type with the same name as in
+ *	typePtr, it is replaced with the new type.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Tk_CreateItemType(
+    Tk_ItemType *typePtr)	/* Information about item type; storage must
+				 * be statically allocated (must live
+				 * forever). */
+{
+    Tk_ItemType *typePtr2, *prevPtr;
+
+    if (typeList == NULL) {
+	InitCanvas();
+    }
+
+    /*
+     * If there's already an item type with the given name, remove it.
+     */
+
+    Tcl_MutexLock(&typeListMutex);
+    for (typePtr2 = typeList, prevPtr = NULL; typePtr2 != NULL;
+	    prevPtr = typePtr2, typePtr2 = typePtr2->nextPtr) {
+	if (strcmp(typePtr2->name, typePtr->name) == 0) {
+	    if (prevPtr == NULL) {
+		typeList = typePtr2->nextPtr;
+	    } else {
+		prevPtr->nextPtr = typePtr2->nextPtr;
+	    }
+	    break;
+	}
+    }
+    typePtr->nextPtr = typeList;
+    typeList = typePtr;
+    Tcl_MutexUnlock(&typeListMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Tk_GetItemTypes --
+ *
+ *	This function returns a pointer to the list of all item types. Note
+ *	that this is inherently thread-unsafe, but since item types are only
+ *	ever registered very rarely this is unlikely to be a problem in
+ *	practice.
+ *
+ * Results:
+ *	The return value is a pointer to the first in the list of item types
+ *	currently supported by canvases.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tk_ItemType *
+Tk_GetItemTypes(void)
+{
+    if (typeList == NULL) {
+	InitCanvas();
+    }
+    return typeList;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitCanvas --
+ *
+ *	This function is invoked to perform once-only-ever initialization for
+ *	the module, such as setting up the type table.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InitCanvas(void)
+{
+    Tcl_MutexLock(&typeListMutex);
+    if (typeList != NULL) {
+	Tcl_MutexUnlock(&typeListMutex);
+	return;
+    }
+    typeList = &tkRectangleType;
+    tkRectangleType.nextPtr = &tkTextType;
+    tkTextType.nextPtr = &tkLineType;
+    tkLineType.nextPtr = &tkPolygonType;
+    tkPolygonType.nextPtr = &tkImageType;
+    tkImageType.nextPtr = &tkOvalType;
+    tkOvalType.nextPtr = &tkBitmapType;
+    tkBitmapType.nextPtr = &tkArcType;
+    tkArcType.nextPtr = &tkWindowType;
+    tkWindowType.nextPtr = NULL;
+    Tcl_MutexUnlock(&typeListMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetStaticUids --
+ *
+ *	This function is invoked to return a structure filled with the Uids
+ *	used when doing tag searching. If it was never before called in the
+ *	current thread, it initializes the structure for that thread (uids are
+ *	only ever local to one thread [Bug 1114977]).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SearchUids *
+GetStaticUids(void)
+{
+    SearchUids *searchUids = (SearchUids *)
+	    Tcl_GetThreadData(&dataKey, sizeof(SearchUids));
+
+    if (searchUids->allUid == NULL) {
+	searchUids->allUid       = Tk_GetUid("all");
+	searchUids->currentUid   = Tk_GetUid("current");
+	searchUids->andUid       = Tk_GetUid("&&");
+	searchUids->orUid        = Tk_GetUid("||");
 	searchUids->xorUid       = Tk_GetUid("^");
 	searchUids->parenUid     = Tk_GetUid("(");
 	searchUids->endparenUid  = Tk_GetUid(")");
@@ -3825,6 +4666,8 @@ TagSearchScan(
 
 	*searchPtrPtr = searchPtr = (TagSearch *)ckalloc(sizeof(TagSearch));
 	searchPtr->expr = NULL;
+	searchPtr->ids = NULL;
+	searchPtr->idsSpace = 0;
 
 	/*
 	 * Allocate buffer for rewritten tags (after de-escaping).
@@ -3860,6 +4703,9 @@ TagSearchScan(
     searchPtr->canvasPtr = canvasPtr;
     searchPtr->searchOver = 0;
     searchPtr->type = SEARCH_TYPE_EMPTY;
+    searchPtr->useIds = 0;
+    searchPtr->numIds = 0;
+    searchPtr->nextId = 0;
 
     /*
      * Find the first matching item in one of several ways. If the tag is a
@@ -3978,6 +4824,9 @@ TagSearchDestroy(
     if (searchPtr) {
 	TagSearchExprDestroy(searchPtr->expr);
 	ckfree(searchPtr->rewritebuffer);
+	if (searchPtr->ids != NULL) {
+	    ckfree(searchPtr->ids);
+	}
 	ckfree(searchPtr);
     }
 }
@@ -4469,6 +5318,15 @@ TagSearchFirst(
 	return searchPtr->canvasPtr->firstItemPtr;
     }
 
+    /*
+     * Tags and tag expressions that only match items carrying one of a few
+     * tags are looked up in the tag index.
+     */
+
+    if (TagSearchUseIndex(searchPtr)) {
+	return TagSearchNextId(searchPtr);
+    }
+
     if (searchPtr->type == SEARCH_TYPE_TAG) {
 	/*
 	 * Optimized single-tag search
@@ -4535,6 +5393,10 @@ TagSearchNext(
     Tk_Uid uid, *tagPtr;
     int count;
 
+    if (searchPtr->useIds) {
+	return TagSearchNextId(searchPtr);
+    }
+
     /*
      * Find next item in list (this may not actually be a suitable one to
      * return), and return if there are no items left.
@@ -4610,6 +5472,141 @@ TagSearchNext(
     return NULL;
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * TagSearchUseIndex --
+ *
+ *	This function is called by TagSearchFirst to look up the items that
+ *	match a simple tag or a tag expression in the tag index of the canvas,
+ *	instead of testing every item in the display list. An expression can
+ *	be looked up if it doesn't match an item without tags: every item it
+ *	matches then carries at least one of the tags named in it.
+ *
+ * Results:
+ *	Returns 1 if the ids of the matching items were stored in *searchPtr,
+ *	to be returned by TagSearchNextId, or 0 if the search should walk the
+ *	display list instead because it would match most items anyway.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+TagSearchUseIndex(
+    TagSearch *searchPtr)	/* Record describing tag search. */
+{
+    TkCanvas *canvasPtr = searchPtr->canvasPtr;
+    TagSearchExpr *expr = searchPtr->expr;
+    SearchUids *searchUids;
+    Tk_Uid *tags;
+    Tk_Item emptyItem;
+    TkCanvIndexResult found;
+    Tcl_Size i, numTags;
+    int result = 0;
+
+    if (searchPtr->type == SEARCH_TYPE_TAG) {
+	tags = &expr->uid;
+	numTags = 1;
+    } else if (searchPtr->type == SEARCH_TYPE_EXPR) {
+	emptyItem.tagPtr = NULL;
+	emptyItem.numTags = 0;
+	expr->index = 0;
+	if (TagSearchEvalExpr(expr, &emptyItem)) {
+	    return 0;
+	}
+	searchUids = GetStaticUids();
+	tags = (Tk_Uid *)ckalloc(expr->length * sizeof(Tk_Uid));
+	numTags = 0;
+	for (i = 0; i < expr->length; i++) {
+	    if ((expr->uids[i] == searchUids->tagvalUid)
+		    || (expr->uids[i] == searchUids->negtagvalUid)) {
+		tags[numTags++] = expr->uids[++i];
+	    }
+	}
+    } else {
+	return 0;
+    }
+
+    /*
+     * Walking the display list is just as fast when most items would be
+     * reported anyway.
+     */
+
+    if (TkCanvIndexCountTags(canvasPtr, numTags, tags)
+	    > canvasPtr->idTable.numEntries / 2 + 8) {
+	goto done;
+    }
+
+    TkCanvIndexFindTags(canvasPtr, numTags, tags, &found);
+    if (found.numItems > searchPtr->idsSpace) {
+	searchPtr->idsSpace = found.numItems;
+	searchPtr->ids = (Tcl_Size *)ckrealloc(searchPtr->ids,
+		searchPtr->idsSpace * sizeof(Tcl_Size));
+    }
+    searchPtr->numIds = 0;
+    for (i = 0; i < found.numItems; i++) {
+	if (searchPtr->type == SEARCH_TYPE_EXPR) {
+	    expr->index = 0;
+	    if (!TagSearchEvalExpr(expr, found.items[i])) {
+		continue;
+	    }
+	}
+	searchPtr->ids[searchPtr->numIds++] = found.items[i]->id;
+    }
+    TkCanvIndexFreeResult(&found);
+    searchPtr->nextId = 0;
+    searchPtr->useIds = 1;
+    result = 1;
+
+  done:
+    if (tags != &expr->uid) {
+	ckfree(tags);
+    }
+    return result;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * TagSearchNextId --
+ *
+ *	Returns the next item of a search whose matching items were looked up
+ *	by TagSearchUseIndex. The items are kept by id, so that items deleted
+ *	while the search is in progress are simply skipped.
+ *
+ * Results:
+ *	The return value is a pointer to the next matching item, or NULL if
+ *	there are no more.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static Tk_Item *
+TagSearchNextId(
+    TagSearch *searchPtr)	/* Record describing search in progress. */
+{
+    Tcl_HashEntry *entryPtr;
+    Tk_Item *itemPtr;
+
+    while (searchPtr->nextId < searchPtr->numIds) {
+	entryPtr = Tcl_FindHashEntry(&searchPtr->canvasPtr->idTable,
+		INT2PTR(searchPtr->ids[searchPtr->nextId++]));
+	if (entryPtr != NULL) {
+	    itemPtr = (Tk_Item *)Tcl_GetHashValue(entryPtr);
+	    searchPtr->currentPtr = itemPtr;
+	    return itemPtr;
+	}
+    }
+    searchPtr->searchOver = 1;
+    return NULL;
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -4631,6 +5628,7 @@ TagSearchNext(
 
 static void
 DoItem(
+    TkCanvas *canvasPtr,	/* Canvas containing the item. */
     Tcl_Obj *accumObj,		/* Object in which to (possibly) record item
 				 * id. */
     Tk_Item *itemPtr,		/* Item to (possibly) modify. */
@@ -4680,6 +5678,8 @@ DoItem(
 
     *tagPtr = tag;
     itemPtr->numTags++;
+    TkCanvIndexSyncTags(canvasPtr, itemPtr);
+    TkCanvLayerCheckItem(canvasPtr, itemPtr);
 }
 
 /*
@@ -4760,7 +5760,7 @@ FindItems(
 	}
 	if ((lastPtr != NULL) && (lastPtr->nextPtr != NULL)) {
 	    resultObj = Tcl_NewObj();
-	    DoItem(resultObj, lastPtr->nextPtr, uid);
+	    DoItem(canvasPtr, resultObj, lastPtr->nextPtr, uid);
 	    Tcl_SetObjResult(interp, resultObj);
 	}
 	break;
@@ -4774,7 +5774,7 @@ FindItems(
 	resultObj = Tcl_NewObj();
 	for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
 		itemPtr = itemPtr->nextPtr) {
-	    DoItem(resultObj, itemPtr, uid);
+	    DoItem(canvasPtr, resultObj, itemPtr, uid);
 	}
 	Tcl_SetObjResult(interp, resultObj);
 	break;
@@ -4788,15 +5788,13 @@ FindItems(
 		return TCL_ERROR);
 	if ((itemPtr != NULL) && (itemPtr->prevPtr != NULL)) {
 	    resultObj = Tcl_NewObj();
-	    DoItem(resultObj, itemPtr->prevPtr, uid);
+	    DoItem(canvasPtr, resultObj, itemPtr->prevPtr, uid);
 	    Tcl_SetObjResult(interp, resultObj);
 	}
 	break;
     case CANV_CLOSEST: {
-	double closestDist;
 	Tk_Item *startPtr, *closestPtr;
 	double coords[2], halo;
-	int x1, y1, x2, y2;
 
 	if ((objc < first+3) || (objc > first+5)) {
 	    Tcl_WrongNumArgs(interp, first+1, objv, "x y ?halo? ?start?");
@@ -4836,11 +5834,8 @@ FindItems(
 	}
 
 	/*
-	 * The code below is optimized so that it can eliminate most items
-	 * without having to call their item-specific functions. This is done
-	 * by keeping a bounding box (x1, y1, x2, y2) that an item's bbox must
-	 * overlap if the item is to have any chance of being closer than the
-	 * closest so far.
+	 * Nothing is found unless there is a visible item at or after the
+	 * start item.
 	 */
 
 	itemPtr = startPtr;
@@ -4852,53 +5847,11 @@ FindItems(
 	if (itemPtr == NULL) {
 	    return TCL_OK;
 	}
-	closestDist = ItemPoint(canvasPtr, itemPtr, coords, halo);
-	while (1) {
-	    double newDist;
-
-	    /*
-	     * Update the bounding box using itemPtr, which is the new closest
-	     * item.
-	     */
-
-	    x1 = (int) (coords[0] - closestDist - halo - 1);
-	    y1 = (int) (coords[1] - closestDist - halo - 1);
-	    x2 = (int) (coords[0] + closestDist + halo + 1);
-	    y2 = (int) (coords[1] + closestDist + halo + 1);
-	    closestPtr = itemPtr;
-
-	    /*
-	     * Search for an item that beats the current closest one. Work
-	     * circularly through the canvas's item list until getting back to
-	     * the starting item.
-	     */
-
-	    while (1) {
-		itemPtr = itemPtr->nextPtr;
-		if (itemPtr == NULL) {
-		    itemPtr = canvasPtr->firstItemPtr;
-		}
-		if (itemPtr == startPtr) {
-		    resultObj = Tcl_NewObj();
-		    DoItem(resultObj, closestPtr, uid);
-		    Tcl_SetObjResult(interp, resultObj);
-		    return TCL_OK;
-		}
-		if (itemPtr->state == TK_STATE_HIDDEN ||
-			(itemPtr->state == TK_STATE_NULL &&
-			canvasPtr->canvas_state == TK_STATE_HIDDEN)) {
-		    continue;
-		}
-		if ((itemPtr->x1 >= x2) || (itemPtr->x2 <= x1)
-			|| (itemPtr->y1 >= y2) || (itemPtr->y2 <= y1)) {
-		    continue;
-		}
-		newDist = ItemPoint(canvasPtr, itemPtr, coords, halo);
-		if (newDist <= closestDist) {
-		    closestDist = newDist;
-		    break;
-		}
-	    }
+	closestPtr = FindClosestFrom(canvasPtr, coords, halo, startPtr);
+	if (closestPtr != NULL) {
+	    resultObj = Tcl_NewObj();
+	    DoItem(canvasPtr, resultObj, closestPtr, uid);
+	    Tcl_SetObjResult(interp, resultObj);
 	}
 	break;
     }
@@ -4922,7 +5875,7 @@ FindItems(
 	resultObj = Tcl_NewObj();
 	FOR_EVERY_CANVAS_ITEM_MATCHING(objv[first+1], searchPtrPtr,
 		goto badWithTagSearch) {
-	    DoItem(resultObj, itemPtr, uid);
+	    DoItem(canvasPtr, resultObj, itemPtr, uid);
 	}
 	Tcl_SetObjResult(interp, resultObj);
 	return TCL_OK;
@@ -4933,6 +5886,101 @@ FindItems(
     return TCL_OK;
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * FindClosestFrom --
+ *
+ *	This function implements the search for the "find closest" and
+ *	"addtag closest" options. It looks at the items in a square around
+ *	the given point, growing the square until the closest item found is
+ *	known to be closer than anything outside the square.
+ *
+ * Results:
+ *	The visible item closest to coords, or NULL if there is no visible
+ *	item. If several items are equally close, the last one in the display
+ *	list, when scanning it circularly from startPtr, is returned.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static inline int
+ClampToInt(
+    double value)
+{
+    if (value <= (double) INT_MIN) {
+	return INT_MIN;
+    }
+    if (value >= (double) INT_MAX) {
+	return INT_MAX;
+    }
+    return (int) value;
+}
+
+static Tk_Item *
+FindClosestFrom(
+    TkCanvas *canvasPtr,	/* Canvas whose items are to be searched. */
+    double coords[2],		/* Point in canvas coordinates. */
+    double halo,		/* Items within this distance of the point
+				 * are considered to be at distance 0. */
+    Tk_Item *startPtr)		/* Item at which the circular scan of the
+				 * display list starts, for ties. */
+{
+    Tcl_WideUInt startOrder = TkCanvIndexItemOrder(startPtr);
+    double radius = 64.0, bestDist = 0.0, newDist;
+    Tk_Item *itemPtr, *bestPtr;
+    TkCanvIndexResult found;
+    int x1, y1, x2, y2, wrapped, bestWrapped = 0;
+    Tcl_Size i;
+
+    while (1) {
+	x1 = ClampToInt(coords[0] - radius);
+	y1 = ClampToInt(coords[1] - radius);
+	x2 = ClampToInt(coords[0] + radius);
+	y2 = ClampToInt(coords[1] + radius);
+
+	bestPtr = NULL;
+	TkCanvIndexSearch(canvasPtr, x1, y1, x2, y2, &found);
+	for (i = 0; i < found.numItems; i++) {
+	    itemPtr = found.items[i];
+	    if (itemPtr->state == TK_STATE_HIDDEN ||
+		    (itemPtr->state == TK_STATE_NULL &&
+		    canvasPtr->canvas_state == TK_STATE_HIDDEN)) {
+		continue;
+	    }
+
+	    /*
+	     * Candidates come in display list order. Items before startPtr
+	     * come after all others in the circular scan.
+	     */
+
+	    newDist = ItemPoint(canvasPtr, itemPtr, coords, halo);
+	    wrapped = (TkCanvIndexItemOrder(itemPtr) < startOrder);
+	    if ((bestPtr == NULL) || (newDist < bestDist)
+		    || ((newDist == bestDist) && (wrapped || !bestWrapped))) {
+		bestPtr = itemPtr;
+		bestDist = newDist;
+		bestWrapped = wrapped;
+	    }
+	}
+	TkCanvIndexFreeResult(&found);
+
+	/*
+	 * Any item that wasn't looked at lies entirely outside the square,
+	 * so it is at least radius-halo away (give or take rounding).
+	 */
+
+	if (((bestPtr != NULL) && (bestDist + halo + 2.0 <= radius))
+		|| TkCanvIndexCoversAll(canvasPtr, x1, y1, x2, y2)) {
+	    return bestPtr;
+	}
+	radius *= 4.0;
+    }
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -4974,6 +6022,8 @@ FindArea(
     int x1, y1, x2, y2;
     Tk_Item *itemPtr;
     Tcl_Obj *resultObj;
+    TkCanvIndexResult found;
+    Tcl_Size i;
 
     if ((Tk_CanvasGetCoordFromObj(interp, (Tk_Canvas) canvasPtr, objv[0],
 		&rect[0]) != TCL_OK)
@@ -5002,8 +6052,9 @@ FindArea(
     x2 = (int) (rect[2] + 1.0);
     y2 = (int) (rect[3] + 1.0);
     resultObj = Tcl_NewObj();
-    for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
-	    itemPtr = itemPtr->nextPtr) {
+    TkCanvIndexSearch(canvasPtr, x1, y1, x2, y2, &found);
+    for (i = 0; i < found.numItems; i++) {
+	itemPtr = found.items[i];
 	if (itemPtr->state == TK_STATE_HIDDEN ||
 		(itemPtr->state == TK_STATE_NULL
 		&& canvasPtr->canvas_state == TK_STATE_HIDDEN)) {
@@ -5014,9 +6065,10 @@ FindArea(
 	    continue;
 	}
 	if (ItemOverlap(canvasPtr, itemPtr, rect) >= enclosed) {
-	    DoItem(resultObj, itemPtr, uid);
+	    DoItem(canvasPtr, resultObj, itemPtr, uid);
 	}
     }
+    TkCanvIndexFreeResult(&found);
     Tcl_SetObjResult(interp, resultObj);
     return TCL_OK;
 }
@@ -5061,6 +6113,7 @@ RelinkItems(
      */
 
     firstMovePtr = lastMovePtr = NULL;
+    TkCanvLayerCheckItem(canvasPtr, NULL);
     FOR_EVERY_CANVAS_ITEM_MATCHING(tag, searchPtrPtr, return TCL_ERROR) {
 	if (itemPtr == prevPtr) {
 	    /*
@@ -5123,6 +6176,7 @@ RelinkItems(
     if (canvasPtr->lastItemPtr == prevPtr) {
 	canvasPtr->lastItemPtr = lastMovePtr;
     }
+    TkCanvIndexRelinkItems(canvasPtr, firstMovePtr, lastMovePtr);
     return TCL_OK;
 }
 
@@ -5384,6 +6438,8 @@ PickCurrentItem(
 			    itemPtr->tagPtr + i + 1,
 			    (itemPtr->numTags - (i+1)) * sizeof(Tk_Uid));
 		    itemPtr->numTags--;
+		    TkCanvIndexSyncTags(canvasPtr, itemPtr);
+		    TkCanvLayerCheckItem(canvasPtr, itemPtr);
 		    break;
 		}
 	    }
@@ -5413,11 +6469,13 @@ PickCurrentItem(
 	    (prevItemPtr->redraw_flags & TK_ITEM_STATE_DEPENDANT)) {
 	EventuallyRedrawItem(canvasPtr, prevItemPtr);
 	ItemConfigure(canvasPtr, prevItemPtr, 0, NULL);
+	TkCanvIndexUpdateItem(canvasPtr, prevItemPtr);
     }
     if (canvasPtr->currentItemPtr != NULL) {
 	XEvent event;
 
-	DoItem(NULL, canvasPtr->currentItemPtr, searchUids->currentUid);
+	DoItem(canvasPtr, NULL, canvasPtr->currentItemPtr,
+		searchUids->currentUid);
 	if ((canvasPtr->currentItemPtr->redraw_flags & TK_ITEM_STATE_DEPENDANT
 		&& prevItemPtr != canvasPtr->currentItemPtr)) {
 	    ItemConfigure(canvasPtr, canvasPtr->currentItemPtr, 0, NULL);
@@ -5458,15 +6516,23 @@ CanvasFindClosest(
     Tk_Item *itemPtr;
     Tk_Item *bestPtr;
     int x1, y1, x2, y2;
+    TkCanvIndexResult found;
+    Tcl_Size i;
 
     x1 = (int) (coords[0] - canvasPtr->closeEnough);
     y1 = (int) (coords[1] - canvasPtr->closeEnough);
     x2 = (int) (coords[0] + canvasPtr->closeEnough);
     y2 = (int) (coords[1] + canvasPtr->closeEnough);
 
+    /*
+     * Look at the candidates from the top of the display list down, so the
+     * search can stop at the first item that is close enough.
+     */
+
     bestPtr = NULL;
-    for (itemPtr = canvasPtr->firstItemPtr; itemPtr != NULL;
-	    itemPtr = itemPtr->nextPtr) {
+    TkCanvIndexSearch(canvasPtr, x1, y1, x2, y2, &found);
+    for (i = found.numItems - 1; i >= 0; i--) {
+	itemPtr = found.items[i];
 	if (itemPtr->state == TK_STATE_HIDDEN ||
 		itemPtr->state==TK_STATE_DISABLED ||
 		(itemPtr->state == TK_STATE_NULL &&
@@ -5480,8 +6546,10 @@ CanvasFindClosest(
 	}
 	if (ItemPoint(canvasPtr,itemPtr,coords,0) <= canvasPtr->closeEnough) {
 	    bestPtr = itemPtr;
+	    break;
 	}
     }
+    TkCanvIndexFreeResult(&found);
     return bestPtr;
 }
 
@@ -6110,17 +7178,17 @@ CanvasSetOrigin(
      * undisplay themselves.
      */
 
-    Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr,
+    EventuallyRedrawArea(canvasPtr,
 	    canvasPtr->xOrigin, canvasPtr->yOrigin,
 	    canvasPtr->xOrigin + Tk_Width(canvasPtr->tkwin),
-	    canvasPtr->yOrigin + Tk_Height(canvasPtr->tkwin));
+	    canvasPtr->yOrigin + Tk_Height(canvasPtr->tkwin), 0);
     canvasPtr->xOrigin = xOrigin;
     canvasPtr->yOrigin = yOrigin;
     canvasPtr->flags |= UPDATE_SCROLLBARS;
-    Tk_CanvasEventuallyRedraw((Tk_Canvas) canvasPtr,
+    EventuallyRedrawArea(canvasPtr,
 	    canvasPtr->xOrigin, canvasPtr->yOrigin,
 	    canvasPtr->xOrigin + Tk_Width(canvasPtr->tkwin),
-	    canvasPtr->yOrigin + Tk_Height(canvasPtr->tkwin));
+	    canvasPtr->yOrigin + Tk_Height(canvasPtr->tkwin), 0);
 }
 
 /*
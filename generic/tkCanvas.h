@@ -35,6 +35,56 @@ struct TagSearchExpr_s {
 };
 #endif /* not USE_OLD_TAG_SEARCH */
 
+/*
+ * Spatial and tag index over the items of a canvas; see tkCanvIndex.c. The
+ * structure below receives the result of a search.
+ */
+
+typedef struct TkCanvIndex TkCanvIndex;
+
+#define TK_CANV_INDEX_STATIC_RESULT 32
+
+typedef struct TkCanvIndexResult {
+    Tk_Item **items;		/* Items found, in display list order. */
+    Tcl_Size numItems;		/* Number of items in items. */
+    Tcl_Size space;		/* Number of slots available in items. */
+    Tk_Item *staticSpace[TK_CANV_INDEX_STATIC_RESULT];
+				/* Initial storage for items. */
+} TkCanvIndexResult;
+
+/*
+ * Areas of a canvas that need to be redrawn are kept as a short list of
+ * rectangles, so that a few small changes far apart do not cause everything
+ * in between to be redrawn. Rectangles are merged when the list is full or
+ * when merging wastes little area. The statistics below are reported by the
+ * "damage" widget command.
+ */
+
+#define TK_CANV_MAX_DAMAGE 8
+
+typedef struct TkCanvDamage {
+    int x1, y1;			/* Upper left corner, included. */
+    int x2, y2;			/* Lower right corner, not included. */
+} TkCanvDamage;
+
+/*
+ * The layer cache of a canvas keeps the rendering of the items at the bottom
+ * of the display list that carry the -layertag tag in an offscreen pixmap.
+ * Its structure is private to tkCanvLayer.c.
+ */
+
+typedef struct TkCanvLayer TkCanvLayer;
+
+typedef struct TkCanvRedrawStats {
+    Tcl_WideInt redraws;	/* Number of times anything was redrawn. */
+    Tcl_WideInt rects;		/* Number of rectangles redrawn. */
+    Tcl_WideInt pixels;		/* Number of pixels redrawn. */
+    Tcl_WideInt unionPixels;	/* Number of pixels a single bounding box of
+				 * the damage would have covered. */
+    Tcl_WideInt merges;		/* Number of times two rectangles were
+				 * merged. */
+} TkCanvRedrawStats;
+
 /*
  * The record below describes a canvas widget. It is made available to the
  * item functions so they can access certain shared fields such as the overall
@@ -233,6 +283,21 @@ typedef struct TkCanvas {
     TagSearchExpr *bindTagExprs;/* Linked list of tag expressions used in
 				 * bindings. */
 #endif
+    TkCanvIndex *indexPtr;	/* Spatial index over the bounding boxes of
+				 * all items, used to limit area searches,
+				 * picking and redisplay to the items near
+				 * the area of interest, and index from tags
+				 * to the items carrying them. */
+    TkCanvDamage damage[TK_CANV_MAX_DAMAGE];
+				/* Areas to redraw, in canvas coordinates.
+				 * Their union is redrawX1..redrawY2. Only
+				 * valid if BBOX_NOT_EMPTY is set. */
+    int numDamage;		/* Number of valid entries in damage. */
+    TkCanvRedrawStats redrawStats;
+				/* Counters reported by "damage". */
+    Tcl_Obj *layerTagObj;	/* Value of -layertag option: tag of the items
+				 * whose rendering is cached. */
+    TkCanvLayer *layerPtr;	/* Layer cache, see tkCanvLayer.c. */
 } TkCanvas;
 
 /*
@@ -294,6 +359,58 @@ MODULE_SCOPE int	TkCanvPostscriptObjCmd(TkCanvas *canvasPtr,
 MODULE_SCOPE int	TkCanvTranslatePath(TkCanvas *canvPtr,
 			    int numVertex, double *coordPtr, int closed,
 			    XPoint *outPtr);
+MODULE_SCOPE int	TkLineSetCoords(Tcl_Interp *interp,
+			    Tk_Canvas canvas, Tk_Item *itemPtr,
+			    const double *coords, Tcl_Size numCoords,
+			    int flags);
+MODULE_SCOPE Tcl_Size	TkLineGetCoords(Tk_Item *itemPtr, double *coords);
+MODULE_SCOPE void	TkCanvIndexCreate(TkCanvas *canvasPtr);
+MODULE_SCOPE void	TkCanvIndexFree(TkCanvas *canvasPtr);
+MODULE_SCOPE void	TkCanvIndexAddItem(TkCanvas *canvasPtr,
+			    Tk_Item *itemPtr);
+MODULE_SCOPE void	TkCanvIndexRemoveItem(TkCanvas *canvasPtr,
+			    Tk_Item *itemPtr);
+MODULE_SCOPE void	TkCanvIndexUpdateItem(TkCanvas *canvasPtr,
+			    Tk_Item *itemPtr);
+MODULE_SCOPE void	TkCanvIndexRelinkItems(TkCanvas *canvasPtr,
+			    Tk_Item *firstPtr, Tk_Item *lastPtr);
+MODULE_SCOPE Tcl_WideUInt TkCanvIndexItemOrder(Tk_Item *itemPtr);
+MODULE_SCOPE void	TkCanvIndexAddPending(TkCanvas *canvasPtr,
+			    Tk_Item *itemPtr);
+MODULE_SCOPE Tcl_Size	TkCanvIndexGetPending(TkCanvas *canvasPtr,
+			    Tk_Item ***itemsPtr);
+MODULE_SCOPE void	TkCanvIndexClearPending(TkCanvas *canvasPtr);
+MODULE_SCOPE Tcl_Size	TkCanvIndexSearch(TkCanvas *canvasPtr,
+			    int x1, int y1, int x2, int y2,
+			    TkCanvIndexResult *resultPtr);
+MODULE_SCOPE void	TkCanvIndexFreeResult(TkCanvIndexResult *resultPtr);
+MODULE_SCOPE int	TkCanvIndexCoversAll(TkCanvas *canvasPtr,
+			    int x1, int y1, int x2, int y2);
+MODULE_SCOPE void	TkCanvIndexSyncTags(TkCanvas *canvasPtr,
+			    Tk_Item *itemPtr);
+MODULE_SCOPE Tcl_Size	TkCanvIndexCountTags(TkCanvas *canvasPtr,
+			    Tcl_Size numTags, const Tk_Uid *tags);
+MODULE_SCOPE Tcl_Size	TkCanvIndexFindTags(TkCanvas *canvasPtr,
+			    Tcl_Size numTags, const Tk_Uid *tags,
+			    TkCanvIndexResult *resultPtr);
+MODULE_SCOPE void	TkCanvLayerCreate(TkCanvas *canvasPtr);
+MODULE_SCOPE void	TkCanvLayerFree(TkCanvas *canvasPtr);
+MODULE_SCOPE void	TkCanvLayerConfigure(TkCanvas *canvasPtr,
+			    int worldChanged);
+MODULE_SCOPE int	TkCanvLayerIsMember(TkCanvas *canvasPtr,
+			    Tk_Item *itemPtr);
+MODULE_SCOPE void	TkCanvLayerCheckItem(TkCanvas *canvasPtr,
+			    Tk_Item *itemPtr);
+MODULE_SCOPE void	TkCanvLayerStale(TkCanvas *canvasPtr,
+			    int x1, int y1, int x2, int y2);
+MODULE_SCOPE int	TkCanvLayerPrepare(TkCanvas *canvasPtr);
+MODULE_SCOPE void	TkCanvLayerComposite(TkCanvas *canvasPtr,
+			    Drawable drawable, int x1, int y1,
+			    int width, int height);
+MODULE_SCOPE int	TkCanvLayerObjCmd(TkCanvas *canvasPtr,
+			    Tcl_Interp *interp, Tcl_Size objc,
+			    Tcl_Obj *const objv[]);
+
 /*
  * Standard item types provided by Tk:
  */
@@ -40,6 +40,8 @@ static int		CaretCmd(void *dummy, Tcl_Interp *interp,
 			    Tcl_Size objc, Tcl_Obj *const *objv);
 static int		InactiveCmd(void *dummy, Tcl_Interp *interp,
 			    Tcl_Size objc, Tcl_Obj *const *objv);
+static int		PixmappoolCmd(void *dummy, Tcl_Interp *interp,
+			    Tcl_Size objc, Tcl_Obj *const *objv);
 static int		ScalingCmd(void *dummy, Tcl_Interp *interp,
 			    Tcl_Size objc, Tcl_Obj *const *objv);
 static int		UseinputmethodsCmd(void *dummy,
@@ -65,6 +67,7 @@ static const TkEnsemble tkCmdMap[] = {
     {"busy",		Tk_BusyObjCmd, NULL },
     {"caret",		CaretCmd, NULL },
     {"inactive",	InactiveCmd, NULL },
+    {"pixmappool",	PixmappoolCmd, NULL },
     {"scaling",		ScalingCmd, NULL },
     {"useinputmethods",	UseinputmethodsCmd, NULL },
     {"windowingsystem",	WindowingsystemCmd, NULL },
@@ -665,7 +668,7 @@ TkInitTkCmd(
  *----------------------------------------------------------------------
  *
  * AppnameCmd, CaretCmd, ScalingCmd, UseinputmethodsCmd,
- * WindowingsystemCmd, InactiveCmd --
+ * WindowingsystemCmd, InactiveCmd, PixmappoolCmd --
  *
  *	These functions are invoked to process the "tk" ensemble subcommands.
  *	See the user documentation for details on what they do.
@@ -991,6 +994,40 @@ InactiveCmd(
     }
     return TCL_OK;
 }
+
+int
+PixmappoolCmd(
+    void *clientData,		/* Main window associated with interpreter. */
+    Tcl_Interp *interp,		/* Current interpreter. */
+    Tcl_Size objc,		/* Number of arguments. */
+    Tcl_Obj *const objv[])	/* Argument objects. */
+{
+    Tk_Window tkwin = (Tk_Window)clientData;
+    Tcl_Size skip = TkGetDisplayOf(interp, objc - 1, objv + 1, &tkwin);
+    TkDisplay *dispPtr;
+
+    if (skip < 0) {
+	return TCL_ERROR;
+    }
+    dispPtr = ((TkWindow *) tkwin)->dispPtr;
+    if (objc == 2 + skip) {
+	const char *string = Tcl_GetString(objv[objc-1]);
+
+	if (strcmp(string, "flush") != 0) {
+	    Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+		    "bad option \"%s\": must be flush", string));
+	    Tcl_SetErrorCode(interp, "TCL", "LOOKUP", "INDEX", "option",
+		    string, (char *)NULL);
+	    return TCL_ERROR;
+	}
+	TkPixmapPoolFlush(dispPtr);
+    } else if (objc != 1 + skip) {
+	Tcl_WrongNumArgs(interp, 1, objv, "?-displayof window? ?flush?");
+	return TCL_ERROR;
+    }
+    Tcl_SetObjResult(interp, TkPixmapPoolStats(dispPtr));
+    return TCL_OK;
+}
 
 /*
  *----------------------------------------------------------------------
@@ -905,6 +905,22 @@ EXTERN int		Tk_MeasureCharsInContext(Tk_Font tkfont,
 				Tcl_Size rangeStart, Tcl_Size rangeLength,
 				int maxPixels, int flags, int *lengthPtr);
 /* 294 */
+EXTERN int		Tk_PhotoLockBuffer(Tcl_Interp *interp,
+				Tk_PhotoHandle handle, int width, int height,
+				Tk_PhotoImageBlock *blockPtr);
+/* 295 */
+EXTERN void		Tk_PhotoCommitBuffer(Tk_PhotoHandle handle, int x,
+				int y, int width, int height, int flags);
+/* 296 */
+EXTERN int		Tk_CanvasSetCoords(Tcl_Interp *interp,
+				Tk_Window tkwin, Tcl_Obj *tagOrIdObj,
+				const double *coords, Tcl_Size numCoords,
+				int flags);
+/* 297 */
+EXTERN int		Tk_CanvasGetCoords(Tcl_Interp *interp,
+				Tk_Window tkwin, Tcl_Obj *tagOrIdObj,
+				Tcl_Size *numCoordsPtr, double **coordsPtr);
+/* 298 */
 EXTERN void		TkUnusedStubEntry(void);
 
 typedef struct {
@@ -1212,7 +1228,11 @@ typedef struct TkStubs {
     void (*tk_UnderlineCharsInContext) (Display *display, Drawable drawable, GC gc, Tk_Font tkfont, const char *string, Tcl_Size numBytes, int x, int y, Tcl_Size firstByte, Tcl_Size lastByte); /* 291 */
     void (*tk_DrawCharsInContext) (Display *display, Drawable drawable, GC gc, Tk_Font tkfont, const char *string, Tcl_Size numBytes, Tcl_Size rangeStart, Tcl_Size rangeLength, int x, int y); /* 292 */
     int (*tk_MeasureCharsInContext) (Tk_Font tkfont, const char *string, Tcl_Size numBytes, Tcl_Size rangeStart, Tcl_Size rangeLength, int maxPixels, int flags, int *lengthPtr); /* 293 */
-    void (*tkUnusedStubEntry) (void); /* 294 */
+    int (*tk_PhotoLockBuffer) (Tcl_Interp *interp, Tk_PhotoHandle handle, int width, int height, Tk_PhotoImageBlock *blockPtr); /* 294 */
+    void (*tk_PhotoCommitBuffer) (Tk_PhotoHandle handle, int x, int y, int width, int height, int flags); /* 295 */
+    int (*tk_CanvasSetCoords) (Tcl_Interp *interp, Tk_Window tkwin, Tcl_Obj *tagOrIdObj, const double *coords, Tcl_Size numCoords, int flags); /* 296 */
+    int (*tk_CanvasGetCoords) (Tcl_Interp *interp, Tk_Window tkwin, Tcl_Obj *tagOrIdObj, Tcl_Size *numCoordsPtr, double **coordsPtr); /* 297 */
+    void (*tkUnusedStubEntry) (void); /* 298 */
 } TkStubs;
 
 extern const TkStubs *tkStubsPtr;
@@ -1798,8 +1818,16 @@ extern const TkStubs *tkStubsPtr;
 	(tkStubsPtr->tk_DrawCharsInContext) /* 292 */
 #define Tk_MeasureCharsInContext \
 	(tkStubsPtr->tk_MeasureCharsInContext) /* 293 */
+#define Tk_PhotoLockBuffer \
+	(tkStubsPtr->tk_PhotoLockBuffer) /* 294 */
+#define Tk_PhotoCommitBuffer \
+	(tkStubsPtr->tk_PhotoCommitBuffer) /* 295 */
+#define Tk_CanvasSetCoords \
+	(tkStubsPtr->tk_CanvasSetCoords) /* 296 */
+#define Tk_CanvasGetCoords \
+	(tkStubsPtr->tk_CanvasGetCoords) /* 297 */
 #define TkUnusedStubEntry \
-	(tkStubsPtr->tkUnusedStubEntry) /* 294 */
+	(tkStubsPtr->tkUnusedStubEntry) /* 298 */
 
 #endif /* defined(USE_TK_STUBS) */
 
@@ -1685,8 +1685,7 @@ DisplayEntry(
      * on-screen image has been cleared.
      */
 
-    pixmap = Tk_GetPixmap(entryPtr->display, Tk_WindowId(tkwin),
-	    Tk_Width(tkwin), Tk_Height(tkwin), Tk_Depth(tkwin));
+    pixmap = TkGetBufferPixmap(tkwin, Tk_Width(tkwin), Tk_Height(tkwin));
 #else
     pixmap = Tk_WindowId(tkwin);
 #endif /* TK_NO_DOUBLE_BUFFERING */
@@ -1972,7 +1971,7 @@ DisplayEntry(
     XCopyArea(entryPtr->display, pixmap, Tk_WindowId(tkwin), entryPtr->textGC,
 	    0, 0, (unsigned) Tk_Width(tkwin), (unsigned) Tk_Height(tkwin),
 	    0, 0);
-    Tk_FreePixmap(entryPtr->display, pixmap);
+    TkFreeBufferPixmap(tkwin, pixmap);
 #endif /* TK_NO_DOUBLE_BUFFERING */
     entryPtr->flags &= ~BORDER_NEEDED;
 }
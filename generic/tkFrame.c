@@ -1498,10 +1498,9 @@ DisplayFrame(
      * crashes, see [610aa08858].
      */
 
-    pixmap = Tk_GetPixmap(framePtr->display, Tk_WindowId(tkwin),
+    pixmap = TkGetBufferPixmap(tkwin,
 	(Tk_Width(tkwin) > 0 ? Tk_Width(tkwin) : 1),
-	(Tk_Height(tkwin) > 0 ? Tk_Height(tkwin) : 1),
-	Tk_Depth(tkwin));
+	(Tk_Height(tkwin) > 0 ? Tk_Height(tkwin) : 1));
 #else
     pixmap = Tk_WindowId(tkwin);
     Tk_ClipDrawableToRect(Tk_Display(tkwin), pixmap, 0, 0,
@@ -1651,7 +1650,7 @@ DisplayFrame(
 	    (unsigned) (Tk_Width(tkwin) - 2 * highlightWidth),
 	    (unsigned) (Tk_Height(tkwin) - 2 * highlightWidth),
 	    highlightWidth, highlightWidth);
-    Tk_FreePixmap(framePtr->display, pixmap);
+    TkFreeBufferPixmap(tkwin, pixmap);
 #endif /* TK_NO_DOUBLE_BUFFERING */
 }
 
@@ -109,15 +109,66 @@ static const char GIF89a[] = {			/* ASCII GIF89a */
 typedef struct {
     const char *fromData;
     unsigned char workingBuffer[280];
-    struct {
-	int bytes;
-	int done;
-	unsigned int window;
-	int bitsInWindow;
-	unsigned char *c;
-    } reader;
+    unsigned char *dataStart;	/* Start of inline data, for seeking. */
+    Tcl_Size dataLength;	/* Length of inline data. */
 } GIFImageConfig;
 
+/*
+ * A place in the GIF source that reading can go back to: a file offset, or
+ * for inline data the offset into the data together with the state of the
+ * base64 decoder there.
+ */
+
+typedef struct {
+    Tcl_WideInt offset;
+    int c;
+    int state;
+} GIFPosition;
+
+/*
+ * Reading frame N of an animated GIF requires stepping over all the frames
+ * before it. To avoid doing that over and over when an animation is played
+ * frame by frame, the first read of a frame other than the first one scans
+ * the whole GIF once and records where each frame starts, together with the
+ * state that reading the extensions before it would have built up. The
+ * result is kept in a small per-thread cache, keyed by the normalized file
+ * name, size and modification time of a file or by the length and a hash of
+ * the contents of inline data. A copy of inline data is kept with its index,
+ * so that data that only hashes the same is not taken for it.
+ */
+
+typedef struct {
+    GIFPosition pos;		/* Position of the image separator. */
+    GIFGraphicControlExtensionBlock gce;
+				/* Graphic control extension in scope. */
+    Tcl_Obj *metadataObj;	/* Metadata from extensions before the frame,
+				 * or NULL if there is none. */
+} GIFFrame;
+
+typedef struct GIFFrameIndex {
+    Tcl_Obj *pathObj;		/* Normalized file name, or NULL for inline
+				 * data. */
+    Tcl_WideInt size;		/* Length of the file or data. */
+    Tcl_WideInt stamp;		/* Modification time of the file, or hash of
+				 * the data. */
+    unsigned char *data;	/* Copy of the inline data, or NULL for a
+				 * file. */
+    int numFrames;
+    GIFFrame *frames;
+    struct GIFFrameIndex *nextPtr;
+				/* Next index in the cache; the list is kept
+				 * in most recently used order. */
+} GIFFrameIndex;
+
+#define GIF_INDEX_CACHE_SIZE	8
+
+typedef struct {
+    GIFFrameIndex *indexList;	/* Cached frame indexes. */
+    int exitHandlerSet;		/* Whether the cache is freed on thread
+				 * exit. */
+} ThreadSpecificData;
+static Tcl_ThreadDataKey dataKey;
+
 /*
  * Type of a function used to do the writing to a file or buffer when
  * serializing in the GIF format.
@@ -193,10 +244,17 @@ static int		DoExtension(GIFImageConfig *gifConfPtr,
 			    GIFGraphicControlExtensionBlock
 			    *gifGraphicControlExtensionBlock,
 			    Tcl_Obj *metadataOutObj);
-static int		GetCode(Tcl_Channel chan, int code_size, int flag,
-			    GIFImageConfig *gifConfPtr);
+static int		BuildFrameIndex(GIFImageConfig *gifConfPtr,
+			    Tcl_Channel chan, GIFFrameIndex *indexPtr);
+static size_t		DecodeLZW(const unsigned char *data, size_t dataLen,
+			    int initialCodeSize, unsigned char *out,
+			    size_t outLen);
+static void		FreeFrameIndex(GIFFrameIndex *indexPtr);
+static void		FreeFrameIndexes(void *clientData);
 static int		GetDataBlock(GIFImageConfig *gifConfPtr,
 			    Tcl_Channel chan, unsigned char *buf);
+static int		GetPosition(GIFImageConfig *gifConfPtr,
+			    Tcl_Channel chan, GIFPosition *posPtr);
 static int		ReadColorMap(GIFImageConfig *gifConfPtr,
 			    Tcl_Channel chan, int number,
 			    unsigned char buffer[MAXCOLORMAPSIZE][4]);
@@ -207,6 +265,15 @@ static int		ReadImage(GIFImageConfig *gifConfPtr,
 			    Tcl_Channel chan, int len, int rows,
 			    unsigned char cmap[MAXCOLORMAPSIZE][4], int srcX,
 			    int srcY, int interlace, int transparent);
+static int		SeekFrame(Tcl_Interp *interp,
+			    GIFImageConfig *gifConfPtr, Tcl_Channel chan,
+			    const char *fileName, int index,
+			    GIFGraphicControlExtensionBlock *gcePtr,
+			    Tcl_Obj *metadataOutObj, unsigned char *buf);
+static int		SetPosition(GIFImageConfig *gifConfPtr,
+			    Tcl_Channel chan, const GIFPosition *posPtr);
+static int		SkipImage(GIFImageConfig *gifConfPtr,
+			    Tcl_Interp *interp, Tcl_Channel chan);
 
 /*
  * these are for the BASE64 image reader code only
@@ -427,7 +494,6 @@ FileReadGIF(
     Tcl_Size objc = 0, i;
     Tcl_Obj **objv;
     unsigned char buf[100];
-    unsigned char *trashBuffer = NULL;
     int bitPixel;
     int gifLabel;
     unsigned char colorMap[MAXCOLORMAPSIZE][4];
@@ -447,6 +513,8 @@ FileReadGIF(
     memset(gifConfPtr, 0, sizeof(GIFImageConfig));
     if (fileName == INLINE_DATA_BINARY || fileName == INLINE_DATA_BASE64) {
 	gifConfPtr->fromData = fileName;
+	gifConfPtr->dataStart = ((MFile *) chan)->data;
+	gifConfPtr->dataLength = ((MFile *) chan)->length;
 	fileName = "inline data";
     }
 
@@ -550,7 +618,22 @@ FileReadGIF(
      */
 
     /*
-     * Search for the frame from the GIF to display.
+     * Go straight to the frame from the GIF to display if it is not the first
+     * one and the frame index allows it.
+     */
+
+    if (index > 0) {
+	switch (SeekFrame(interp, gifConfPtr, chan, fileName, index,
+		&gifGraphicControlExtensionBlock, metadataOutObj, buf)) {
+	case TCL_OK:
+	    goto frameFound;
+	case TCL_ERROR:
+	    goto error;
+	}
+    }
+
+    /*
+     * Otherwise search for it.
      */
 
     while (1) {
@@ -603,22 +686,15 @@ FileReadGIF(
 	    continue;
 	}
 
-	/*
-	 * We've read the header for a GIF frame. Work out what we are going
-	 * to do about it.
-	 */
-
-	imageWidth = LM_to_uint(buf[4], buf[5]);
-	imageHeight = LM_to_uint(buf[6], buf[7]);
-	bitPixel = 1 << ((buf[8] & 0x07) + 1);
-
 	if (index--) {
 	    /*
-	     * This is not the GIF frame we want to read: skip it.
+	     * This is not the GIF frame we want to read: skip it. Its local
+	     * color map only applies to it, so leave the global one alone.
 	     */
 
 	    if (BitSet(buf[8], LOCALCOLORMAP)) {
-		if (!ReadColorMap(gifConfPtr, chan, bitPixel, colorMap)) {
+		if (!ReadColorMap(gifConfPtr, chan,
+			1 << ((buf[8] & 0x07) + 1), NULL)) {
 		    Tcl_SetObjResult(interp, Tcl_NewStringObj(
 			    "error reading color map", TCL_INDEX_NONE));
 		    Tcl_SetErrorCode(interp, "TK", "IMAGE", "GIF",
@@ -626,41 +702,7 @@ FileReadGIF(
 		    goto error;
 		}
 	    }
-
-	    /*
-	     * If we've not yet allocated a trash buffer, do so now.
-	     */
-
-	    if (trashBuffer == NULL) {
-		if (fileWidth > (int)((UINT_MAX/3)/fileHeight)) {
-		    goto error;
-		}
-		nBytes = fileWidth * fileHeight * 3;
-		trashBuffer = (unsigned char *)ckalloc(nBytes);
-		if (trashBuffer) {
-		    memset(trashBuffer, 0, nBytes);
-		}
-	    }
-
-	    /*
-	     * Slurp! Process the data for this image and stuff it in a trash
-	     * buffer.
-	     *
-	     * Yes, it might be more efficient here to *not* store the data
-	     * (we're just going to throw it away later). However, I elected
-	     * to implement it this way for good reasons. First, I wanted to
-	     * avoid duplicating the (fairly complex) LWZ decoder in
-	     * ReadImage. Fine, you say, why didn't you just modify it to
-	     * allow the use of a NULL specifier for the output buffer? I
-	     * tried that, but it negatively impacted the performance of what
-	     * I think will be the common case: reading the first image in the
-	     * file. Rather than marginally improve the speed of the less
-	     * frequent case, I chose to maintain high performance for the
-	     * common case.
-	     */
-
-	    if (ReadImage(gifConfPtr, interp, trashBuffer, chan, imageWidth,
-		    imageHeight, colorMap, 0, 0, 0, -1) != TCL_OK) {
+	    if (SkipImage(gifConfPtr, interp, chan) != TCL_OK) {
 		goto error;
 	    }
 
@@ -675,6 +717,16 @@ FileReadGIF(
 	break;
     }
 
+    /*
+     * We've read the header for the GIF frame we want to read. Work out what
+     * we are going to do about it.
+     */
+
+  frameFound:
+    imageWidth = LM_to_uint(buf[4], buf[5]);
+    imageHeight = LM_to_uint(buf[6], buf[7]);
+    bitPixel = 1 << ((buf[8] & 0x07) + 1);
+
     /*
      * Found the frame we want to read. Next, check for a local color map for
      * this frame.
@@ -891,14 +943,6 @@ FileReadGIF(
     result = TCL_OK;
 
 error:
-
-    /*
-     * If a trash buffer has been allocated, free it now.
-     */
-
-    if (trashBuffer != NULL) {
-	ckfree(trashBuffer);
-    }
     return result;
 }
 
@@ -1292,15 +1336,11 @@ GetDataBlock(
  *	Process a GIF image from a given source, with a given height, width,
  *	transparency, etc.
  *
- *	This code is based on the code found in the ImageMagick GIF decoder,
- *	which is © 2000 ImageMagick Studio.
- *
- *	Some thoughts on our implementation:
- *	It sure would be nice if ReadImage didn't take 11 parameters! I think
- *	that if we were smarter, we could avoid doing that.
- *
- *	Possible further optimizations: we could pull the GetCode function
- *	directly into ReadImage, which would improve our speed.
+ *	The compressed data of the image is first gathered from its data
+ *	sub-blocks into one buffer, which DecodeLZW turns into color indices
+ *	without going back to the source for every code. The indices are then
+ *	mapped through the color map into the rows of the image, taking care
+ *	of interlacing.
  *
  * Results:
  *	Processes a GIF image and loads the pixel data into a memory array.
@@ -1325,16 +1365,12 @@ ReadImage(
     int transparent)
 {
     unsigned char initialCodeSize;
-    int xpos = 0, ypos = 0, pass = 0, i, count;
-    unsigned char *pixelPtr;
+    int ypos = 0, pass = 0, i, count;
+    int pixelSize = (transparent >= 0) ? 4 : 3;
     static const int interlaceStep[] = { 8, 8, 4, 2 };
     static const int interlaceStart[] = { 0, 4, 2, 1 };
-    unsigned short prefix[(1 << MAX_LWZ_BITS)];
-    unsigned char append[(1 << MAX_LWZ_BITS)];
-    unsigned char stack[(1 << MAX_LWZ_BITS)*2];
-    unsigned char *top;
-    int codeSize, clearCode, inCode, endCode, oldCode, maxCode;
-    int code, firstCode, v;
+    unsigned char *data = NULL, *indices;
+    size_t dataLen = 0, dataSize = 0, numIndices;
 
     /*
      * Initialize the decoder
@@ -1360,310 +1396,668 @@ ReadImage(
 	cmap[transparent][CM_ALPHA] = 0;
     }
 
-    pixelPtr = imagePtr;
-
     /*
-     * Initialize the decoder.
-     *
-     * Set values for "special" numbers:
-     * clear code	reset the decoder
-     * end code		stop decoding
-     * code size	size of the next code to retrieve
-     * max code		next available table position
+     * Collect the data sub-blocks up to the terminating empty one. Data that
+     * stops early just leaves the rest of the image blank.
      */
 
-    clearCode = 1 << (int) initialCodeSize;
-    endCode = clearCode + 1;
-    codeSize = (int) initialCodeSize + 1;
-    maxCode = clearCode + 2;
-    oldCode = -1;
-    firstCode = -1;
-
-    memset(prefix, 0, (1 << MAX_LWZ_BITS) * sizeof(short));
-    memset(append, 0, (1 << MAX_LWZ_BITS) * sizeof(char));
-    for (i = 0; i < clearCode; i++) {
-	append[i] = i;
+    while ((count = GetDataBlock(gifConfPtr, chan,
+	    gifConfPtr->workingBuffer)) > 0) {
+	if (dataLen + count > dataSize) {
+	    dataSize = dataSize ? 2 * dataSize : 4096;
+	    data = (unsigned char *)ckrealloc(data, dataSize);
+	}
+	memcpy(data + dataLen, gifConfPtr->workingBuffer, count);
+	dataLen += count;
+    }
+    if (data == NULL) {
+	return TCL_OK;
     }
-    top = stack;
-
-    GetCode(chan, 0, 1, gifConfPtr);
 
     /*
-     * Read until we finish the image
+     * Decode to color indices, then map these to pixels row by row.
      */
 
-    for (i = 0, ypos = 0; i < rows; i++) {
-	for (xpos = 0; xpos < len; ) {
-	    if (top == stack) {
-		/*
-		 * Bummer - our stack is empty. Now we have to work!
-		 */
-
-		code = GetCode(chan, codeSize, 0, gifConfPtr);
-		if (code < 0) {
-		    return TCL_OK;
-		}
-
-		if (code > maxCode || code == endCode) {
-		    /*
-		     * If we're doing things right, we should never receive a
-		     * code that is greater than our current maximum code. If
-		     * we do, bail, because our decoder does not yet have that
-		     * code set up.
-		     *
-		     * If the code is the magic endCode value, quit.
-		     */
-
-		    return TCL_OK;
-		}
-
-		if (code == clearCode) {
-		    /*
-		     * Reset the decoder.
-		     */
+    indices = (unsigned char *)ckalloc((size_t) len * rows);
+    numIndices = DecodeLZW(data, dataLen, initialCodeSize, indices,
+	    (size_t) len * rows);
+    ckfree(data);
 
-		    codeSize = initialCodeSize + 1;
-		    maxCode = clearCode + 2;
-		    oldCode = -1;
-		    continue;
-		}
+    for (i = 0; (size_t) i * len < numIndices; i++) {
+	const unsigned char *srcPtr = indices + (size_t) i * len;
+	unsigned char *pixelPtr = imagePtr + (size_t) ypos * len * pixelSize;
+	int xpos, width = len;
 
-		if (oldCode == -1) {
-		    /*
-		     * Last pass reset the decoder, so the first code we see
-		     * must be a singleton. Seed the stack with it, and set up
-		     * the old/first code pointers for insertion into the
-		     * codes table. We can't just roll this into the clearCode
-		     * test above, because at that point we have not yet read
-		     * the next code.
-		     */
-
-		    *top++ = append[code];
-		    oldCode = code;
-		    firstCode = code;
-		    continue;
-		}
+	if ((size_t) i * len + width > numIndices) {
+	    width = (int) (numIndices - (size_t) i * len);
+	}
+	if (pixelSize == 4) {
+	    for (xpos = 0; xpos < width; xpos++) {
+		memcpy(pixelPtr, cmap[srcPtr[xpos]], 4);
+		pixelPtr += 4;
+	    }
+	} else {
+	    for (xpos = 0; xpos < width; xpos++) {
+		const unsigned char *colorPtr = cmap[srcPtr[xpos]];
 
-		inCode = code;
+		*pixelPtr++ = colorPtr[CM_RED];
+		*pixelPtr++ = colorPtr[CM_GREEN];
+		*pixelPtr++ = colorPtr[CM_BLUE];
+	    }
+	}
 
-		if ((code == maxCode) && (maxCode < (1 << MAX_LWZ_BITS))) {
-		    /*
-		     * maxCode is always one bigger than our highest assigned
-		     * code. If the code we see is equal to maxCode, then we
-		     * are about to add a new entry to the codes table.
-		     */
+	/*
+	 * If interlacing, the next ypos is not just +1.
+	 */
 
-		    *top++ = firstCode;
-		    code = oldCode;
+	if (interlace) {
+	    ypos += interlaceStep[pass];
+	    while (ypos >= rows) {
+		pass++;
+		if (pass > 3) {
+		    goto done;
 		}
+		ypos = interlaceStart[pass];
+	    }
+	} else {
+	    ypos++;
+	}
+    }
 
-		while (code > clearCode) {
-		    /*
-		     * Populate the stack by tracing the code in the codes
-		     * table from its tail to its head
-		     */
-
-		    *top++ = append[code];
-		    code = prefix[code];
-		}
-		firstCode = append[code];
+  done:
+    ckfree(indices);
+    return TCL_OK;
+}
 
-		/*
-		 * Push the head of the code onto the stack.
-		 */
+/*
+ *----------------------------------------------------------------------
+ *
+ * DecodeLZW --
+ *
+ *	Decompresses the LZW data of a GIF image into color indices. The codes
+ *	are between 3 and 12 bits long and are packed into bytes least
+ *	significant bit first, for example:
+ *		bbbaaaaa
+ *		dcccccbb
+ *		eeeedddd
+ *		...
+ *	For each code the table holds the length of its string and its first
+ *	and last byte, so a code's string is written directly into place from
+ *	its end backwards instead of going through a stack.
+ *
+ * Results:
+ *	The number of indices stored in out, which is less than outLen if the
+ *	data ends early or is corrupt.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-		*top++ = firstCode;
+static size_t
+DecodeLZW(
+    const unsigned char *data,	/* The compressed data. */
+    size_t dataLen,		/* Number of bytes of data. */
+    int initialCodeSize,	/* LZW minimum code size from the image. */
+    unsigned char *out,		/* Where to put the color indices. */
+    size_t outLen)		/* Number of indices wanted. */
+{
+    unsigned short prefix[1 << MAX_LWZ_BITS];
+    unsigned short length[1 << MAX_LWZ_BITS];
+    unsigned char suffix[1 << MAX_LWZ_BITS];
+    unsigned char first[1 << MAX_LWZ_BITS];
+    int clearCode = 1 << initialCodeSize, endCode = clearCode + 1;
+    int codeSize = initialCodeSize + 1, codeMask = (1 << codeSize) - 1;
+    int nextCode = clearCode + 2, oldCode = -1, code, i;
+    unsigned int window = 0;
+    int bitsInWindow = 0;
+    size_t pos = 0, n = 0;
+
+    memset(prefix, 0, sizeof(prefix));
+    memset(length, 0, sizeof(length));
+    memset(suffix, 0, sizeof(suffix));
+    memset(first, 0, sizeof(first));
+    for (i = 0; i < clearCode; i++) {
+	suffix[i] = first[i] = (unsigned char) i;
+	length[i] = 1;
+    }
 
-		if (maxCode < (1 << MAX_LWZ_BITS)) {
-		    /*
-		     * If there's still room in our codes table, add a new entry.
-		     * Otherwise don't, and keep using the current table.
-		     * See DEFERRED CLEAR CODE IN LZW COMPRESSION in the GIF89a
-		     * specification.
-		     */
+    while (n < outLen) {
+	int stringCode, c;
+	size_t end, p;
 
-		    prefix[maxCode] = oldCode;
-		    append[maxCode] = firstCode;
-		    maxCode++;
-		}
+	while (bitsInWindow < codeSize) {
+	    if (pos >= dataLen) {
+		return n;
+	    }
+	    window |= (unsigned int) data[pos++] << bitsInWindow;
+	    bitsInWindow += 8;
+	}
+	code = window & codeMask;
+	window >>= codeSize;
+	bitsInWindow -= codeSize;
+
+	if (code == clearCode) {
+	    codeSize = initialCodeSize + 1;
+	    codeMask = (1 << codeSize) - 1;
+	    nextCode = clearCode + 2;
+	    oldCode = -1;
+	    continue;
+	}
 
-		/*
-		 * maxCode tells us the maximum code value we can accept. If
-		 * we see that we need more bits to represent it than we are
-		 * requesting from the unpacker, we need to increase the
-		 * number we ask for.
-		 */
+	/*
+	 * A code that is not in the table yet cannot be decoded, so stop
+	 * there as at the end code.
+	 */
 
-		if ((maxCode >= (1 << codeSize))
-			&& (maxCode < (1<<MAX_LWZ_BITS))) {
-		    codeSize++;
-		}
-		oldCode = inCode;
-	    }
+	if (code == endCode || code > nextCode) {
+	    break;
+	}
 
+	if (oldCode == -1) {
 	    /*
-	     * Pop the next color index off the stack.
+	     * The first code after a reset must be a single byte.
 	     */
 
-	    v = *(--top);
-	    if (v < 0) {
-		return TCL_OK;
-	    }
+	    out[n++] = suffix[code];
+	    oldCode = code;
+	    continue;
+	}
 
-	    /*
-	     * If pixelPtr is null, we're skipping this image (presumably
-	     * there are more in the file and we will be called to read one of
-	     * them later)
-	     */
+	/*
+	 * Write out the string for the code. A code just about to be added to
+	 * the table stands for the previous string followed by its own first
+	 * byte.
+	 */
 
-	    *pixelPtr++ = cmap[v][CM_RED];
-	    *pixelPtr++ = cmap[v][CM_GREEN];
-	    *pixelPtr++ = cmap[v][CM_BLUE];
-	    if (transparent >= 0) {
-		*pixelPtr++ = cmap[v][CM_ALPHA];
+	if (code < nextCode) {
+	    stringCode = code;
+	    end = n + length[code];
+	    p = end;
+	} else {
+	    stringCode = oldCode;
+	    end = n + length[oldCode] + 1;
+	    p = end - 1;
+	    if (p < outLen) {
+		out[p] = first[oldCode];
 	    }
-	    xpos++;
-
 	}
+	c = first[stringCode];
+	while (p > n) {
+	    p--;
+	    if (p < outLen) {
+		out[p] = suffix[stringCode];
+	    }
+	    stringCode = prefix[stringCode];
+	}
+	n = end;
 
 	/*
-	 * If interlacing, the next ypos is not just +1.
+	 * Add the previous string plus the first byte of this one to the
+	 * table, if there's still room. Otherwise keep using the current table;
+	 * see DEFERRED CLEAR CODE IN LZW COMPRESSION in the GIF89a
+	 * specification.
 	 */
 
-	if (interlace) {
-	    ypos += interlaceStep[pass];
-	    while (ypos >= rows) {
-		pass++;
-		if (pass > 3) {
-		    return TCL_OK;
-		}
-		ypos = interlaceStart[pass];
+	if (nextCode < (1 << MAX_LWZ_BITS)) {
+	    prefix[nextCode] = oldCode;
+	    suffix[nextCode] = c;
+	    first[nextCode] = first[oldCode];
+	    length[nextCode] = length[oldCode] + 1;
+	    nextCode++;
+	    if ((nextCode >= (1 << codeSize)) && (codeSize < MAX_LWZ_BITS)) {
+		codeSize++;
+		codeMask = (1 << codeSize) - 1;
 	    }
-	} else {
-	    ypos++;
 	}
-	pixelPtr = imagePtr + (ypos) * len * ((transparent>=0)?4:3);
+	oldCode = code;
     }
+    return (n < outLen) ? n : outLen;
+}
 
-    /*
-     * Now read until the final zero byte.
-     * It was observed that there might be 1 length blocks
-     * (test imgPhoto-14.1) which are not read.
-     *
-     * The field "stack" is abused for temporary buffer. it has 4096 bytes
-     * and we need 256.
-     *
-     * Loop until we hit a 0 length block which is the end sign.
-     */
-    while ( 0 < (count = GetDataBlock(gifConfPtr, chan, stack)))
-    {
-	if (-1 == count ) {
+/*
+ *----------------------------------------------------------------------
+ *
+ * SkipImage --
+ *
+ *	Steps over the compressed data of a GIF image that is not going to be
+ *	displayed, without decoding it.
+ *
+ * Results:
+ *	A standard Tcl result. If an error occurs and interp is not NULL, an
+ *	error message is left in it.
+ *
+ * Side effects:
+ *	The access position in the source advances past the image data.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SkipImage(
+    GIFImageConfig *gifConfPtr,
+    Tcl_Interp *interp,		/* For error messages, or NULL. */
+    Tcl_Channel chan)
+{
+    unsigned char initialCodeSize;
+    int count;
+
+    if (Fread(gifConfPtr, &initialCodeSize, 1, 1, chan) <= 0) {
+	if (interp) {
 	    Tcl_SetObjResult(interp, Tcl_ObjPrintf(
 		    "error reading GIF image: %s", Tcl_PosixError(interp)));
-	    return TCL_ERROR;
 	}
+	return TCL_ERROR;
+    }
+    if (initialCodeSize > MAX_LWZ_BITS) {
+	if (interp) {
+	    Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		    "malformed image", TCL_INDEX_NONE));
+	    Tcl_SetErrorCode(interp, "TK", "IMAGE", "GIF", "MALFORMED",
+		    (char *)NULL);
+	}
+	return TCL_ERROR;
     }
+    do {
+	count = GetDataBlock(gifConfPtr, chan, gifConfPtr->workingBuffer);
+    } while (count > 0);
     return TCL_OK;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * GetCode --
+ * GetPosition, SetPosition --
  *
- *	Extract the next compression code from the file. In GIF's, the
- *	compression codes are between 3 and 12 bits long and are then packed
- *	into 8 bit bytes, left to right, for example:
- *		bbbaaaaa
- *		dcccccbb
- *		eeeedddd
- *		...
- *	We use a byte buffer read from the file and a sliding window to unpack
- *	the bytes. Thanks to ImageMagick for the sliding window idea.
- *	args:  chan	    the channel to read from
- *	       code_size    size of the code to extract
- *	       flag	    boolean indicating whether the extractor should be
- *			    reset or not
+ *	Remember the current position in the GIF source, and go back to a
+ *	remembered one.
  *
  * Results:
- *	code		    the next compression code
+ *	1 on success, or 0 if the source is a channel that cannot seek.
  *
  * Side effects:
- *	May consume more input from chan.
+ *	SetPosition changes the access position in the source.
  *
  *----------------------------------------------------------------------
  */
 
 static int
-GetCode(
+GetPosition(
+    GIFImageConfig *gifConfPtr,
     Tcl_Channel chan,
-    int code_size,
-    int flag,
-    GIFImageConfig *gifConfPtr)
+    GIFPosition *posPtr)
 {
-    int ret;
-
-    if (flag) {
-	/*
-	 * Initialize the decoder.
-	 */
+    if (gifConfPtr->fromData) {
+	MFile *handle = (MFile *) chan;
 
-	gifConfPtr->reader.bitsInWindow = 0;
-	gifConfPtr->reader.bytes = 0;
-	gifConfPtr->reader.window = 0;
-	gifConfPtr->reader.done = 0;
-	gifConfPtr->reader.c = NULL;
-	return 0;
+	posPtr->offset = handle->data - gifConfPtr->dataStart;
+	posPtr->c = handle->c;
+	posPtr->state = handle->state;
+	return 1;
     }
+    posPtr->offset = Tcl_Tell(chan);
+    posPtr->c = posPtr->state = 0;
+    return (posPtr->offset >= 0);
+}
 
-    while (gifConfPtr->reader.bitsInWindow < code_size) {
-	/*
-	 * Not enough bits in our window to cover the request.
-	 */
+static int
+SetPosition(
+    GIFImageConfig *gifConfPtr,
+    Tcl_Channel chan,
+    const GIFPosition *posPtr)
+{
+    if (gifConfPtr->fromData) {
+	MFile *handle = (MFile *) chan;
 
-	if (gifConfPtr->reader.done) {
-	    return -1;
+	if (posPtr->offset > gifConfPtr->dataLength) {
+	    return 0;
 	}
-	if (gifConfPtr->reader.bytes == 0) {
-	    /*
-	     * Not enough bytes in our buffer to add to the window.
-	     */
+	handle->data = gifConfPtr->dataStart + posPtr->offset;
+	handle->length = gifConfPtr->dataLength - posPtr->offset;
+	handle->c = posPtr->c;
+	handle->state = posPtr->state;
+	return 1;
+    }
+    return (Tcl_Seek(chan, posPtr->offset, SEEK_SET) >= 0);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BuildFrameIndex --
+ *
+ *	Scans the frames of a GIF from the current position, which must be
+ *	just after the global color map, to its end, and records where each
+ *	frame starts and the state of the extensions before it.
+ *
+ * Results:
+ *	1 if the whole GIF could be scanned, 0 otherwise.
+ *
+ * Side effects:
+ *	The access position in the source advances. The frames of indexPtr
+ *	are filled in; they must be released with FreeFrameIndex even on
+ *	failure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+BuildFrameIndex(
+    GIFImageConfig *gifConfPtr,
+    Tcl_Channel chan,
+    GIFFrameIndex *indexPtr)
+{
+    GIFGraphicControlExtensionBlock gce;
+    Tcl_Obj *metadataObj = Tcl_NewDictObj(), *snapshotObj = NULL;
+    int numAllocated = 0, changed = 0, ok = 0;
+    unsigned char label, buf[9];
+
+    Tcl_IncrRefCount(metadataObj);
+    memset(&gce, 0, sizeof(gce));
+
+    while (1) {
+	GIFPosition pos;
+	GIFFrame *framePtr;
 
-	    gifConfPtr->reader.bytes =
-		    GetDataBlock(gifConfPtr, chan, gifConfPtr->workingBuffer);
-	    gifConfPtr->reader.c = gifConfPtr->workingBuffer;
-	    if (gifConfPtr->reader.bytes <= 0) {
-		gifConfPtr->reader.done = 1;
+	if (!GetPosition(gifConfPtr, chan, &pos)
+		|| (Fread(gifConfPtr, &label, 1, 1, chan) != 1)) {
+	    break;
+	}
+	if (label == GIF_TERMINATOR) {
+	    ok = 1;
+	    break;
+	} else if (label == GIF_EXTENSION) {
+	    if ((Fread(gifConfPtr, &label, 1, 1, chan) != 1)
+		    || (DoExtension(gifConfPtr, chan, label,
+			    gifConfPtr->workingBuffer, &gce, metadataObj) < 0)) {
 		break;
 	    }
+	    if (label == 0xfe) {
+		changed = 1;
+	    }
+	    continue;
+	} else if (label != GIF_START) {
+	    continue;
 	}
 
 	/*
-	 * Tack another byte onto the window, see if that's enough.
+	 * An image: remember where it starts, then step over it.
 	 */
 
-	gifConfPtr->reader.window +=
-		(*gifConfPtr->reader.c) << gifConfPtr->reader.bitsInWindow;
-	gifConfPtr->reader.c++;
-	gifConfPtr->reader.bitsInWindow += 8;
-	gifConfPtr->reader.bytes--;
+	if ((Fread(gifConfPtr, buf, 1, 9, chan) != 9)
+		|| (BitSet(buf[8], LOCALCOLORMAP) && !ReadColorMap(gifConfPtr,
+			chan, 1 << ((buf[8] & 0x07) + 1), NULL))
+		|| (SkipImage(gifConfPtr, NULL, chan) != TCL_OK)) {
+	    break;
+	}
+	if (changed) {
+	    if (snapshotObj) {
+		Tcl_DecrRefCount(snapshotObj);
+	    }
+	    snapshotObj = Tcl_DuplicateObj(metadataObj);
+	    Tcl_IncrRefCount(snapshotObj);
+	    changed = 0;
+	}
+	if (indexPtr->numFrames >= numAllocated) {
+	    numAllocated = numAllocated ? 2 * numAllocated : 16;
+	    indexPtr->frames = (GIFFrame *)ckrealloc(indexPtr->frames,
+		    numAllocated * sizeof(GIFFrame));
+	}
+	framePtr = &indexPtr->frames[indexPtr->numFrames++];
+	framePtr->pos = pos;
+	framePtr->gce = gce;
+	framePtr->metadataObj = snapshotObj;
+	if (snapshotObj) {
+	    Tcl_IncrRefCount(snapshotObj);
+	}
+	gce.blockPresent = 0;
+    }
+
+    if (snapshotObj) {
+	Tcl_DecrRefCount(snapshotObj);
+    }
+    Tcl_DecrRefCount(metadataObj);
+    return ok;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeFrameIndex, FreeFrameIndexes --
+ *
+ *	Release a frame index, or all the frame indexes cached by the current
+ *	thread when it exits.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeFrameIndex(
+    GIFFrameIndex *indexPtr)
+{
+    int i;
+
+    for (i = 0; i < indexPtr->numFrames; i++) {
+	if (indexPtr->frames[i].metadataObj) {
+	    Tcl_DecrRefCount(indexPtr->frames[i].metadataObj);
+	}
+    }
+    if (indexPtr->frames) {
+	ckfree(indexPtr->frames);
+    }
+    if (indexPtr->pathObj) {
+	Tcl_DecrRefCount(indexPtr->pathObj);
+    }
+    if (indexPtr->data) {
+	ckfree(indexPtr->data);
+    }
+    ckfree(indexPtr);
+}
+
+static void
+FreeFrameIndexes(
+    TCL_UNUSED(void *))
+{
+    ThreadSpecificData *tsdPtr = (ThreadSpecificData *)
+	    Tcl_GetThreadData(&dataKey, sizeof(ThreadSpecificData));
+
+    while (tsdPtr->indexList) {
+	GIFFrameIndex *indexPtr = tsdPtr->indexList;
+
+	tsdPtr->indexList = indexPtr->nextPtr;
+	FreeFrameIndex(indexPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SeekFrame --
+ *
+ *	Moves to the frame with the given index, using the cached frame index
+ *	for the GIF or building one if there is none yet. The current position
+ *	must be just after the global color map.
+ *
+ * Results:
+ *	TCL_OK if the frame was found; its image descriptor has then been read
+ *	into buf, and the graphic control extension and metadata in scope for
+ *	it have been set. TCL_ERROR with a message in interp if there is no
+ *	such frame. TCL_CONTINUE if the index cannot be used, in which case the
+ *	position is unchanged and the caller should search for the frame.
+ *
+ * Side effects:
+ *	The access position in the source changes. A frame index may be built
+ *	and cached.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SeekFrame(
+    Tcl_Interp *interp,
+    GIFImageConfig *gifConfPtr,
+    Tcl_Channel chan,
+    const char *fileName,
+    int index,
+    GIFGraphicControlExtensionBlock *gcePtr,
+    Tcl_Obj *metadataOutObj,
+    unsigned char *buf)
+{
+    ThreadSpecificData *tsdPtr = (ThreadSpecificData *)
+	    Tcl_GetThreadData(&dataKey, sizeof(ThreadSpecificData));
+    GIFFrameIndex *indexPtr, **prevPtrPtr;
+    GIFPosition start;
+    GIFFrame *framePtr;
+    Tcl_Obj *pathObj = NULL;
+    Tcl_WideInt size, stamp;
+    unsigned char label;
+    int numIndexes = 0;
+
+    if (!GetPosition(gifConfPtr, chan, &start)) {
+	return TCL_CONTINUE;
     }
 
     /*
-     * The next code will always be the last code_size bits of the window.
+     * Work out the cache key.
      */
 
-    ret = gifConfPtr->reader.window & ((1 << code_size) - 1);
+    if (gifConfPtr->fromData) {
+	Tcl_WideUInt hash = 0;
+	Tcl_Size i;
+
+	for (i = 0; i < gifConfPtr->dataLength; i++) {
+	    hash = hash * 1000003 + gifConfPtr->dataStart[i];
+	}
+	size = gifConfPtr->dataLength;
+	stamp = (Tcl_WideInt) hash;
+    } else {
+	Tcl_StatBuf *statBuf = Tcl_AllocStatBuf();
+	Tcl_Obj *nameObj = Tcl_NewStringObj(fileName, TCL_INDEX_NONE);
+
+	Tcl_IncrRefCount(nameObj);
+	pathObj = Tcl_FSGetNormalizedPath(NULL, nameObj);
+	if (pathObj && (Tcl_FSStat(pathObj, statBuf) == 0)) {
+	    pathObj = Tcl_DuplicateObj(pathObj);
+	    Tcl_IncrRefCount(pathObj);
+	    size = (Tcl_WideInt) Tcl_GetSizeFromStat(statBuf);
+	    stamp = Tcl_GetModificationTimeFromStat(statBuf);
+	} else {
+	    pathObj = NULL;
+	}
+	Tcl_DecrRefCount(nameObj);
+	ckfree(statBuf);
+	if (pathObj == NULL) {
+	    return TCL_CONTINUE;
+	}
+    }
 
     /*
-     * Shift data in the window to put the next code at the end.
+     * Look the GIF up in the cache, moving it to the front if found. If it
+     * is not there, build its index and add it, forgetting the least
+     * recently used one if the cache is full.
      */
 
-    gifConfPtr->reader.window >>= code_size;
-    gifConfPtr->reader.bitsInWindow -= code_size;
-    return ret;
+    for (prevPtrPtr = &tsdPtr->indexList; *prevPtrPtr != NULL;
+	    prevPtrPtr = &(*prevPtrPtr)->nextPtr) {
+	indexPtr = *prevPtrPtr;
+	if ((indexPtr->size == size) && (indexPtr->stamp == stamp)
+		&& ((indexPtr->pathObj == NULL) == (pathObj == NULL))
+		&& (pathObj == NULL || !strcmp(Tcl_GetString(pathObj),
+			Tcl_GetString(indexPtr->pathObj)))
+		&& (indexPtr->data == NULL || !memcmp(indexPtr->data,
+			gifConfPtr->dataStart, size))) {
+	    *prevPtrPtr = indexPtr->nextPtr;
+	    break;
+	}
+    }
+    if (*prevPtrPtr == NULL) {
+	indexPtr = (GIFFrameIndex *)ckalloc(sizeof(GIFFrameIndex));
+	memset(indexPtr, 0, sizeof(GIFFrameIndex));
+	indexPtr->size = size;
+	indexPtr->stamp = stamp;
+	indexPtr->pathObj = pathObj;
+	pathObj = NULL;
+	if (gifConfPtr->fromData) {
+	    indexPtr->data = (unsigned char *)attemptckalloc(size ? size : 1);
+	    if (indexPtr->data == NULL) {
+		FreeFrameIndex(indexPtr);
+		return TCL_CONTINUE;
+	    }
+	    memcpy(indexPtr->data, gifConfPtr->dataStart, size);
+	}
+	if (!BuildFrameIndex(gifConfPtr, chan, indexPtr)) {
+	    FreeFrameIndex(indexPtr);
+	    SetPosition(gifConfPtr, chan, &start);
+	    return TCL_CONTINUE;
+	}
+	if (!tsdPtr->exitHandlerSet) {
+	    TkCreateThreadExitHandler(FreeFrameIndexes, NULL);
+	    tsdPtr->exitHandlerSet = 1;
+	}
+    }
+    if (pathObj) {
+	Tcl_DecrRefCount(pathObj);
+    }
+    indexPtr->nextPtr = tsdPtr->indexList;
+    tsdPtr->indexList = indexPtr;
+    for (prevPtrPtr = &indexPtr->nextPtr; *prevPtrPtr != NULL; ) {
+	GIFFrameIndex *oldPtr = *prevPtrPtr;
+
+	if (++numIndexes < GIF_INDEX_CACHE_SIZE) {
+	    prevPtrPtr = &oldPtr->nextPtr;
+	} else {
+	    *prevPtrPtr = oldPtr->nextPtr;
+	    FreeFrameIndex(oldPtr);
+	}
+    }
+
+    if (index >= indexPtr->numFrames) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		"no image data for this index", TCL_INDEX_NONE));
+	Tcl_SetErrorCode(interp, "TK", "IMAGE", "GIF", "NO_DATA",
+		(char *)NULL);
+	return TCL_ERROR;
+    }
+
+    /*
+     * Go to the frame. If what is found there is not an image after all,
+     * the file must have been rewritten in place: drop the index.
+     */
+
+    framePtr = &indexPtr->frames[index];
+    if (!SetPosition(gifConfPtr, chan, &framePtr->pos)
+	    || (Fread(gifConfPtr, &label, 1, 1, chan) != 1)
+	    || (label != GIF_START)
+	    || (Fread(gifConfPtr, buf, 1, 9, chan) != 9)) {
+	tsdPtr->indexList = indexPtr->nextPtr;
+	FreeFrameIndex(indexPtr);
+	SetPosition(gifConfPtr, chan, &start);
+	return TCL_CONTINUE;
+    }
+
+    *gcePtr = framePtr->gce;
+    if (metadataOutObj && framePtr->metadataObj) {
+	Tcl_DictSearch search;
+	Tcl_Obj *keyObj, *valueObj;
+	int done;
+
+	Tcl_DictObjFirst(NULL, framePtr->metadataObj, &search, &keyObj,
+		&valueObj, &done);
+	for (; !done ; Tcl_DictObjNext(&search, &keyObj, &valueObj, &done)) {
+	    Tcl_DictObjPut(NULL, metadataOutObj, keyObj, valueObj);
+	}
+	Tcl_DictObjDone(&search);
+    }
+    return TCL_OK;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
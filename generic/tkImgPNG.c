@@ -10,13 +10,28 @@
  * this file, and for a DISCLAIMER OF ALL WARRANTIES.
  */
 
-#include "tkInt.h"
+#include "tkImgPhoto.h"
 
 #define	PNG_UINT32(a,b,c,d)	\
 	(((unsigned long)(a) << 24) | ((unsigned long)(b) << 16) | ((unsigned long)(c) << 8) | (unsigned long)(d))
 #define	PNG_BLOCK_SZ	1024		/* Process up to 1k at a time. */
 #define PNG_MIN(a, b) (((a) < (b)) ? (a) : (b))
 
+/*
+ * The Paeth unfilter for 3, 4, 6 and 8 byte pixels and the Average unfilter
+ * for 4 and 8 byte pixels use SSE2 when the compiler provides it, which is
+ * always the case on x86-64. The scalar Average loop is faster for 3 and 6
+ * byte pixels, which SSE2 can only load and store through a copy. The test
+ * suite can turn SSE2 off with TkPNGUseSIMD to compare the results.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) \
+	|| (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#   define PNG_USE_SSE2 1
+#   include <emmintrin.h>
+static int useSSE2 = 1;
+#endif
+
 /*
  * Every PNG image starts with the following 8-byte signature.
  */
@@ -106,6 +121,18 @@ static const int startLine[8] = {
 
 #define PNG_FILTMETH_STANDARD	0
 
+/*
+ * Filter types of the standard method, given by the first byte of each line.
+ */
+
+#define	PNG_FILTER_NONE		0
+#define	PNG_FILTER_SUB		1
+#define	PNG_FILTER_UP		2
+#define	PNG_FILTER_AVG		3
+#define	PNG_FILTER_PAETH	4
+#define	PNG_FILTER_ADAPTIVE	5	/* Encoder picks one of the above
+					 * for each line. */
+
 /*
  * Interlacing Methods.
  */
@@ -113,6 +140,27 @@ static const int startLine[8] = {
 #define	PNG_INTERLACE_NONE	0
 #define PNG_INTERLACE_ADAM7	1
 
+/*
+ * Images with at least PNG_PARALLEL_BYTES bytes of filtered lines are
+ * compressed in bands of rows, shared out between the writing thread and
+ * PNG_ENCODE_THREADS worker threads. Each band is compressed on its own into
+ * raw deflate data that ends in a full flush, so the bands can be joined
+ * into the single zlib stream of the IDAT chunk. A band holds about
+ * PNG_BAND_BYTES bytes, since every band starts with an empty dictionary.
+ */
+
+#define PNG_PARALLEL_BYTES	(1024 * 1024)
+#define PNG_ENCODE_THREADS	3
+#define PNG_BAND_BYTES		(256 * 1024)
+
+/*
+ * Images read with the -progressive format option are decoded by a worker
+ * thread, which sends the rows back to the thread of the image in bands of
+ * about PNG_DECODE_BAND_BYTES bytes of pixels.
+ */
+
+#define PNG_DECODE_BAND_BYTES	(64 * 1024)
+
 /*
  * State information, used to store everything about the PNG image being
  * currently parsed or created.
@@ -131,6 +179,11 @@ typedef struct {
     unsigned char base64Bits;	/* Remaining bits from last base64 read. */
     unsigned char base64State;	/* Current state of base64 decoder. */
     double alpha;		/* Alpha from -format option. */
+    int progressive;		/* Non-zero if the -format option asks for
+				 * decoding on the worker thread. */
+    struct DecodeJob *decodeJobPtr;
+				/* Job the image is decoded for, when this
+				 * is done by the worker thread. */
 
     /*
      * Image header information.
@@ -176,6 +229,13 @@ typedef struct {
     int lineSize;		/* Number of bytes in a PNG line. */
     int phaseSize;		/* Number of bytes/line in current phase. */
 
+    /*
+     * Encoder settings from the -format option.
+     */
+
+    int level;			/* Zlib compression level, or
+				 * TCL_ZLIB_COMPRESS_DEFAULT. */
+    int filterType;		/* PNG_FILTER_* to apply to every line. */
 
     /*
      * Physical size: pHYS chunks.
@@ -186,6 +246,112 @@ typedef struct {
 
 } PNGImage;
 
+/*
+ * A band of rows of an image being compressed in parallel, and the job
+ * holding all the bands of an image.
+ */
+
+typedef struct {
+    int firstRow;		/* First row of the band. */
+    int numRows;		/* Number of rows in the band. */
+    unsigned char *data;	/* Compressed rows, or NULL if they could not
+				 * be compressed. */
+    Tcl_Size size;		/* Number of bytes in data. */
+    unsigned int adler;		/* Adler-32 checksum of the filtered rows. */
+} EncodeBand;
+
+typedef struct EncodeJob {
+    PNGImage *pngPtr;		/* Encoder settings; only read by the
+				 * workers. */
+    Tk_PhotoImageBlock *blockPtr;
+				/* Pixels to compress. */
+    EncodeBand *bands;		/* Bands of the image. */
+    int numBands;		/* Number of bands. */
+    int nextBand;		/* First band nobody has taken yet. */
+    int bandsDone;		/* Number of bands compressed. */
+    struct EncodeJob *nextPtr;	/* Next job in encodeQueue. */
+} EncodeJob;
+
+/*
+ * The worker threads are shared by all interps and started the first time a
+ * large image is written. Everything here is protected by encodeMutex.
+ */
+
+TCL_DECLARE_MUTEX(encodeMutex)
+static Tcl_Condition encodeCond = NULL;	/* Signals new jobs to workers. */
+static Tcl_Condition encodeDoneCond = NULL;
+					/* Signals finished jobs to their
+					 * owners. */
+static EncodeJob *encodeQueue = NULL;	/* Jobs being compressed. */
+static Tcl_ThreadId encodeThreads[PNG_ENCODE_THREADS];
+static int numEncodeThreads = 0;	/* Number of workers started. */
+static int encodeWorkerState = 0;	/* 0 means the workers haven't been
+					 * started yet, 1 that they are
+					 * running and -1 that none could be
+					 * started or they have been told to
+					 * quit. */
+
+/*
+ * An image being decoded by the worker thread, and the event that sends a
+ * band of decoded rows back to the thread of the image. The last event of a
+ * job tells that the worker is done with it, so that it can be freed.
+ */
+
+typedef struct DecodeJob {
+    PNGImage png;		/* Decoder state; only used by the worker. It
+				 * reads the image data from the job's copy
+				 * and owns the zlib stream and lines. */
+    Tk_PhotoImageBlock block;	/* The rows being decoded, for copying them
+				 * into the image. */
+    unsigned char *data;	/* Copy of the image data following the
+				 * header of the first IDAT chunk. */
+    Tcl_Size chunkSz;		/* Size of the first IDAT chunk. */
+    unsigned long crc;		/* CRC of the header of the first IDAT
+				 * chunk. */
+    int bandRows;		/* Number of rows to send back at once. */
+    int bandStart;		/* First row not sent back yet. */
+    Tcl_ThreadId owner;		/* Thread the image lives in. */
+    Tcl_Interp *interp;		/* Interpreter of the image; it is preserved
+				 * until the job is freed. */
+    Tk_PhotoHandle imageHandle;	/* The photo image to write into... */
+    char *imageName;		/* ...and its name, to find out whether it
+				 * still exists. */
+    int destX, destY;		/* Where the rows go in the image, and */
+    int width, height;		/* which part of the decoded image is */
+    int srcX, srcY;		/* wanted, as passed to DecodePNG. */
+    int cancelled;		/* Set by the owner thread when the rows of
+				 * the job are no longer wanted, protected by
+				 * decodeMutex. */
+    char *errorMsg;		/* Error message and code the worker stopped */
+    char *errorCode;		/* on, or NULL. */
+    struct DecodeJob *nextPtr;	/* Next job waiting for the worker. */
+} DecodeJob;
+
+typedef struct {
+    Tcl_Event header;		/* Must be first. */
+    DecodeJob *jobPtr;		/* Job the rows belong to. */
+    int firstRow;		/* First row of the band. */
+    int numRows;		/* Number of rows in the band, may be 0. */
+    int last;			/* Non-zero for the last event of the
+				 * job. */
+} DecodeBand;
+
+/*
+ * The worker thread is shared by all interps and started the first time an
+ * image is read progressively. Everything here, and the cancelled field of
+ * the jobs, is protected by decodeMutex.
+ */
+
+TCL_DECLARE_MUTEX(decodeMutex)
+static Tcl_Condition decodeCond = NULL;	/* Signals new jobs to the worker. */
+static DecodeJob *decodeQueue = NULL;	/* Jobs waiting for the worker. */
+static DecodeJob *decodeQueueTail = NULL;
+static Tcl_ThreadId decodeThread;	/* The worker thread. */
+static int decodeWorkerState = 0;	/* 0 means the worker hasn't been
+					 * started yet, 1 that it is running
+					 * and -1 that it could not be started
+					 * or has been told to quit. */
+
 /*
  * Maximum size of various chunks.
  */
@@ -197,19 +363,31 @@ typedef struct {
  * Forward declarations of non-global functions defined in this file:
  */
 
-static void		ApplyAlpha(PNGImage *pngPtr);
+static unsigned int	Adler32Combine(unsigned int adler1,
+			    unsigned int adler2, size_t len2);
+static void		ApplyAlpha(PNGImage *pngPtr, int firstRow,
+			    int numRows);
 static int		CheckColor(Tcl_Interp *interp, PNGImage *pngPtr);
 static inline int	CheckCRC(Tcl_Interp *interp, PNGImage *pngPtr,
 			    unsigned long calculated);
 static void		CleanupPNGImage(PNGImage *pngPtr);
+static void		CompressBand(EncodeJob *jobPtr,
+			    EncodeBand *bandPtr);
+static void		CompressBands(EncodeJob *jobPtr);
+static int		DecodeBandProc(Tcl_Event *evPtr, int flags);
 static int		DecodeLine(Tcl_Interp *interp, PNGImage *pngPtr);
 static int		DecodePNG(Tcl_Interp *interp, PNGImage *pngPtr,
 			    Tcl_Obj *fmtObj, Tk_PhotoHandle imageHandle,
 			    int destX, int destY, int width, int height,
 			    int srcX, int srcY);
+static void		DecodeRows(Tcl_Interp *interp, DecodeJob *jobPtr);
+static Tcl_ThreadCreateType DecodeThreadProc(void *clientData);
+static void		DecodeThreadExitProc(void *clientData);
 static int		EncodePNG(Tcl_Interp *interp,
 			    Tk_PhotoImageBlock *blockPtr, PNGImage *pngPtr,
-			    Tcl_Obj *metadataInObj);
+			    Tcl_Obj *fmtObj, Tcl_Obj *metadataInObj);
+static Tcl_ThreadCreateType EncodeThreadProc(void *clientData);
+static void		EncodeThreadsExitProc(void *clientData);
 static int		FileMatchPNG(Tcl_Interp *interp, Tcl_Channel chan,
 			    const char *fileName, Tcl_Obj *fmtObj,
 			    Tcl_Obj *metadataInObj, int *widthPtr,
@@ -222,8 +400,22 @@ static int		FileReadPNG(Tcl_Interp *interp, Tcl_Channel chan,
 static int		FileWritePNG(Tcl_Interp *interp, const char *filename,
 			    Tcl_Obj *fmtObj, Tcl_Obj *metadataInObj,
 			    Tk_PhotoImageBlock *blockPtr);
+static void		FilterLine(int filterType,
+			    const unsigned char *raw,
+			    const unsigned char *prior, unsigned char *dest,
+			    int len, int bpp);
+static void		FilterRow(PNGImage *pngPtr,
+			    const unsigned char *thisRaw,
+			    const unsigned char *lastRaw,
+			    unsigned char *scratch, unsigned char *destPtr);
 static int		InitPNGImage(Tcl_Interp *interp, PNGImage *pngPtr,
 			    Tcl_Channel chan, Tcl_Obj *objPtr, int dir);
+static unsigned long	LineCost(const unsigned char *line, int len,
+			    unsigned long limit);
+static void		PackLine(PNGImage *pngPtr,
+			    Tk_PhotoImageBlock *blockPtr,
+			    const unsigned char *srcPtr,
+			    unsigned char *destPtr);
 static inline unsigned char Paeth(int a, int b, int c);
 static int		ParseFormat(Tcl_Interp *interp, Tcl_Obj *fmtObj,
 			    PNGImage *pngPtr);
@@ -242,14 +434,24 @@ static int		ReadChunkHeader(Tcl_Interp *interp, PNGImage *pngPtr,
 static int		ReadIDAT(Tcl_Interp *interp, PNGImage *pngPtr,
 			    int chunkSz, unsigned long crc);
 static int		ReadIHDR(Tcl_Interp *interp, PNGImage *pngPtr);
+static int		ReadImageData(Tcl_Interp *interp, PNGImage *pngPtr,
+			    Tcl_Size chunkSz, unsigned long crc);
 static inline int	ReadInt32(Tcl_Interp *interp, PNGImage *pngPtr,
 			    unsigned long *resultPtr, unsigned long *crcPtr);
 static int		ReadPLTE(Tcl_Interp *interp, PNGImage *pngPtr,
 			    int chunkSz, unsigned long crc);
 static int		ReadTRNS(Tcl_Interp *interp, PNGImage *pngPtr,
 			    int chunkSz, unsigned long crc);
+static int		SendDecodeBand(DecodeJob *jobPtr, int endRow,
+			    int flush);
 static int		SkipChunk(Tcl_Interp *interp, PNGImage *pngPtr,
 			    int chunkSz, unsigned long crc);
+static int		StartDecodeJob(Tcl_Interp *interp, PNGImage *pngPtr,
+			    Tk_PhotoHandle imageHandle, int destX, int destY,
+			    int width, int height, int srcX, int srcY,
+			    Tcl_Size chunkSz, unsigned long crc);
+static int		StartDecodeThread(void);
+static int		StartEncodeThreads(void);
 static int		StringMatchPNG(Tcl_Interp *interp, Tcl_Obj *pObjData,
 			    Tcl_Obj *fmtObj, Tcl_Obj *metadataInObj,
 			    int *widthPtr, int *heightPtr,
@@ -278,6 +480,8 @@ static int		WriteIHDR(Tcl_Interp *interp, PNGImage *pngPtr,
 			    Tk_PhotoImageBlock *blockPtr);
 static int		WriteIDAT(Tcl_Interp *interp, PNGImage *pngPtr,
 			    Tk_PhotoImageBlock *blockPtr);
+static int		WriteIDATParallel(Tcl_Interp *interp,
+			    PNGImage *pngPtr, Tk_PhotoImageBlock *blockPtr);
 static inline int	WriteInt32(Tcl_Interp *interp, PNGImage *pngPtr,
 			    unsigned long l, unsigned long *crcPtr);
 
@@ -326,6 +530,8 @@ InitPNGImage(
 
     pngPtr->channel = chan;
     pngPtr->alpha = 1.0;
+    pngPtr->level = TCL_ZLIB_COMPRESS_DEFAULT;
+    pngPtr->filterType = PNG_FILTER_NONE;
 
     /*
      * If decoding from a -data string object, increment its reference count
@@ -1782,6 +1988,195 @@ Paeth(
 
     return (unsigned char) c;
 }
+
+#ifdef PNG_USE_SSE2
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadPixel, StorePixel --
+ *
+ *	Move the bytes of one pixel of a scan line, bpp (3, 4, 6 or 8) bytes
+ *	long, between memory and the low bytes of an SSE2 register. Pixels of
+ *	3 and 6 bytes go through a copy, so that nothing is read or written
+ *	past the end of the line.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static inline __m128i
+LoadPixel(
+    const unsigned char *p,
+    int bpp)
+{
+    unsigned char buf[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+    if (bpp == 8) {
+	return _mm_loadl_epi64((const __m128i *) p);
+    } else if (bpp == 4) {
+	int v;
+
+	memcpy(&v, p, 4);
+	return _mm_cvtsi32_si128(v);
+    }
+    memcpy(buf, p, bpp);
+    return _mm_loadl_epi64((const __m128i *) buf);
+}
+
+static inline void
+StorePixel(
+    unsigned char *p,
+    __m128i v,
+    int bpp)
+{
+    unsigned char buf[8];
+
+    if (bpp == 8) {
+	_mm_storel_epi64((__m128i *) p, v);
+    } else if (bpp == 4) {
+	int w = _mm_cvtsi128_si32(v);
+
+	memcpy(p, &w, 4);
+    } else {
+	_mm_storel_epi64((__m128i *) buf, v);
+	memcpy(p, buf, bpp);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UnfilterAvgSSE2, UnfilterPaethSSE2 --
+ *
+ *	Undo the Average or Paeth filter for a whole scan line that has a
+ *	prior line, one pixel at a time. Each pixel depends on the one to its
+ *	left, so the parallelism is across the bytes of a pixel. The first
+ *	pixel needs no special treatment since its missing left neighbours
+ *	are zero, exactly as the filter definitions require.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The bytes from raw up to end are unfiltered in place.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static inline void
+UnfilterAvgSSE2(
+    unsigned char *raw,
+    const unsigned char *prior,
+    const unsigned char *end,
+    int bpp)
+{
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i a, b, d = _mm_setzero_si128();
+
+    while (raw < end) {
+	b = LoadPixel(prior, bpp);
+	a = d;
+	d = LoadPixel(raw, bpp);
+
+	/*
+	 * _mm_avg_epu8 rounds up; subtract the carry it added when a+b is
+	 * odd to get floor((a+b)/2).
+	 */
+
+	d = _mm_add_epi8(d, _mm_sub_epi8(_mm_avg_epu8(a, b),
+		_mm_and_si128(_mm_xor_si128(a, b), one)));
+	StorePixel(raw, d, bpp);
+	raw += bpp;
+	prior += bpp;
+    }
+}
+
+static inline void
+UnfilterPaethSSE2(
+    unsigned char *raw,
+    const unsigned char *prior,
+    const unsigned char *end,
+    int bpp)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a, b = zero, c, d = zero;
+
+    /*
+     * Work on 16-bit lanes so that the predictor differences cannot
+     * overflow; a is left, b is above and c is above-left.
+     */
+
+    while (raw < end) {
+	__m128i pa, pb, pc, smallest, useA, useB, nearest;
+
+	c = b;
+	b = _mm_unpacklo_epi8(LoadPixel(prior, bpp), zero);
+	a = d;
+	d = _mm_unpacklo_epi8(LoadPixel(raw, bpp), zero);
+
+	pa = _mm_sub_epi16(b, c);
+	pb = _mm_sub_epi16(a, c);
+	pc = _mm_add_epi16(pa, pb);
+	pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+	pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+	pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+	smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+
+	/*
+	 * Ties go to a, then b, then c, as in Paeth().
+	 */
+
+	useA = _mm_cmpeq_epi16(smallest, pa);
+	useB = _mm_andnot_si128(useA, _mm_cmpeq_epi16(smallest, pb));
+	nearest = _mm_or_si128(_mm_and_si128(useA, a),
+		_mm_or_si128(_mm_and_si128(useB, b),
+		_mm_andnot_si128(_mm_or_si128(useA, useB), c)));
+
+	/*
+	 * Byte-wise addition keeps the sum modulo 256 and the high byte of
+	 * each lane zero.
+	 */
+
+	d = _mm_add_epi8(d, nearest);
+	StorePixel(raw, _mm_packus_epi16(d, d), bpp);
+	raw += bpp;
+	prior += bpp;
+    }
+}
+#endif /* PNG_USE_SSE2 */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkPNGUseSIMD --
+ *
+ *	Turns the SSE2 unfilters on or off, so that the test suite can compare
+ *	their output with that of the scalar loops. A negative value leaves
+ *	the setting alone.
+ *
+ * Results:
+ *	1 if the SSE2 unfilters are now in use, and 0 otherwise; always 0 if
+ *	they were not compiled in.
+ *
+ * Side effects:
+ *	Changes how all PNG images are decoded from now on.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TkPNGUseSIMD(
+    int use)
+{
+#ifdef PNG_USE_SSE2
+    if (use >= 0) {
+	useSSE2 = (use != 0);
+    }
+    return useSSE2;
+#else
+    (void) use;
+    return 0;
+#endif /* PNG_USE_SSE2 */
+}
 
 /*
  *----------------------------------------------------------------------
@@ -1815,12 +2210,6 @@ UnfilterLine(
     unsigned char *lastLine =
 	    Tcl_GetByteArrayFromObj(pngPtr->lastLineObj, (Tcl_Size *)NULL);
 
-#define	PNG_FILTER_NONE		0
-#define	PNG_FILTER_SUB		1
-#define	PNG_FILTER_UP		2
-#define	PNG_FILTER_AVG		3
-#define	PNG_FILTER_PAETH	4
-
     switch (*thisLine) {
     case PNG_FILTER_NONE:	/* Nothing to do */
 	break;
@@ -1854,6 +2243,19 @@ UnfilterLine(
 	    unsigned char *end = thisLine + pngPtr->phaseSize;
 	    unsigned char *end2 = raw + pngPtr->bytesPerPixel;
 
+#ifdef PNG_USE_SSE2
+	    if (useSSE2) {
+		switch (pngPtr->bytesPerPixel) {
+		case 4:
+		    UnfilterAvgSSE2(raw, prior, end, 4);
+		    return TCL_OK;
+		case 8:
+		    UnfilterAvgSSE2(raw, prior, end, 8);
+		    return TCL_OK;
+		}
+	    }
+#endif /* PNG_USE_SSE2 */
+
 	    while ((raw < end2) && (raw < end)) {
 		*raw++ += *prior++ / 2;
 	    }
@@ -1882,6 +2284,25 @@ UnfilterLine(
 	    unsigned char *end = thisLine + pngPtr->phaseSize;
 	    unsigned char *end2 = rawBpp + pngPtr->bytesPerPixel;
 
+#ifdef PNG_USE_SSE2
+	    if (useSSE2) {
+		switch (pngPtr->bytesPerPixel) {
+		case 3:
+		    UnfilterPaethSSE2(raw, prior, end, 3);
+		    return TCL_OK;
+		case 4:
+		    UnfilterPaethSSE2(raw, prior, end, 4);
+		    return TCL_OK;
+		case 6:
+		    UnfilterPaethSSE2(raw, prior, end, 6);
+		    return TCL_OK;
+		case 8:
+		    UnfilterPaethSSE2(raw, prior, end, 8);
+		    return TCL_OK;
+		}
+	    }
+#endif /* PNG_USE_SSE2 */
+
 	    while ((raw < end) && (raw < end2)) {
 		*raw++ += *prior++;
 	    }
@@ -2252,6 +2673,14 @@ ReadIDAT(
 	Tcl_GetByteArrayFromObj(pngPtr->thisLineObj, &len1);
 	if (Tcl_ZlibStreamGet(pngPtr->stream, pngPtr->thisLineObj,
 		pngPtr->phaseSize - len1) == TCL_ERROR) {
+	    /*
+	     * The stream isn't bound to an interpreter, so it leaves no
+	     * message of its own.
+	     */
+
+	    Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		    "corrupt compressed data in PNG data", TCL_INDEX_NONE));
+	    Tcl_SetErrorCode(interp, "TK", "IMAGE", "PNG", "BAD_DATA", NULL);
 	    return TCL_ERROR;
 	}
 	Tcl_GetByteArrayFromObj(pngPtr->thisLineObj, &len2);
@@ -2283,6 +2712,18 @@ ReadIDAT(
 	    }
 	    Tcl_SetByteArrayLength(pngPtr->thisLineObj, 0);
 
+	    /*
+	     * When decoding on the worker thread, hand the rows over as they
+	     * are finished. Interlaced rows are only finished by the last
+	     * phase, so those are all sent at the end.
+	     */
+
+	    if ((pngPtr->decodeJobPtr != NULL) && !pngPtr->interlace
+		    && (SendDecodeBand(pngPtr->decodeJobPtr,
+		    pngPtr->currentLine, 0) == TCL_ERROR)) {
+		return TCL_ERROR;
+	    }
+
 	    /*
 	     * Try to read another line of pixels out of the buffer
 	     * immediately, but don't allow write past end of block.
@@ -2322,9 +2763,9 @@ ReadIDAT(
  *
  * ApplyAlpha --
  *
- *	Applies an overall alpha value to a complete image that has been read.
- *	This alpha value is specified using the -format option to [image
- *	create photo].
+ *	Applies an overall alpha value to rows of an image that have been
+ *	read. This alpha value is specified using the -format option to
+ *	[image create photo].
  *
  * Results:
  *	N/A
@@ -2337,11 +2778,14 @@ ReadIDAT(
 
 static void
 ApplyAlpha(
-    PNGImage *pngPtr)
+    PNGImage *pngPtr,
+    int firstRow,		/* First row to apply the alpha to. */
+    int numRows)		/* Number of rows. */
 {
     if (pngPtr->alpha != 1.0) {
-	unsigned char *p = pngPtr->block.pixelPtr;
-	unsigned char *endPtr = p + pngPtr->blockLen;
+	unsigned char *p = pngPtr->block.pixelPtr
+		+ firstRow * pngPtr->block.pitch;
+	unsigned char *endPtr = p + numRows * pngPtr->block.pitch;
 	int offset = pngPtr->block.offset[3];
 
 	p += offset;
@@ -2374,9 +2818,11 @@ ApplyAlpha(
  *
  *	This function parses the -format string that can be specified to the
  *	[image create photo] command to extract options for postprocessing of
- *	loaded images. Currently, this just allows specifying and applying an
- *	overall alpha value to the loaded image (for example, to make it
- *	entirely 50% as transparent as the actual image file).
+ *	loaded images. This allows specifying and applying an overall alpha
+ *	value to the loaded image (for example, to make it entirely 50% as
+ *	transparent as the actual image file), and decoding the image on the
+ *	worker thread. When writing, it selects the compression level and the
+ *	filter applied to the lines.
  *
  * Results:
  *	TCL_OK, or TCL_ERROR if the format specification is invalid.
@@ -2396,10 +2842,13 @@ ParseFormat(
     Tcl_Obj **objv = NULL;
     Tcl_Size objc = 0;
     static const char *const fmtOptions[] = {
-	"-alpha", NULL
+	"-alpha", "-compression", "-filter", "-progressive", NULL
     };
     enum fmtOptionsEnum {
-	OPT_ALPHA
+	OPT_ALPHA, OPT_COMPRESSION, OPT_FILTER, OPT_PROGRESSIVE
+    };
+    static const char *const filterTypes[] = {
+	"none", "sub", "up", "average", "paeth", "adaptive", NULL
     };
 
     /*
@@ -2427,6 +2876,15 @@ ParseFormat(
 	    return TCL_ERROR;
 	}
 
+	/*
+	 * -progressive is a flag, all the other options take a value.
+	 */
+
+	if (optIndex == OPT_PROGRESSIVE) {
+	    pngPtr->progressive = 1;
+	    continue;
+	}
+
 	if (objc < 2) {
 	    Tcl_WrongNumArgs(interp, 1, objv, "value");
 	    return TCL_ERROR;
@@ -2450,6 +2908,30 @@ ParseFormat(
 		return TCL_ERROR;
 	    }
 	    break;
+	case OPT_COMPRESSION:
+	    if (Tcl_GetIntFromObj(interp, objv[0],
+		    &pngPtr->level) == TCL_ERROR) {
+		return TCL_ERROR;
+	    }
+
+	    if ((pngPtr->level < TCL_ZLIB_COMPRESS_NONE)
+		    || (pngPtr->level > TCL_ZLIB_COMPRESS_BEST)) {
+		Tcl_SetObjResult(interp, Tcl_NewStringObj(
+			"-compression value must be between 0 and 9",
+			TCL_INDEX_NONE));
+		Tcl_SetErrorCode(interp, "TK", "IMAGE", "PNG",
+			"BAD_COMPRESSION", NULL);
+		return TCL_ERROR;
+	    }
+	    break;
+	case OPT_FILTER:
+	    if (Tcl_GetIndexFromObj(interp, objv[0], filterTypes, "filter",
+		    0, &pngPtr->filterType) == TCL_ERROR) {
+		return TCL_ERROR;
+	    }
+	    break;
+	case OPT_PROGRESSIVE:
+	    break;
 	}
     }
 
@@ -2666,14 +3148,9 @@ DecodePNG(
     }
 
     /*
-     * Allocate space for decoding the scan lines.
+     * Allocate space for the decoded pixels.
      */
 
-    pngPtr->lastLineObj = Tcl_NewObj();
-    Tcl_IncrRefCount(pngPtr->lastLineObj);
-    pngPtr->thisLineObj = Tcl_NewObj();
-    Tcl_IncrRefCount(pngPtr->thisLineObj);
-
     pngPtr->block.pixelPtr = (unsigned char *)attemptckalloc(pngPtr->blockLen);
     if (!pngPtr->block.pixelPtr) {
 	Tcl_SetObjResult(interp, Tcl_NewStringObj(
@@ -2706,6 +3183,76 @@ DecodePNG(
 	pngPtr->phaseSize = pngPtr->lineSize;
     }
 
+    /*
+     * With the -progressive option, the rows are decoded by the worker
+     * thread, unless it can't be started.
+     */
+
+    if (pngPtr->progressive && StartDecodeThread()) {
+	return StartDecodeJob(interp, pngPtr, imageHandle, destX, destY,
+		width, height, srcX, srcY, chunkSz, crc);
+    }
+
+    if (ReadImageData(interp, pngPtr, chunkSz, crc) == TCL_ERROR) {
+	return TCL_ERROR;
+    }
+
+    /*
+     * Apply overall image alpha if specified.
+     */
+
+    ApplyAlpha(pngPtr, 0, pngPtr->block.height);
+
+    /*
+     * Copy the decoded image block into the Tk photo image.
+     */
+
+    pngPtr->block.pixelPtr += srcX * pngPtr->block.pixelSize + srcY * pngPtr->block.pitch;
+    result = Tk_PhotoPutBlock(interp, imageHandle, &pngPtr->block, destX, destY,
+	    width, height, TK_PHOTO_COMPOSITE_SET);
+    pngPtr->block.pixelPtr -= srcX * pngPtr->block.pixelSize + srcY * pngPtr->block.pitch;
+
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadImageData --
+ *
+ *	This function reads the IDAT chunks into the block of the image, and
+ *	checks the chunks after them up to the IEND chunk. It is called with
+ *	the header of the first IDAT chunk read.
+ *
+ * Results:
+ *	TCL_OK, or TCL_ERROR if an I/O error occurs or any problems are
+ *	detected in the PNG data.
+ *
+ * Side effects:
+ *	The access position in f advances. The lines for unfiltering are
+ *	allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ReadImageData(
+    Tcl_Interp *interp,		/* Interpreter to use for reporting errors. */
+    PNGImage *pngPtr,		/* PNG image information record. */
+    Tcl_Size chunkSz,		/* Size of the first IDAT chunk. */
+    unsigned long crc)		/* CRC of its header. */
+{
+    unsigned long chunkType = CHUNK_IDAT;
+
+    /*
+     * Allocate space for decoding the scan lines.
+     */
+
+    pngPtr->lastLineObj = Tcl_NewObj();
+    Tcl_IncrRefCount(pngPtr->lastLineObj);
+    pngPtr->thisLineObj = Tcl_NewObj();
+    Tcl_IncrRefCount(pngPtr->thisLineObj);
+
     /*
      * All of the IDAT (data) chunks must be consecutive.
      */
@@ -2782,47 +3329,539 @@ DecodePNG(
     }
 #endif
 
-    /*
-     * Apply overall image alpha if specified.
-     */
-
-    ApplyAlpha(pngPtr);
-
-    /*
-     * Copy the decoded image block into the Tk photo image.
-     */
-
-    pngPtr->block.pixelPtr += srcX * pngPtr->block.pixelSize + srcY * pngPtr->block.pitch;
-    result = Tk_PhotoPutBlock(interp, imageHandle, &pngPtr->block, destX, destY,
-	    width, height, TK_PHOTO_COMPOSITE_SET);
-    pngPtr->block.pixelPtr -= srcX * pngPtr->block.pixelSize + srcY * pngPtr->block.pitch;
-
-    return result;
+    return TCL_OK;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * FileMatchPNG --
+ * StartDecodeThread --
  *
- *	This function is invoked by the photo image type to see if a file
- *	contains image data in PNG format.
+ *	Starts the worker thread that decodes images read with the
+ *	-progressive format option, unless that has been done already.
  *
  * Results:
- *	The return value is 1 if the first characters in file f look like PNG
- *	data, and 0 otherwise.
+ *	Returns 1 if the worker is running, and 0 otherwise.
  *
  * Side effects:
- *	The access position in f may change.
+ *	A thread may be created, with an exit handler to stop it.
  *
  *----------------------------------------------------------------------
  */
 
 static int
-FileMatchPNG(
-    Tcl_Interp *interp,		/* Interpreter to use for reporting errors. */
-    Tcl_Channel chan,		/* The image file, open for reading. */
-    TCL_UNUSED(const char *),	/* The name of the image file. */
+StartDecodeThread(void)
+{
+    int running;
+
+    Tcl_MutexLock(&decodeMutex);
+    if (decodeWorkerState == 0) {
+	if (Tcl_CreateThread(&decodeThread, DecodeThreadProc, NULL,
+		TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE) == TCL_OK) {
+	    decodeWorkerState = 1;
+	    Tcl_CreateExitHandler(DecodeThreadExitProc, NULL);
+	} else {
+	    decodeWorkerState = -1;
+	}
+    }
+    running = (decodeWorkerState == 1);
+    Tcl_MutexUnlock(&decodeMutex);
+    return running;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StartDecodeJob --
+ *
+ *	Hands the decoding of the rows of an image over to the worker thread.
+ *	It is called with the header of the first IDAT chunk read, the photo
+ *	image expanded and the block of the image allocated. The rest of the
+ *	image data is copied, since the channel or the -data object can only
+ *	be used by this thread.
+ *
+ * Results:
+ *	TCL_OK, or TCL_ERROR if the data could not be read or copied.
+ *
+ * Side effects:
+ *	The job takes over the block of the image and preserves the
+ *	interpreter. The rows will be put into the image by DecodeBandProc as
+ *	the worker sends them back.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+StartDecodeJob(
+    Tcl_Interp *interp,		/* Interpreter to use for reporting errors. */
+    PNGImage *pngPtr,		/* PNG image information record. */
+    Tk_PhotoHandle imageHandle,	/* The photo image to write into. */
+    int destX, int destY,	/* Coordinates of top-left pixel in photo
+				 * image to be written to. */
+    int width, int height,	/* Dimensions of block of photo image to be
+				 * written to. */
+    int srcX, int srcY,		/* Coordinates of top-left pixel to be used in
+				 * image being read. */
+    Tcl_Size chunkSz,		/* Size of the first IDAT chunk. */
+    unsigned long crc)		/* CRC of its header. */
+{
+    DecodeJob *jobPtr;
+    unsigned char *data;
+    Tcl_Size size;
+    const char *imageName =
+	    Tk_NameOfImage(((PhotoModel *) imageHandle)->tkModel);
+
+    if (pngPtr->strDataBuf) {
+	size = pngPtr->strDataLen;
+	data = (unsigned char *)attemptckalloc(size + 1);
+	if (data) {
+	    memcpy(data, pngPtr->strDataBuf, size);
+	}
+    } else {
+	Tcl_Size space = PNG_DECODE_BAND_BYTES, readSz;
+
+	size = 0;
+	data = (unsigned char *)attemptckalloc(space);
+	while (data != NULL) {
+	    readSz = Tcl_Read(pngPtr->channel, (char *)data + size,
+		    space - size);
+	    if (readSz == TCL_IO_FAILURE) {
+		ckfree(data);
+		Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+			"channel read failed: %s", Tcl_PosixError(interp)));
+		return TCL_ERROR;
+	    }
+	    size += readSz;
+	    if (Tcl_Eof(pngPtr->channel)) {
+		break;
+	    }
+	    if (size == space) {
+		unsigned char *newData =
+			(unsigned char *)attemptckrealloc(data, 2 * space);
+
+		if (newData == NULL) {
+		    ckfree(data);
+		}
+		data = newData;
+		space *= 2;
+	    }
+	}
+    }
+    if (data == NULL) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		"memory allocation failed", TCL_INDEX_NONE));
+	Tcl_SetErrorCode(interp, "TK", "MALLOC", NULL);
+	return TCL_ERROR;
+    }
+
+    /*
+     * The worker reads the copy as if it were -data, and sets up its own
+     * zlib stream and lines.
+     */
+
+    jobPtr = (DecodeJob *)ckalloc(sizeof(DecodeJob));
+    jobPtr->png = *pngPtr;
+    jobPtr->png.channel = NULL;
+    jobPtr->png.objDataPtr = NULL;
+    jobPtr->png.strDataBuf = data;
+    jobPtr->png.strDataLen = size;
+    if (pngPtr->base64Data) {
+	jobPtr->png.base64Data = data;
+    }
+    jobPtr->png.stream = NULL;
+    jobPtr->png.decodeJobPtr = jobPtr;
+    jobPtr->block = pngPtr->block;
+    pngPtr->block.pixelPtr = NULL;
+    jobPtr->data = data;
+    jobPtr->chunkSz = chunkSz;
+    jobPtr->crc = crc;
+    jobPtr->bandRows = PNG_DECODE_BAND_BYTES / jobPtr->block.pitch;
+    if (jobPtr->bandRows < 1) {
+	jobPtr->bandRows = 1;
+    }
+    jobPtr->bandStart = 0;
+    jobPtr->owner = Tcl_GetCurrentThread();
+    jobPtr->interp = interp;
+    Tcl_Preserve(interp);
+    jobPtr->imageHandle = imageHandle;
+    if (imageName == NULL) {
+	imageName = "";
+    }
+    jobPtr->imageName = (char *)ckalloc(strlen(imageName) + 1);
+    strcpy(jobPtr->imageName, imageName);
+    jobPtr->destX = destX;
+    jobPtr->destY = destY;
+    jobPtr->width = width;
+    jobPtr->height = height;
+    jobPtr->srcX = srcX;
+    jobPtr->srcY = srcY;
+    jobPtr->cancelled = 0;
+    jobPtr->errorMsg = NULL;
+    jobPtr->errorCode = NULL;
+    jobPtr->nextPtr = NULL;
+
+    Tcl_MutexLock(&decodeMutex);
+    if (decodeQueueTail == NULL) {
+	decodeQueue = jobPtr;
+    } else {
+	decodeQueueTail->nextPtr = jobPtr;
+    }
+    decodeQueueTail = jobPtr;
+    Tcl_ConditionNotify(&decodeCond);
+    Tcl_MutexUnlock(&decodeMutex);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DecodeThreadProc --
+ *
+ *	The body of the worker thread that decodes images: takes jobs off the
+ *	queue and decodes them one after the other. The decoder reports its
+ *	errors in an interpreter of the thread's own.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Events are queued for other threads. The thread's Tcl data is
+ *	released when it quits.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_ThreadCreateType
+DecodeThreadProc(
+    TCL_UNUSED(void *))
+{
+    Tcl_Interp *interp = Tcl_CreateInterp();
+    DecodeJob *jobPtr;
+
+    Tcl_MutexLock(&decodeMutex);
+    while (1) {
+	while ((decodeQueue == NULL) && (decodeWorkerState == 1)) {
+	    Tcl_ConditionWait(&decodeCond, &decodeMutex, NULL);
+	}
+	if (decodeWorkerState != 1) {
+	    break;
+	}
+	jobPtr = decodeQueue;
+	decodeQueue = jobPtr->nextPtr;
+	if (decodeQueue == NULL) {
+	    decodeQueueTail = NULL;
+	}
+	Tcl_MutexUnlock(&decodeMutex);
+
+	DecodeRows(interp, jobPtr);
+
+	Tcl_MutexLock(&decodeMutex);
+    }
+    Tcl_MutexUnlock(&decodeMutex);
+    Tcl_DeleteInterp(interp);
+    Tcl_FinalizeThread();
+    TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DecodeThreadExitProc --
+ *
+ *	Tells the decoding thread to quit and waits for it, so that it isn't
+ *	left waiting on a condition while Tcl is finalized. The image it is
+ *	decoding is left unfinished and jobs still in the queue are
+ *	abandoned.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The decoding thread exits.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DecodeThreadExitProc(
+    TCL_UNUSED(void *))
+{
+    int result;
+
+    Tcl_MutexLock(&decodeMutex);
+    decodeWorkerState = -1;
+    Tcl_ConditionNotify(&decodeCond);
+    Tcl_MutexUnlock(&decodeMutex);
+    Tcl_JoinThread(decodeThread, &result);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DecodeRows --
+ *
+ *	Decodes the rows of a job in the worker thread, sending them back to
+ *	the thread of the image in bands. The last event sent tells that the
+ *	worker is done with the job, and carries the error it stopped on.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Events are queued for the thread of the image. The job must not be
+ *	touched after the last one.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DecodeRows(
+    Tcl_Interp *interp,		/* Interpreter of the worker thread. */
+    DecodeJob *jobPtr)		/* Job to decode. */
+{
+    PNGImage *pngPtr = &jobPtr->png;
+    DecodeBand *bandPtr;
+    int result, cancelled;
+
+    result = Tcl_ZlibStreamInit(NULL, TCL_ZLIB_STREAM_INFLATE,
+	    TCL_ZLIB_FORMAT_ZLIB, TCL_ZLIB_COMPRESS_DEFAULT, NULL,
+	    &pngPtr->stream);
+    if (result != TCL_OK) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		"zlib initialization failed", TCL_INDEX_NONE));
+	Tcl_SetErrorCode(interp, "TK", "IMAGE", "PNG", "ZLIB_INIT", NULL);
+    } else {
+	result = ReadImageData(interp, pngPtr, jobPtr->chunkSz, jobPtr->crc);
+    }
+    if (result == TCL_OK) {
+	result = SendDecodeBand(jobPtr, pngPtr->block.height, 1);
+    }
+
+    /*
+     * Tcl objects can't be passed to another thread, so the error is sent
+     * back as strings. There is none to send if the job has been cancelled.
+     */
+
+    Tcl_MutexLock(&decodeMutex);
+    cancelled = jobPtr->cancelled || (decodeWorkerState != 1);
+    Tcl_MutexUnlock(&decodeMutex);
+    if ((result != TCL_OK) && !cancelled) {
+	Tcl_Obj *optionsObj = Tcl_GetReturnOptions(interp, TCL_ERROR);
+	Tcl_Obj *keyObj = Tcl_NewStringObj("-errorcode", TCL_INDEX_NONE);
+	Tcl_Obj *codeObj = NULL;
+	const char *str = Tcl_GetString(Tcl_GetObjResult(interp));
+
+	jobPtr->errorMsg = (char *)ckalloc(strlen(str) + 1);
+	strcpy(jobPtr->errorMsg, str);
+	Tcl_IncrRefCount(optionsObj);
+	Tcl_IncrRefCount(keyObj);
+	if ((Tcl_DictObjGet(NULL, optionsObj, keyObj, &codeObj) == TCL_OK)
+		&& (codeObj != NULL)) {
+	    str = Tcl_GetString(codeObj);
+	    jobPtr->errorCode = (char *)ckalloc(strlen(str) + 1);
+	    strcpy(jobPtr->errorCode, str);
+	}
+	Tcl_DecrRefCount(keyObj);
+	Tcl_DecrRefCount(optionsObj);
+    }
+    Tcl_ResetResult(interp);
+
+    /*
+     * The block and the copy of the data belong to the job, everything else
+     * was set up by this thread.
+     */
+
+    pngPtr->block.pixelPtr = NULL;
+    CleanupPNGImage(pngPtr);
+
+    bandPtr = (DecodeBand *)ckalloc(sizeof(DecodeBand));
+    bandPtr->header.proc = DecodeBandProc;
+    bandPtr->header.nextPtr = NULL;
+    bandPtr->jobPtr = jobPtr;
+    bandPtr->firstRow = 0;
+    bandPtr->numRows = 0;
+    bandPtr->last = 1;
+    Tcl_ThreadQueueEvent(jobPtr->owner, &bandPtr->header, TCL_QUEUE_TAIL);
+    Tcl_ThreadAlert(jobPtr->owner);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SendDecodeBand --
+ *
+ *	Called by the worker thread as rows of a job are decoded. Once there
+ *	are enough of them, or if flush is set, the rows decoded since the
+ *	last band are sent back to the thread of the image.
+ *
+ * Results:
+ *	TCL_OK, or TCL_ERROR if the job has been cancelled or the worker
+ *	has been told to quit, in which case decoding should stop.
+ *
+ * Side effects:
+ *	The overall alpha is applied to the rows sent back, and an event is
+ *	queued for the thread of the image.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SendDecodeBand(
+    DecodeJob *jobPtr,		/* Job being decoded. */
+    int endRow,			/* Row after the last one decoded. */
+    int flush)			/* Non-zero to send the rows even if there
+				 * are only a few of them. */
+{
+    DecodeBand *bandPtr;
+    int cancelled;
+
+    if (!flush && (endRow - jobPtr->bandStart < jobPtr->bandRows)) {
+	return TCL_OK;
+    }
+
+    Tcl_MutexLock(&decodeMutex);
+    cancelled = jobPtr->cancelled || (decodeWorkerState != 1);
+    Tcl_MutexUnlock(&decodeMutex);
+    if (cancelled) {
+	return TCL_ERROR;
+    }
+    if (endRow <= jobPtr->bandStart) {
+	return TCL_OK;
+    }
+
+    ApplyAlpha(&jobPtr->png, jobPtr->bandStart, endRow - jobPtr->bandStart);
+
+    bandPtr = (DecodeBand *)ckalloc(sizeof(DecodeBand));
+    bandPtr->header.proc = DecodeBandProc;
+    bandPtr->header.nextPtr = NULL;
+    bandPtr->jobPtr = jobPtr;
+    bandPtr->firstRow = jobPtr->bandStart;
+    bandPtr->numRows = endRow - jobPtr->bandStart;
+    bandPtr->last = 0;
+    jobPtr->bandStart = endRow;
+    Tcl_ThreadQueueEvent(jobPtr->owner, &bandPtr->header, TCL_QUEUE_TAIL);
+    Tcl_ThreadAlert(jobPtr->owner);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DecodeBandProc --
+ *
+ *	This function is invoked by the event loop when the worker thread
+ *	sends back a band of rows. Unless the image or its interpreter has
+ *	been deleted in the meantime, the rows are put into the image. The
+ *	last event of a job reports the error the worker stopped on, if any,
+ *	as a background error and frees the job.
+ *
+ * Results:
+ *	Always 1, the event has been handled.
+ *
+ * Side effects:
+ *	The image changes. The job may be cancelled or freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DecodeBandProc(
+    Tcl_Event *evPtr,		/* The band. */
+    TCL_UNUSED(int))		/* Flags passed to the event loop. */
+{
+    DecodeBand *bandPtr = (DecodeBand *)evPtr;
+    DecodeJob *jobPtr = bandPtr->jobPtr;
+    Tcl_Interp *interp = jobPtr->interp;
+    int cancel = 0;
+
+    if (!jobPtr->cancelled) {
+	cancel = Tcl_InterpDeleted(interp) || (Tk_FindPhoto(interp,
+		jobPtr->imageName) != jobPtr->imageHandle);
+    }
+    if (!jobPtr->cancelled && !cancel && (bandPtr->numRows > 0)) {
+	int firstRow = bandPtr->firstRow;
+	int endRow = firstRow + bandPtr->numRows;
+
+	/*
+	 * Only the rows from srcY to srcY+height are wanted.
+	 */
+
+	if (firstRow < jobPtr->srcY) {
+	    firstRow = jobPtr->srcY;
+	}
+	if (endRow > jobPtr->srcY + jobPtr->height) {
+	    endRow = jobPtr->srcY + jobPtr->height;
+	}
+	if (firstRow < endRow) {
+	    Tk_PhotoImageBlock block = jobPtr->block;
+
+	    block.pixelPtr += jobPtr->srcX * block.pixelSize
+		    + firstRow * block.pitch;
+	    if (Tk_PhotoPutBlock(interp, jobPtr->imageHandle, &block,
+		    jobPtr->destX, jobPtr->destY + firstRow - jobPtr->srcY,
+		    jobPtr->width, endRow - firstRow,
+		    TK_PHOTO_COMPOSITE_SET) != TCL_OK) {
+		Tcl_BackgroundException(interp, TCL_ERROR);
+		cancel = 1;
+	    }
+	}
+    }
+    if (cancel) {
+	Tcl_MutexLock(&decodeMutex);
+	jobPtr->cancelled = 1;
+	Tcl_MutexUnlock(&decodeMutex);
+    }
+
+    if (bandPtr->last) {
+	if ((jobPtr->errorMsg != NULL) && !jobPtr->cancelled) {
+	    Tcl_SetObjResult(interp, Tcl_NewStringObj(jobPtr->errorMsg,
+		    TCL_INDEX_NONE));
+	    if (jobPtr->errorCode != NULL) {
+		Tcl_SetObjErrorCode(interp, Tcl_NewStringObj(
+			jobPtr->errorCode, TCL_INDEX_NONE));
+	    }
+	    Tcl_AppendObjToErrorInfo(interp, Tcl_ObjPrintf(
+		    "\n    (decoding PNG image \"%s\")", jobPtr->imageName));
+	    Tcl_BackgroundException(interp, TCL_ERROR);
+	}
+	Tcl_Release(interp);
+	if (jobPtr->errorMsg != NULL) {
+	    ckfree(jobPtr->errorMsg);
+	}
+	if (jobPtr->errorCode != NULL) {
+	    ckfree(jobPtr->errorCode);
+	}
+	ckfree(jobPtr->imageName);
+	ckfree(jobPtr->block.pixelPtr);
+	ckfree(jobPtr->data);
+	ckfree(jobPtr);
+    }
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FileMatchPNG --
+ *
+ *	This function is invoked by the photo image type to see if a file
+ *	contains image data in PNG format.
+ *
+ * Results:
+ *	The return value is 1 if the first characters in file f look like PNG
+ *	data, and 0 otherwise.
+ *
+ * Side effects:
+ *	The access position in f may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+FileMatchPNG(
+    Tcl_Interp *interp,		/* Interpreter to use for reporting errors. */
+    Tcl_Channel chan,		/* The image file, open for reading. */
+    TCL_UNUSED(const char *),	/* The name of the image file. */
     TCL_UNUSED(Tcl_Obj *),	/* User-specified format object, or NULL. */
     TCL_UNUSED(Tcl_Obj *),	/* metadata input, may be NULL */
     int *widthPtr, int *heightPtr,
@@ -3319,85 +4358,315 @@ WriteIHDR(
 /*
  *----------------------------------------------------------------------
  *
- * WriteIDAT --
+ * PackLine --
  *
- *	Writes the IDAT (data) chunk to the PNG image, containing the pixel
- *	channel data. Currently, image lines are not filtered and writing
- *	interlaced pixels is not supported.
+ *	Copies one row of a photo image block into the channel layout of the
+ *	PNG color type chosen for it, without the filter type byte.
  *
  * Results:
- *	TCL_OK, or TCL_ERROR if the write fails.
+ *	None.
  *
  * Side effects:
- *	None
+ *	The row is written to destPtr.
  *
  *----------------------------------------------------------------------
  */
 
-static int
-WriteIDAT(
-    Tcl_Interp *interp,
+static void
+PackLine(
     PNGImage *pngPtr,
-    Tk_PhotoImageBlock *blockPtr)
+    Tk_PhotoImageBlock *blockPtr,
+    const unsigned char *srcPtr,
+    unsigned char *destPtr)
 {
-    int rowNum, flush = TCL_ZLIB_NO_FLUSH, result;
-    Tcl_Obj *outputObj;
-    unsigned char *outputBytes;
-    Tcl_Size outputSize;
+    int colNum, width = blockPtr->width, pixelSize = blockPtr->pixelSize;
+    const unsigned char *r = srcPtr + blockPtr->offset[0];
+    const unsigned char *g = srcPtr + blockPtr->offset[1];
+    const unsigned char *b = srcPtr + blockPtr->offset[2];
+    const unsigned char *a = srcPtr + blockPtr->offset[3];
 
     /*
-     * Filter and compress each row one at a time.
+     * The commonest layout by far is the RGBA one used by the photo image
+     * itself, which needs no reordering at all.
      */
 
-    for (rowNum=0 ; rowNum < blockPtr->height ; rowNum++) {
-	int colNum;
-	unsigned char *srcPtr, *destPtr;
-
-	srcPtr = blockPtr->pixelPtr + (rowNum * blockPtr->pitch);
-	destPtr = Tcl_SetByteArrayLength(pngPtr->thisLineObj,
-		pngPtr->lineSize);
-
-	/*
-	 * TODO: use Paeth filtering.
-	 */
-
-	*destPtr++ = PNG_FILTER_NONE;
+    switch (pngPtr->colorType) {
+    case PNG_COLOR_RGBA:
+	if ((pixelSize == 4) && (blockPtr->offset[0] == 0)
+		&& (blockPtr->offset[1] == 1) && (blockPtr->offset[2] == 2)
+		&& (blockPtr->offset[3] == 3)) {
+	    memcpy(destPtr, srcPtr, 4 * (size_t) width);
+	    break;
+	}
+	for (colNum = 0 ; colNum < width ; colNum++) {
+	    *destPtr++ = *r;
+	    *destPtr++ = *g;
+	    *destPtr++ = *b;
+	    *destPtr++ = *a;
+	    r += pixelSize;
+	    g += pixelSize;
+	    b += pixelSize;
+	    a += pixelSize;
+	}
+	break;
+    case PNG_COLOR_RGB:
+	for (colNum = 0 ; colNum < width ; colNum++) {
+	    *destPtr++ = *r;
+	    *destPtr++ = *g;
+	    *destPtr++ = *b;
+	    r += pixelSize;
+	    g += pixelSize;
+	    b += pixelSize;
+	}
+	break;
+    case PNG_COLOR_GRAYALPHA:
+	for (colNum = 0 ; colNum < width ; colNum++) {
+	    *destPtr++ = *r;
+	    *destPtr++ = *a;
+	    r += pixelSize;
+	    a += pixelSize;
+	}
+	break;
+    default:
+	for (colNum = 0 ; colNum < width ; colNum++) {
+	    *destPtr++ = *r;
+	    r += pixelSize;
+	}
+	break;
+    }
+}
 
-	/*
-	 * Copy each pixel into the destination buffer after the filter type
-	 * before filtering.
-	 */
+/*
+ *----------------------------------------------------------------------
+ *
+ * FilterLine --
+ *
+ *	Applies one of the PNG filter algorithms to a row of len bytes with
+ *	bpp bytes per pixel, given the previous row (all zeroes for the first
+ *	row of the image).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The filtered bytes are written to dest, which must not overlap raw.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	for (colNum = 0 ; colNum < blockPtr->width ; colNum++) {
-	    /*
-	     * Copy red or gray channel.
-	     */
+static void
+FilterLine(
+    int filterType,
+    const unsigned char *raw,
+    const unsigned char *prior,
+    unsigned char *dest,
+    int len,
+    int bpp)
+{
+    int i;
 
-	    *destPtr++ = srcPtr[blockPtr->offset[0]];
+    switch (filterType) {
+    case PNG_FILTER_SUB:
+	for (i = 0 ; i < bpp ; i++) {
+	    dest[i] = raw[i];
+	}
+	for (; i < len ; i++) {
+	    dest[i] = (unsigned char) (raw[i] - raw[i - bpp]);
+	}
+	break;
+    case PNG_FILTER_UP:
+	for (i = 0 ; i < len ; i++) {
+	    dest[i] = (unsigned char) (raw[i] - prior[i]);
+	}
+	break;
+    case PNG_FILTER_AVG:
+	for (i = 0 ; i < bpp ; i++) {
+	    dest[i] = (unsigned char) (raw[i] - prior[i] / 2);
+	}
+	for (; i < len ; i++) {
+	    dest[i] = (unsigned char)
+		    (raw[i] - ((int) raw[i - bpp] + (int) prior[i]) / 2);
+	}
+	break;
+    case PNG_FILTER_PAETH:
+	for (i = 0 ; i < bpp ; i++) {
+	    dest[i] = (unsigned char) (raw[i] - prior[i]);
+	}
+	for (; i < len ; i++) {
+	    dest[i] = (unsigned char) (raw[i] -
+		    Paeth(raw[i - bpp], prior[i], prior[i - bpp]));
+	}
+	break;
+    default:
+	memcpy(dest, raw, len);
+	break;
+    }
+}
 
-	    /*
-	     * If not grayscale, copy the green and blue channels.
-	     */
+/*
+ *----------------------------------------------------------------------
+ *
+ * LineCost --
+ *
+ *	Estimates how well a filtered row will compress, as the sum of its
+ *	bytes taken as signed differences. This is the heuristic recommended
+ *	by the PNG specification for choosing a filter for each line. The sum
+ *	stops early once it reaches limit.
+ *
+ * Results:
+ *	The cost of the line; lower is better.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	    if (pngPtr->colorType & PNG_COLOR_USED) {
-		*destPtr++ = srcPtr[blockPtr->offset[1]];
-		*destPtr++ = srcPtr[blockPtr->offset[2]];
-	    }
+static unsigned long
+LineCost(
+    const unsigned char *line,
+    int len,
+    unsigned long limit)
+{
+    unsigned long sum = 0;
+    int i;
 
-	    /*
-	     * Copy the alpha channel, if used.
-	     */
+    for (i = 0 ; i < len ; i++) {
+	sum += (line[i] < 128) ? line[i] : 256 - line[i];
+	if (((i & 63) == 63) && (sum >= limit)) {
+	    break;
+	}
+    }
+    return sum;
+}
 
-	    if (pngPtr->colorType & PNG_COLOR_ALPHA) {
-		*destPtr++ = srcPtr[blockPtr->offset[3]];
-	    }
+/*
+ *----------------------------------------------------------------------
+ *
+ * FilterRow --
+ *
+ *	Filters one packed row as selected by the -filter format option,
+ *	given the packed row above it. The "adaptive" setting tries each
+ *	filter in turn in the 2 * (lineSize - 1) bytes of scratch space.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The filter type byte and the filtered row, lineSize bytes in all, are
+ *	written to destPtr.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	    /*
-	     * Point to the start of the next pixel.
-	     */
+static void
+FilterRow(
+    PNGImage *pngPtr,
+    const unsigned char *thisRaw,
+    const unsigned char *lastRaw,
+    unsigned char *scratch,
+    unsigned char *destPtr)
+{
+    int rawSize = pngPtr->lineSize - 1;
+    int bpp = pngPtr->bytesPerPixel;
+
+    if (pngPtr->filterType == PNG_FILTER_ADAPTIVE) {
+	/*
+	 * Try each filter and keep the one whose output looks most
+	 * compressible.
+	 */
 
-	    srcPtr += blockPtr->pixelSize;
+	unsigned char *trial = scratch, *best = scratch + rawSize;
+	unsigned long cost, bestCost = LineCost(thisRaw, rawSize, ULONG_MAX);
+	int type, bestType = PNG_FILTER_NONE;
+
+	for (type = PNG_FILTER_SUB ; type <= PNG_FILTER_PAETH ; type++) {
+	    FilterLine(type, thisRaw, lastRaw, trial, rawSize, bpp);
+	    cost = LineCost(trial, rawSize, bestCost);
+	    if (cost < bestCost) {
+		unsigned char *temp = best;
+
+		best = trial;
+		trial = temp;
+		bestCost = cost;
+		bestType = type;
+	    }
 	}
+	*destPtr++ = (unsigned char) bestType;
+	memcpy(destPtr, (bestType == PNG_FILTER_NONE) ? thisRaw : best,
+		rawSize);
+    } else {
+	*destPtr++ = (unsigned char) pngPtr->filterType;
+	FilterLine(pngPtr->filterType, thisRaw, lastRaw, destPtr,
+		rawSize, bpp);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WriteIDAT --
+ *
+ *	Writes the IDAT (data) chunk to the PNG image, containing the pixel
+ *	channel data. Each line is filtered as selected by the -filter format
+ *	option, which by default leaves the lines unfiltered. Writing
+ *	interlaced pixels is not supported. Large images are handed over to
+ *	WriteIDATParallel.
+ *
+ * Results:
+ *	TCL_OK, or TCL_ERROR if the write fails.
+ *
+ * Side effects:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+WriteIDAT(
+    Tcl_Interp *interp,
+    PNGImage *pngPtr,
+    Tk_PhotoImageBlock *blockPtr)
+{
+    int rowNum, flush = TCL_ZLIB_NO_FLUSH, result;
+    int rawSize = pngPtr->lineSize - 1;
+    unsigned char *rawBuf, *thisRaw, *lastRaw;
+    Tcl_Obj *outputObj;
+    unsigned char *outputBytes;
+    Tcl_Size outputSize;
+
+    if ((pngPtr->blockLen >= PNG_PARALLEL_BYTES) && StartEncodeThreads()) {
+	return WriteIDATParallel(interp, pngPtr, blockPtr);
+    }
+
+    /*
+     * Unfiltered copies of this line and the last one, which the filters
+     * refer to, and room for trying out filters on the line.
+     */
+
+    rawBuf = (unsigned char *)attemptckalloc(4 * (size_t) rawSize + 1);
+    if (!rawBuf) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		"memory allocation failed", TCL_INDEX_NONE));
+	Tcl_SetErrorCode(interp, "TK", "MALLOC", NULL);
+	return TCL_ERROR;
+    }
+    thisRaw = rawBuf;
+    lastRaw = thisRaw + rawSize;
+    memset(lastRaw, 0, rawSize);
+
+    /*
+     * Filter and compress each row one at a time.
+     */
+
+    for (rowNum=0 ; rowNum < blockPtr->height ; rowNum++) {
+	unsigned char *destPtr;
+
+	PackLine(pngPtr, blockPtr,
+		blockPtr->pixelPtr + (size_t) rowNum * blockPtr->pitch, thisRaw);
+	destPtr = Tcl_SetByteArrayLength(pngPtr->thisLineObj,
+		pngPtr->lineSize);
+	FilterRow(pngPtr, thisRaw, lastRaw, rawBuf + 2 * rawSize, destPtr);
 
 	/*
 	 * Compress the line of pixels into the destination. If this is the
@@ -3411,6 +4680,7 @@ WriteIDAT(
 	}
 	if (Tcl_ZlibStreamPut(pngPtr->stream, pngPtr->thisLineObj,
 		flush) != TCL_OK) {
+	    ckfree(rawBuf);
 	    Tcl_SetObjResult(interp, Tcl_NewStringObj(
 		    "deflate() returned error", TCL_INDEX_NONE));
 	    Tcl_SetErrorCode(interp, "TK", "IMAGE", "PNG", "DEFLATE", NULL);
@@ -3422,12 +4692,13 @@ WriteIDAT(
 	 */
 
 	{
-	    Tcl_Obj *temp = pngPtr->lastLineObj;
+	    unsigned char *temp = lastRaw;
 
-	    pngPtr->lastLineObj = pngPtr->thisLineObj;
-	    pngPtr->thisLineObj = temp;
+	    lastRaw = thisRaw;
+	    thisRaw = temp;
 	}
     }
+    ckfree(rawBuf);
 
     /*
      * Now get the compressed data and write it as one big IDAT chunk.
@@ -3441,6 +4712,435 @@ WriteIDAT(
     return result;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * StartEncodeThreads --
+ *
+ *	Starts the worker threads that compress large images, unless that has
+ *	been done already.
+ *
+ * Results:
+ *	Returns 1 if the workers are running, and 0 otherwise.
+ *
+ * Side effects:
+ *	Threads may be created, with an exit handler to stop them.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+StartEncodeThreads(void)
+{
+    int running;
+
+    Tcl_MutexLock(&encodeMutex);
+    if (encodeWorkerState == 0) {
+	encodeWorkerState = 1;
+	while ((numEncodeThreads < PNG_ENCODE_THREADS)
+		&& (Tcl_CreateThread(&encodeThreads[numEncodeThreads],
+		EncodeThreadProc, NULL, TCL_THREAD_STACK_DEFAULT,
+		TCL_THREAD_JOINABLE) == TCL_OK)) {
+	    numEncodeThreads++;
+	}
+	if (numEncodeThreads > 0) {
+	    Tcl_CreateExitHandler(EncodeThreadsExitProc, NULL);
+	} else {
+	    encodeWorkerState = -1;
+	}
+    }
+    running = (encodeWorkerState == 1);
+    Tcl_MutexUnlock(&encodeMutex);
+    return running;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Adler32Combine --
+ *
+ *	Computes the Adler-32 checksum of two blocks of data laid end to end
+ *	from the checksums of each, given the length of the second block. This
+ *	is the same computation as zlib's adler32_combine(), which Tcl does not
+ *	export.
+ *
+ * Results:
+ *	The combined checksum.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned int
+Adler32Combine(
+    unsigned int adler1,
+    unsigned int adler2,
+    size_t len2)
+{
+    const unsigned long base = 65521;	/* Largest prime below 65536. */
+    unsigned long sum1, sum2, rem = (unsigned long) (len2 % base);
+
+    sum1 = adler1 & 0xFFFF;
+    sum2 = (rem * sum1) % base;
+    sum1 += (adler2 & 0xFFFF) + base - 1;
+    sum2 += ((adler1 >> 16) & 0xFFFF) + ((adler2 >> 16) & 0xFFFF) + base - rem;
+    if (sum1 >= base) {
+	sum1 -= base;
+    }
+    if (sum1 >= base) {
+	sum1 -= base;
+    }
+    if (sum2 >= (base << 1)) {
+	sum2 -= (base << 1);
+    }
+    if (sum2 >= base) {
+	sum2 -= base;
+    }
+    return (unsigned int) (sum1 | (sum2 << 16));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WriteIDATParallel --
+ *
+ *	Writes the IDAT chunk of a large image, like WriteIDAT, with the rows
+ *	compressed in bands by the calling thread and the worker threads. The
+ *	chunk holds a zlib header, the raw deflate data of every band in order
+ *	and the Adler-32 checksum of all the filtered lines. Lines are
+ *	filtered exactly as WriteIDAT does, so only the deflate blocks differ.
+ *
+ * Results:
+ *	TCL_OK, or TCL_ERROR if the write fails.
+ *
+ * Side effects:
+ *	None
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+WriteIDATParallel(
+    Tcl_Interp *interp,
+    PNGImage *pngPtr,
+    Tk_PhotoImageBlock *blockPtr)
+{
+    EncodeJob job, **jobPtrPtr;
+    int i, rowsPerBand, header, level = pngPtr->level, result = TCL_OK;
+    unsigned int adler = 0;
+    size_t outputSize = 6;
+    unsigned char *outputBytes, *p;
+
+    rowsPerBand = PNG_BAND_BYTES / pngPtr->lineSize;
+    if (rowsPerBand < 1) {
+	rowsPerBand = 1;
+    }
+    job.pngPtr = pngPtr;
+    job.blockPtr = blockPtr;
+    job.numBands = (blockPtr->height + rowsPerBand - 1) / rowsPerBand;
+    job.nextBand = 0;
+    job.bandsDone = 0;
+    job.bands = (EncodeBand *)attemptckalloc(
+	    job.numBands * sizeof(EncodeBand));
+    if (!job.bands) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		"memory allocation failed", TCL_INDEX_NONE));
+	Tcl_SetErrorCode(interp, "TK", "MALLOC", NULL);
+	return TCL_ERROR;
+    }
+    for (i = 0 ; i < job.numBands ; i++) {
+	job.bands[i].firstRow = i * rowsPerBand;
+	job.bands[i].numRows = blockPtr->height - job.bands[i].firstRow;
+	if (job.bands[i].numRows > rowsPerBand) {
+	    job.bands[i].numRows = rowsPerBand;
+	}
+	job.bands[i].data = NULL;
+    }
+
+    Tcl_MutexLock(&encodeMutex);
+    job.nextPtr = encodeQueue;
+    encodeQueue = &job;
+    Tcl_ConditionNotify(&encodeCond);
+    CompressBands(&job);
+    while (job.bandsDone < job.numBands) {
+	Tcl_ConditionWait(&encodeDoneCond, &encodeMutex, NULL);
+    }
+    for (jobPtrPtr = &encodeQueue; *jobPtrPtr != &job;
+	    jobPtrPtr = &(*jobPtrPtr)->nextPtr) {
+	/* Empty loop body. */
+    }
+    *jobPtrPtr = job.nextPtr;
+    Tcl_MutexUnlock(&encodeMutex);
+
+    for (i = 0 ; i < job.numBands ; i++) {
+	if (!job.bands[i].data) {
+	    Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		    "deflate() returned error", TCL_INDEX_NONE));
+	    Tcl_SetErrorCode(interp, "TK", "IMAGE", "PNG", "DEFLATE", NULL);
+	    result = TCL_ERROR;
+	    goto done;
+	}
+	outputSize += job.bands[i].size;
+    }
+    outputBytes = (unsigned char *)attemptckalloc(outputSize);
+    if (!outputBytes) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		"memory allocation failed", TCL_INDEX_NONE));
+	Tcl_SetErrorCode(interp, "TK", "MALLOC", NULL);
+	result = TCL_ERROR;
+	goto done;
+    }
+
+    /*
+     * The zlib header gives the window size and the compression level,
+     * the latter as in deflateInit(), and is a multiple of 31.
+     */
+
+    header = 0x7800 | ((level == TCL_ZLIB_COMPRESS_DEFAULT) ? 2 << 6
+	    : (level < 2) ? 0 : (level < 6) ? 1 << 6
+	    : (level == 6) ? 2 << 6 : 3 << 6);
+    header += 31 - (header % 31);
+    p = outputBytes;
+    *p++ = (unsigned char) (header >> 8);
+    *p++ = (unsigned char) header;
+    for (i = 0 ; i < job.numBands ; i++) {
+	memcpy(p, job.bands[i].data, job.bands[i].size);
+	p += job.bands[i].size;
+	adler = (i == 0) ? job.bands[i].adler : Adler32Combine(adler,
+		job.bands[i].adler,
+		(size_t) job.bands[i].numRows * pngPtr->lineSize);
+    }
+    *p++ = (unsigned char) (adler >> 24);
+    *p++ = (unsigned char) (adler >> 16);
+    *p++ = (unsigned char) (adler >> 8);
+    *p++ = (unsigned char) adler;
+
+    result = WriteChunk(interp, pngPtr, CHUNK_IDAT, outputBytes,
+	    (Tcl_Size) outputSize);
+    ckfree(outputBytes);
+
+  done:
+    for (i = 0 ; i < job.numBands ; i++) {
+	if (job.bands[i].data) {
+	    ckfree(job.bands[i].data);
+	}
+    }
+    ckfree(job.bands);
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompressBands --
+ *
+ *	Takes bands of a job that nobody has taken yet and compresses them,
+ *	until there are none left. Must be called with encodeMutex locked;
+ *	the mutex is released while a band is being compressed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The compressed data of the bands is stored in them. The owner of the
+ *	job is signalled when its last band is done.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CompressBands(
+    EncodeJob *jobPtr)
+{
+    while (jobPtr->nextBand < jobPtr->numBands) {
+	EncodeBand *bandPtr = &jobPtr->bands[jobPtr->nextBand++];
+
+	Tcl_MutexUnlock(&encodeMutex);
+	CompressBand(jobPtr, bandPtr);
+	Tcl_MutexLock(&encodeMutex);
+	if (++jobPtr->bandsDone == jobPtr->numBands) {
+	    Tcl_ConditionNotify(&encodeDoneCond);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompressBand --
+ *
+ *	Packs, filters and compresses the rows of one band into raw deflate
+ *	data, with a deflate stream and Tcl_Objs of the calling thread's own.
+ *	The band ends with a full flush so that the next band can follow it
+ *	directly, or with the final deflate block if it is the last one.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The compressed data and the checksum of the filtered rows are stored
+ *	in the band; the data is left NULL if anything fails.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CompressBand(
+    EncodeJob *jobPtr,
+    EncodeBand *bandPtr)
+{
+    PNGImage *pngPtr = jobPtr->pngPtr;
+    Tk_PhotoImageBlock *blockPtr = jobPtr->blockPtr;
+    int rowNum, flush = TCL_ZLIB_NO_FLUSH;
+    int lastRow = bandPtr->firstRow + bandPtr->numRows - 1;
+    int rawSize = pngPtr->lineSize - 1;
+    unsigned char *rawBuf, *thisRaw, *lastRaw, *outputBytes;
+    unsigned int adler = Tcl_ZlibAdler32(0, NULL, 0);
+    Tcl_ZlibStream stream;
+    Tcl_Obj *lineObj, *outputObj;
+    Tcl_Size outputSize;
+
+    rawBuf = (unsigned char *)attemptckalloc(4 * (size_t) rawSize + 1);
+    if (!rawBuf) {
+	return;
+    }
+    if (Tcl_ZlibStreamInit(NULL, TCL_ZLIB_STREAM_DEFLATE,
+	    TCL_ZLIB_FORMAT_RAW, pngPtr->level, NULL, &stream) != TCL_OK) {
+	ckfree(rawBuf);
+	return;
+    }
+    lineObj = Tcl_NewObj();
+    Tcl_IncrRefCount(lineObj);
+
+    /*
+     * The filters of the first row refer to the row above the band.
+     */
+
+    thisRaw = rawBuf;
+    lastRaw = thisRaw + rawSize;
+    if (bandPtr->firstRow > 0) {
+	PackLine(pngPtr, blockPtr, blockPtr->pixelPtr
+		+ (size_t) (bandPtr->firstRow - 1) * blockPtr->pitch, lastRaw);
+    } else {
+	memset(lastRaw, 0, rawSize);
+    }
+
+    for (rowNum = bandPtr->firstRow ; rowNum <= lastRow ; rowNum++) {
+	unsigned char *destPtr, *temp;
+
+	PackLine(pngPtr, blockPtr,
+		blockPtr->pixelPtr + (size_t) rowNum * blockPtr->pitch, thisRaw);
+	destPtr = Tcl_SetByteArrayLength(lineObj, pngPtr->lineSize);
+	FilterRow(pngPtr, thisRaw, lastRaw, rawBuf + 2 * rawSize, destPtr);
+	adler = Tcl_ZlibAdler32(adler, destPtr, pngPtr->lineSize);
+
+	if (rowNum == lastRow) {
+	    flush = (rowNum + 1 == blockPtr->height)
+		    ? TCL_ZLIB_FINALIZE : TCL_ZLIB_FULLFLUSH;
+	}
+	if (Tcl_ZlibStreamPut(stream, lineObj, flush) != TCL_OK) {
+	    break;
+	}
+
+	temp = lastRaw;
+	lastRaw = thisRaw;
+	thisRaw = temp;
+    }
+
+    if (rowNum > lastRow) {
+	outputObj = Tcl_NewObj();
+	(void) Tcl_ZlibStreamGet(stream, outputObj, TCL_INDEX_NONE);
+	outputBytes = Tcl_GetByteArrayFromObj(outputObj, &outputSize);
+	bandPtr->data = (unsigned char *)attemptckalloc(
+		outputSize ? outputSize : 1);
+	if (bandPtr->data) {
+	    memcpy(bandPtr->data, outputBytes, outputSize);
+	    bandPtr->size = outputSize;
+	    bandPtr->adler = adler;
+	}
+	Tcl_DecrRefCount(outputObj);
+    }
+    Tcl_DecrRefCount(lineObj);
+    Tcl_ZlibStreamClose(stream);
+    ckfree(rawBuf);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EncodeThreadProc --
+ *
+ *	The body of a worker thread: helps with the bands of the jobs in the
+ *	queue until it is told to quit.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Bands of the jobs are compressed. The thread's Tcl data is released
+ *	when it quits.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_ThreadCreateType
+EncodeThreadProc(
+    TCL_UNUSED(void *))
+{
+    EncodeJob *jobPtr;
+
+    Tcl_MutexLock(&encodeMutex);
+    while (encodeWorkerState == 1) {
+	for (jobPtr = encodeQueue; jobPtr != NULL; jobPtr = jobPtr->nextPtr) {
+	    if (jobPtr->nextBand < jobPtr->numBands) {
+		break;
+	    }
+	}
+	if (jobPtr == NULL) {
+	    Tcl_ConditionWait(&encodeCond, &encodeMutex, NULL);
+	} else {
+	    CompressBands(jobPtr);
+	}
+    }
+    Tcl_MutexUnlock(&encodeMutex);
+    Tcl_FinalizeThread();
+    TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EncodeThreadsExitProc --
+ *
+ *	Tells the worker threads to quit and waits for them, so that none is
+ *	left waiting on a condition while Tcl is finalized.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The worker threads exit.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+EncodeThreadsExitProc(
+    TCL_UNUSED(void *))
+{
+    int i, result;
+
+    Tcl_MutexLock(&encodeMutex);
+    encodeWorkerState = -1;
+    Tcl_ConditionNotify(&encodeCond);
+    Tcl_MutexUnlock(&encodeMutex);
+    for (i = 0; i < numEncodeThreads; i++) {
+	Tcl_JoinThread(encodeThreads[i], &result);
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -3596,8 +5296,9 @@ WriteExtraChunks(
  * EncodePNG --
  *
  *	This function handles the entirety of writing a PNG file (or data)
- *	from the first byte to the last. No effort is made to optimize the
- *	image data for best compression.
+ *	from the first byte to the last. The compression level and line
+ *	filters may be chosen with the -format option; by default the lines
+ *	are not filtered.
  *
  * Results:
  *	TCL_OK, or TCL_ERROR if an I/O or memory error occurs.
@@ -3613,10 +5314,33 @@ EncodePNG(
     Tcl_Interp *interp,
     Tk_PhotoImageBlock *blockPtr,
     PNGImage *pngPtr,
+    Tcl_Obj *fmtObj,
     Tcl_Obj *metadataInObj)
 {
     int greenOffset, blueOffset, alphaOffset;
 
+    /*
+     * Extract the compression level and filter type from the -format
+     * object, if specified. The deflate stream was set up with the default
+     * level, so replace it if another one is wanted.
+     */
+
+    if (ParseFormat(interp, fmtObj, pngPtr) == TCL_ERROR) {
+	return TCL_ERROR;
+    }
+    if (pngPtr->level != TCL_ZLIB_COMPRESS_DEFAULT) {
+	Tcl_ZlibStreamClose(pngPtr->stream);
+	pngPtr->stream = NULL;
+	if (Tcl_ZlibStreamInit(NULL, TCL_ZLIB_STREAM_DEFLATE,
+		TCL_ZLIB_FORMAT_ZLIB, pngPtr->level, NULL,
+		&pngPtr->stream) != TCL_OK) {
+	    Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		    "zlib initialization failed", TCL_INDEX_NONE));
+	    Tcl_SetErrorCode(interp, "TK", "IMAGE", "PNG", "ZLIB_INIT", NULL);
+	    return TCL_ERROR;
+	}
+    }
+
     /*
      * Determine appropriate color type based on color usage (e.g., only red
      * and maybe alpha channel = grayscale).
@@ -3737,7 +5461,7 @@ static int
 FileWritePNG(
     Tcl_Interp *interp,
     const char *filename,
-    TCL_UNUSED(Tcl_Obj *),
+    Tcl_Obj *fmtObj,
     Tcl_Obj *metadataInObj,
     Tk_PhotoImageBlock *blockPtr)
 {
@@ -3774,7 +5498,7 @@ FileWritePNG(
      * Write the raw PNG data out to the file.
      */
 
-    result = EncodePNG(interp, blockPtr, &png, metadataInObj);
+    result = EncodePNG(interp, blockPtr, &png, fmtObj, metadataInObj);
 
   cleanup:
     Tcl_Close(interp, chan);
@@ -3803,7 +5527,7 @@ FileWritePNG(
 static int
 StringWritePNG(
     Tcl_Interp *interp,
-    TCL_UNUSED(Tcl_Obj *),
+    Tcl_Obj *fmtObj,
     Tcl_Obj *metadataInObj,
     Tk_PhotoImageBlock *blockPtr)
 {
@@ -3825,7 +5549,7 @@ StringWritePNG(
      * back to the interpreter if successful.
      */
 
-    result = EncodePNG(interp, blockPtr, &png, metadataInObj);
+    result = EncodePNG(interp, blockPtr, &png, fmtObj, metadataInObj);
 
     if (TCL_OK == result) {
 	Tcl_SetObjResult(interp, png.objDataPtr);
@@ -105,6 +105,29 @@ static const char *const optionNames[] = {
 #define TK_PHOTO_ALLOC_FAILURE_MESSAGE \
 	"not enough free memory for image buffer"
 
+/*
+ * The loops copying pixels into photos use SSE2 when the compiler provides
+ * it, which is always the case on x86-64. Elsewhere plain C loops are used,
+ * written so that compilers can vectorize them.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) \
+	|| (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#   define PHOTO_USE_SSE2 1
+#   include <emmintrin.h>
+#endif
+
+/*
+ * Bits returned by PutSpan to describe the alpha values of the pixels it
+ * stored:
+ *
+ * PHOTO_ALPHA_TRANSPARENT -	Some pixels are fully transparent.
+ * PHOTO_ALPHA_PARTIAL -	Some pixels are partially transparent.
+ */
+
+#define PHOTO_ALPHA_TRANSPARENT	1
+#define PHOTO_ALPHA_PARTIAL	2
+
 /*
  * Functions used in the type record for photo images.
  */
@@ -196,6 +219,12 @@ static int		ImgPhotoConfigureModel(Tcl_Interp *interp,
 			    PhotoModel *modelPtr, Tcl_Size objc,
 			    Tcl_Obj *const objv[], int flags);
 static int		ToggleComplexAlphaIfNeeded(PhotoModel *mPtr);
+static int		AlphaIsComplex(const unsigned char *pixelPtr,
+			    size_t count);
+static int		PutSpan(unsigned char *destPtr,
+			    const unsigned char *srcPtr, int count,
+			    int pixelSize, int greenOffset, int blueOffset,
+			    int alphaOffset);
 static int		ImgPhotoSetSize(PhotoModel *modelPtr, int width,
 			    int height);
 static char *		ImgGetPhoto(PhotoModel *modelPtr,
@@ -2305,8 +2334,6 @@ ToggleComplexAlphaIfNeeded(
 {
     size_t len = (size_t)MAX(mPtr->userWidth, mPtr->width) *
 	    (size_t)MAX(mPtr->userHeight, mPtr->height) * 4;
-    unsigned char *c = mPtr->pix32;
-    unsigned char *end;
 
     /*
      * Set the COMPLEX_ALPHA flag if we have an image with partially
@@ -2314,19 +2341,228 @@ ToggleComplexAlphaIfNeeded(
      */
 
     mPtr->flags &= ~COMPLEX_ALPHA;
-    if (c == NULL) {
+    if (mPtr->pix32 == NULL) {
 	return 0;
     }
-    end = c + len;
-    c += 3;			/* Start at first alpha byte. */
-    for (; c < end; c += 4) {
-	if (*c && *c != 255) {
-	    mPtr->flags |= COMPLEX_ALPHA;
-	    break;
-	}
+    if (AlphaIsComplex(mPtr->pix32, len / 4)) {
+	mPtr->flags |= COMPLEX_ALPHA;
     }
     return (mPtr->flags & COMPLEX_ALPHA);
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AlphaIsComplex --
+ *
+ *	Tells whether some pixels in a run of 32-bit RGBA pixels are
+ *	partially transparent.
+ *
+ * Results:
+ *	1 if such a pixel is found, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+AlphaIsComplex(
+    const unsigned char *pixelPtr,
+				/* First pixel to examine. */
+    size_t count)		/* Number of pixels to examine. */
+{
+    size_t i = 0;
+    unsigned alpha;
+
+#ifdef PHOTO_USE_SSE2
+    const __m128i alphaMask = _mm_set1_epi32((int) 0xFF000000);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 4 <= count; i += 4) {
+	__m128i a = _mm_and_si128(alphaMask,
+		_mm_loadu_si128((const __m128i *) (pixelPtr + 4*i)));
+	__m128i simple = _mm_or_si128(_mm_cmpeq_epi32(a, zero),
+		_mm_cmpeq_epi32(a, alphaMask));
+
+	if (_mm_movemask_epi8(simple) != 0xFFFF) {
+	    return 1;
+	}
+    }
+#endif /* PHOTO_USE_SSE2 */
+    for (; i < count; i++) {
+	alpha = pixelPtr[4*i + 3];
+	if (alpha - 1 < 254) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PutSpan --
+ *
+ *	Copies a span of pixels from an image block into the 32-bit RGBA pixel
+ *	array of a photo, replacing what was there. The common layouts (RGBA,
+ *	BGRA, RGBX and RGB) have dedicated loops, other layouts go through a
+ *	generic one. The alpha values are classified while they are copied, so
+ *	that the caller doesn't have to scan the pixels again to update the
+ *	valid region and the COMPLEX_ALPHA flag.
+ *
+ * Results:
+ *	A combination of the PHOTO_ALPHA_* bits, 0 if all pixels stored are
+ *	opaque.
+ *
+ * Side effects:
+ *	count pixels are stored at destPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+PutSpan(
+    unsigned char *destPtr,	/* Where to store the first pixel. */
+    const unsigned char *srcPtr,/* Red component of the first source
+				 * pixel. */
+    int count,			/* Number of pixels to copy. */
+    int pixelSize,		/* Bytes between successive source pixels. */
+    int greenOffset,		/* Offset of green component from red. */
+    int blueOffset,		/* Offset of blue component from red. */
+    int alphaOffset)		/* Offset of alpha component from red, or 0
+				 * if the source has no alpha. */
+{
+    const unsigned char *pixPtr;
+    unsigned alpha, transparent = 0, partial = 0;
+    int i = 0;
+#ifdef PHOTO_USE_SSE2
+    const __m128i alphaMask = _mm_set1_epi32((int) 0xFF000000);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i anyZero = zero, anyPartial = zero;
+#endif /* PHOTO_USE_SSE2 */
+
+    if (alphaOffset == 0) {
+	if ((pixelSize == 4) && (greenOffset == 1) && (blueOffset == 2)) {
+	    /*
+	     * RGBX: copy and force the alpha byte to 255. The padding byte of
+	     * the last pixel may lie outside the block, so it isn't loaded.
+	     */
+
+#ifdef PHOTO_USE_SSE2
+	    for (; i + 4 < count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (srcPtr + 4*i));
+
+		_mm_storeu_si128((__m128i *) (destPtr + 4*i),
+			_mm_or_si128(v, alphaMask));
+	    }
+#endif /* PHOTO_USE_SSE2 */
+	    for (; i < count; i++) {
+		destPtr[4*i] = srcPtr[4*i];
+		destPtr[4*i + 1] = srcPtr[4*i + 1];
+		destPtr[4*i + 2] = srcPtr[4*i + 2];
+		destPtr[4*i + 3] = 255;
+	    }
+	} else if ((pixelSize == 3) && (greenOffset == 1)
+		&& (blueOffset == 2)) {
+	    for (; i < count; i++) {
+		destPtr[4*i] = srcPtr[3*i];
+		destPtr[4*i + 1] = srcPtr[3*i + 1];
+		destPtr[4*i + 2] = srcPtr[3*i + 2];
+		destPtr[4*i + 3] = 255;
+	    }
+	} else {
+	    for (; i < count; i++, srcPtr += pixelSize) {
+		*destPtr++ = srcPtr[0];
+		*destPtr++ = srcPtr[greenOffset];
+		*destPtr++ = srcPtr[blueOffset];
+		*destPtr++ = 255;
+	    }
+	}
+	return 0;
+    }
+
+    if ((pixelSize == 4) && (greenOffset == 1) && (blueOffset == 2)
+	    && (alphaOffset == 3)) {
+	/*
+	 * RGBA: same layout as ours, a straight copy.
+	 */
+
+#ifdef PHOTO_USE_SSE2
+	for (; i + 4 <= count; i += 4) {
+	    __m128i v = _mm_loadu_si128((const __m128i *) (srcPtr + 4*i));
+	    __m128i a = _mm_and_si128(v, alphaMask);
+	    __m128i isZero = _mm_cmpeq_epi32(a, zero);
+
+	    _mm_storeu_si128((__m128i *) (destPtr + 4*i), v);
+	    anyZero = _mm_or_si128(anyZero, isZero);
+	    anyPartial = _mm_or_si128(anyPartial, _mm_cmpeq_epi32(zero,
+		    _mm_or_si128(isZero, _mm_cmpeq_epi32(a, alphaMask))));
+	}
+#endif /* PHOTO_USE_SSE2 */
+	memcpy(destPtr + 4*i, srcPtr + 4*i, (size_t) (count - i) * 4);
+	for (; i < count; i++) {
+	    alpha = srcPtr[4*i + 3];
+	    transparent |= (alpha == 0);
+	    partial |= (alpha - 1 < 254);
+	}
+    } else if ((pixelSize == 4) && (greenOffset == -1) && (blueOffset == -2)
+	    && (alphaOffset == 1)) {
+	/*
+	 * BGRA, the native layout of many cameras and toolkits: swap the red
+	 * and blue bytes.
+	 */
+
+	pixPtr = srcPtr - 2;
+#ifdef PHOTO_USE_SSE2
+	{
+	    const __m128i keepMask = _mm_set1_epi32((int) 0xFF00FF00);
+	    const __m128i byteMask = _mm_set1_epi32(0xFF);
+
+	    for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (pixPtr + 4*i));
+		__m128i a = _mm_and_si128(v, alphaMask);
+		__m128i isZero = _mm_cmpeq_epi32(a, zero);
+
+		_mm_storeu_si128((__m128i *) (destPtr + 4*i),
+			_mm_or_si128(_mm_and_si128(v, keepMask), _mm_or_si128(
+			_mm_and_si128(_mm_srli_epi32(v, 16), byteMask),
+			_mm_slli_epi32(_mm_and_si128(v, byteMask), 16))));
+		anyZero = _mm_or_si128(anyZero, isZero);
+		anyPartial = _mm_or_si128(anyPartial, _mm_cmpeq_epi32(zero,
+			_mm_or_si128(isZero, _mm_cmpeq_epi32(a, alphaMask))));
+	    }
+	}
+#endif /* PHOTO_USE_SSE2 */
+	for (; i < count; i++) {
+	    alpha = pixPtr[4*i + 3];
+	    destPtr[4*i] = pixPtr[4*i + 2];
+	    destPtr[4*i + 1] = pixPtr[4*i + 1];
+	    destPtr[4*i + 2] = pixPtr[4*i];
+	    destPtr[4*i + 3] = alpha;
+	    transparent |= (alpha == 0);
+	    partial |= (alpha - 1 < 254);
+	}
+    } else {
+	for (; i < count; i++, srcPtr += pixelSize) {
+	    alpha = srcPtr[alphaOffset];
+	    *destPtr++ = srcPtr[0];
+	    *destPtr++ = srcPtr[greenOffset];
+	    *destPtr++ = srcPtr[blueOffset];
+	    *destPtr++ = alpha;
+	    transparent |= (alpha == 0);
+	    partial |= (alpha - 1 < 254);
+	}
+    }
+
+#ifdef PHOTO_USE_SSE2
+    transparent |= (_mm_movemask_epi8(anyZero) != 0);
+    partial |= (_mm_movemask_epi8(anyPartial) != 0);
+#endif /* PHOTO_USE_SSE2 */
+    return (transparent ? PHOTO_ALPHA_TRANSPARENT : 0)
+	    | (partial ? PHOTO_ALPHA_PARTIAL : 0);
+}
 
 /*
  *----------------------------------------------------------------------
@@ -3069,6 +3305,7 @@ Tk_PhotoPutBlock(
     int wLeft, hLeft, wCopy, hCopy, pitch;
     unsigned char *srcPtr, *srcLinePtr, *destPtr, *destLinePtr;
     int sourceIsSimplePhoto = compRule & SOURCE_IS_SIMPLE_ALPHA_PHOTO;
+    int alphaBits = 0, classified = 1;
     XRectangle rect;
 
     /*
@@ -3181,33 +3418,21 @@ Tk_PhotoPutBlock(
     }
 
     /*
-     * Copy the data into our local 32-bit/pixel array. If we can do it with a
-     * single memmove, we do.
+     * Copy the data into our local 32-bit/pixel array. If the source rows
+     * are laid out back to back just like ours, we copy everything in one
+     * go.
      */
 
     destLinePtr = modelPtr->pix32 + (y * modelPtr->width + x) * 4;
     pitch = modelPtr->width * 4;
 
-    /*
-     * Test to see if we can do the whole write in a single copy. This test is
-     * probably too restrictive. We should also be able to do a memmove if
-     * pixelSize == 3 and alphaOffset == 0. Maybe other cases too.
-     */
-
-    if ((sourceBlock.pixelSize == 4)
-	    && (greenOffset == 1) && (blueOffset == 2) && (alphaOffset == 3)
+    if (((compRule == TK_PHOTO_COMPOSITE_SET) || (alphaOffset == 0))
 	    && (width <= sourceBlock.width) && (height <= sourceBlock.height)
 	    && ((height == 1) || ((x == 0) && (width == modelPtr->width)
-		&& (sourceBlock.pitch == pitch)))
-	    && (compRule == TK_PHOTO_COMPOSITE_SET)) {
-	memmove(destLinePtr, sourceBlock.pixelPtr + sourceBlock.offset[0],
-		((size_t)height * width * 4));
-
-	/*
-	 * We know there's an alpha offset and we're setting the data, so skip
-	 * directly to the point when we recompute the photo validity region.
-	 */
-
+		&& (sourceBlock.pitch == width * sourceBlock.pixelSize)))) {
+	alphaBits = PutSpan(destLinePtr,
+		sourceBlock.pixelPtr + sourceBlock.offset[0], width * height,
+		sourceBlock.pixelSize, greenOffset, blueOffset, alphaOffset);
 	goto recalculateValidRegion;
     }
 
@@ -3223,26 +3448,6 @@ Tk_PhotoPutBlock(
 	hCopy = MIN(hLeft, sourceBlock.height);
 	hLeft -= hCopy;
 	for (; hCopy > 0; --hCopy) {
-	    /*
-	     * If the layout of the source line matches our memory layout and
-	     * we're setting, we can just copy the bytes directly, which is
-	     * much faster.
-	     */
-
-	    if ((pixelSize == 4) && (greenOffset == 1)
-		    && (blueOffset == 2) && (alphaOffset == 3)
-		    && (width <= sourceBlock.width)
-		    && compRuleSet) {
-		memcpy(destLinePtr, srcLinePtr, ((size_t)width * 4));
-		srcLinePtr += sourceBlock.pitch;
-		destLinePtr += pitch;
-		continue;
-	    }
-
-	    /*
-	     * Have to copy the slow way.
-	     */
-
 	    destPtr = destLinePtr;
 	    for (wLeft = width; wLeft > 0;) {
 		wCopy = MIN(wLeft, sourceBlock.width);
@@ -3250,46 +3455,27 @@ Tk_PhotoPutBlock(
 		srcPtr = srcLinePtr;
 
 		/*
-		 * But we might be lucky and be able to use fairly fast loops.
-		 * It's worth checking...
+		 * If the source has no alpha, or if this is the SET
+		 * compositing rule which just replaces what was there before
+		 * with the new data, the pixels can be converted in bulk. Note
+		 * that in the non-alpha-source case, the compositing rule
+		 * doesn't apply.
 		 */
 
-		if (alphaOffset == 0) {
-		    /*
-		     * This is the non-alpha case, so can still be fairly
-		     * fast. Note that in the non-alpha-source case, the
-		     * compositing rule doesn't apply.
-		     */
-
-		    for (; wCopy>0 ; --wCopy, srcPtr+=pixelSize) {
-			*destPtr++ = srcPtr[0];
-			*destPtr++ = srcPtr[greenOffset];
-			*destPtr++ = srcPtr[blueOffset];
-			*destPtr++ = 255;
-		    }
-		    continue;
-		} else if (compRuleSet) {
-		    /*
-		     * This is the SET compositing rule, which just replaces
-		     * what was there before with the new data. This is
-		     * another fairly fast case. No point in doing a memcpy();
-		     * the order of channels is probably wrong.
-		     */
-
-		    for (; wCopy>0 ; --wCopy, srcPtr+=pixelSize) {
-			*destPtr++ = srcPtr[0];
-			*destPtr++ = srcPtr[greenOffset];
-			*destPtr++ = srcPtr[blueOffset];
-			*destPtr++ = srcPtr[alphaOffset];
-		    }
+		if ((alphaOffset == 0) || compRuleSet) {
+		    alphaBits |= PutSpan(destPtr, srcPtr, wCopy, pixelSize,
+			    greenOffset, blueOffset, alphaOffset);
+		    destPtr += 4 * wCopy;
 		    continue;
 		}
 
 		/*
 		 * Bother; need to consider the alpha value of each pixel to
-		 * know what to do.
+		 * know what to do. The alpha values that result aren't
+		 * tracked.
 		 */
 
+		classified = 0;
 		for (; wCopy>0 ; --wCopy, srcPtr+=pixelSize) {
 		    int alpha = srcPtr[alphaOffset];
 
@@ -3342,9 +3528,12 @@ Tk_PhotoPutBlock(
 
     /*
      * Add this new block to the region which specifies which data is valid.
+     * If none of the pixels stored is transparent, that's the whole block.
      */
 
-    if (alphaOffset) {
+  recalculateValidRegion:
+    if (alphaOffset && (!classified
+	    || (alphaBits & PHOTO_ALPHA_TRANSPARENT))) {
 	/*
 	 * This block is grossly inefficient. For each row in the image, it
 	 * finds each contiguous string of nontransparent pixels, then marks
@@ -3372,7 +3561,6 @@ Tk_PhotoPutBlock(
 	     * always strictly increases the valid region.
 	     */
 
-	recalculateValidRegion:
 	    workRgn = TkCreateRegion();
 	    rect.x = x;
 	    rect.y = y;
@@ -3403,10 +3591,14 @@ Tk_PhotoPutBlock(
     }
 
     /*
-     * Check if display code needs alpha blending...
+     * Check if display code needs alpha blending... If the pixels were
+     * classified while they were copied, we already know whether they add
+     * partial transparency.
      */
 
-    if (!sourceIsSimplePhoto && (height == 1)) {
+    if (classified && (alphaBits & PHOTO_ALPHA_PARTIAL)) {
+	modelPtr->flags |= COMPLEX_ALPHA;
+    } else if (!sourceIsSimplePhoto && (height == 1)) {
 	/*
 	 * Optimize the single span case if we can. This speeds up code that
 	 * builds up large simple-alpha images by scan-lines or individual
@@ -3414,7 +3606,7 @@ Tk_PhotoPutBlock(
 	 * [Patch 1539990]
 	 */
 
-	if (!(modelPtr->flags & COMPLEX_ALPHA)) {
+	if (!classified && !(modelPtr->flags & COMPLEX_ALPHA)) {
 	    int x1;
 
 	    for (x1=x ; x1<x+width ; x1++) {
@@ -3428,12 +3620,13 @@ Tk_PhotoPutBlock(
 		}
 	    }
 	}
-    } else if ((alphaOffset != 0) || (modelPtr->flags & COMPLEX_ALPHA)) {
+    } else if (((alphaOffset != 0) && !classified)
+	    || (modelPtr->flags & COMPLEX_ALPHA)) {
 	/*
-	 * Check for partial transparency if alpha pixels are specified, or
-	 * rescan if we already knew such pixels existed. To restrict this
-	 * Toggle to only checking the changed pixels requires knowing where
-	 * the alpha pixels are.
+	 * Check for partial transparency if unknown alpha pixels were
+	 * stored, or rescan if we already knew such pixels existed: they may
+	 * have been overwritten. To restrict this Toggle to only checking the
+	 * changed pixels requires knowing where the alpha pixels are.
 	 */
 
 	ToggleComplexAlphaIfNeeded(modelPtr);
@@ -4343,6 +4536,151 @@ Tk_PhotoGetImage(
     blockPtr->offset[3] = 3;
     return 1;
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Tk_PhotoLockBuffer --
+ *
+ *	This function gives a producer of image data, such as a video source,
+ *	direct access to the pixels of a photo image. The image is first
+ *	expanded to be at least width x height pixels, as by Tk_PhotoExpand,
+ *	then *blockPtr is filled in as by Tk_PhotoGetImage. The caller writes
+ *	the pixels in place and then calls Tk_PhotoCommitBuffer for the area
+ *	it changed; the block stays valid as long as no script is evaluated
+ *	and the event loop isn't entered in between.
+ *
+ * Results:
+ *	A standard Tcl result code. If TCL_ERROR is returned, an error message
+ *	is placed in the interpreter (if non-NULL).
+ *
+ * Side effects:
+ *	The image may be expanded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Tk_PhotoLockBuffer(
+    Tcl_Interp *interp,		/* Interpreter for passing back error
+				 * messages, or NULL. */
+    Tk_PhotoHandle handle,	/* Handle for the photo image. */
+    int width, int height,	/* Minimum dimensions of the image. */
+    Tk_PhotoImageBlock *blockPtr)
+				/* Address and layout of the pixels are
+				 * returned here. */
+{
+    PhotoModel *modelPtr = (PhotoModel *) handle;
+
+    if (Tk_PhotoExpand(interp, handle, width, height) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    Tk_PhotoGetImage(handle, blockPtr);
+
+    /*
+     * We can't tell what the producer is going to write.
+     */
+
+    modelPtr->flags |= COLOR_IMAGE;
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Tk_PhotoCommitBuffer --
+ *
+ *	This function is called after pixels of a photo image were written in
+ *	place following Tk_PhotoLockBuffer. It does what Tk_PhotoPutBlock does
+ *	after copying the pixels: the valid region and the COMPLEX_ALPHA flag
+ *	are updated from the alpha values in the changed area, unless the
+ *	caller promises with TK_PHOTO_BUFFER_OPAQUE that they are all 255, and
+ *	the instances are redithered and redisplayed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The Tk image code is informed that the image has changed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Tk_PhotoCommitBuffer(
+    Tk_PhotoHandle handle,	/* Handle for the photo image. */
+    int x, int y,		/* Coordinates of the top-left pixel of the
+				 * area that was written. */
+    int width, int height,	/* Dimensions of that area. */
+    int flags)			/* TK_PHOTO_BUFFER_OPAQUE or 0. */
+{
+    PhotoModel *modelPtr = (PhotoModel *) handle;
+    unsigned char *linePtr;
+    XRectangle rect;
+    TkRegion workRgn;
+    int y1;
+
+    if (x < 0) {
+	width += x;
+	x = 0;
+    }
+    if (y < 0) {
+	height += y;
+	y = 0;
+    }
+    if (x + width > modelPtr->width) {
+	width = modelPtr->width - x;
+    }
+    if (y + height > modelPtr->height) {
+	height = modelPtr->height - y;
+    }
+    if ((width <= 0) || (height <= 0)) {
+	return;
+    }
+
+    if ((y < modelPtr->ditherY) || ((y == modelPtr->ditherY)
+	    && (x < modelPtr->ditherX))) {
+	modelPtr->ditherX = x;
+	modelPtr->ditherY = y;
+    }
+
+    rect.x = x;
+    rect.y = y;
+    rect.width = width;
+    rect.height = height;
+    if (flags & TK_PHOTO_BUFFER_OPAQUE) {
+	TkUnionRectWithRegion(&rect, modelPtr->validRegion,
+		modelPtr->validRegion);
+	if (modelPtr->flags & COMPLEX_ALPHA) {
+	    ToggleComplexAlphaIfNeeded(modelPtr);
+	}
+    } else {
+	workRgn = TkCreateRegion();
+	TkUnionRectWithRegion(&rect, workRgn, workRgn);
+	TkSubtractRegion(modelPtr->validRegion, workRgn,
+		modelPtr->validRegion);
+	TkDestroyRegion(workRgn);
+	linePtr = modelPtr->pix32 + (y * modelPtr->width + x) * 4;
+	TkpBuildRegionFromAlphaData(modelPtr->validRegion, (unsigned) x,
+		(unsigned) y, (unsigned) width, (unsigned) height,
+		linePtr + 3, 4, (unsigned) modelPtr->width * 4);
+
+	for (y1 = 0; y1 < height; y1++) {
+	    if (AlphaIsComplex(linePtr, (size_t) width)) {
+		modelPtr->flags |= COMPLEX_ALPHA;
+		break;
+	    }
+	    linePtr += modelPtr->width * 4;
+	}
+	if ((y1 == height) && (modelPtr->flags & COMPLEX_ALPHA)) {
+	    ToggleComplexAlphaIfNeeded(modelPtr);
+	}
+    }
+
+    Tk_DitherPhoto((Tk_PhotoHandle)modelPtr, x, y, width, height);
+    Tk_ImageChanged(modelPtr->tkModel, x, y, width, height,
+	    modelPtr->width, modelPtr->height);
+}
 
 /*
  *--------------------------------------------------------------
@@ -35,6 +35,37 @@ typedef struct {
     int scaleToWidth;
 } RastOpts;
 
+/*
+ * Parsed images are kept per interp, keyed by a hash of the SVG text and the
+ * dpi it was parsed at; the scale options only matter to the rasterizer, so
+ * an image loaded at several scales is parsed once. Entries that are not in
+ * use are dropped, least recently used first, once the estimated size of all
+ * entries exceeds SVG_CACHE_MAX_BYTES.
+ */
+
+#define SVG_CACHE_MAX_BYTES	(8 * 1024 * 1024)
+
+typedef struct {
+    Tcl_WideUInt hash;		/* FNV-1a hash of the SVG text. */
+    Tcl_WideUInt length;	/* Length of the SVG text. */
+    double dpi;			/* Resolution the text was parsed at. */
+} SVGKey;
+
+typedef struct SVGEntry {
+    NSVGimage *nsvgImage;	/* The parsed image. */
+    char *data;			/* Copy of the SVG text, to tell apart texts
+				 * that hash alike. */
+    Tcl_Size length;		/* Number of bytes at data. */
+    size_t size;		/* Estimated memory used by the entry. */
+    Tcl_Size refCount;		/* Number of users of the entry; entries in
+				 * use are never dropped. */
+    Tcl_HashEntry *hPtr;	/* Entry in parsedTable, or NULL if the entry
+				 * isn't in the cache and is freed when its
+				 * last user releases it. */
+    struct SVGEntry *prevPtr;	/* Neighbours in the cache's list, most */
+    struct SVGEntry *nextPtr;	/* recently used first. */
+} SVGEntry;
+
 /*
  * Per interp cache of last NSVGimage which was matched to
  * be immediately rasterized after the match. This helps to
@@ -48,10 +79,56 @@ typedef struct {
      */
     void *dataOrChan;
     Tcl_DString formatString;
-    NSVGimage *nsvgImage;
+    SVGEntry *entryPtr;
     RastOpts ropts;
+    Tcl_HashTable parsedTable;	/* Parsed images by SVGKey. */
+    SVGEntry *firstPtr;		/* Most recently used parsed image. */
+    SVGEntry *lastPtr;		/* Least recently used parsed image. */
+    size_t parsedSize;		/* Total size of the parsed images. */
 } NSVGcache;
 
+/*
+ * Images of at least SVG_PARALLEL_PIXELS pixels are rasterized in bands of
+ * rows, shared out between the loading thread and SVG_RASTER_THREADS worker
+ * threads. Every band flattens all the shapes again, so there are only
+ * SVG_BANDS_PER_THREAD bands for each thread taking part.
+ */
+
+#define SVG_PARALLEL_PIXELS	(256 * 256)
+#define SVG_RASTER_THREADS	3
+#define SVG_BANDS_PER_THREAD	2
+
+typedef struct RasterJob {
+    NSVGimage *nsvgImage;	/* Image to rasterize. */
+    float scale;		/* Scale to rasterize it at. */
+    unsigned char *imgData;	/* Buffer for the whole image. */
+    int width, height;		/* Size of the buffer in pixels. */
+    int bandHeight;		/* Number of rows in each band. */
+    int numBands;		/* Number of bands. */
+    int nextBand;		/* First band nobody has taken yet. */
+    int bandsDone;		/* Number of bands rasterized. */
+    struct RasterJob *nextPtr;	/* Next job in rasterQueue. */
+} RasterJob;
+
+/*
+ * The worker threads are shared by all interps and started the first time a
+ * large image is rasterized. Everything here is protected by rasterMutex.
+ */
+
+TCL_DECLARE_MUTEX(rasterMutex)
+static Tcl_Condition rasterCond = NULL;	/* Signals new jobs to workers. */
+static Tcl_Condition rasterDoneCond = NULL;
+					/* Signals finished jobs to their
+					 * owners. */
+static RasterJob *rasterQueue = NULL;	/* Jobs being rasterized. */
+static Tcl_ThreadId rasterThreads[SVG_RASTER_THREADS];
+static int numRasterThreads = 0;	/* Number of workers started. */
+static int rasterWorkerState = 0;	/* 0 means the workers haven't been
+					 * started yet, 1 that they are
+					 * running and -1 that none could be
+					 * started or they have been told to
+					 * quit. */
+
 static const void *	MemMem(const void *haystack, size_t haysize,
 			       const void *needle, size_t needlen);
 static int		FileMatchSVG(Tcl_Channel chan, const char *fileName,
@@ -67,20 +144,33 @@ static int		StringReadSVG(Tcl_Interp *interp, Tcl_Obj *dataObj,
 			    Tcl_Obj *format, Tk_PhotoHandle imageHandle,
 			    int destX, int destY, int width, int height,
 			    int srcX, int srcY);
-static NSVGimage *	ParseSVGWithOptions(Tcl_Interp *interp,
+static SVGEntry *	ParseSVGWithOptions(Tcl_Interp *interp,
 			    const char *input, Tcl_Size length, Tcl_Obj *format,
 			    RastOpts *ropts);
+static SVGEntry *	GetParsedSVG(Tcl_Interp *interp, const char *input,
+			    Tcl_Size length, double dpi);
+static void		ReleaseSVG(Tcl_Interp *interp, SVGEntry *entryPtr);
+static void		TrimParsedCache(NSVGcache *cachePtr);
+static void		FreeSVGEntry(NSVGcache *cachePtr, SVGEntry *entryPtr);
 static int		RasterizeSVG(Tcl_Interp *interp,
 			    Tk_PhotoHandle imageHandle, NSVGimage *nsvgImage,
 			    int destX, int destY, int width, int height,
 			    int srcX, int srcY, RastOpts *ropts);
+static int		StartRasterThreads(void);
+static void		RasterizeParallel(NSVGrasterizer *rast,
+			    NSVGimage *nsvgImage, float scale,
+			    unsigned char *imgData, int width, int height);
+static void		RasterizeBands(RasterJob *jobPtr,
+			    NSVGrasterizer *rast);
+static Tcl_ThreadCreateType RasterThreadProc(void *clientData);
+static void		RasterThreadsExitProc(void *clientData);
 static double		GetScaleFromParameters(NSVGimage *nsvgImage,
 			    RastOpts *ropts, int *widthPtr, int *heightPtr);
 static NSVGcache *	GetCachePtr(Tcl_Interp *interp);
 static int		CacheSVG(Tcl_Interp *interp, void *dataOrChan,
-			    Tcl_Obj *formatObj, NSVGimage *nsvgImage,
+			    Tcl_Obj *formatObj, SVGEntry *entryPtr,
 			    RastOpts *ropts);
-static NSVGimage *	GetCachedSVG(Tcl_Interp *interp, void *dataOrChan,
+static SVGEntry *	GetCachedSVG(Tcl_Interp *interp, void *dataOrChan,
 			    Tcl_Obj *formatObj, RastOpts *ropts);
 static void		CleanCache(Tcl_Interp *interp);
 static void		FreeCache(void *clientData, Tcl_Interp *interp);
@@ -170,7 +260,7 @@ FileMatchSVG(
     Tcl_Obj *dataObj = Tcl_NewObj();
     const char *data;
     RastOpts ropts;
-    NSVGimage *nsvgImage;
+    SVGEntry *entryPtr;
 
     CleanCache(interp);
     if (Tcl_ReadChars(chan, dataObj, 4096, 0) == TCL_IO_FAILURE) {
@@ -191,16 +281,17 @@ FileMatchSVG(
 	return 0;
     }
     data = Tcl_GetStringFromObj(dataObj, &length);
-    nsvgImage = ParseSVGWithOptions(interp, data, length, formatObj, &ropts);
+    entryPtr = ParseSVGWithOptions(interp, data, length, formatObj, &ropts);
     Tcl_DecrRefCount(dataObj);
-    if (nsvgImage != NULL) {
-	GetScaleFromParameters(nsvgImage, &ropts, widthPtr, heightPtr);
+    if (entryPtr != NULL) {
+	GetScaleFromParameters(entryPtr->nsvgImage, &ropts, widthPtr,
+		heightPtr);
 	if ((*widthPtr <= 0.0) || (*heightPtr <= 0.0)) {
-	    nsvgDelete(nsvgImage);
+	    ReleaseSVG(interp, entryPtr);
 	    return 0;
 	}
-	if (!CacheSVG(interp, chan, formatObj, nsvgImage, &ropts)) {
-	    nsvgDelete(nsvgImage);
+	if (!CacheSVG(interp, chan, formatObj, entryPtr, &ropts)) {
+	    ReleaseSVG(interp, entryPtr);
 	}
 	return 1;
     }
@@ -240,9 +331,10 @@ FileReadSVG(
     Tcl_Size length;
     const char *data;
     RastOpts ropts;
-    NSVGimage *nsvgImage = GetCachedSVG(interp, chan, formatObj, &ropts);
+    int result;
+    SVGEntry *entryPtr = GetCachedSVG(interp, chan, formatObj, &ropts);
 
-    if (nsvgImage == NULL) {
+    if (entryPtr == NULL) {
 	Tcl_Obj *dataObj = Tcl_NewObj();
 
 	if (Tcl_ReadChars(chan, dataObj, TCL_INDEX_NONE, 0) == TCL_IO_FAILURE) {
@@ -253,15 +345,17 @@ FileReadSVG(
 	    return TCL_ERROR;
 	}
 	data = Tcl_GetStringFromObj(dataObj, &length);
-	nsvgImage = ParseSVGWithOptions(interp, data, length, formatObj,
+	entryPtr = ParseSVGWithOptions(interp, data, length, formatObj,
 			    &ropts);
 	Tcl_DecrRefCount(dataObj);
-	if (nsvgImage == NULL) {
+	if (entryPtr == NULL) {
 	    return TCL_ERROR;
 	}
     }
-    return RasterizeSVG(interp, imageHandle, nsvgImage, destX, destY,
-		width, height, srcX, srcY, &ropts);
+    result = RasterizeSVG(interp, imageHandle, entryPtr->nsvgImage, destX,
+	    destY, width, height, srcX, srcY, &ropts);
+    ReleaseSVG(interp, entryPtr);
+    return result;
 }
 
 /*
@@ -292,7 +386,7 @@ StringMatchSVG(
     Tcl_Size length, testLength;
     const char *data;
     RastOpts ropts;
-    NSVGimage *nsvgImage;
+    SVGEntry *entryPtr;
 
     CleanCache(interp);
     data = Tcl_GetStringFromObj(dataObj, &length);
@@ -302,15 +396,16 @@ StringMatchSVG(
 	(MemMem(data, testLength, "<svg", 4) == NULL)) {
 	return 0;
     }
-    nsvgImage = ParseSVGWithOptions(interp, data, length, formatObj, &ropts);
-    if (nsvgImage != NULL) {
-	GetScaleFromParameters(nsvgImage, &ropts, widthPtr, heightPtr);
+    entryPtr = ParseSVGWithOptions(interp, data, length, formatObj, &ropts);
+    if (entryPtr != NULL) {
+	GetScaleFromParameters(entryPtr->nsvgImage, &ropts, widthPtr,
+		heightPtr);
 	if ((*widthPtr <= 0.0) || (*heightPtr <= 0.0)) {
-	    nsvgDelete(nsvgImage);
+	    ReleaseSVG(interp, entryPtr);
 	    return 0;
 	}
-	if (!CacheSVG(interp, dataObj, formatObj, nsvgImage, &ropts)) {
-	    nsvgDelete(nsvgImage);
+	if (!CacheSVG(interp, dataObj, formatObj, entryPtr, &ropts)) {
+	    ReleaseSVG(interp, entryPtr);
 	}
 	return 1;
     }
@@ -348,18 +443,21 @@ StringReadSVG(
     Tcl_Size length;
     const char *data;
     RastOpts ropts;
-    NSVGimage *nsvgImage = GetCachedSVG(interp, dataObj, formatObj, &ropts);
+    int result;
+    SVGEntry *entryPtr = GetCachedSVG(interp, dataObj, formatObj, &ropts);
 
-    if (nsvgImage == NULL) {
+    if (entryPtr == NULL) {
 	data = Tcl_GetStringFromObj(dataObj, &length);
-	nsvgImage = ParseSVGWithOptions(interp, data, length, formatObj,
+	entryPtr = ParseSVGWithOptions(interp, data, length, formatObj,
 			    &ropts);
     }
-    if (nsvgImage == NULL) {
+    if (entryPtr == NULL) {
 	return TCL_ERROR;
     }
-    return RasterizeSVG(interp, imageHandle, nsvgImage, destX, destY,
-		width, height, srcX, srcY, &ropts);
+    result = RasterizeSVG(interp, imageHandle, entryPtr->nsvgImage, destX,
+	    destY, width, height, srcX, srcY, &ropts);
+    ReleaseSVG(interp, entryPtr);
+    return result;
 }
 
 /*
@@ -370,14 +468,16 @@ StringReadSVG(
  *	This function is called to parse the given input string as SVG.
  *
  * Results:
- *	Return a newly create NSVGimage on success, and NULL otherwise.
+ *	Return the parsed image on success, and NULL otherwise. The caller
+ *	must release it with ReleaseSVG.
  *
  * Side effects:
+ *	The image may be taken from or added to the cache of parsed images.
  *
  *----------------------------------------------------------------------
  */
 
-static NSVGimage *
+static SVGEntry *
 ParseSVGWithOptions(
     Tcl_Interp *interp,
     const char *input,
@@ -388,8 +488,6 @@ ParseSVGWithOptions(
     Tcl_Obj **objv = NULL;
     Tcl_Size objc = 0;
     double dpi = 96.0;
-    char *inputCopy = NULL;
-    NSVGimage *nsvgImage;
     int parameterScaleSeen = 0;
     static const char *const fmtOptions[] = {
 	"-dpi", "-scale", "-scaletoheight", "-scaletowidth", NULL
@@ -398,20 +496,6 @@ ParseSVGWithOptions(
 	OPT_DPI, OPT_SCALE, OPT_SCALE_TO_HEIGHT, OPT_SCALE_TO_WIDTH
     };
 
-    /*
-     * The parser destroys the original input string,
-     * therefore first duplicate.
-     */
-
-    inputCopy = (char *)attemptckalloc(length+1);
-    if (inputCopy == NULL) {
-	Tcl_SetObjResult(interp, Tcl_NewStringObj("cannot alloc data buffer", TCL_INDEX_NONE));
-	Tcl_SetErrorCode(interp, "TK", "IMAGE", "SVG", "OUT_OF_MEMORY", NULL);
-	goto error;
-    }
-    memcpy(inputCopy, input, length);
-    inputCopy[length] = '\0';
-
     /*
      * Process elements of format specification as a list.
      */
@@ -421,7 +505,7 @@ ParseSVGWithOptions(
     ropts->scaleToWidth = 0;
     if ((formatObj != NULL) &&
 	    Tcl_ListObjGetElements(interp, formatObj, &objc, &objv) != TCL_OK) {
-	goto error;
+	return NULL;
     }
     for (; objc > 0 ; objc--, objv++) {
 	int optIndex;
@@ -436,14 +520,12 @@ ParseSVGWithOptions(
 
 	if (Tcl_GetIndexFromObjStruct(interp, objv[0], fmtOptions,
 		sizeof(char *), "option", 0, &optIndex) == TCL_ERROR) {
-	    goto error;
+	    return NULL;
 	}
 
 	if (objc < 2) {
-	    ckfree(inputCopy);
-	    inputCopy = NULL;
 	    Tcl_WrongNumArgs(interp, 1, objv, "value");
-	    goto error;
+	    return NULL;
 	}
 
 	objc--;
@@ -461,7 +543,7 @@ ParseSVGWithOptions(
 			"only one of -scale, -scaletoheight, -scaletowidth may be given", TCL_INDEX_NONE));
 		Tcl_SetErrorCode(interp, "TK", "IMAGE", "SVG", "BAD_SCALE",
 			NULL);
-		goto error;
+		return NULL;
 	    }
 	    parameterScaleSeen = 1;
 	    break;
@@ -475,72 +557,298 @@ ParseSVGWithOptions(
 	switch ((enum fmtOptionsEnum) optIndex) {
 	case OPT_DPI:
 	    if (Tcl_GetDoubleFromObj(interp, objv[0], &dpi) == TCL_ERROR) {
-		goto error;
+		return NULL;
 	    }
 	    if (dpi < 0.0) {
 		Tcl_SetObjResult(interp, Tcl_NewStringObj(
 			"-dpi value must be positive", TCL_INDEX_NONE));
 		Tcl_SetErrorCode(interp, "TK", "IMAGE", "SVG", "BAD_DPI",
 			NULL);
-		goto error;
+		return NULL;
 	    }
 	    break;
 	case OPT_SCALE:
 	    if (Tcl_GetDoubleFromObj(interp, objv[0], &ropts->scale) ==
 		TCL_ERROR) {
-		goto error;
+		return NULL;
 	    }
 	    if (ropts->scale <= 0.0) {
 		Tcl_SetObjResult(interp, Tcl_NewStringObj(
 			"-scale value must be positive", TCL_INDEX_NONE));
 		Tcl_SetErrorCode(interp, "TK", "IMAGE", "SVG", "BAD_SCALE",
 			NULL);
-		goto error;
+		return NULL;
 	    }
 	    break;
 	case OPT_SCALE_TO_HEIGHT:
 	    if (Tcl_GetIntFromObj(interp, objv[0], &ropts->scaleToHeight) ==
 		TCL_ERROR) {
-		goto error;
+		return NULL;
 	    }
 	    if (ropts->scaleToHeight <= 0) {
 		Tcl_SetObjResult(interp, Tcl_NewStringObj(
 			"-scaletoheight value must be positive", TCL_INDEX_NONE));
 		Tcl_SetErrorCode(interp, "TK", "IMAGE", "SVG", "BAD_SCALE",
 			NULL);
-		goto error;
+		return NULL;
 	    }
 	    break;
 	case OPT_SCALE_TO_WIDTH:
 	    if (Tcl_GetIntFromObj(interp, objv[0], &ropts->scaleToWidth) ==
 		TCL_ERROR) {
-		goto error;
+		return NULL;
 	    }
 	    if (ropts->scaleToWidth <= 0) {
 		Tcl_SetObjResult(interp, Tcl_NewStringObj(
 			"-scaletowidth value must be positive", TCL_INDEX_NONE));
 		Tcl_SetErrorCode(interp, "TK", "IMAGE", "SVG", "BAD_SCALE",
 			NULL);
-		goto error;
+		return NULL;
 	    }
 	    break;
 	}
     }
 
+    return GetParsedSVG(interp, input, length, dpi);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetParsedSVG --
+ *
+ *	Looks up the SVG text in the interp's cache of parsed images, and
+ *	parses it if it isn't there.
+ *
+ * Results:
+ *	Return the parsed image on success, and NULL otherwise, in which case
+ *	an error message is left in the interp's result. The caller must
+ *	release the image with ReleaseSVG.
+ *
+ * Side effects:
+ *	A newly parsed image is added to the cache, which may drop the least
+ *	recently used images that are not in use.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static SVGEntry *
+GetParsedSVG(
+    Tcl_Interp *interp,
+    const char *input,
+    Tcl_Size length,
+    double dpi)
+{
+    NSVGcache *cachePtr = GetCachePtr(interp);
+    Tcl_HashEntry *hPtr;
+    SVGEntry *entryPtr;
+    NSVGimage *nsvgImage;
+    NSVGshape *shapePtr;
+    NSVGpath *pathPtr;
+    SVGKey key;
+    char *inputCopy;
+    Tcl_Size i;
+    int isNew;
+
+    memset(&key, 0, sizeof(key));
+    key.hash = ((Tcl_WideUInt) 0xcbf29ce4 << 32) | 0x84222325;
+    for (i = 0; i < length; i++) {
+	key.hash ^= (unsigned char) input[i];
+	key.hash *= ((Tcl_WideUInt) 0x100 << 32) | 0x1b3;
+    }
+    key.length = (Tcl_WideUInt) length;
+    key.dpi = dpi;
+
+    hPtr = Tcl_FindHashEntry(&cachePtr->parsedTable, (char *) &key);
+    if (hPtr != NULL) {
+	entryPtr = (SVGEntry *)Tcl_GetHashValue(hPtr);
+	if (memcmp(entryPtr->data, input, length) == 0) {
+	    if (entryPtr->prevPtr != NULL) {
+		entryPtr->prevPtr->nextPtr = entryPtr->nextPtr;
+		if (entryPtr->nextPtr != NULL) {
+		    entryPtr->nextPtr->prevPtr = entryPtr->prevPtr;
+		} else {
+		    cachePtr->lastPtr = entryPtr->prevPtr;
+		}
+		entryPtr->prevPtr = NULL;
+		entryPtr->nextPtr = cachePtr->firstPtr;
+		cachePtr->firstPtr->prevPtr = entryPtr;
+		cachePtr->firstPtr = entryPtr;
+	    }
+	    entryPtr->refCount++;
+	    return entryPtr;
+	}
+    }
+
+    /*
+     * The parser destroys the original input string,
+     * therefore first duplicate. The copy is refilled afterwards and kept
+     * to check later lookups against.
+     */
+
+    inputCopy = (char *)attemptckalloc(length+1);
+    if (inputCopy == NULL) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj("cannot alloc data buffer", TCL_INDEX_NONE));
+	Tcl_SetErrorCode(interp, "TK", "IMAGE", "SVG", "OUT_OF_MEMORY", NULL);
+	return NULL;
+    }
+    memcpy(inputCopy, input, length);
+    inputCopy[length] = '\0';
     nsvgImage = nsvgParse(inputCopy, "px", (float) dpi);
     if (nsvgImage == NULL) {
+	ckfree(inputCopy);
 	Tcl_SetObjResult(interp, Tcl_NewStringObj("cannot parse SVG image", TCL_INDEX_NONE));
 	Tcl_SetErrorCode(interp, "TK", "IMAGE", "SVG", "PARSE_ERROR", NULL);
-	goto error;
+	return NULL;
     }
-    ckfree(inputCopy);
-    return nsvgImage;
+    memcpy(inputCopy, input, length);
 
-error:
-    if (inputCopy != NULL) {
-	ckfree(inputCopy);
+    entryPtr = (SVGEntry *)ckalloc(sizeof(SVGEntry));
+    entryPtr->nsvgImage = nsvgImage;
+    entryPtr->data = inputCopy;
+    entryPtr->length = length;
+    entryPtr->size = sizeof(SVGEntry) + length + sizeof(NSVGimage);
+    for (shapePtr = nsvgImage->shapes; shapePtr != NULL;
+	    shapePtr = shapePtr->next) {
+	entryPtr->size += sizeof(NSVGshape);
+	for (pathPtr = shapePtr->paths; pathPtr != NULL;
+		pathPtr = pathPtr->next) {
+	    entryPtr->size += sizeof(NSVGpath) + 2 * sizeof(float) * pathPtr->npts;
+	}
+    }
+    entryPtr->refCount = 1;
+    entryPtr->prevPtr = NULL;
+    entryPtr->nextPtr = NULL;
+    entryPtr->hPtr = NULL;
+
+    /*
+     * A different text with the same key is left in the cache; this one is
+     * freed once it has been used.
+     */
+
+    if (hPtr == NULL) {
+	hPtr = Tcl_CreateHashEntry(&cachePtr->parsedTable, (char *) &key,
+		&isNew);
+	Tcl_SetHashValue(hPtr, entryPtr);
+	entryPtr->hPtr = hPtr;
+	entryPtr->nextPtr = cachePtr->firstPtr;
+	if (cachePtr->firstPtr != NULL) {
+	    cachePtr->firstPtr->prevPtr = entryPtr;
+	} else {
+	    cachePtr->lastPtr = entryPtr;
+	}
+	cachePtr->firstPtr = entryPtr;
+	cachePtr->parsedSize += entryPtr->size;
+	TrimParsedCache(cachePtr);
+    }
+    return entryPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReleaseSVG --
+ *
+ *	Gives up a reference to a parsed image obtained from GetParsedSVG.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The image is freed if it isn't in the cache and has no other users,
+ *	and the cache may be trimmed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ReleaseSVG(
+    Tcl_Interp *interp,
+    SVGEntry *entryPtr)
+{
+    NSVGcache *cachePtr = GetCachePtr(interp);
+
+    if (--entryPtr->refCount > 0) {
+	return;
+    }
+    if (entryPtr->hPtr == NULL) {
+	FreeSVGEntry(cachePtr, entryPtr);
+    } else {
+	TrimParsedCache(cachePtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TrimParsedCache --
+ *
+ *	Drops the least recently used parsed images that are not in use until
+ *	the cache is no larger than SVG_CACHE_MAX_BYTES.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Parsed images may be freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TrimParsedCache(
+    NSVGcache *cachePtr)
+{
+    SVGEntry *entryPtr = cachePtr->lastPtr, *prevPtr;
+
+    while ((cachePtr->parsedSize > SVG_CACHE_MAX_BYTES)
+	    && (entryPtr != NULL)) {
+	prevPtr = entryPtr->prevPtr;
+	if (entryPtr->refCount == 0) {
+	    FreeSVGEntry(cachePtr, entryPtr);
+	}
+	entryPtr = prevPtr;
     }
-    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeSVGEntry --
+ *
+ *	Removes a parsed image from the cache, if it is in it, and frees it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeSVGEntry(
+    NSVGcache *cachePtr,
+    SVGEntry *entryPtr)
+{
+    if (entryPtr->hPtr != NULL) {
+	Tcl_DeleteHashEntry(entryPtr->hPtr);
+	if (entryPtr->prevPtr != NULL) {
+	    entryPtr->prevPtr->nextPtr = entryPtr->nextPtr;
+	} else {
+	    cachePtr->firstPtr = entryPtr->nextPtr;
+	}
+	if (entryPtr->nextPtr != NULL) {
+	    entryPtr->nextPtr->prevPtr = entryPtr->prevPtr;
+	} else {
+	    cachePtr->lastPtr = entryPtr->prevPtr;
+	}
+	cachePtr->parsedSize -= entryPtr->size;
+    }
+    nsvgDelete(entryPtr->nsvgImage);
+    ckfree(entryPtr->data);
+    ckfree(entryPtr);
 }
 
 /*
@@ -549,7 +857,8 @@ error:
  * RasterizeSVG --
  *
  *	This function is called to rasterize the given nsvgImage and
- *	fill the imageHandle with data.
+ *	fill the imageHandle with data. Large images are rasterized in
+ *	parallel by the worker threads.
  *
  * Results:
  *	A standard TCL completion code. If TCL_ERROR is returned then an error
@@ -557,7 +866,7 @@ error:
  *
  *
  * Side effects:
- *	On error the given nsvgImage will be deleted.
+ *	None beyond the image data; the nsvgImage still belongs to the caller.
  *
  *----------------------------------------------------------------------
  */
@@ -587,7 +896,7 @@ RasterizeSVG(
 	Tcl_SetObjResult(interp, Tcl_NewStringObj("cannot initialize rasterizer", TCL_INDEX_NONE));
 	Tcl_SetErrorCode(interp, "TK", "IMAGE", "SVG", "RASTERIZER_ERROR",
 		NULL);
-	goto cleanAST;
+	return TCL_ERROR;
     }
 
     /* Tk Ticket [822330269b] Check potential int overflow in following ckalloc */
@@ -604,8 +913,12 @@ RasterizeSVG(
 	Tcl_SetErrorCode(interp, "TK", "IMAGE", "SVG", "OUT_OF_MEMORY", NULL);
 	goto cleanRAST;
     }
-    nsvgRasterize(rast, nsvgImage, 0, 0,
-	    (float) scale, imgData, w, h, w * 4);
+    if ((wh >= SVG_PARALLEL_PIXELS) && StartRasterThreads()) {
+	RasterizeParallel(rast, nsvgImage, (float) scale, imgData, w, h);
+    } else {
+	nsvgRasterize(rast, nsvgImage, 0, 0,
+		(float) scale, imgData, w, h, w * 4);
+    }
     /* transfer the data to a photo block */
     svgblock.pixelPtr = imgData;
     svgblock.width = w;
@@ -617,7 +930,7 @@ RasterizeSVG(
     }
     if (Tk_PhotoExpand(interp, imageHandle,
 		destX + width, destY + height) != TCL_OK) {
-	goto cleanRAST;
+	goto cleanimg;
     }
     if (Tk_PhotoPutBlock(interp, imageHandle, &svgblock, destX, destY,
 		width, height, TK_PHOTO_COMPOSITE_SET) != TCL_OK) {
@@ -625,7 +938,6 @@ RasterizeSVG(
     }
     ckfree(imgData);
     nsvgDeleteRasterizer(rast);
-    nsvgDelete(nsvgImage);
     return TCL_OK;
 
 cleanimg:
@@ -633,12 +945,223 @@ cleanimg:
 
 cleanRAST:
     nsvgDeleteRasterizer(rast);
-
-cleanAST:
-    nsvgDelete(nsvgImage);
     return TCL_ERROR;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * StartRasterThreads --
+ *
+ *	Starts the worker threads that rasterize large images, unless that
+ *	has been done already.
+ *
+ * Results:
+ *	Returns 1 if the workers are running, and 0 otherwise.
+ *
+ * Side effects:
+ *	Threads may be created, with an exit handler to stop them.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+StartRasterThreads(void)
+{
+    int running;
+
+    Tcl_MutexLock(&rasterMutex);
+    if (rasterWorkerState == 0) {
+	rasterWorkerState = 1;
+	while ((numRasterThreads < SVG_RASTER_THREADS)
+		&& (Tcl_CreateThread(&rasterThreads[numRasterThreads],
+		RasterThreadProc, NULL, TCL_THREAD_STACK_DEFAULT,
+		TCL_THREAD_JOINABLE) == TCL_OK)) {
+	    numRasterThreads++;
+	}
+	if (numRasterThreads > 0) {
+	    Tcl_CreateExitHandler(RasterThreadsExitProc, NULL);
+	} else {
+	    rasterWorkerState = -1;
+	}
+    }
+    running = (rasterWorkerState == 1);
+    Tcl_MutexUnlock(&rasterMutex);
+    return running;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RasterizeParallel --
+ *
+ *	Rasterizes an image in bands of rows, which the calling thread and the
+ *	worker threads take in turn, and waits for all of them to be done.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The image is drawn into imgData.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RasterizeParallel(
+    NSVGrasterizer *rast,	/* Rasterizer of the calling thread. */
+    NSVGimage *nsvgImage,
+    float scale,
+    unsigned char *imgData,
+    int width, int height)
+{
+    RasterJob job, **jobPtrPtr;
+    int numBands = (SVG_RASTER_THREADS + 1) * SVG_BANDS_PER_THREAD;
+
+    job.nsvgImage = nsvgImage;
+    job.scale = scale;
+    job.imgData = imgData;
+    job.width = width;
+    job.height = height;
+    job.bandHeight = (height + numBands - 1) / numBands;
+    job.numBands = (height + job.bandHeight - 1) / job.bandHeight;
+    job.nextBand = 0;
+    job.bandsDone = 0;
+
+    Tcl_MutexLock(&rasterMutex);
+    job.nextPtr = rasterQueue;
+    rasterQueue = &job;
+    Tcl_ConditionNotify(&rasterCond);
+    RasterizeBands(&job, rast);
+    while (job.bandsDone < job.numBands) {
+	Tcl_ConditionWait(&rasterDoneCond, &rasterMutex, NULL);
+    }
+    for (jobPtrPtr = &rasterQueue; *jobPtrPtr != &job;
+	    jobPtrPtr = &(*jobPtrPtr)->nextPtr) {
+	/* Empty loop body. */
+    }
+    *jobPtrPtr = job.nextPtr;
+    Tcl_MutexUnlock(&rasterMutex);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RasterizeBands --
+ *
+ *	Takes bands of a job that nobody has taken yet and rasterizes them,
+ *	until there are none left. Must be called with rasterMutex locked;
+ *	the mutex is released while a band is being rasterized.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Parts of the image are drawn into the job's buffer. The owner of the
+ *	job is signalled when its last band is done.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RasterizeBands(
+    RasterJob *jobPtr,
+    NSVGrasterizer *rast)
+{
+    while (jobPtr->nextBand < jobPtr->numBands) {
+	int y = jobPtr->nextBand++ * jobPtr->bandHeight;
+	int h = jobPtr->height - y;
+
+	if (h > jobPtr->bandHeight) {
+	    h = jobPtr->bandHeight;
+	}
+	Tcl_MutexUnlock(&rasterMutex);
+	nsvgRasterize(rast, jobPtr->nsvgImage, 0.0f, (float) -y,
+		jobPtr->scale, jobPtr->imgData + (size_t) y * jobPtr->width * 4,
+		jobPtr->width, h, jobPtr->width * 4);
+	Tcl_MutexLock(&rasterMutex);
+	if (++jobPtr->bandsDone == jobPtr->numBands) {
+	    Tcl_ConditionNotify(&rasterDoneCond);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RasterThreadProc --
+ *
+ *	The body of a worker thread: helps with the bands of the jobs in the
+ *	queue until it is told to quit.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Images are drawn into the buffers of the jobs.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_ThreadCreateType
+RasterThreadProc(
+    TCL_UNUSED(void *))
+{
+    NSVGrasterizer *rast = nsvgCreateRasterizer();
+    RasterJob *jobPtr;
+
+    Tcl_MutexLock(&rasterMutex);
+    while ((rast != NULL) && (rasterWorkerState == 1)) {
+	for (jobPtr = rasterQueue; jobPtr != NULL; jobPtr = jobPtr->nextPtr) {
+	    if (jobPtr->nextBand < jobPtr->numBands) {
+		break;
+	    }
+	}
+	if (jobPtr == NULL) {
+	    Tcl_ConditionWait(&rasterCond, &rasterMutex, NULL);
+	} else {
+	    RasterizeBands(jobPtr, rast);
+	}
+    }
+    Tcl_MutexUnlock(&rasterMutex);
+    if (rast != NULL) {
+	nsvgDeleteRasterizer(rast);
+    }
+    TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RasterThreadsExitProc --
+ *
+ *	Tells the worker threads to quit and waits for them, so that none is
+ *	left waiting on a condition while Tcl is finalized.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The worker threads exit.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RasterThreadsExitProc(
+    TCL_UNUSED(void *))
+{
+    int i, result;
+
+    Tcl_MutexLock(&rasterMutex);
+    rasterWorkerState = -1;
+    Tcl_ConditionNotify(&rasterCond);
+    Tcl_MutexUnlock(&rasterMutex);
+    for (i = 0; i < numRasterThreads; i++) {
+	Tcl_JoinThread(rasterThreads[i], &result);
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -725,7 +1248,12 @@ GetCachePtr(
 	cachePtr = (NSVGcache *)ckalloc(sizeof(NSVGcache));
 	cachePtr->dataOrChan = NULL;
 	Tcl_DStringInit(&cachePtr->formatString);
-	cachePtr->nsvgImage = NULL;
+	cachePtr->entryPtr = NULL;
+	Tcl_InitHashTable(&cachePtr->parsedTable,
+		sizeof(SVGKey) / sizeof(int));
+	cachePtr->firstPtr = NULL;
+	cachePtr->lastPtr = NULL;
+	cachePtr->parsedSize = 0;
 	Tcl_SetAssocData(interp, "tksvgnano", FreeCache, cachePtr);
     }
     return cachePtr;
@@ -751,7 +1279,7 @@ CacheSVG(
     Tcl_Interp *interp,
     void *dataOrChan,
     Tcl_Obj *formatObj,
-    NSVGimage *nsvgImage,
+    SVGEntry *entryPtr,
     RastOpts *ropts)
 {
     Tcl_Size length;
@@ -764,7 +1292,7 @@ CacheSVG(
 	    data = Tcl_GetStringFromObj(formatObj, &length);
 	    Tcl_DStringAppend(&cachePtr->formatString, data, length);
 	}
-	cachePtr->nsvgImage = nsvgImage;
+	cachePtr->entryPtr = entryPtr;
 	cachePtr->ropts = *ropts;
 	return 1;
     }
@@ -779,7 +1307,8 @@ CacheSVG(
  *	Try to get the NSVGimage from the internal cache.
  *
  * Results:
- *	Return the found NSVGimage on success, and NULL otherwise.
+ *	Return the found image on success, and NULL otherwise. The caller
+ *	must release it with ReleaseSVG.
  *
  * Side effects:
  *	Calls the CleanCache() function.
@@ -787,7 +1316,7 @@ CacheSVG(
  *----------------------------------------------------------------------
  */
 
-static NSVGimage *
+static SVGEntry *
 GetCachedSVG(
     Tcl_Interp *interp,
     void *dataOrChan,
@@ -797,25 +1326,25 @@ GetCachedSVG(
     Tcl_Size length;
     const char *data;
     NSVGcache *cachePtr = GetCachePtr(interp);
-    NSVGimage *nsvgImage = NULL;
+    SVGEntry *entryPtr = NULL;
 
-    if ((cachePtr != NULL) && (cachePtr->nsvgImage != NULL) &&
+    if ((cachePtr != NULL) && (cachePtr->entryPtr != NULL) &&
 	(cachePtr->dataOrChan == dataOrChan)) {
 	if (formatObj != NULL) {
 	    data = Tcl_GetStringFromObj(formatObj, &length);
 	    if (strcmp(data, Tcl_DStringValue(&cachePtr->formatString)) == 0) {
-		nsvgImage = cachePtr->nsvgImage;
+		entryPtr = cachePtr->entryPtr;
 		*ropts = cachePtr->ropts;
-		cachePtr->nsvgImage = NULL;
+		cachePtr->entryPtr = NULL;
 	    }
 	} else if (Tcl_DStringLength(&cachePtr->formatString) == 0) {
-	    nsvgImage = cachePtr->nsvgImage;
+	    entryPtr = cachePtr->entryPtr;
 	    *ropts = cachePtr->ropts;
-	    cachePtr->nsvgImage = NULL;
+	    cachePtr->entryPtr = NULL;
 	}
     }
     CleanCache(interp);
-    return nsvgImage;
+    return entryPtr;
 }
 
 /*
@@ -823,7 +1352,7 @@ GetCachedSVG(
  *
  * CleanCache --
  *
- *	Reset the cache and delete the saved image in it.
+ *	Reset the cache and release the saved image in it.
  *
  * Results:
  *
@@ -840,9 +1369,11 @@ CleanCache(Tcl_Interp *interp)
     if (cachePtr != NULL) {
 	cachePtr->dataOrChan = NULL;
 	Tcl_DStringSetLength(&cachePtr->formatString, 0);
-	if (cachePtr->nsvgImage != NULL) {
-	    nsvgDelete(cachePtr->nsvgImage);
-	    cachePtr->nsvgImage = NULL;
+	if (cachePtr->entryPtr != NULL) {
+	    SVGEntry *entryPtr = cachePtr->entryPtr;
+
+	    cachePtr->entryPtr = NULL;
+	    ReleaseSVG(interp, entryPtr);
 	}
     }
 }
@@ -868,9 +1399,13 @@ FreeCache(void *clientData, TCL_UNUSED(Tcl_Interp *))
     NSVGcache *cachePtr = (NSVGcache *)clientData;
 
     Tcl_DStringFree(&cachePtr->formatString);
-    if (cachePtr->nsvgImage != NULL) {
-	nsvgDelete(cachePtr->nsvgImage);
+    if ((cachePtr->entryPtr != NULL) && (cachePtr->entryPtr->hPtr == NULL)) {
+	FreeSVGEntry(cachePtr, cachePtr->entryPtr);
+    }
+    while (cachePtr->firstPtr != NULL) {
+	FreeSVGEntry(cachePtr, cachePtr->firstPtr);
     }
+    Tcl_DeleteHashTable(&cachePtr->parsedTable);
     ckfree(cachePtr);
 }
 
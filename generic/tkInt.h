@@ -141,6 +141,7 @@
 typedef struct TkColormap TkColormap;
 typedef struct TkFontAttributes TkFontAttributes;
 typedef struct TkGrabEvent TkGrabEvent;
+typedef struct TkPixmapPool TkPixmapPool;
 typedef struct TkpCursor_ *TkpCursor;
 #define TkRegion Region
 typedef struct TkStressedCmap TkStressedCmap;
@@ -561,6 +562,9 @@ typedef struct TkDisplay {
     int iconDataSize;		/* Size of default iconphoto image data. */
     unsigned char *iconDataPtr;	/* Default iconphoto image data, if set. */
     int ximGeneration;          /* Used to invalidate XIC */
+    TkPixmapPool *pixmapPoolPtr;
+				/* Double-buffer pixmaps that can be reused,
+				 * or NULL. Used by tkPixmapPool.c only. */
 } TkDisplay;
 
 /*
@@ -1189,6 +1193,9 @@ MODULE_SCOPE int	TkCanvasGetCoordObj(Tcl_Interp *interp,
 			    double *doublePtr);
 MODULE_SCOPE int	TkGetDoublePixels(Tcl_Interp *interp, Tk_Window tkwin,
 			    const char *string, double *doublePtr);
+MODULE_SCOPE int	TkListboxGetVarUpdates(Tk_Window tkwin,
+			    Tcl_Size *partialPtr, Tcl_Size *fullPtr);
+MODULE_SCOPE int	TkPNGUseSIMD(int use);
 MODULE_SCOPE int	TkPostscriptImage(Tcl_Interp *interp, Tk_Window tkwin,
 			    Tk_PostscriptInfo psInfo, XImage *ximage,
 			    int x, int y, int width, int height);
@@ -1249,6 +1256,12 @@ MODULE_SCOPE void	TkRotatePoint(double originX, double originY,
 			    double sine, double cosine, double *xPtr,
 			    double *yPtr);
 MODULE_SCOPE int TkGetIntForIndex(Tcl_Obj *, Tcl_Size, int lastOK, Tcl_Size*);
+MODULE_SCOPE Pixmap	TkGetBufferPixmap(Tk_Window tkwin, int width,
+			    int height);
+MODULE_SCOPE void	TkFreeBufferPixmap(Tk_Window tkwin, Pixmap pixmap);
+MODULE_SCOPE void	TkPixmapPoolFlush(TkDisplay *dispPtr);
+MODULE_SCOPE Tcl_Obj *	TkPixmapPoolStats(TkDisplay *dispPtr);
+MODULE_SCOPE void	TkPixmapPoolCleanup(TkDisplay *dispPtr);
 
 #define TkNewIndexObj(value) (((Tcl_Size)(value) == TCL_INDEX_NONE) ? Tcl_NewObj() : Tcl_NewWideIntObj((Tcl_WideInt)(value)))
 #define TK_OPTION_UNDERLINE_DEF(type, field) NULL, TCL_INDEX_NONE, offsetof(type, field), TK_OPTION_NULL_OK, NULL
@@ -1285,6 +1298,9 @@ MODULE_SCOPE Status TkParseColor (Display * display,
 
 #ifdef HAVE_XFT
 MODULE_SCOPE void	TkUnixSetXftClipRegion(Region clipRegion);
+MODULE_SCOPE void	TkUnixBeginXftBatch(void);
+MODULE_SCOPE void	TkUnixEndXftBatch(void);
+MODULE_SCOPE void	TkUnixFlushXftBatch(void);
 #endif
 
 MODULE_SCOPE void	TkpCopyRegion(TkRegion dst, TkRegion src);
@@ -24,6 +24,29 @@ typedef struct {
 				 * available for listbox items. */
 } ListboxOptionTables;
 
+/*
+ * The selection and the item attributes of a listbox are sparse maps from
+ * element index to a value. They are kept in treaps ordered by index, in
+ * which each node stores the distance from the entry before it rather than
+ * its index, so that inserting or deleting elements only has to adjust the
+ * entry just after the change instead of renumbering all following entries.
+ */
+
+typedef struct IndexNode {
+    struct IndexNode *left;	/* Entries with smaller indices. */
+    struct IndexNode *right;	/* Entries with larger indices. */
+    unsigned int priority;	/* Heap priority, assigned randomly. */
+    Tcl_Size gap;		/* Index of this entry minus the index of the
+				 * entry before it (-1 for the first). */
+    Tcl_Size sum;		/* Total of gap over this subtree. */
+    void *value;		/* Value of the entry; ckalloc'ed or NULL. */
+} IndexNode;
+
+typedef struct {
+    IndexNode *root;		/* Root of the treap, NULL when empty. */
+    unsigned int seed;		/* State for generating priorities. */
+} IndexMap;
+
 /*
  * A data structure of the following type is kept for each listbox widget
  * managed by this file:
@@ -47,9 +70,8 @@ typedef struct {
     Tcl_Obj *listVarNameObj;	/* List variable name */
     Tcl_Obj *listObj;		/* Pointer to the list object being used */
     Tcl_Size nElements;		/* Holds the current count of elements */
-    Tcl_HashTable *selection;	/* Tracks selection */
-    Tcl_HashTable *itemAttrTable;
-				/* Tracks item attributes */
+    IndexMap selection;		/* Tracks selection */
+    IndexMap itemAttrs;		/* Tracks item attributes */
 
     /*
      * Information used when displaying widget:
@@ -103,6 +125,16 @@ typedef struct {
 
     int maxWidth;		/* Width (in pixels) of widest string in
 				 * listbox. */
+    Tcl_HashTable widthCounts;	/* Number of elements of each pixel width,
+				 * keyed by width, so that maxWidth can be
+				 * updated when elements are deleted without
+				 * measuring all of the others. */
+    Tcl_Size partialVarUpdates;	/* Number of writes to the -listvariable for
+				 * which only the changed elements were
+				 * measured. */
+    Tcl_Size fullVarUpdates;	/* Number of writes to the -listvariable that
+				 * required all elements to be measured. For
+				 * the test suite. */
     int xScrollUnit;		/* Number of pixels in one "unit" for
 				 * horizontal scrolling (window scrolls
 				 * horizontally in increments of this size).
@@ -165,13 +197,6 @@ typedef struct {
     Tk_Justify justify;         /* Justification. */
 } Listbox;
 
-/*
- * How to encode the keys for the hash tables used to store what items are
- * selected and what the attributes are.
- */
-
-#define KEY(i)		((char *) INT2PTR(i))
-
 /*
  * ItemAttr structures are used to store item configuration information for
  * the items in a listbox
@@ -425,8 +450,22 @@ static int		NearestListboxElement(Listbox *listPtr, int y);
 static char *		ListboxListVarProc(void *clientData,
 			    Tcl_Interp *interp, const char *name1,
 			    const char *name2, int flags);
-static void		MigrateHashEntries(Tcl_HashTable *table,
-			    Tcl_Size first, Tcl_Size last, Tcl_Size offset);
+static Tcl_Size		ListboxVarChanged(Listbox *listPtr,
+			    Tcl_Obj *oldListObj, Tcl_Obj *newListObj);
+static void		CountElementWidth(Listbox *listPtr, int width,
+			    int delta);
+static void		IndexMapInit(IndexMap *mapPtr);
+static void		IndexMapFree(IndexMap *mapPtr);
+static IndexNode *	IndexMapFind(const IndexMap *mapPtr, Tcl_Size index);
+static Tcl_Size		IndexMapNext(const IndexMap *mapPtr, Tcl_Size index);
+static IndexNode *	IndexMapCreate(IndexMap *mapPtr, Tcl_Size index,
+			    int *isNewPtr);
+static int		IndexMapRemove(IndexMap *mapPtr, Tcl_Size index,
+			    void **valuePtr);
+static void		IndexMapInsert(IndexMap *mapPtr, Tcl_Size index,
+			    Tcl_Size count);
+static Tcl_Size		IndexMapDelete(IndexMap *mapPtr, Tcl_Size first,
+			    Tcl_Size last);
 static int		GetMaxOffset(Listbox *listPtr);
 
 /*
@@ -524,10 +563,9 @@ Tk_ListboxObjCmd(
 	    ListboxCmdDeletedProc);
     listPtr->optionTable	 = optionTables->listboxOptionTable;
     listPtr->itemAttrOptionTable = optionTables->itemAttrOptionTable;
-    listPtr->selection		 = (Tcl_HashTable *)ckalloc(sizeof(Tcl_HashTable));
-    Tcl_InitHashTable(listPtr->selection, TCL_ONE_WORD_KEYS);
-    listPtr->itemAttrTable	 = (Tcl_HashTable *)ckalloc(sizeof(Tcl_HashTable));
-    Tcl_InitHashTable(listPtr->itemAttrTable, TCL_ONE_WORD_KEYS);
+    IndexMapInit(&listPtr->selection);
+    IndexMapInit(&listPtr->itemAttrs);
+    Tcl_InitHashTable(&listPtr->widthCounts, TCL_ONE_WORD_KEYS);
     listPtr->relief		 = TK_RELIEF_RAISED;
     listPtr->textGC		 = NULL;
     listPtr->selFgColorPtr	 = NULL;
@@ -697,7 +735,7 @@ ListboxWidgetObjCmd(
 	break;
 
     case COMMAND_CURSELECTION: {
-	int i;
+	Tcl_Size i;
 
 	if (objc != 2) {
 	    Tcl_WrongNumArgs(interp, 2, objv, NULL);
@@ -706,18 +744,13 @@ ListboxWidgetObjCmd(
 	}
 
 	/*
-	 * Of course, it would be more efficient to use the Tcl_HashTable
-	 * search functions (Tcl_FirstHashEntry, Tcl_NextHashEntry), but then
-	 * the result wouldn't be in sorted order. So instead we loop through
-	 * the indices in order, adding them to the result if they are
-	 * selected.
+	 * The selection map yields the selected indices in order.
 	 */
 
 	objPtr = Tcl_NewObj();
-	for (i = 0; i < (int)listPtr->nElements; i++) {
-	    if (Tcl_FindHashEntry(listPtr->selection, KEY(i))) {
-		Tcl_ListObjAppendElement(NULL, objPtr, Tcl_NewWideIntObj(i));
-	    }
+	for (i = IndexMapNext(&listPtr->selection, 0); i >= 0;
+		i = IndexMapNext(&listPtr->selection, i + 1)) {
+	    Tcl_ListObjAppendElement(NULL, objPtr, Tcl_NewWideIntObj(i));
 	}
 	Tcl_SetObjResult(interp, objPtr);
 	result = TCL_OK;
@@ -1211,7 +1244,7 @@ ListboxSelectionSubCmd(
 	    return TCL_ERROR;
 	}
 	Tcl_SetObjResult(interp, Tcl_NewBooleanObj(
-		Tcl_FindHashEntry(listPtr->selection, KEY(first)) != NULL));
+		IndexMapFind(&listPtr->selection, first) != NULL));
 	result = TCL_OK;
 	break;
     case SELECTION_SET:
@@ -1399,10 +1432,10 @@ ListboxGetItemAttributes(
 				 * for. */
 {
     int isNew;
-    Tcl_HashEntry *entry;
+    IndexNode *nodePtr;
     ItemAttr *attrs;
 
-    entry = Tcl_CreateHashEntry(listPtr->itemAttrTable, KEY(index), &isNew);
+    nodePtr = IndexMapCreate(&listPtr->itemAttrs, index, &isNew);
     if (isNew) {
 	attrs = (ItemAttr *)ckalloc(sizeof(ItemAttr));
 	attrs->border = NULL;
@@ -1411,9 +1444,9 @@ ListboxGetItemAttributes(
 	attrs->selFgColor = NULL;
 	Tk_InitOptions(interp, attrs, listPtr->itemAttrOptionTable,
 		listPtr->tkwin);
-	Tcl_SetHashValue(entry, attrs);
+	nodePtr->value = attrs;
     } else {
-	attrs = (ItemAttr *)Tcl_GetHashValue(entry);
+	attrs = (ItemAttr *)nodePtr->value;
     }
     return attrs;
 }
@@ -1441,8 +1474,6 @@ DestroyListbox(
     void *memPtr)		/* Info about listbox widget. */
 {
     Listbox *listPtr = (Listbox *)memPtr;
-    Tcl_HashEntry *entry;
-    Tcl_HashSearch search;
 
     /*
      * If we have an internal list object, free it.
@@ -1460,22 +1491,12 @@ DestroyListbox(
     }
 
     /*
-     * Free the selection hash table.
+     * Free the selection and item attribute maps and the width counts.
      */
 
-    Tcl_DeleteHashTable(listPtr->selection);
-    ckfree(listPtr->selection);
-
-    /*
-     * Free the item attribute hash table.
-     */
-
-    for (entry = Tcl_FirstHashEntry(listPtr->itemAttrTable, &search);
-	    entry != NULL; entry = Tcl_NextHashEntry(&search)) {
-	ckfree(Tcl_GetHashValue(entry));
-    }
-    Tcl_DeleteHashTable(listPtr->itemAttrTable);
-    ckfree(listPtr->itemAttrTable);
+    IndexMapFree(&listPtr->selection);
+    IndexMapFree(&listPtr->itemAttrs);
+    Tcl_DeleteHashTable(&listPtr->widthCounts);
 
     /*
      * Free up all the stuff that requires special handling, then let
@@ -1858,7 +1879,7 @@ DisplayListbox(
     Tcl_Size stringLen;
     Tk_FontMetrics fm;
     Tcl_Obj *curElement;
-    Tcl_HashEntry *entry;
+    IndexNode *attrNode;
     const char *stringRep;
     ItemAttr *attrs;
     Tk_3DBorder selectedBg;
@@ -1909,8 +1930,7 @@ DisplayListbox(
      * screen).
      */
 
-    pixmap = Tk_GetPixmap(disp, Tk_WindowId(tkwin),
-	    Tk_Width(tkwin), Tk_Height(tkwin), Tk_Depth(tkwin));
+    pixmap = TkGetBufferPixmap(tkwin, Tk_Width(tkwin), Tk_Height(tkwin));
 #else
     pixmap = Tk_WindowId(tkwin);
 #endif /* TK_NO_DOUBLE_BUFFERING */
@@ -1949,7 +1969,7 @@ DisplayListbox(
 	 * special foreground/background colors.
 	 */
 
-	entry = Tcl_FindHashEntry(listPtr->itemAttrTable, KEY(i));
+	attrNode = IndexMapFind(&listPtr->itemAttrs, i);
 
 	/*
 	 * If the listbox is enabled, items may be drawn differently; they may
@@ -1958,7 +1978,7 @@ DisplayListbox(
 	 */
 
 	if (listPtr->state & STATE_NORMAL) {
-	    if (Tcl_FindHashEntry(listPtr->selection, KEY(i))) {
+	    if (IndexMapFind(&listPtr->selection, i)) {
 		/*
 		 * Selected items are drawn differently.
 		 */
@@ -1972,8 +1992,8 @@ DisplayListbox(
 		 * drawing accordingly.
 		 */
 
-		if (entry != NULL) {
-		    attrs = (ItemAttr *)Tcl_GetHashValue(entry);
+		if (attrNode != NULL) {
+		    attrs = (ItemAttr *)attrNode->value;
 
 		    /*
 		     * Default GC has the values from the widget at large.
@@ -2040,7 +2060,7 @@ DisplayListbox(
 		}
 		/* Draw bottom bevel */
 		if (i + 1 == (int)listPtr->nElements ||
-			!Tcl_FindHashEntry(listPtr->selection, KEY(i + 1))) {
+			!IndexMapFind(&listPtr->selection, i + 1)) {
 		    Tk_3DHorizontalBevel(tkwin, pixmap, selectedBg, x-left,
 			    y + listPtr->lineHeight - selBorderWidth,
 			    width+left+right, selBorderWidth, 0, 0, 0,
@@ -2053,8 +2073,8 @@ DisplayListbox(
 		 * the background box and set the foreground color accordingly.
 		 */
 
-		if (entry != NULL) {
-		    attrs = (ItemAttr *)Tcl_GetHashValue(entry);
+		if (attrNode != NULL) {
+		    attrs = (ItemAttr *)attrNode->value;
 		    gcValues.foreground = listPtr->fgColorPtr->pixel;
 		    gcValues.font = Tk_FontId(listPtr->tkfont);
 		    gcValues.graphics_exposures = False;
@@ -2179,7 +2199,7 @@ DisplayListbox(
 #ifndef TK_NO_DOUBLE_BUFFERING
     XCopyArea(disp, pixmap, Tk_WindowId(tkwin), listPtr->textGC, 0, 0,
 	    (unsigned) Tk_Width(tkwin), (unsigned) Tk_Height(tkwin), 0, 0);
-    Tk_FreePixmap(disp, pixmap);
+    TkFreeBufferPixmap(tkwin, pixmap);
 #endif /* TK_NO_DOUBLE_BUFFERING */
 }
 
@@ -2230,6 +2250,8 @@ ListboxComputeGeometry(
 	    listPtr->xScrollUnit = 1;
 	}
 	listPtr->maxWidth = 0;
+	Tcl_DeleteHashTable(&listPtr->widthCounts);
+	Tcl_InitHashTable(&listPtr->widthCounts, TCL_ONE_WORD_KEYS);
 	for (i = 0; i < (int)listPtr->nElements; i++) {
 	    /*
 	     * Compute the pixel width of the current element.
@@ -2241,11 +2263,8 @@ ListboxComputeGeometry(
 		continue;
 	    }
 	    text = Tcl_GetStringFromObj(element, &textLength);
-	    Tk_GetFontMetrics(listPtr->tkfont, &fm);
 	    pixelWidth = Tk_TextWidth(listPtr->tkfont, text, textLength);
-	    if (pixelWidth > listPtr->maxWidth) {
-		listPtr->maxWidth = pixelWidth;
-	    }
+	    CountElementWidth(listPtr, pixelWidth, 1);
 	}
     }
 
@@ -2315,15 +2334,13 @@ ListboxInsertSubCmd(
     oldMaxWidth = listPtr->maxWidth;
     for (i = 0; i < objc; i++) {
 	/*
-	 * Check if any of the new elements are wider than the current widest;
-	 * if so, update our notion of "widest."
+	 * Count the widths of the new elements; this also updates our notion
+	 * of "widest."
 	 */
 
 	stringRep = Tcl_GetStringFromObj(objv[i], &length);
 	pixelWidth = Tk_TextWidth(listPtr->tkfont, stringRep, length);
-	if (pixelWidth > listPtr->maxWidth) {
-	    listPtr->maxWidth = pixelWidth;
-	}
+	CountElementWidth(listPtr, pixelWidth, 1);
     }
 
     /*
@@ -2331,9 +2348,8 @@ ListboxInsertSubCmd(
      * first index.
      */
 
-    MigrateHashEntries(listPtr->selection, index, listPtr->nElements-1, objc);
-    MigrateHashEntries(listPtr->itemAttrTable, index, listPtr->nElements-1,
-	    objc);
+    IndexMapInsert(&listPtr->selection, index, objc);
+    IndexMapInsert(&listPtr->itemAttrs, index, objc);
 
     /*
      * If the object is shared, duplicate it before writing to it.
@@ -2422,11 +2438,10 @@ ListboxDeleteSubCmd(
     int first,			/* Index of first element to delete. */
     int last)			/* Index of last element to delete. */
 {
-    int count, i, widthChanged, result, pixelWidth;
+    int count, i, recount, oldMaxWidth, result, pixelWidth;
     Tcl_Size length;
     Tcl_Obj *newListObj, *element;
     const char *stringRep;
-    Tcl_HashEntry *entry;
 
     /*
      * Adjust the range to fit within the existing elements of the listbox,
@@ -2445,55 +2460,37 @@ ListboxDeleteSubCmd(
     }
 
     /*
-     * Foreach deleted index we must:
-     * a) remove selection information,
-     * b) check the width of the element; if it is equal to the max, set
-     *    widthChanged to 1, because it may be the only element with that
-     *    width.
+     * Take the widths of the deleted elements out of the width counts, which
+     * keeps maxWidth up to date. If more elements are deleted than are left,
+     * it is cheaper to count the remaining ones from scratch afterwards. If
+     * the counts are stale, they will be redone at the next redisplay
+     * anyway.
      */
 
-    widthChanged = 0;
-    for (i = first; i <= last; i++) {
-	/*
-	 * Remove selection information.
-	 */
-
-	entry = Tcl_FindHashEntry(listPtr->selection, KEY(i));
-	if (entry != NULL) {
-	    listPtr->numSelected--;
-	    Tcl_DeleteHashEntry(entry);
-	}
-
-	entry = Tcl_FindHashEntry(listPtr->itemAttrTable, KEY(i));
-	if (entry != NULL) {
-	    ckfree(Tcl_GetHashValue(entry));
-	    Tcl_DeleteHashEntry(entry);
-	}
-
-	/*
-	 * Check width of the element. We only have to check if widthChanged
-	 * has not already been set to 1, because we only need one maxWidth
-	 * element to disappear for us to have to recompute the width.
-	 */
-
-	if (widthChanged == 0) {
-	    Tcl_ListObjIndex(listPtr->interp, listPtr->listObj, i, &element);
-	    stringRep = Tcl_GetStringFromObj(element, &length);
-	    pixelWidth = Tk_TextWidth(listPtr->tkfont, stringRep, length);
-	    if (pixelWidth == listPtr->maxWidth) {
-		widthChanged = 1;
+    oldMaxWidth = listPtr->maxWidth;
+    recount = 0;
+    if (!(listPtr->flags & MAXWIDTH_IS_STALE)) {
+	if (count > (int)listPtr->nElements - count) {
+	    recount = 1;
+	} else {
+	    for (i = first; i <= last; i++) {
+		Tcl_ListObjIndex(listPtr->interp, listPtr->listObj, i,
+			&element);
+		stringRep = Tcl_GetStringFromObj(element, &length);
+		pixelWidth = Tk_TextWidth(listPtr->tkfont, stringRep, length);
+		CountElementWidth(listPtr, pixelWidth, -1);
 	    }
 	}
     }
 
     /*
-     * Adjust selection and attribute info for indices after lastIndex.
+     * Remove selection and attribute information for the deleted elements,
+     * and renumber that of the elements after them.
      */
 
-    MigrateHashEntries(listPtr->selection, last+1,
-	    listPtr->nElements-1, count*-1);
-    MigrateHashEntries(listPtr->itemAttrTable, last+1,
-	    listPtr->nElements-1, count*-1);
+    listPtr->numSelected -= (int)IndexMapDelete(&listPtr->selection,
+	    first, last);
+    IndexMapDelete(&listPtr->itemAttrs, first, last);
 
     /*
      * Delete the requested elements.
@@ -2565,8 +2562,8 @@ ListboxDeleteSubCmd(
 	}
     }
     listPtr->flags |= UPDATE_V_SCROLLBAR;
-    ListboxComputeGeometry(listPtr, 0, widthChanged, 0);
-    if (widthChanged) {
+    ListboxComputeGeometry(listPtr, 0, recount, 0);
+    if (listPtr->maxWidth != oldMaxWidth) {
 	listPtr->flags |= UPDATE_H_SCROLLBAR;
     }
     EventuallyRedrawRange(listPtr, first, listPtr->nElements-1);
@@ -3013,7 +3010,7 @@ ListboxSelect(
 				 * them. */
 {
     int i, firstRedisplay, oldCount, isNew;
-    Tcl_HashEntry *entry;
+    Tcl_Size index;
 
     if (last < first) {
 	i = first;
@@ -3033,32 +3030,31 @@ ListboxSelect(
     firstRedisplay = -1;
 
     /*
-     * For each index in the range, find it in our selection hash table. If
-     * it's not there but should be, add it. If it's there but shouldn't be,
-     * remove it.
+     * When selecting, add each index in the range to the selection map if it
+     * is not there yet. When deselecting, only the indices in the range that
+     * are in the map need to be visited.
      */
 
-    for (i = first; i <= last; i++) {
-	entry = Tcl_FindHashEntry(listPtr->selection, KEY(i));
-	if (entry != NULL) {
-	    if (!select) {
-		Tcl_DeleteHashEntry(entry);
-		listPtr->numSelected--;
-		if (firstRedisplay < 0) {
-		    firstRedisplay = i;
-		}
-	    }
-	} else {
-	    if (select) {
-		entry = Tcl_CreateHashEntry(listPtr->selection, KEY(i),
-			&isNew);
-		Tcl_SetHashValue(entry, NULL);
+    if (select) {
+	for (i = first; i <= last; i++) {
+	    IndexMapCreate(&listPtr->selection, i, &isNew);
+	    if (isNew) {
 		listPtr->numSelected++;
 		if (firstRedisplay < 0) {
 		    firstRedisplay = i;
 		}
 	    }
 	}
+    } else {
+	for (index = IndexMapNext(&listPtr->selection, first);
+		index >= 0 && index <= last;
+		index = IndexMapNext(&listPtr->selection, index)) {
+	    IndexMapRemove(&listPtr->selection, index, NULL);
+	    listPtr->numSelected--;
+	    if (firstRedisplay < 0) {
+		firstRedisplay = (int)index;
+	    }
+	}
     }
 
     if (firstRedisplay >= 0) {
@@ -3107,11 +3103,10 @@ ListboxFetchSelection(
 {
     Listbox *listPtr = (Listbox *)clientData;
     Tcl_DString selection;
-    int count, needNewline, i;
-    Tcl_Size length, stringLen;
+    int count, needNewline;
+    Tcl_Size i, length, stringLen;
     Tcl_Obj *curElement;
     const char *stringRep;
-    Tcl_HashEntry *entry;
 
     if ((!listPtr->exportSelection) || Tcl_IsSafe(listPtr->interp)) {
 	return -1;
@@ -3123,18 +3118,15 @@ ListboxFetchSelection(
 
     needNewline = 0;
     Tcl_DStringInit(&selection);
-    for (i = 0; i < (int)listPtr->nElements; i++) {
-	entry = Tcl_FindHashEntry(listPtr->selection, KEY(i));
-	if (entry != NULL) {
-	    if (needNewline) {
-		Tcl_DStringAppend(&selection, "\n", 1);
-	    }
-	    Tcl_ListObjIndex(listPtr->interp, listPtr->listObj, i,
-		    &curElement);
-	    stringRep = Tcl_GetStringFromObj(curElement, &stringLen);
-	    Tcl_DStringAppend(&selection, stringRep, stringLen);
-	    needNewline = 1;
+    for (i = IndexMapNext(&listPtr->selection, 0); i >= 0;
+	    i = IndexMapNext(&listPtr->selection, i + 1)) {
+	if (needNewline) {
+	    Tcl_DStringAppend(&selection, "\n", 1);
 	}
+	Tcl_ListObjIndex(listPtr->interp, listPtr->listObj, i, &curElement);
+	stringRep = Tcl_GetStringFromObj(curElement, &stringLen);
+	Tcl_DStringAppend(&selection, stringRep, stringLen);
+	needNewline = 1;
     }
 
     length = Tcl_DStringLength(&selection);
@@ -3425,8 +3417,8 @@ ListboxListVarProc(
 {
     Listbox *listPtr = (Listbox *)clientData;
     Tcl_Obj *oldListObj, *varListObj;
-    Tcl_Size oldLength, i;
-    Tcl_HashEntry *entry;
+    Tcl_Size oldLength, i, first = 0;
+    int oldMaxWidth = listPtr->maxWidth;
 
     /*
      * Bwah hahahaha! Puny mortal, you can't unset a -listvar'd variable!
@@ -3462,6 +3454,7 @@ ListboxListVarProc(
 		    ListboxListVarProc, clientData);
 	    return NULL;
 	}
+	listPtr->flags |= MAXWIDTH_IS_STALE;
     } else {
 	oldListObj = listPtr->listObj;
 	varListObj = Tcl_GetVar2Ex(listPtr->interp, Tcl_GetString(listPtr->listVarNameObj),
@@ -3488,9 +3481,11 @@ ListboxListVarProc(
 	Tcl_IncrRefCount(listPtr->listObj);
 
 	/*
-	 * Clean up the ref to our old list obj.
+	 * Account for the widths of the elements that changed, then clean up
+	 * the ref to our old list obj.
 	 */
 
+	first = ListboxVarChanged(listPtr, oldListObj, varListObj);
 	Tcl_DecrRefCount(oldListObj);
     }
 
@@ -3502,27 +3497,10 @@ ListboxListVarProc(
     oldLength = listPtr->nElements;
     Tcl_ListObjLength(listPtr->interp, listPtr->listObj, &listPtr->nElements);
     if (listPtr->nElements < oldLength) {
-	for (i = listPtr->nElements; i < oldLength; i++) {
-	    /*
-	     * Clean up selection.
-	     */
-
-	    entry = Tcl_FindHashEntry(listPtr->selection, KEY(i));
-	    if (entry != NULL) {
-		listPtr->numSelected--;
-		Tcl_DeleteHashEntry(entry);
-	    }
-
-	    /*
-	     * Clean up attributes.
-	     */
-
-	    entry = Tcl_FindHashEntry(listPtr->itemAttrTable, KEY(i));
-	    if (entry != NULL) {
-		ckfree(Tcl_GetHashValue(entry));
-		Tcl_DeleteHashEntry(entry);
-	    }
-	}
+	listPtr->numSelected -= (int)IndexMapDelete(&listPtr->selection,
+		listPtr->nElements, oldLength - 1);
+	IndexMapDelete(&listPtr->itemAttrs, listPtr->nElements,
+		oldLength - 1);
     }
 
     if (oldLength != listPtr->nElements) {
@@ -3536,84 +3514,579 @@ ListboxListVarProc(
     }
 
     /*
-     * The computed maxWidth may have changed as a result of this operation.
-     * However, we don't want to recompute it every time this trace fires
-     * (imagine the user doing 1000 lappends to the listvar). Therefore, set
-     * the MAXWIDTH_IS_STALE flag, which will cause the width to be recomputed
-     * next time the list is redrawn.
+     * Unless ListboxVarChanged gave up and set the MAXWIDTH_IS_STALE flag,
+     * which makes the next redisplay remeasure every element, the width
+     * counts are up to date and only the requested size has to be updated.
      */
 
-    listPtr->flags |= MAXWIDTH_IS_STALE;
+    if (!(listPtr->flags & MAXWIDTH_IS_STALE)) {
+	ListboxComputeGeometry(listPtr, 0, 0, 0);
+	if (listPtr->maxWidth != oldMaxWidth) {
+	    listPtr->flags |= UPDATE_H_SCROLLBAR;
+	}
+    }
 
-    EventuallyRedrawRange(listPtr, 0, listPtr->nElements-1);
+    EventuallyRedrawRange(listPtr, first, listPtr->nElements-1);
     return NULL;
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ListboxVarChanged --
+ *
+ *	Called when the -listvariable of a listbox is set to a new list.
+ *	Finds the range of elements in which the new list differs from the
+ *	old one by comparing the element objects, not their strings, so that
+ *	appending to a list, which keeps the objects of the existing elements,
+ *	is cheap. Only the changed elements are measured to update the width
+ *	counts. If most of the list changed, or the counts are stale anyway,
+ *	the MAXWIDTH_IS_STALE flag is set instead, so that all the elements
+ *	are measured once at the next redisplay, however many times the
+ *	variable is written until then.
+ *
+ * Results:
+ *	The index of the first element that changed.
+ *
+ * Side effects:
+ *	The width counts and maxWidth of the listbox may change, or its
+ *	MAXWIDTH_IS_STALE flag may be set.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Size
+ListboxVarChanged(
+    Listbox *listPtr,		/* Listbox whose variable was set. */
+    Tcl_Obj *oldListObj,	/* Previous list of the listbox. */
+    Tcl_Obj *newListObj)	/* New value of the variable. */
+{
+    Tcl_Obj **oldv, **newv;
+    Tcl_Size oldc, newc, prefix, suffix, limit, i, length;
+    const char *stringRep;
+
+    if (newListObj == oldListObj) {
+	/*
+	 * This is the listbox storing its own list after an insert or delete,
+	 * which has accounted for the widths already.
+	 */
+
+	return listPtr->nElements;
+    }
+    if ((listPtr->flags & MAXWIDTH_IS_STALE)
+	    || (Tcl_ListObjGetElements(NULL, oldListObj, &oldc, &oldv)
+		    != TCL_OK)
+	    || (Tcl_ListObjGetElements(NULL, newListObj, &newc, &newv)
+		    != TCL_OK)) {
+	goto fullUpdate;
+    }
+
+    /*
+     * Lists that share their element storage have the same leading
+     * elements without looking at them.
+     */
+
+    limit = (oldc < newc) ? oldc : newc;
+    if (oldv == newv) {
+	prefix = limit;
+    } else {
+	for (prefix = 0; prefix < limit; prefix++) {
+	    if (oldv[prefix] != newv[prefix]) {
+		break;
+	    }
+	}
+    }
+    for (suffix = 0; suffix < limit - prefix; suffix++) {
+	if (oldv[oldc - 1 - suffix] != newv[newc - 1 - suffix]) {
+	    break;
+	}
+    }
+    if ((oldc - prefix - suffix) + (newc - prefix - suffix) > newc) {
+	goto fullUpdate;
+    }
+
+    /*
+     * Count the new elements before forgetting the old ones, so that
+     * replacing an element by one just as wide doesn't make the maximum
+     * width look like it went away.
+     */
+
+    for (i = prefix; i < newc - suffix; i++) {
+	stringRep = Tcl_GetStringFromObj(newv[i], &length);
+	CountElementWidth(listPtr,
+		Tk_TextWidth(listPtr->tkfont, stringRep, length), 1);
+    }
+    for (i = prefix; i < oldc - suffix; i++) {
+	stringRep = Tcl_GetStringFromObj(oldv[i], &length);
+	CountElementWidth(listPtr,
+		Tk_TextWidth(listPtr->tkfont, stringRep, length), -1);
+    }
+    listPtr->partialVarUpdates++;
+    return prefix;
+
+  fullUpdate:
+    listPtr->flags |= MAXWIDTH_IS_STALE;
+    listPtr->fullVarUpdates++;
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkListboxGetVarUpdates --
+ *
+ *	Reports how many writes to the -listvariable of a listbox were
+ *	handled by measuring only the elements that changed, and how many
+ *	made it remeasure all of them. Used by the test suite.
+ *
+ * Results:
+ *	Returns 1 and stores the counts if tkwin is a listbox, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TkListboxGetVarUpdates(
+    Tk_Window tkwin,		/* Window to query. */
+    Tcl_Size *partialPtr,	/* Returns the number of partial updates. */
+    Tcl_Size *fullPtr)		/* Returns the number of full updates. */
+{
+    TkWindow *winPtr = (TkWindow *)tkwin;
+    Listbox *listPtr;
+
+    if (winPtr->classProcsPtr != &listboxClass
+	    || winPtr->instanceData == NULL) {
+	return 0;
+    }
+    listPtr = (Listbox *)winPtr->instanceData;
+    *partialPtr = listPtr->partialVarUpdates;
+    *fullPtr = listPtr->fullVarUpdates;
+    return 1;
+}
 
 /*
  *----------------------------------------------------------------------
  *
- * MigrateHashEntries --
+ * CountElementWidth --
  *
- *	Given a hash table with entries keyed by a single integer value, move
- *	all entries in a given range by a fixed amount, so that if in the
- *	original table there was an entry with key n and the offset was i, in
- *	the new table that entry would have key n + i.
+ *	Record that delta elements of the given pixel width were added to the
+ *	listbox (or removed from it, if delta is negative) and keep maxWidth
+ *	up to date.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	Rekeys some hash table entries.
+ *	The width counts and maxWidth of the listbox may change.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-MigrateHashEntries(
-    Tcl_HashTable *table,
-    Tcl_Size first,
-    Tcl_Size last,
-    Tcl_Size offset)
+CountElementWidth(
+    Listbox *listPtr,		/* Listbox whose elements changed. */
+    int width,			/* Pixel width of the elements. */
+    int delta)			/* Number of elements added (positive) or
+				 * removed (negative). */
 {
-    Tcl_Size i;
-    int isNew;
     Tcl_HashEntry *entry;
-    void *clientData;
-
-    if (offset == 0) {
+    Tcl_HashSearch search;
+    int isNew, count;
+
+    entry = Tcl_CreateHashEntry(&listPtr->widthCounts, INT2PTR(width),
+	    &isNew);
+    count = (isNew ? 0 : PTR2INT(Tcl_GetHashValue(entry))) + delta;
+    if (count > 0) {
+	Tcl_SetHashValue(entry, INT2PTR(count));
+	if (width > listPtr->maxWidth) {
+	    listPtr->maxWidth = width;
+	}
 	return;
     }
+    Tcl_DeleteHashEntry(entry);
 
     /*
-     * It's more efficient to do one if/else and nest the for loops inside,
-     * although we could avoid some code duplication if we nested the if/else
-     * inside the for loops.
+     * If the last of the widest elements went away, the new maximum is the
+     * largest width still counted. There are far fewer distinct widths than
+     * elements.
      */
 
-    if (offset > 0) {
-	for (i = last; i >= first; i--) {
-	    entry = Tcl_FindHashEntry(table, KEY(i));
-	    if (entry != NULL) {
-		clientData = Tcl_GetHashValue(entry);
-		Tcl_DeleteHashEntry(entry);
-		entry = Tcl_CreateHashEntry(table, KEY(i + offset), &isNew);
-		Tcl_SetHashValue(entry, clientData);
+    if (width == listPtr->maxWidth) {
+	listPtr->maxWidth = 0;
+	for (entry = Tcl_FirstHashEntry(&listPtr->widthCounts, &search);
+		entry != NULL; entry = Tcl_NextHashEntry(&search)) {
+	    width = PTR2INT(Tcl_GetHashKey(&listPtr->widthCounts, entry));
+	    if (width > listPtr->maxWidth) {
+		listPtr->maxWidth = width;
 	    }
 	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IndexMapInit, IndexMapFree --
+ *
+ *	Initialize an empty index map, or release all of the entries in one.
+ *	The values of the entries are owned by the map: when an entry is
+ *	released, its value is passed to ckfree unless it is NULL.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed by IndexMapFree.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+IndexMapInit(
+    IndexMap *mapPtr)		/* Map to initialize. */
+{
+    mapPtr->root = NULL;
+    mapPtr->seed = 0x9E3779B9U;
+}
+
+static Tcl_Size
+FreeIndexNodes(
+    IndexNode *nodePtr)
+{
+    Tcl_Size count = 0;
+
+    while (nodePtr != NULL) {
+	IndexNode *rightPtr = nodePtr->right;
+
+	count += FreeIndexNodes(nodePtr->left) + 1;
+	if (nodePtr->value != NULL) {
+	    ckfree(nodePtr->value);
+	}
+	ckfree(nodePtr);
+	nodePtr = rightPtr;
+    }
+    return count;
+}
+
+static void
+IndexMapFree(
+    IndexMap *mapPtr)		/* Map to empty. */
+{
+    FreeIndexNodes(mapPtr->root);
+    mapPtr->root = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IndexMapSplit, IndexMapMerge --
+ *
+ *	The two primitive treap operations. IndexMapSplit divides a subtree
+ *	into the entries whose index is less than a given index and the rest;
+ *	base is the index of the entry just before the subtree (-1 at the
+ *	top). IndexMapMerge concatenates two subtrees, all entries of the
+ *	first coming before those of the second. Since nodes store the gap to
+ *	their predecessor, neither operation changes the index of any entry.
+ *
+ * Results:
+ *	IndexMapMerge returns the root of the merged subtree.
+ *
+ * Side effects:
+ *	The subtrees are restructured.
+ *
+ *----------------------------------------------------------------------
+ */
+
+#define INDEX_SUM(nodePtr)	((nodePtr) ? (nodePtr)->sum : 0)
+#define INDEX_UPDATE(nodePtr) \
+    ((nodePtr)->sum = INDEX_SUM((nodePtr)->left) + (nodePtr)->gap \
+	    + INDEX_SUM((nodePtr)->right))
+
+static void
+IndexMapSplit(
+    IndexNode *nodePtr,		/* Subtree to split. */
+    Tcl_Size index,		/* First index to go to the right part. */
+    Tcl_Size base,		/* Index of the entry before the subtree. */
+    IndexNode **leftPtr,	/* Returns the entries before index. */
+    IndexNode **rightPtr)	/* Returns the entries at or after index. */
+{
+    Tcl_Size nodeIndex;
+
+    if (nodePtr == NULL) {
+	*leftPtr = *rightPtr = NULL;
+	return;
+    }
+    nodeIndex = base + INDEX_SUM(nodePtr->left) + nodePtr->gap;
+    if (nodeIndex < index) {
+	IndexMapSplit(nodePtr->right, index, nodeIndex, &nodePtr->right,
+		rightPtr);
+	*leftPtr = nodePtr;
     } else {
-	for (i = first; i <= last; i++) {
-	    entry = Tcl_FindHashEntry(table, KEY(i));
-	    if (entry != NULL) {
-		clientData = Tcl_GetHashValue(entry);
-		Tcl_DeleteHashEntry(entry);
-		entry = Tcl_CreateHashEntry(table, KEY(i + offset), &isNew);
-		Tcl_SetHashValue(entry, clientData);
-	    }
+	IndexMapSplit(nodePtr->left, index, base, leftPtr, &nodePtr->left);
+	*rightPtr = nodePtr;
+    }
+    INDEX_UPDATE(nodePtr);
+}
+
+static IndexNode *
+IndexMapMerge(
+    IndexNode *leftPtr,		/* Entries that come first. */
+    IndexNode *rightPtr)	/* Entries that come after them. */
+{
+    if (leftPtr == NULL) {
+	return rightPtr;
+    }
+    if (rightPtr == NULL) {
+	return leftPtr;
+    }
+    if (leftPtr->priority > rightPtr->priority) {
+	leftPtr->right = IndexMapMerge(leftPtr->right, rightPtr);
+	INDEX_UPDATE(leftPtr);
+	return leftPtr;
+    }
+    rightPtr->left = IndexMapMerge(leftPtr, rightPtr->left);
+    INDEX_UPDATE(rightPtr);
+    return rightPtr;
+}
+
+/*
+ * Adds delta to the gap of the first entry of a subtree, which moves every
+ * entry in the subtree by delta.
+ */
+
+static void
+IndexMapMoveFirst(
+    IndexNode *nodePtr,
+    Tcl_Size delta)
+{
+    while (nodePtr != NULL) {
+	nodePtr->sum += delta;
+	if (nodePtr->left == NULL) {
+	    nodePtr->gap += delta;
+	    break;
 	}
+	nodePtr = nodePtr->left;
     }
-    return;
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IndexMapFind, IndexMapNext --
+ *
+ *	IndexMapFind looks up the entry for an index. IndexMapNext returns
+ *	the smallest index at or after a given one that has an entry; it is
+ *	used to walk the entries of a map in order.
+ *
+ * Results:
+ *	IndexMapFind returns the entry's node or NULL if there is none.
+ *	IndexMapNext returns an index, or TCL_INDEX_NONE when there are no
+ *	more entries.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static IndexNode *
+IndexMapFind(
+    const IndexMap *mapPtr,	/* Map to search. */
+    Tcl_Size index)		/* Index to look up. */
+{
+    IndexNode *nodePtr = mapPtr->root;
+    Tcl_Size base = -1, nodeIndex;
+
+    while (nodePtr != NULL) {
+	nodeIndex = base + INDEX_SUM(nodePtr->left) + nodePtr->gap;
+	if (index == nodeIndex) {
+	    return nodePtr;
+	}
+	if (index < nodeIndex) {
+	    nodePtr = nodePtr->left;
+	} else {
+	    base = nodeIndex;
+	    nodePtr = nodePtr->right;
+	}
+    }
+    return NULL;
+}
+
+static Tcl_Size
+IndexMapNext(
+    const IndexMap *mapPtr,	/* Map to search. */
+    Tcl_Size index)		/* Index to start at. */
+{
+    IndexNode *nodePtr = mapPtr->root;
+    Tcl_Size base = -1, nodeIndex, result = TCL_INDEX_NONE;
+
+    while (nodePtr != NULL) {
+	nodeIndex = base + INDEX_SUM(nodePtr->left) + nodePtr->gap;
+	if (nodeIndex >= index) {
+	    result = nodeIndex;
+	    nodePtr = nodePtr->left;
+	} else {
+	    base = nodeIndex;
+	    nodePtr = nodePtr->right;
+	}
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IndexMapCreate --
+ *
+ *	Find the entry for an index, creating it with a NULL value if there
+ *	is none.
+ *
+ * Results:
+ *	The entry's node. *isNewPtr is set to 1 if the entry was created and
+ *	0 if it already existed.
+ *
+ * Side effects:
+ *	Memory may be allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static IndexNode *
+IndexMapCreate(
+    IndexMap *mapPtr,		/* Map to add to. */
+    Tcl_Size index,		/* Index of the entry. */
+    int *isNewPtr)		/* Set to whether the entry is new. */
+{
+    IndexNode *nodePtr, *leftPtr, *rightPtr;
+
+    nodePtr = IndexMapFind(mapPtr, index);
+    if (nodePtr != NULL) {
+	*isNewPtr = 0;
+	return nodePtr;
+    }
+    *isNewPtr = 1;
+
+    /*
+     * Priorities come from a xorshift generator; they only have to be
+     * unrelated to the order in which indices are added.
+     */
+
+    mapPtr->seed ^= mapPtr->seed << 13;
+    mapPtr->seed ^= mapPtr->seed >> 17;
+    mapPtr->seed ^= mapPtr->seed << 5;
+
+    IndexMapSplit(mapPtr->root, index, -1, &leftPtr, &rightPtr);
+    nodePtr = (IndexNode *)ckalloc(sizeof(IndexNode));
+    nodePtr->left = nodePtr->right = NULL;
+    nodePtr->priority = mapPtr->seed;
+    nodePtr->gap = nodePtr->sum = index - (INDEX_SUM(leftPtr) - 1);
+    nodePtr->value = NULL;
+    IndexMapMoveFirst(rightPtr, -nodePtr->gap);
+    mapPtr->root = IndexMapMerge(IndexMapMerge(leftPtr, nodePtr), rightPtr);
+    return nodePtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IndexMapRemove --
+ *
+ *	Remove the entry for an index, if there is one, without renumbering
+ *	any other entry.
+ *
+ * Results:
+ *	Returns 1 if there was an entry, 0 otherwise. The entry's value is
+ *	stored in *valuePtr (if valuePtr is not NULL) and becomes the
+ *	caller's.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+IndexMapRemove(
+    IndexMap *mapPtr,		/* Map to remove from. */
+    Tcl_Size index,		/* Index of the entry. */
+    void **valuePtr)		/* Returns the entry's value, or NULL. */
+{
+    IndexNode *leftPtr, *nodePtr, *rightPtr;
+
+    IndexMapSplit(mapPtr->root, index, -1, &leftPtr, &rightPtr);
+    IndexMapSplit(rightPtr, index + 1, INDEX_SUM(leftPtr) - 1, &nodePtr,
+	    &rightPtr);
+    if (nodePtr != NULL) {
+	IndexMapMoveFirst(rightPtr, nodePtr->gap);
+	if (valuePtr != NULL) {
+	    *valuePtr = nodePtr->value;
+	}
+	ckfree(nodePtr);
+    }
+    mapPtr->root = IndexMapMerge(leftPtr, rightPtr);
+    return nodePtr != NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IndexMapInsert, IndexMapDelete --
+ *
+ *	Renumber a map to follow the insertion of count elements before
+ *	index, or the deletion of the elements first through last. Entries
+ *	for deleted elements are released. Either way only the entries that
+ *	the change divides the map at are touched, not all of the following
+ *	ones.
+ *
+ * Results:
+ *	IndexMapDelete returns the number of entries released.
+ *
+ * Side effects:
+ *	Entries are renumbered and memory may be freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+IndexMapInsert(
+    IndexMap *mapPtr,		/* Map to renumber. */
+    Tcl_Size index,		/* Index of the first new element. */
+    Tcl_Size count)		/* Number of elements inserted. */
+{
+    IndexNode *leftPtr, *rightPtr;
+
+    if (count <= 0 || mapPtr->root == NULL) {
+	return;
+    }
+    IndexMapSplit(mapPtr->root, index, -1, &leftPtr, &rightPtr);
+    IndexMapMoveFirst(rightPtr, count);
+    mapPtr->root = IndexMapMerge(leftPtr, rightPtr);
+}
+
+static Tcl_Size
+IndexMapDelete(
+    IndexMap *mapPtr,		/* Map to renumber. */
+    Tcl_Size first,		/* Index of the first deleted element. */
+    Tcl_Size last)		/* Index of the last deleted element. */
+{
+    IndexNode *leftPtr, *midPtr, *rightPtr;
+    Tcl_Size count;
+
+    if (last < first || mapPtr->root == NULL) {
+	return 0;
+    }
+    IndexMapSplit(mapPtr->root, first, -1, &leftPtr, &rightPtr);
+    IndexMapSplit(rightPtr, last + 1, INDEX_SUM(leftPtr) - 1, &midPtr,
+	    &rightPtr);
+    IndexMapMoveFirst(rightPtr, INDEX_SUM(midPtr) - (last + 1 - first));
+    count = FreeIndexNodes(midPtr);
+    mapPtr->root = IndexMapMerge(leftPtr, rightPtr);
+    return count;
+}
+
 /*
  *----------------------------------------------------------------------
  *
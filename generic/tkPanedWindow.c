@@ -1475,8 +1475,7 @@ DisplayPanedWindow(
      * Create a pixmap for double-buffering, if necessary.
      */
 
-    pixmap = Tk_GetPixmap(Tk_Display(tkwin), Tk_WindowId(tkwin),
-	    Tk_Width(tkwin), Tk_Height(tkwin), Tk_Depth(tkwin));
+    pixmap = TkGetBufferPixmap(tkwin, Tk_Width(tkwin), Tk_Height(tkwin));
 #else
     pixmap = Tk_WindowId(tkwin);
 #endif /* TK_NO_DOUBLE_BUFFERING */
@@ -1536,7 +1535,7 @@ DisplayPanedWindow(
 
     XCopyArea(Tk_Display(tkwin), pixmap, Tk_WindowId(tkwin), pwPtr->gc, 0, 0,
 	    (unsigned) Tk_Width(tkwin), (unsigned) Tk_Height(tkwin), 0, 0);
-    Tk_FreePixmap(Tk_Display(tkwin), pixmap);
+    TkFreeBufferPixmap(tkwin, pixmap);
 #endif /* TK_NO_DOUBLE_BUFFERING */
 }
 
@@ -2854,8 +2853,7 @@ DisplayProxyWindow(
      * Create a pixmap for double-buffering, if necessary.
      */
 
-    pixmap = Tk_GetPixmap(Tk_Display(tkwin), Tk_WindowId(tkwin),
-	    Tk_Width(tkwin), Tk_Height(tkwin), Tk_Depth(tkwin));
+    pixmap = TkGetBufferPixmap(tkwin, Tk_Width(tkwin), Tk_Height(tkwin));
 #else
     pixmap = Tk_WindowId(tkwin);
 #endif /* TK_NO_DOUBLE_BUFFERING */
@@ -2877,7 +2875,7 @@ DisplayProxyWindow(
 
     XCopyArea(Tk_Display(tkwin), pixmap, Tk_WindowId(tkwin), pwPtr->gc, 0, 0,
 	    (unsigned) Tk_Width(tkwin), (unsigned) Tk_Height(tkwin), 0, 0);
-    Tk_FreePixmap(Tk_Display(tkwin), pixmap);
+    TkFreeBufferPixmap(tkwin, pixmap);
 #endif /* TK_NO_DOUBLE_BUFFERING */
 }
 
@@ -0,0 +1,491 @@
+/*
+ * tkPixmapPool.c --
+ *
+ *	This file maintains a per-display pool of offscreen pixmaps for the
+ *	double buffers that widgets draw into during redisplay. Instead of
+ *	creating a pixmap at the start of every redraw and freeing it at the
+ *	end, display procedures borrow one from the pool and give it back
+ *	afterwards, so that a widget that is redrawn many times per second
+ *	doesn't cost a pixmap creation and destruction each time. Pixmaps are
+ *	pooled by screen, depth, colormap and size class; the least recently
+ *	used ones are freed when the pool grows too large, and all of them are
+ *	freed once they have been idle for a while.
+ *
+ * See the file "license.terms" for information on usage and redistribution of
+ * this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ */
+
+#include "tkInt.h"
+
+/*
+ * Limits on the idle part of a pool. Returning a pixmap to a pool that would
+ * exceed either of them frees the least recently used idle pixmaps.
+ */
+
+#define POOL_MAX_IDLE		16
+#define POOL_MAX_BYTES		(32 * 1024 * 1024)
+
+/*
+ * Idle pixmaps that haven't been borrowed during a whole period of this many
+ * milliseconds are freed.
+ */
+
+#define POOL_EXPIRE_MS		5000
+
+/*
+ * One pixmap known to a pool, either idle or lent out to a widget.
+ */
+
+typedef struct PooledPixmap {
+    Pixmap pixmap;		/* The pixmap itself. */
+    int width, height;		/* Its size, a multiple of the size class
+				 * granularity. */
+    int depth;			/* Its depth. */
+    int screenNum;		/* Screen it was created for. */
+    Colormap colormap;		/* Colormap of the window it was created for,
+				 * which Windows associates with pixmaps. */
+    unsigned long epoch;	/* Value of the pool's epoch when the pixmap
+				 * was last returned. */
+    struct PooledPixmap *nextPtr;
+				/* Next pixmap in the same list. */
+} PooledPixmap;
+
+/*
+ * The pool of a display, pointed to by its pixmapPoolPtr field.
+ */
+
+struct TkPixmapPool {
+    TkDisplay *dispPtr;		/* Display the pixmaps belong to. */
+    PooledPixmap *idlePtr;	/* Pixmaps available for borrowing, most
+				 * recently returned first. */
+    PooledPixmap *busyPtr;	/* Pixmaps currently lent out. */
+    Tcl_Size numIdle;		/* Number of pixmaps in idlePtr. */
+    Tcl_Size numBusy;		/* Number of pixmaps in busyPtr. */
+    size_t idleBytes;		/* Estimated server memory of idle
+				 * pixmaps. */
+    unsigned long epoch;	/* Incremented each time the expiry timer
+				 * fires. */
+    Tcl_TimerToken timer;	/* Expiry timer, or NULL if no pixmap is
+				 * idle. */
+    size_t hits;		/* Number of requests served from the
+				 * pool. */
+    size_t misses;		/* Number of requests that created a new
+				 * pixmap. */
+    size_t freed;		/* Number of pooled pixmaps freed by trimming,
+				 * expiry or flushing. */
+};
+
+/*
+ * Prototypes for functions used only in this file:
+ */
+
+static int		SizeClass(int size);
+static size_t		PixmapBytes(PooledPixmap *pooledPtr);
+static void		FreeIdle(TkPixmapPool *poolPtr,
+			    PooledPixmap **prevPtrPtr);
+static void		ExpirePool(void *clientData);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SizeClass --
+ *
+ *	Rounds a pixmap dimension up to its size class. The granularity
+ *	grows with the size, so that windows being resized by a few pixels
+ *	keep using the same pixmaps while the wasted area stays small.
+ *
+ * Results:
+ *	The rounded size.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SizeClass(
+    int size)
+{
+    int step;
+
+    if (size <= 0) {
+	return 1;
+    }
+    step = (size <= 64) ? 16 : (size <= 512) ? 64 : 256;
+    return (size + step - 1) / step * step;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PixmapBytes --
+ *
+ *	Estimates the server memory used by a pooled pixmap.
+ *
+ * Results:
+ *	The estimated number of bytes.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static size_t
+PixmapBytes(
+    PooledPixmap *pooledPtr)
+{
+    size_t bytesPerPixel = (pooledPtr->depth > 16) ? 4
+	    : (pooledPtr->depth > 8) ? 2 : 1;
+
+    return (size_t) pooledPtr->width * pooledPtr->height * bytesPerPixel;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeIdle --
+ *
+ *	Frees the idle pixmap *prevPtrPtr points to and unlinks it from the
+ *	idle list.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The pixmap is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeIdle(
+    TkPixmapPool *poolPtr,
+    PooledPixmap **prevPtrPtr)	/* Link that points to the pixmap. */
+{
+    PooledPixmap *pooledPtr = *prevPtrPtr;
+
+    *prevPtrPtr = pooledPtr->nextPtr;
+    poolPtr->numIdle--;
+    poolPtr->idleBytes -= PixmapBytes(pooledPtr);
+    poolPtr->freed++;
+    Tk_FreePixmap(poolPtr->dispPtr->display, pooledPtr->pixmap);
+    ckfree(pooledPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExpirePool --
+ *
+ *	Timer callback that frees the idle pixmaps which haven't been used
+ *	since the previous time it ran.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Pixmaps may be freed. The timer is rescheduled as long as there are
+ *	idle pixmaps left.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ExpirePool(
+    void *clientData)		/* Pool to expire. */
+{
+    TkPixmapPool *poolPtr = (TkPixmapPool *)clientData;
+    PooledPixmap **prevPtrPtr = &poolPtr->idlePtr;
+
+    while (*prevPtrPtr != NULL) {
+	if ((*prevPtrPtr)->epoch != poolPtr->epoch) {
+	    FreeIdle(poolPtr, prevPtrPtr);
+	} else {
+	    prevPtrPtr = &(*prevPtrPtr)->nextPtr;
+	}
+    }
+    poolPtr->epoch++;
+    poolPtr->timer = (poolPtr->numIdle > 0)
+	    ? Tcl_CreateTimerHandler(POOL_EXPIRE_MS, ExpirePool, poolPtr)
+	    : NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkGetBufferPixmap --
+ *
+ *	Borrows a pixmap of at least the given size, with the depth and on
+ *	the screen of tkwin, for use as a double buffer. The pixmap may be
+ *	larger than requested and its contents are undefined. It must be
+ *	given back with TkFreeBufferPixmap instead of Tk_FreePixmap.
+ *
+ * Results:
+ *	The pixmap, or None if it couldn't be created.
+ *
+ * Side effects:
+ *	A pixmap is taken from the pool of the display of tkwin, or created
+ *	if there is no suitable idle one.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Pixmap
+TkGetBufferPixmap(
+    Tk_Window tkwin,		/* Window the buffer will be copied to. */
+    int width, int height)	/* Minimum size of the buffer. */
+{
+    TkDisplay *dispPtr = ((TkWindow *) tkwin)->dispPtr;
+    TkPixmapPool *poolPtr = dispPtr->pixmapPoolPtr;
+    PooledPixmap *pooledPtr, **prevPtrPtr;
+    int depth = Tk_Depth(tkwin), screenNum = Tk_ScreenNumber(tkwin);
+    Colormap colormap = Tk_Colormap(tkwin);
+
+    width = SizeClass(width);
+    height = SizeClass(height);
+    if (poolPtr == NULL) {
+	poolPtr = (TkPixmapPool *)ckalloc(sizeof(TkPixmapPool));
+	memset(poolPtr, 0, sizeof(TkPixmapPool));
+	poolPtr->dispPtr = dispPtr;
+	dispPtr->pixmapPoolPtr = poolPtr;
+    }
+
+    for (prevPtrPtr = &poolPtr->idlePtr; *prevPtrPtr != NULL;
+	    prevPtrPtr = &(*prevPtrPtr)->nextPtr) {
+	pooledPtr = *prevPtrPtr;
+	if ((pooledPtr->width == width) && (pooledPtr->height == height)
+		&& (pooledPtr->depth == depth)
+		&& (pooledPtr->screenNum == screenNum)
+		&& (pooledPtr->colormap == colormap)) {
+	    *prevPtrPtr = pooledPtr->nextPtr;
+	    poolPtr->numIdle--;
+	    poolPtr->idleBytes -= PixmapBytes(pooledPtr);
+	    poolPtr->hits++;
+	    goto lend;
+	}
+    }
+
+    pooledPtr = (PooledPixmap *)ckalloc(sizeof(PooledPixmap));
+    pooledPtr->pixmap = Tk_GetPixmap(Tk_Display(tkwin), Tk_WindowId(tkwin),
+	    width, height, depth);
+    if (pooledPtr->pixmap == None) {
+	ckfree(pooledPtr);
+	return None;
+    }
+    pooledPtr->width = width;
+    pooledPtr->height = height;
+    pooledPtr->depth = depth;
+    pooledPtr->screenNum = screenNum;
+    pooledPtr->colormap = colormap;
+    poolPtr->misses++;
+
+  lend:
+    pooledPtr->nextPtr = poolPtr->busyPtr;
+    poolPtr->busyPtr = pooledPtr;
+    poolPtr->numBusy++;
+    return pooledPtr->pixmap;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkFreeBufferPixmap --
+ *
+ *	Gives back a pixmap obtained from TkGetBufferPixmap.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The pixmap becomes idle in the pool, and the least recently used idle
+ *	pixmaps are freed if the pool is over its limits. Pixmaps the pool
+ *	doesn't know about are simply freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkFreeBufferPixmap(
+    Tk_Window tkwin,		/* Window the buffer was borrowed for. */
+    Pixmap pixmap)		/* Pixmap to give back. */
+{
+    TkPixmapPool *poolPtr = ((TkWindow *) tkwin)->dispPtr->pixmapPoolPtr;
+    PooledPixmap *pooledPtr, **prevPtrPtr = NULL;
+    Tcl_Size count;
+
+    if (poolPtr != NULL) {
+	for (prevPtrPtr = &poolPtr->busyPtr; *prevPtrPtr != NULL;
+		prevPtrPtr = &(*prevPtrPtr)->nextPtr) {
+	    if ((*prevPtrPtr)->pixmap == pixmap) {
+		break;
+	    }
+	}
+    }
+    if ((poolPtr == NULL) || (*prevPtrPtr == NULL)) {
+	Tk_FreePixmap(Tk_Display(tkwin), pixmap);
+	return;
+    }
+
+    pooledPtr = *prevPtrPtr;
+    *prevPtrPtr = pooledPtr->nextPtr;
+    poolPtr->numBusy--;
+    pooledPtr->epoch = poolPtr->epoch;
+    pooledPtr->nextPtr = poolPtr->idlePtr;
+    poolPtr->idlePtr = pooledPtr;
+    poolPtr->numIdle++;
+    poolPtr->idleBytes += PixmapBytes(pooledPtr);
+
+    /*
+     * Keep the most recently used pixmaps that fit within the limits. The
+     * one just returned is always kept.
+     */
+
+    if ((poolPtr->numIdle > POOL_MAX_IDLE)
+	    || (poolPtr->idleBytes > POOL_MAX_BYTES)) {
+	size_t bytes = 0;
+
+	count = 0;
+	prevPtrPtr = &poolPtr->idlePtr;
+	while (*prevPtrPtr != NULL) {
+	    bytes += PixmapBytes(*prevPtrPtr);
+	    if ((count > 0) && ((count >= POOL_MAX_IDLE)
+		    || (bytes > POOL_MAX_BYTES))) {
+		FreeIdle(poolPtr, prevPtrPtr);
+	    } else {
+		count++;
+		prevPtrPtr = &(*prevPtrPtr)->nextPtr;
+	    }
+	}
+    }
+
+    if (poolPtr->timer == NULL) {
+	poolPtr->timer = Tcl_CreateTimerHandler(POOL_EXPIRE_MS, ExpirePool,
+		poolPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkPixmapPoolFlush --
+ *
+ *	Frees all idle pixmaps of the pool of a display.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Pixmaps are freed. Pixmaps currently lent out are not affected.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkPixmapPoolFlush(
+    TkDisplay *dispPtr)
+{
+    TkPixmapPool *poolPtr = dispPtr->pixmapPoolPtr;
+
+    if (poolPtr == NULL) {
+	return;
+    }
+    while (poolPtr->idlePtr != NULL) {
+	FreeIdle(poolPtr, &poolPtr->idlePtr);
+    }
+    if (poolPtr->timer != NULL) {
+	Tcl_DeleteTimerHandler(poolPtr->timer);
+	poolPtr->timer = NULL;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkPixmapPoolStats --
+ *
+ *	Describes the state of the pool of a display, for the "tk pixmappool"
+ *	command.
+ *
+ * Results:
+ *	A dictionary with the number and estimated size of the idle pixmaps,
+ *	the number of pixmaps lent out, and counts of the requests served
+ *	from the pool, the pixmaps created and the pooled pixmaps freed.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Tcl_Obj *
+TkPixmapPoolStats(
+    TkDisplay *dispPtr)
+{
+    TkPixmapPool *poolPtr = dispPtr->pixmapPoolPtr;
+    TkPixmapPool empty;
+    Tcl_Obj *resultObj = Tcl_NewObj();
+
+    if (poolPtr == NULL) {
+	memset(&empty, 0, sizeof(TkPixmapPool));
+	poolPtr = &empty;
+    }
+
+#define STAT(name, value) \
+    Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj(name, TCL_INDEX_NONE), \
+	    Tcl_NewWideIntObj((Tcl_WideInt) (value)))
+    STAT("idle", poolPtr->numIdle);
+    STAT("idlebytes", poolPtr->idleBytes);
+    STAT("busy", poolPtr->numBusy);
+    STAT("hits", poolPtr->hits);
+    STAT("misses", poolPtr->misses);
+    STAT("freed", poolPtr->freed);
+#undef STAT
+    return resultObj;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkPixmapPoolCleanup --
+ *
+ *	Frees the pool of a display that is being closed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	All pooled pixmaps and the pool itself are freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkPixmapPoolCleanup(
+    TkDisplay *dispPtr)		/* Display to clean up resources in. */
+{
+    TkPixmapPool *poolPtr = dispPtr->pixmapPoolPtr;
+    PooledPixmap *pooledPtr;
+
+    if (poolPtr == NULL) {
+	return;
+    }
+    TkPixmapPoolFlush(dispPtr);
+    while (poolPtr->busyPtr != NULL) {
+	pooledPtr = poolPtr->busyPtr;
+	poolPtr->busyPtr = pooledPtr->nextPtr;
+	Tk_FreePixmap(dispPtr->display, pooledPtr->pixmap);
+	ckfree(pooledPtr);
+    }
+    ckfree(poolPtr);
+    dispPtr->pixmapPoolPtr = NULL;
+}
+
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 4
+ * fill-column: 78
+ * End:
+ */
@@ -1245,7 +1245,11 @@ const TkStubs tkStubs = {
     Tk_UnderlineCharsInContext, /* 291 */
     Tk_DrawCharsInContext, /* 292 */
     Tk_MeasureCharsInContext, /* 293 */
-    TkUnusedStubEntry, /* 294 */
+    Tk_PhotoLockBuffer, /* 294 */
+    Tk_PhotoCommitBuffer, /* 295 */
+    Tk_CanvasSetCoords, /* 296 */
+    Tk_CanvasGetCoords, /* 297 */
+    TkUnusedStubEntry, /* 298 */
 };
 
 /* !END!: Do not edit above this line. */
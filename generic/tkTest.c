@@ -180,6 +180,10 @@ static Tcl_ObjCmdProc TrivialConfigObjCmd;
 static void		TrivialEventProc(void *clientData,
 			    XEvent *eventPtr);
 static Tcl_ObjCmdProc TestPhotoStringMatchCmd;
+static Tcl_ObjCmdProc TestPhotoPutBlockCmd;
+static Tcl_ObjCmdProc TestxrequestsObjCmd;
+static Tcl_ObjCmdProc TestlistboxvarObjCmd;
+static Tcl_ObjCmdProc TestpngsimdObjCmd;
 
 /*
  *----------------------------------------------------------------------
@@ -246,6 +250,14 @@ Tktest_Init(
     Tcl_CreateObjCommand(interp, "testphotostringmatch",
 	    TestPhotoStringMatchCmd, Tk_MainWindow(interp),
 	    NULL);
+    Tcl_CreateObjCommand(interp, "testphotoputblock",
+	    TestPhotoPutBlockCmd, Tk_MainWindow(interp), NULL);
+    Tcl_CreateObjCommand(interp, "testxrequests", TestxrequestsObjCmd,
+	    Tk_MainWindow(interp), NULL);
+    Tcl_CreateObjCommand(interp, "testlistboxvar", TestlistboxvarObjCmd,
+	    Tk_MainWindow(interp), NULL);
+    Tcl_CreateObjCommand(interp, "testpngsimd", TestpngsimdObjCmd,
+	    NULL, NULL);
 
 #if defined(_WIN32)
     Tcl_CreateObjCommand(interp, "testmetrics", TestmetricsObjCmd,
@@ -2139,6 +2151,284 @@ TestPhotoStringMatchCmd(
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TestPhotoPutBlockCmd --
+ *
+ *	This function implements the "testphotoputblock" command, which
+ *	measures the speed of Tk_PhotoPutBlock. It is invoked as
+ *
+ *	    testphotoputblock imageName layout width height ?iterations?
+ *
+ *	where layout is one of rgb, rgbx, rgba, bgra or argb. A block of the
+ *	given size and layout, filled with a gradient whose alpha is 255 except
+ *	in the first row, is put into the photo image the given number of
+ *	times (default 1) with the SET compositing rule. With the layout
+ *	buffer, the gradient is written in place once using
+ *	Tk_PhotoLockBuffer, and each iteration locks and commits it again.
+ *
+ * Results:
+ *	A standard Tcl result. The result is the rate achieved in millions of
+ *	pixels per second.
+ *
+ * Side effects:
+ *	The photo image is modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TestPhotoPutBlockCmd(
+    TCL_UNUSED(void *),	/* Main window for application. */
+    Tcl_Interp *interp,		/* Current interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *const objv[])	/* Argument objects. */
+{
+    static const char *const layouts[] = {
+	"rgb", "rgbx", "rgba", "bgra", "argb", "buffer", NULL
+    };
+    static const int layoutOffsets[][5] = {
+	/* pixelSize, red, green, blue, alpha */
+	{3, 0, 1, 2, 3},
+	{4, 0, 1, 2, 4},
+	{4, 0, 1, 2, 3},
+	{4, 2, 1, 0, 3},
+	{4, 1, 2, 3, 0},
+	{4, 0, 1, 2, 3}
+    };
+    Tk_PhotoHandle photo;
+    Tk_PhotoImageBlock block;
+    Tcl_Time start, stop;
+    int index, width, height, iterations = 1, i, x, y, result = TCL_OK;
+    double elapsed;
+    unsigned char *p;
+
+    if ((objc != 5) && (objc != 6)) {
+	Tcl_WrongNumArgs(interp, 1, objv,
+		"imageName layout width height ?iterations?");
+	return TCL_ERROR;
+    }
+    photo = Tk_FindPhoto(interp, Tcl_GetString(objv[1]));
+    if (photo == NULL) {
+	Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+		"image \"%s\" doesn't exist or is not a photo image",
+		Tcl_GetString(objv[1])));
+	return TCL_ERROR;
+    }
+    if ((Tcl_GetIndexFromObj(interp, objv[2], layouts, "layout", 0,
+	    &index) != TCL_OK)
+	    || (Tcl_GetIntFromObj(interp, objv[3], &width) != TCL_OK)
+	    || (Tcl_GetIntFromObj(interp, objv[4], &height) != TCL_OK)
+	    || ((objc == 6) && (Tcl_GetIntFromObj(interp, objv[5],
+		    &iterations) != TCL_OK))) {
+	return TCL_ERROR;
+    }
+    if ((width <= 0) || (height <= 0) || (iterations <= 0)) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		"width, height and iterations must be positive", -1));
+	return TCL_ERROR;
+    }
+
+    if (index == 5) {
+	if (Tk_PhotoLockBuffer(interp, photo, width, height,
+		&block) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+    } else {
+	block.pixelSize = layoutOffsets[index][0];
+	block.offset[0] = layoutOffsets[index][1];
+	block.offset[1] = layoutOffsets[index][2];
+	block.offset[2] = layoutOffsets[index][3];
+	block.offset[3] = layoutOffsets[index][4];
+	block.width = width;
+	block.height = height;
+	block.pitch = width * block.pixelSize;
+	block.pixelPtr = (unsigned char *)ckalloc((size_t) block.pitch * height);
+    }
+    for (y = 0; y < height; y++) {
+	for (x = 0; x < width; x++) {
+	    p = block.pixelPtr + y * block.pitch + x * block.pixelSize;
+	    p[block.offset[0]] = (unsigned char) x;
+	    p[block.offset[1]] = (unsigned char) y;
+	    p[block.offset[2]] = (unsigned char) (x + y);
+	    if (block.pixelSize == 4) {
+		p[(block.offset[3] < 4) ? block.offset[3] : 3] =
+			(y == 0) ? (unsigned char) (x * 16) : 255;
+	    }
+	}
+    }
+
+    Tcl_GetTime(&start);
+    for (i = 0; i < iterations; i++) {
+	if (index == 5) {
+	    result = Tk_PhotoLockBuffer(interp, photo, width, height, &block);
+	    if (result == TCL_OK) {
+		Tk_PhotoCommitBuffer(photo, 0, 0, width, height, 0);
+	    }
+	} else {
+	    result = Tk_PhotoPutBlock(interp, photo, &block, 0, 0, width,
+		    height, TK_PHOTO_COMPOSITE_SET);
+	}
+	if (result != TCL_OK) {
+	    break;
+	}
+    }
+    Tcl_GetTime(&stop);
+    if (index != 5) {
+	ckfree(block.pixelPtr);
+    }
+    if (result != TCL_OK) {
+	return result;
+    }
+
+    elapsed = (stop.sec - start.sec) * 1e6 + (stop.usec - start.usec);
+    if (elapsed < 1) {
+	elapsed = 1;
+    }
+    Tcl_SetObjResult(interp, Tcl_NewDoubleObj(
+	    (double) width * height * iterations / elapsed));
+    return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TestxrequestsObjCmd --
+ *
+ *	This function implements the "testxrequests" command. It evaluates
+ *	a script and returns the number of requests that were sent to the
+ *	display of the main window meanwhile, so that tests can check that
+ *	drawing does not issue more requests than expected.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Whatever the script does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TestxrequestsObjCmd(
+    void *clientData,		/* Main window for application. */
+    Tcl_Interp *interp,		/* Current interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *const objv[])	/* Argument objects. */
+{
+    Display *display = Tk_Display((Tk_Window)clientData);
+    unsigned long before;
+    int result;
+
+    if (objc != 2) {
+	Tcl_WrongNumArgs(interp, 1, objv, "script");
+	return TCL_ERROR;
+    }
+    before = NextRequest(display);
+    result = Tcl_EvalObjEx(interp, objv[1], 0);
+    if (result != TCL_OK) {
+	return result;
+    }
+    Tcl_SetObjResult(interp,
+	    Tcl_NewWideIntObj((Tcl_WideInt)(NextRequest(display) - before)));
+    return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TestlistboxvarObjCmd --
+ *
+ *	This function implements the "testlistboxvar" command. It returns
+ *	how many writes to the -listvariable of a listbox were handled by
+ *	measuring only the changed elements ("partial") and how many
+ *	required measuring all of them ("full").
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TestlistboxvarObjCmd(
+    void *clientData,		/* Main window for application. */
+    Tcl_Interp *interp,		/* Current interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *const objv[])	/* Argument objects. */
+{
+    Tk_Window tkwin;
+    Tcl_Size partial, full;
+    Tcl_Obj *resultObj;
+
+    if (objc != 2) {
+	Tcl_WrongNumArgs(interp, 1, objv, "pathName");
+	return TCL_ERROR;
+    }
+    tkwin = Tk_NameToWindow(interp, Tcl_GetString(objv[1]),
+	    (Tk_Window)clientData);
+    if (tkwin == NULL) {
+	return TCL_ERROR;
+    }
+    if (!TkListboxGetVarUpdates(tkwin, &partial, &full)) {
+	Tcl_SetObjResult(interp, Tcl_ObjPrintf("\"%s\" is not a listbox",
+		Tcl_GetString(objv[1])));
+	return TCL_ERROR;
+    }
+    resultObj = Tcl_NewObj();
+    Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj("partial", -1));
+    Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewWideIntObj(partial));
+    Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj("full", -1));
+    Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewWideIntObj(full));
+    Tcl_SetObjResult(interp, resultObj);
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TestpngsimdObjCmd --
+ *
+ *	This function implements the "testpngsimd" command. With a boolean
+ *	argument it turns the SIMD unfilters of the PNG reader on or off. It
+ *	returns whether they are in use, which is always 0 if they were not
+ *	compiled in.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Changes how PNG images are decoded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TestpngsimdObjCmd(
+    TCL_UNUSED(void *),
+    Tcl_Interp *interp,		/* Current interpreter. */
+    int objc,			/* Number of arguments. */
+    Tcl_Obj *const objv[])	/* Argument objects. */
+{
+    int use = -1;
+
+    if (objc > 2) {
+	Tcl_WrongNumArgs(interp, 1, objv, "?boolean?");
+	return TCL_ERROR;
+    }
+    if ((objc == 2)
+	    && (Tcl_GetBooleanFromObj(interp, objv[1], &use) != TCL_OK)) {
+	return TCL_ERROR;
+    }
+    Tcl_SetObjResult(interp, Tcl_NewBooleanObj(TkPNGUseSIMD(use)));
+    return TCL_OK;
+}
 
 
 /*
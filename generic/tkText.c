@@ -179,6 +179,12 @@ static const Tk_OptionSpec optionSpecs[] = {
     {TK_OPTION_INT, "-maxundo", "maxUndo", "MaxUndo",
 	DEF_TEXT_MAX_UNDO, TCL_INDEX_NONE, offsetof(TkText, maxUndo),
 	TK_OPTION_DONT_SET_DEFAULT, 0, 0},
+    {TK_OPTION_INT, "-maxundobytes", "maxUndoBytes", "MaxUndoBytes",
+	DEF_TEXT_MAX_UNDO_BYTES, TCL_INDEX_NONE, offsetof(TkText, maxUndoBytes),
+	TK_OPTION_DONT_SET_DEFAULT, 0, 0},
+    {TK_OPTION_BOOLEAN, "-metricsthread", "metricsThread", "MetricsThread",
+	DEF_TEXT_METRICS_THREAD, TCL_INDEX_NONE, offsetof(TkText, metricsThread),
+	0, 0, 0},
     {TK_OPTION_PIXELS, "-padx", "padX", "Pad",
 	DEF_TEXT_PADX, offsetof(TkText, padXObj), TCL_INDEX_NONE, 0, 0,
 	TK_TEXT_LINE_GEOMETRY},
@@ -292,6 +298,15 @@ typedef struct SearchSpec {
     Tcl_Obj *countPtr;		/* Keeps track of currently found lengths. */
     Tcl_Obj *resPtr;		/* Keeps track of currently found locations */
     int searchElide;		/* Search in hidden text as well. */
+    int countOnly;		/* If set, matches are only counted, in
+				 * numMatches, instead of being stored in
+				 * countPtr and resPtr. */
+    Tcl_Size numMatches;	/* Number of matches found so far. */
+    void *lineHint;		/* Token returned by the most recent call of
+				 * 'addLineProc' for its first line... */
+    int lineHintNum;		/* ...and the number of that line. Lets the
+				 * next or previous line be found without a
+				 * search from the top. */
     SearchAddLineProc *addLineProc;
 				/* Function to call when we need to add
 				 * another line to the search string so far */
@@ -305,6 +320,66 @@ typedef struct SearchSpec {
 				 * in this case a text widget. */
 } SearchSpec;
 
+/*
+ * Forward exact searches for all matches don't need the line-based code
+ * above; TextSearchScan walks the character segments of the B-tree instead,
+ * using the two structures below.
+ */
+
+typedef struct TextScanPos {
+    TkTextLine *linePtr;	/* Line containing the position. */
+    int lineNum;		/* Number of that line. */
+    TkTextSegment *segPtr;	/* Segment containing the position, or NULL
+				 * past the last one of the line. */
+    Tcl_Size segByte;		/* Byte index of segPtr within the line. */
+    Tcl_Size offset;		/* Byte offset within segPtr. */
+} TextScanPos;
+
+typedef struct TextScan {
+    SearchSpec *searchSpecPtr;	/* Search parameters; receives the matches. */
+    const char *pattern;	/* Pattern, in lower case if noCase. */
+    Tcl_Size patLength;		/* Length of the pattern in bytes. */
+    int numLines;		/* Number of lines that may be scanned. */
+    int noCase;			/* Whether to compare in lower case. */
+    char candidate[256];	/* For noCase: the bytes that may start a
+				 * match. */
+} TextScan;
+
+/*
+ * Undo records for the insertion and deletion of text. Each edit is stored
+ * as a single TextUndoRecord shared by its 'apply' and 'revert' sub-atoms:
+ * the two positions as line and character numbers, and the text itself,
+ * which is kept in a chunked arena owned by the shared text. The Tcl
+ * commands that carry out the edit, move the insertion cursor and set the
+ * undo marks are only built when the record is actually undone or redone.
+ */
+
+#define UNDO_CHUNK_SIZE 4096
+
+typedef struct TkTextUndoChunk {
+    TkSharedText *sharedTextPtr;/* Shared text whose arena this chunk is
+				 * part of. */
+    Tcl_Size refCount;		/* Number of records whose text is in this
+				 * chunk, plus one while it is the current
+				 * chunk of the arena. */
+    Tcl_Size size;		/* Number of bytes available in 'bytes'. */
+    Tcl_Size used;		/* Number of bytes handed out so far. */
+    char bytes[TKFLEXARRAY];	/* The text of the records. */
+} TextUndoChunk;
+
+typedef struct TextUndoRecord {
+    TkSharedText *sharedTextPtr;/* Text the edit was made to. */
+    Tcl_Obj *pathObj;		/* Path name of the widget the edit was made
+				 * through. */
+    TextUndoChunk *chunkPtr;	/* Arena chunk holding the text. */
+    Tcl_Size offset;		/* Position of the text in the chunk. */
+    Tcl_Size length;		/* Number of bytes of text. */
+    Tcl_Size markId;		/* Number of the tk::undoMarkL/R marks. */
+    int line1, line2;		/* Lines of the start and end of the text,
+				 * counting from 0. */
+    Tcl_Size char1, char2;	/* Character positions in these lines. */
+} TextUndoRecord;
+
 /*
  * The text-widget-independent functions which actually perform the search,
  * handling both regexp and exact searches.
@@ -312,6 +387,10 @@ typedef struct SearchSpec {
 
 static int		SearchCore(Tcl_Interp *interp,
 			    SearchSpec *searchSpecPtr, Tcl_Obj *patObj);
+static const char *	SearchExactBackwards(const char *string,
+			    Tcl_Size length, Tcl_Size firstOffset,
+			    Tcl_Size fromOffset, const char *pattern,
+			    Tcl_Size patLength, const Tcl_Size *skip);
 static int		SearchPerform(Tcl_Interp *interp,
 			    SearchSpec *searchSpecPtr, Tcl_Obj *patObj,
 			    Tcl_Obj *fromPtr, Tcl_Obj *toPtr);
@@ -355,6 +434,8 @@ static int		TextInsertCmd(TkSharedText *sharedTextPtr,
 			    TkText *textPtr, Tcl_Interp *interp,
 			    Tcl_Size objc, Tcl_Obj *const objv[],
 			    const TkTextIndex *indexPtr, int viewUpdate);
+static int		TextLoadCmd(TkText *textPtr, Tcl_Interp *interp,
+			    Tcl_Size objc, Tcl_Obj *const objv[]);
 static int		TextReplaceCmd(TkText *textPtr, Tcl_Interp *interp,
 			    const TkTextIndex *indexFromPtr,
 			    const TkTextIndex *indexToPtr,
@@ -376,20 +457,50 @@ static int		DumpSegment(TkText *textPtr, Tcl_Interp *interp,
 			    const char *key, const char *value,
 			    Tcl_Obj *command, const TkTextIndex *index,
 			    int what);
+static int		DumpFlush(Tcl_Interp *interp, Tcl_Channel chan,
+			    int force);
 static int		TextEditUndo(TkText *textPtr);
 static int		TextEditRedo(TkText *textPtr);
 static Tcl_Obj *	TextGetText(const TkText *textPtr,
 			    const TkTextIndex *index1,
 			    const TkTextIndex *index2, int visibleOnly);
+static Tcl_Channel	TextGetWritableChannel(Tcl_Interp *interp,
+			    Tcl_Obj *nameObj);
+static int		TextWriteText(Tcl_Interp *interp,
+			    const TkText *textPtr,
+			    const TkTextIndex *index1,
+			    const TkTextIndex *index2, int visibleOnly,
+			    Tcl_Channel chan);
 static void		GenerateModifiedEvent(TkText *textPtr);
 static void		GenerateUndoStackEvent(TkText *textPtr);
 static void		UpdateDirtyFlag(TkSharedText *sharedPtr);
-static void		TextPushUndoAction(TkText *textPtr,
-			    Tcl_Obj *undoString, int insert,
+static int		TextPushUndoAction(TkText *textPtr,
+			    const char *string, Tcl_Size length, int insert,
 			    const TkTextIndex *index1Ptr,
 			    const TkTextIndex *index2Ptr);
+static void		TextUndoReleaseChunk(TextUndoChunk *chunkPtr);
+static TkUndoFreeProc	TextUndoFreeRecord;
+static TkUndoProc	TextUndoInsertProc;
+static TkUndoProc	TextUndoDeleteProc;
+static int		TextUndoReplay(Tcl_Interp *interp,
+			    TextUndoRecord *recordPtr, int insert);
 static Tcl_Size		TextSearchIndexInLine(const SearchSpec *searchSpecPtr,
 			    TkTextLine *linePtr, Tcl_Size byteIndex);
+static int		TextCanElide(const TkText *textPtr);
+static int		TextScanMatch(const TkText *textPtr,
+			    const TextScan *scanPtr, TextScanPos *posPtr,
+			    Tcl_Size *numCharsPtr);
+static void		TextScanRange(TkText *textPtr,
+			    const TextScan *scanPtr,
+			    const TextScanPos *posPtr, int limitLine,
+			    Tcl_Size limitByte, int strict);
+static int		TextScanSettle(const TkText *textPtr, int numLines,
+			    TextScanPos *posPtr, Tcl_Size *skippedPtr);
+static int		TextSearchCanScan(const SearchSpec *searchSpecPtr,
+			    Tcl_Obj *patObj);
+static int		TextSearchScan(Tcl_Interp *interp, TkText *textPtr,
+			    SearchSpec *searchSpecPtr, Tcl_Obj *patObj,
+			    Tcl_Obj *fromPtr, Tcl_Obj *toPtr);
 static int		TextPeerCmd(TkText *textPtr, Tcl_Interp *interp,
 			    Tcl_Size objc, Tcl_Obj *const objv[]);
 static TkUndoProc	TextUndoRedoCallback;
@@ -592,6 +703,7 @@ CreateWidget(
     textPtr->pickEvent.type = LeaveNotify;
     textPtr->undo = textPtr->sharedTextPtr->undo;
     textPtr->maxUndo = textPtr->sharedTextPtr->maxUndo;
+    textPtr->maxUndoBytes = textPtr->sharedTextPtr->maxUndoBytes;
     textPtr->autoSeparators = textPtr->sharedTextPtr->autoSeparators;
     textPtr->tabOptionObj = NULL;
 
@@ -681,14 +793,14 @@ TextWidgetObjCmd(
     static const char *const optionStrings[] = {
 	"bbox", "cget", "compare", "configure", "count", "debug", "delete",
 	"dlineinfo", "dump", "edit", "get", "image", "index", "insert",
-	"mark", "peer", "pendingsync", "replace", "scan", "search",
+	"load", "mark", "peer", "pendingsync", "replace", "scan", "search",
 	"see", "sync", "tag", "window", "xview", "yview", NULL
     };
     enum options {
 	TEXT_BBOX, TEXT_CGET, TEXT_COMPARE, TEXT_CONFIGURE, TEXT_COUNT,
 	TEXT_DEBUG, TEXT_DELETE, TEXT_DLINEINFO, TEXT_DUMP, TEXT_EDIT,
-	TEXT_GET, TEXT_IMAGE, TEXT_INDEX, TEXT_INSERT, TEXT_MARK,
-	TEXT_PEER, TEXT_PENDINGSYNC, TEXT_REPLACE, TEXT_SCAN,
+	TEXT_GET, TEXT_IMAGE, TEXT_INDEX, TEXT_INSERT, TEXT_LOAD,
+	TEXT_MARK, TEXT_PEER, TEXT_PENDINGSYNC, TEXT_REPLACE, TEXT_SCAN,
 	TEXT_SEARCH, TEXT_SEE, TEXT_SYNC, TEXT_TAG, TEXT_WINDOW,
 	TEXT_XVIEW, TEXT_YVIEW
     };
@@ -1233,35 +1345,46 @@ TextWidgetObjCmd(
 	break;
     case TEXT_GET: {
 	Tcl_Obj *objPtr = NULL;
+	Tcl_Channel chan = NULL;
 	Tcl_Size i;
 	int found = 0, visible = 0;
 	const char *name;
 	Tcl_Size length;
 
 	if (objc < 3) {
-	    Tcl_WrongNumArgs(interp, 2, objv,
-		    "?-displaychars? ?--? index1 ?index2 ...?");
+	    Tcl_WrongNumArgs(interp, 2, objv, "?-displaychars? "
+		    "?-channel channelId? ?--? index1 ?index2 ...?");
 	    result = TCL_ERROR;
 	    goto done;
 	}
 
 	/*
-	 * Simple, restrictive argument parsing. The only options are -- and
-	 * -displaychars (or any unique prefix).
+	 * Simple, restrictive argument parsing. The only options are --,
+	 * -displaychars and -channel (or any unique prefix).
 	 */
 
 	i = 2;
-	if (objc > 3) {
+	while (i < objc-1) {
 	    name = Tcl_GetStringFromObj(objv[i], &length);
-	    if (length > 1 && name[0] == '-') {
-		if (strncmp("-displaychars", name, length) == 0) {
-		    i++;
-		    visible = 1;
-		    name = Tcl_GetStringFromObj(objv[i], &length);
+	    if (length < 2 || name[0] != '-') {
+		break;
+	    }
+	    if (strncmp("-displaychars", name, length) == 0) {
+		i++;
+		visible = 1;
+	    } else if (strncmp("-channel", name, length) == 0
+		    && i < objc-2) {
+		chan = TextGetWritableChannel(interp, objv[i+1]);
+		if (chan == NULL) {
+		    result = TCL_ERROR;
+		    goto done;
 		}
-		if ((i < objc-1) && (length == 2) && !strcmp("--", name)) {
+		i += 2;
+	    } else {
+		if ((length == 2) && !strcmp("--", name)) {
 		    i++;
 		}
+		break;
 	    }
 	}
 
@@ -1293,7 +1416,13 @@ TextWidgetObjCmd(
 		}
 	    }
 
-	    if (TkTextIndexCmp(index1Ptr, index2Ptr) < 0) {
+	    if (chan != NULL) {
+		if (TextWriteText(interp, textPtr, index1Ptr, index2Ptr,
+			visible, chan) != TCL_OK) {
+		    result = TCL_ERROR;
+		    goto done;
+		}
+	    } else if (TkTextIndexCmp(index1Ptr, index2Ptr) < 0) {
 		/*
 		 * We want to move the text we get from the window into the
 		 * result, but since this could in principle be a megabyte or
@@ -1366,6 +1495,9 @@ TextWidgetObjCmd(
 	}
 	break;
     }
+    case TEXT_LOAD:
+	result = TextLoadCmd(textPtr, interp, objc, objv);
+	break;
     case TEXT_MARK:
 	result = TkTextMarkCmd(textPtr, interp, objc, objv);
 	break;
@@ -2004,6 +2136,9 @@ DestroyText(
 	}
 	Tcl_DeleteHashTable(&sharedTextPtr->markTable);
 	TkUndoFreeStack(sharedTextPtr->undoStack);
+	if (sharedTextPtr->undoChunkPtr != NULL) {
+	    TextUndoReleaseChunk(sharedTextPtr->undoChunkPtr);
+	}
 
 	Tcl_DeleteHashTable(&sharedTextPtr->windowTable);
 	Tcl_DeleteHashTable(&sharedTextPtr->imageTable);
@@ -2023,6 +2158,9 @@ DestroyText(
 
     textPtr->tkwin = NULL;
     Tcl_DeleteCommandFromToken(textPtr->interp, textPtr->widgetCmd);
+    if (textPtr->undoPathObj != NULL) {
+	Tcl_DecrRefCount(textPtr->undoPathObj);
+    }
     if (textPtr->afterSyncCmd){
 	Tcl_DecrRefCount(textPtr->afterSyncCmd);
 	textPtr->afterSyncCmd = NULL;
@@ -2076,10 +2214,13 @@ ConfigureText(
 
     textPtr->sharedTextPtr->undo = textPtr->undo;
     textPtr->sharedTextPtr->maxUndo = textPtr->maxUndo;
+    textPtr->sharedTextPtr->maxUndoBytes = textPtr->maxUndoBytes;
     textPtr->sharedTextPtr->autoSeparators = textPtr->autoSeparators;
 
     TkUndoSetMaxDepth(textPtr->sharedTextPtr->undoStack,
 	    textPtr->sharedTextPtr->maxUndo);
+    TkUndoSetMaxBytes(textPtr->sharedTextPtr->undoStack,
+	    textPtr->sharedTextPtr->maxUndoBytes);
 
     /*
      * A few other options also need special processing, such as parsing the
@@ -2755,6 +2896,8 @@ InsertChars(
      */
 
     if (length > 0) {
+	int merged = 0;
+
 	if (sharedTextPtr->undo) {
 	    TkTextIndex toIndex;
 
@@ -2766,10 +2909,13 @@ InsertChars(
 	    sharedTextPtr->lastEditMode = TK_TEXT_EDIT_INSERT;
 
 	    TkTextIndexForwBytes(textPtr, indexPtr, length, &toIndex);
-	    TextPushUndoAction(textPtr, stringPtr, 1, indexPtr, &toIndex);
+	    merged = TextPushUndoAction(textPtr, string, length, 1, indexPtr,
+		    &toIndex);
 	}
 
-	UpdateDirtyFlag(sharedTextPtr);
+	if (!merged) {
+	    UpdateDirtyFlag(sharedTextPtr);
+	}
     }
 
     resetViewCount = 0;
@@ -2813,171 +2959,280 @@ InsertChars(
 /*
  *----------------------------------------------------------------------
  *
- * TextPushUndoAction --
+ * TextUndoAlloc --
+ *
+ *	Reserve room for length bytes of undo text in the arena of the shared
+ *	text. Small strings are packed into the current chunk. Strings that
+ *	may grow to more than a quarter of a chunk get a chunk of their own,
+ *	with room for reserve bytes so that a record being added to can grow
+ *	in place for a while.
+ *
+ * Results:
+ *	The chunk that the room was taken from, which has a reference added
+ *	for the caller. The position in the chunk is stored in *offsetPtr.
+ *
+ * Side effects:
+ *	May allocate a new chunk.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TextUndoChunk *
+TextUndoAlloc(
+    TkSharedText *sharedTextPtr,/* Shared text owning the arena. */
+    Tcl_Size length,		/* Number of bytes needed. */
+    Tcl_Size reserve,		/* Number of bytes the string may grow to,
+				 * at least length. */
+    Tcl_Size *offsetPtr)	/* Where to store the position of the room in
+				 * the chunk. */
+{
+    TextUndoChunk *chunkPtr = sharedTextPtr->undoChunkPtr;
+    int dedicated = (reserve > UNDO_CHUNK_SIZE / 4);
+
+    if (dedicated || chunkPtr == NULL
+	    || chunkPtr->size - chunkPtr->used < length) {
+	Tcl_Size size = UNDO_CHUNK_SIZE;
+
+	if (dedicated) {
+	    size = reserve;
+	}
+	chunkPtr = (TextUndoChunk *)ckalloc(
+		offsetof(TextUndoChunk, bytes) + size);
+	chunkPtr->sharedTextPtr = sharedTextPtr;
+	chunkPtr->refCount = 0;
+	chunkPtr->size = size;
+	chunkPtr->used = 0;
+	sharedTextPtr->undoArenaBytes += size;
+	if (!dedicated) {
+	    if (sharedTextPtr->undoChunkPtr != NULL) {
+		TextUndoReleaseChunk(sharedTextPtr->undoChunkPtr);
+	    }
+	    sharedTextPtr->undoChunkPtr = chunkPtr;
+	    chunkPtr->refCount++;
+	}
+    }
+    *offsetPtr = chunkPtr->used;
+    chunkPtr->used += length;
+    chunkPtr->refCount++;
+    return chunkPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextUndoReleaseChunk --
  *
- *	Shared by insert and delete actions. Stores the appropriate scripts
- *	into our undo stack. We will add a single refCount to the 'undoString'
- *	object, so, if it previously had a refCount of zero, the caller should
- *	not free it.
+ *	Drop a reference to a chunk of the undo arena.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	Items pushed onto stack.
+ *	The chunk is freed when its last reference goes away.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TextUndoReleaseChunk(
+    TextUndoChunk *chunkPtr)
+{
+    if (chunkPtr->refCount-- <= 1) {
+	chunkPtr->sharedTextPtr->undoArenaBytes -= chunkPtr->size;
+	ckfree(chunkPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextUndoFreeRecord --
+ *
+ *	Called by the undo code when the atom holding an undo record is
+ *	discarded.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The record is freed and its text released from the arena.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TextUndoFreeRecord(
+    void *clientData)		/* The TextUndoRecord. */
+{
+    TextUndoRecord *recordPtr = (TextUndoRecord *)clientData;
+
+    TextUndoReleaseChunk(recordPtr->chunkPtr);
+    Tcl_DecrRefCount(recordPtr->pathObj);
+    ckfree(recordPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextUndoPosition --
+ *
+ *	Convert an index into the line and character numbers stored in undo
+ *	records. These are relative to the whole text, not to any -startline
+ *	of the widget.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Stores the numbers in *linePtr and *charPtr.
  *
  *----------------------------------------------------------------------
  */
 
 static void
+TextUndoPosition(
+    const TkTextIndex *indexPtr,
+    int *linePtr,
+    Tcl_Size *charPtr)
+{
+    TkTextIndex lineStart = *indexPtr;
+
+    lineStart.byteIndex = 0;
+    lineStart.textPtr = NULL;
+    *linePtr = TkBTreeLinesTo(NULL, indexPtr->linePtr);
+    *charPtr = TkTextIndexCount(NULL, &lineStart, indexPtr, COUNT_INDICES);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextPushUndoAction --
+ *
+ *	Shared by insert and delete actions. Stores an undo record for the
+ *	edit on our undo stack, or, when a single line of text is inserted
+ *	right where the previous insertion in the same compound action ended,
+ *	appends the text to the record of that insertion so that typing a
+ *	word costs one record instead of one per character.
+ *
+ * Results:
+ *	1 if the edit was merged into the previous record, which already
+ *	accounts for it in the modified state of the widget, 0 otherwise.
+ *
+ * Side effects:
+ *	Items pushed onto stack.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
 TextPushUndoAction(
     TkText *textPtr,		/* Overall information about text widget. */
-    Tcl_Obj *undoString,	/* New text. */
+    const char *string,		/* Text inserted or deleted. */
+    Tcl_Size length,		/* Number of bytes in string. */
     int insert,			/* 1 if insert, else delete. */
     const TkTextIndex *index1Ptr,
 				/* Index describing first location. */
     const TkTextIndex *index2Ptr)
 				/* Index describing second location. */
 {
+    TkSharedText *sharedTextPtr = textPtr->sharedTextPtr;
+    TextUndoRecord *recordPtr;
     TkUndoSubAtom *iAtom, *dAtom;
-    int canUndo, canRedo;
-    char lMarkName[16 + TCL_INTEGER_SPACE] = "tk::undoMarkL";
-    char rMarkName[16 + TCL_INTEGER_SPACE] = "tk::undoMarkR";
-    char stringUndoMarkId[TCL_INTEGER_SPACE] = "";
+    int canUndo, canRedo, line1;
+    Tcl_Size char1;
 
     /*
-     * Create the helpers.
+     * Note: we don't wish to use textPtr->widgetCmd in the records because
+     * if we delete the textPtr, but peers still exist, we will then have
+     * references to a non-existent Tcl_Command in the undo stack, which will
+     * lead to crashes later. Also, the behaviour of the widget w.r.t.
+     * bindings (%W substitutions) always uses the widget path name, so there
+     * is no good reason the undo stack should do otherwise.
      */
 
-    Tcl_Obj *seeInsertObj = Tcl_NewObj();
-    Tcl_Obj *markSet1InsertObj = Tcl_NewObj();
-    Tcl_Obj *markSet2InsertObj = NULL;
-    Tcl_Obj *insertCmdObj = Tcl_NewObj();
-    Tcl_Obj *deleteCmdObj = Tcl_NewObj();
-    Tcl_Obj *markSetLUndoMarkCmdObj = Tcl_NewObj();
-    Tcl_Obj *markSetRUndoMarkCmdObj = NULL;
-    Tcl_Obj *markGravityLUndoMarkCmdObj = Tcl_NewObj();
-    Tcl_Obj *markGravityRUndoMarkCmdObj = NULL;
+    if (textPtr->undoPathObj == NULL) {
+	textPtr->undoPathObj = Tcl_NewStringObj(Tk_PathName(textPtr->tkwin),
+		TCL_INDEX_NONE);
+	Tcl_IncrRefCount(textPtr->undoPathObj);
+    }
+    TextUndoPosition(index1Ptr, &line1, &char1);
 
     /*
-     * Get the index positions.
+     * Typed text is merged into the previous insertion if nothing separates
+     * the two. The merged record must not reach back past a point where the
+     * widget was marked unmodified, so only do it while the modified state
+     * counts edits normally and is non-zero.
      */
 
-    Tcl_Obj *index1Obj = TkTextNewIndexObj(NULL, index1Ptr);
-    Tcl_Obj *index2Obj = TkTextNewIndexObj(NULL, index2Ptr);
+    recordPtr = (TextUndoRecord *)TkUndoGetTopRecord(sharedTextPtr->undoStack,
+	    TextUndoInsertProc);
+    if (insert && recordPtr != NULL
+	    && recordPtr->pathObj == textPtr->undoPathObj
+	    && recordPtr->line2 == line1 && recordPtr->char2 == char1
+	    && sharedTextPtr->dirtyMode == TK_TEXT_DIRTY_NORMAL
+	    && sharedTextPtr->isDirty > 0
+	    && memchr(string, '\n', length) == NULL) {
+	TextUndoChunk *chunkPtr = recordPtr->chunkPtr;
 
-    /*
-     * These need refCounts, because they are used more than once below.
-     */
-
-    Tcl_IncrRefCount(seeInsertObj);
-    Tcl_IncrRefCount(index1Obj);
-    Tcl_IncrRefCount(index2Obj);
+	/*
+	 * Nothing is ever placed after the last string of a chunk except by
+	 * TextUndoAlloc in the current chunk, so the record can grow in place
+	 * whenever it is last and there is room. Otherwise it moves, to a
+	 * chunk of its own with twice the room once it is large, so that a
+	 * long run of typing is copied a logarithmic number of times.
+	 */
 
-    Tcl_ListObjAppendElement(NULL, seeInsertObj,
-	    Tcl_NewStringObj(Tk_PathName(textPtr->tkwin), TCL_INDEX_NONE));
-    Tcl_ListObjAppendElement(NULL, seeInsertObj, Tcl_NewStringObj("see", 3));
-    Tcl_ListObjAppendElement(NULL, seeInsertObj,
-	    Tcl_NewStringObj("insert", 6));
-
-    Tcl_ListObjAppendElement(NULL, markSet1InsertObj,
-	    Tcl_NewStringObj(Tk_PathName(textPtr->tkwin), TCL_INDEX_NONE));
-    Tcl_ListObjAppendElement(NULL, markSet1InsertObj,
-	    Tcl_NewStringObj("mark", 4));
-    Tcl_ListObjAppendElement(NULL, markSet1InsertObj,
-	    Tcl_NewStringObj("set", 3));
-    Tcl_ListObjAppendElement(NULL, markSet1InsertObj,
-	    Tcl_NewStringObj("insert", 6));
-    markSet2InsertObj = Tcl_DuplicateObj(markSet1InsertObj);
-    Tcl_ListObjAppendElement(NULL, markSet1InsertObj, index1Obj);
-    Tcl_ListObjAppendElement(NULL, markSet2InsertObj, index2Obj);
-
-    Tcl_ListObjAppendElement(NULL, insertCmdObj,
-	    Tcl_NewStringObj("insert", 6));
-    Tcl_ListObjAppendElement(NULL, insertCmdObj, index1Obj);
+	if (recordPtr->offset + recordPtr->length == chunkPtr->used
+		&& chunkPtr->size - chunkPtr->used >= length) {
+	    chunkPtr->used += length;
+	} else {
+	    Tcl_Size offset;
 
-    /*
-     * Only use of 'undoString' is here.
-     */
+	    chunkPtr = TextUndoAlloc(sharedTextPtr,
+		    recordPtr->length + length,
+		    2 * (recordPtr->length + length), &offset);
+	    memcpy(chunkPtr->bytes + offset,
+		    recordPtr->chunkPtr->bytes + recordPtr->offset,
+		    recordPtr->length);
+	    TextUndoReleaseChunk(recordPtr->chunkPtr);
+	    recordPtr->chunkPtr = chunkPtr;
+	    recordPtr->offset = offset;
+	}
+	memcpy(chunkPtr->bytes + recordPtr->offset + recordPtr->length,
+		string, length);
+	recordPtr->length += length;
+	TextUndoPosition(index2Ptr, &recordPtr->line2, &recordPtr->char2);
+	TkUndoResizeTopAction(sharedTextPtr->undoStack, length);
+	return 1;
+    }
 
-    Tcl_ListObjAppendElement(NULL, insertCmdObj, undoString);
-
-    Tcl_ListObjAppendElement(NULL, deleteCmdObj,
-	    Tcl_NewStringObj("delete", 6));
-    Tcl_ListObjAppendElement(NULL, deleteCmdObj, index1Obj);
-    Tcl_ListObjAppendElement(NULL, deleteCmdObj, index2Obj);
-
-    Tcl_ListObjAppendElement(NULL, markSetLUndoMarkCmdObj,
-	    Tcl_NewStringObj(Tk_PathName(textPtr->tkwin), TCL_INDEX_NONE));
-    Tcl_ListObjAppendElement(NULL, markSetLUndoMarkCmdObj,
-	    Tcl_NewStringObj("mark", 4));
-    Tcl_ListObjAppendElement(NULL, markSetLUndoMarkCmdObj,
-	    Tcl_NewStringObj("set", 3));
-    markSetRUndoMarkCmdObj = Tcl_DuplicateObj(markSetLUndoMarkCmdObj);
-    textPtr->sharedTextPtr->undoMarkId++;
-    snprintf(stringUndoMarkId, TCL_INTEGER_SPACE, "%" TCL_SIZE_MODIFIER "d", textPtr->sharedTextPtr->undoMarkId);
-    strcat(lMarkName, stringUndoMarkId);
-    strcat(rMarkName, stringUndoMarkId);
-    Tcl_ListObjAppendElement(NULL, markSetLUndoMarkCmdObj,
-	    Tcl_NewStringObj(lMarkName, TCL_INDEX_NONE));
-    Tcl_ListObjAppendElement(NULL, markSetRUndoMarkCmdObj,
-	    Tcl_NewStringObj(rMarkName, TCL_INDEX_NONE));
-    Tcl_ListObjAppendElement(NULL, markSetLUndoMarkCmdObj, index1Obj);
-    Tcl_ListObjAppendElement(NULL, markSetRUndoMarkCmdObj, index2Obj);
-
-    Tcl_ListObjAppendElement(NULL, markGravityLUndoMarkCmdObj,
-	    Tcl_NewStringObj(Tk_PathName(textPtr->tkwin), TCL_INDEX_NONE));
-    Tcl_ListObjAppendElement(NULL, markGravityLUndoMarkCmdObj,
-	    Tcl_NewStringObj("mark", 4));
-    Tcl_ListObjAppendElement(NULL, markGravityLUndoMarkCmdObj,
-	    Tcl_NewStringObj("gravity", 7));
-    markGravityRUndoMarkCmdObj = Tcl_DuplicateObj(markGravityLUndoMarkCmdObj);
-    Tcl_ListObjAppendElement(NULL, markGravityLUndoMarkCmdObj,
-	    Tcl_NewStringObj(lMarkName, TCL_INDEX_NONE));
-    Tcl_ListObjAppendElement(NULL, markGravityRUndoMarkCmdObj,
-	    Tcl_NewStringObj(rMarkName, TCL_INDEX_NONE));
-    Tcl_ListObjAppendElement(NULL, markGravityLUndoMarkCmdObj,
-	    Tcl_NewStringObj("left", 4));
-    Tcl_ListObjAppendElement(NULL, markGravityRUndoMarkCmdObj,
-	    Tcl_NewStringObj("right", 5));
+    recordPtr = (TextUndoRecord *)ckalloc(sizeof(TextUndoRecord));
+    recordPtr->sharedTextPtr = sharedTextPtr;
+    recordPtr->pathObj = textPtr->undoPathObj;
+    Tcl_IncrRefCount(recordPtr->pathObj);
+    recordPtr->chunkPtr = TextUndoAlloc(sharedTextPtr, length, length,
+	    &recordPtr->offset);
+    memcpy(recordPtr->chunkPtr->bytes + recordPtr->offset, string, length);
+    recordPtr->length = length;
+    recordPtr->markId = ++sharedTextPtr->undoMarkId;
+    recordPtr->line1 = line1;
+    recordPtr->char1 = char1;
+    TextUndoPosition(index2Ptr, &recordPtr->line2, &recordPtr->char2);
 
     /*
-     * Note: we don't wish to use textPtr->widgetCmd in these callbacks
-     * because if we delete the textPtr, but peers still exist, we will then
-     * have references to a non-existent Tcl_Command in the undo stack, which
-     * will lead to crashes later. Also, the behaviour of the widget w.r.t.
-     * bindings (%W substitutions) always uses the widget path name, so there
-     * is no good reason the undo stack should do otherwise.
-     *
-     * For the 'insert' and 'delete' actions, we have to register a functional
-     * callback, because these actions are defined to operate on the
-     * underlying data shared by all peers.
+     * Only the 'apply' sub-atom owns the record; both lists are always freed
+     * together.
      */
 
-    iAtom = TkUndoMakeSubAtom(&TextUndoRedoCallback, textPtr->sharedTextPtr,
-	    insertCmdObj, NULL);
-    TkUndoMakeCmdSubAtom(NULL, markSet2InsertObj, iAtom);
-    TkUndoMakeCmdSubAtom(NULL, seeInsertObj, iAtom);
-    TkUndoMakeCmdSubAtom(NULL, markSetLUndoMarkCmdObj, iAtom);
-    TkUndoMakeCmdSubAtom(NULL, markSetRUndoMarkCmdObj, iAtom);
-    TkUndoMakeCmdSubAtom(NULL, markGravityLUndoMarkCmdObj, iAtom);
-    TkUndoMakeCmdSubAtom(NULL, markGravityRUndoMarkCmdObj, iAtom);
-
-    dAtom = TkUndoMakeSubAtom(&TextUndoRedoCallback, textPtr->sharedTextPtr,
-	    deleteCmdObj, NULL);
-    TkUndoMakeCmdSubAtom(NULL, markSet1InsertObj, dAtom);
-    TkUndoMakeCmdSubAtom(NULL, seeInsertObj, dAtom);
-    TkUndoMakeCmdSubAtom(NULL, markSetLUndoMarkCmdObj, dAtom);
-    TkUndoMakeCmdSubAtom(NULL, markSetRUndoMarkCmdObj, dAtom);
-    TkUndoMakeCmdSubAtom(NULL, markGravityLUndoMarkCmdObj, dAtom);
-    TkUndoMakeCmdSubAtom(NULL, markGravityRUndoMarkCmdObj, dAtom);
-
-    Tcl_DecrRefCount(seeInsertObj);
-    Tcl_DecrRefCount(index1Obj);
-    Tcl_DecrRefCount(index2Obj);
+    iAtom = TkUndoMakeRecordSubAtom(TextUndoInsertProc,
+	    insert ? TextUndoFreeRecord : NULL, recordPtr,
+	    insert ? (Tcl_Size) sizeof(TextUndoRecord) + length : 0);
+    dAtom = TkUndoMakeRecordSubAtom(TextUndoDeleteProc,
+	    insert ? NULL : TextUndoFreeRecord, recordPtr,
+	    insert ? 0 : (Tcl_Size) sizeof(TextUndoRecord) + length);
 
-    canUndo = TkUndoCanUndo(textPtr->sharedTextPtr->undoStack);
-    canRedo = TkUndoCanRedo(textPtr->sharedTextPtr->undoStack);
+    canUndo = TkUndoCanUndo(sharedTextPtr->undoStack);
+    canRedo = TkUndoCanRedo(sharedTextPtr->undoStack);
 
     /*
      * Depending whether the action is to insert or delete, we provide the
@@ -2986,14 +3241,161 @@ TextPushUndoAction(
      */
 
     if (insert) {
-	TkUndoPushAction(textPtr->sharedTextPtr->undoStack, iAtom, dAtom);
+	TkUndoPushAction(sharedTextPtr->undoStack, iAtom, dAtom);
     } else {
-	TkUndoPushAction(textPtr->sharedTextPtr->undoStack, dAtom, iAtom);
+	TkUndoPushAction(sharedTextPtr->undoStack, dAtom, iAtom);
     }
 
     if (!canUndo || canRedo) {
 	GenerateUndoStackEvent(textPtr);
     }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextUndoInsertProc, TextUndoDeleteProc --
+ *
+ *	Called by the undo code to insert or delete the text of an undo
+ *	record. Besides the edit itself, this moves the insertion cursor to
+ *	the end of the change and makes it visible, and sets the temporary
+ *	tk::undoMarkL/R marks around the change that
+ *	::tk::TextUndoRedoProcessMarks turns into the result of "edit undo"
+ *	and "edit redo".
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Text is inserted or deleted, marks are set and the view may change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextUndoInsertProc(
+    Tcl_Interp *interp,		/* Current interpreter. */
+    void *clientData,		/* The TextUndoRecord. */
+    TCL_UNUSED(Tcl_Obj *))
+{
+    return TextUndoReplay(interp, (TextUndoRecord *)clientData, 1);
+}
+
+static int
+TextUndoDeleteProc(
+    Tcl_Interp *interp,		/* Current interpreter. */
+    void *clientData,		/* The TextUndoRecord. */
+    TCL_UNUSED(Tcl_Obj *))
+{
+    return TextUndoReplay(interp, (TextUndoRecord *)clientData, 0);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextUndoReplay --
+ *
+ *	Carry out the edit of an undo record, in the same order as the script
+ *	based undo actions of earlier versions: the insert or delete through
+ *	TextUndoRedoCallback, then "mark set insert", "see insert", and the
+ *	two undo marks with their gravities. Evaluation stops at the first
+ *	error.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Whatever the evaluated commands do.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextUndoReplay(
+    Tcl_Interp *interp,		/* Current interpreter. */
+    TextUndoRecord *recordPtr,	/* The edit to carry out. */
+    int insert)			/* 1 to insert the text, 0 to delete it. */
+{
+    Tcl_Obj *index1Obj, *index2Obj, *markLObj, *markRObj, *objv[5];
+    Tcl_Obj *cmdObj;
+    int i, res;
+
+    index1Obj = Tcl_ObjPrintf("%d.%" TCL_SIZE_MODIFIER "d",
+	    recordPtr->line1 + 1, recordPtr->char1);
+    index2Obj = Tcl_ObjPrintf("%d.%" TCL_SIZE_MODIFIER "d",
+	    recordPtr->line2 + 1, recordPtr->char2);
+    markLObj = Tcl_ObjPrintf("tk::undoMarkL%" TCL_SIZE_MODIFIER "d",
+	    recordPtr->markId);
+    markRObj = Tcl_ObjPrintf("tk::undoMarkR%" TCL_SIZE_MODIFIER "d",
+	    recordPtr->markId);
+    Tcl_IncrRefCount(index1Obj);
+    Tcl_IncrRefCount(index2Obj);
+    Tcl_IncrRefCount(markLObj);
+    Tcl_IncrRefCount(markRObj);
+
+    if (insert) {
+	objv[0] = Tcl_NewStringObj("insert", 6);
+	objv[1] = index1Obj;
+	objv[2] = Tcl_NewStringObj(recordPtr->chunkPtr->bytes
+		+ recordPtr->offset, recordPtr->length);
+	cmdObj = Tcl_NewListObj(3, objv);
+    } else {
+	objv[0] = Tcl_NewStringObj("delete", 6);
+	objv[1] = index1Obj;
+	objv[2] = index2Obj;
+	cmdObj = Tcl_NewListObj(3, objv);
+    }
+    Tcl_IncrRefCount(cmdObj);
+    res = TextUndoRedoCallback(interp, recordPtr->sharedTextPtr, cmdObj);
+    Tcl_DecrRefCount(cmdObj);
+
+    for (i = 0; i < 6 && res == TCL_OK; i++) {
+	Tcl_Size objc;
+
+	objv[0] = recordPtr->pathObj;
+	if (i == 1) {
+	    objv[1] = Tcl_NewStringObj("see", 3);
+	} else {
+	    objv[1] = Tcl_NewStringObj("mark", 4);
+	}
+	switch (i) {
+	case 0:
+	    objv[2] = Tcl_NewStringObj("set", 3);
+	    objv[3] = Tcl_NewStringObj("insert", 6);
+	    objv[4] = insert ? index2Obj : index1Obj;
+	    objc = 5;
+	    break;
+	case 1:
+	    objv[2] = Tcl_NewStringObj("insert", 6);
+	    objc = 3;
+	    break;
+	case 2:
+	case 3:
+	    objv[2] = Tcl_NewStringObj("set", 3);
+	    objv[3] = (i == 2) ? markLObj : markRObj;
+	    objv[4] = (i == 2) ? index1Obj : index2Obj;
+	    objc = 5;
+	    break;
+	default:
+	    objv[2] = Tcl_NewStringObj("gravity", 7);
+	    objv[3] = (i == 4) ? markLObj : markRObj;
+	    objv[4] = (i == 4) ? Tcl_NewStringObj("left", 4)
+		    : Tcl_NewStringObj("right", 5);
+	    objc = 5;
+	    break;
+	}
+	cmdObj = Tcl_NewListObj(objc, objv);
+	Tcl_IncrRefCount(cmdObj);
+	res = Tcl_EvalObjEx(interp, cmdObj, TCL_EVAL_GLOBAL);
+	Tcl_DecrRefCount(cmdObj);
+    }
+
+    Tcl_DecrRefCount(index1Obj);
+    Tcl_DecrRefCount(index2Obj);
+    Tcl_DecrRefCount(markLObj);
+    Tcl_DecrRefCount(markRObj);
+    return res;
 }
 
 /*
@@ -3369,6 +3771,8 @@ DeleteIndexRange(
     if (TkTextIndexCmp(&index1, &index2) < 0) {
 	if (sharedTextPtr->undo) {
 	    Tcl_Obj *get;
+	    const char *string;
+	    Tcl_Size length;
 
 	    if (sharedTextPtr->autoSeparators
 		    && (sharedTextPtr->lastEditMode != TK_TEXT_EDIT_DELETE)) {
@@ -3378,7 +3782,10 @@ DeleteIndexRange(
 	    sharedTextPtr->lastEditMode = TK_TEXT_EDIT_DELETE;
 
 	    get = TextGetText(textPtr, &index1, &index2, 0);
-	    TextPushUndoAction(textPtr, get, 0, &index1, &index2);
+	    Tcl_IncrRefCount(get);
+	    string = Tcl_GetStringFromObj(get, &length);
+	    TextPushUndoAction(textPtr, string, length, 0, &index1, &index2);
+	    Tcl_DecrRefCount(get);
 	}
 	sharedTextPtr->stateEpoch++;
 
@@ -3834,10 +4241,13 @@ TextInsertCmd(
 /*
  *----------------------------------------------------------------------
  *
- * TextSearchCmd --
+ * TextLoadCmd --
  *
- *	This function is invoked to process the "search" widget command for
- *	text widgets. See the user documentation for details on what it does.
+ *	This function is invoked to process the "load" widget command for
+ *	text widgets. It replaces the whole text with the given data or the
+ *	contents of a channel, without recording undo information; the B-tree
+ *	is built bottom-up in one pass, so this is much faster than "delete"
+ *	and "insert" for large texts.
  *
  * Results:
  *	A standard Tcl result.
@@ -3848,58 +4258,224 @@ TextInsertCmd(
  *----------------------------------------------------------------------
  */
 
+/*
+ * Number of characters read from a channel at a time by TextLoadCmd.
+ */
+
+#define LOAD_CHUNK_CHARS (1 << 20)
+
 static int
-TextSearchCmd(
+TextLoadCmd(
     TkText *textPtr,		/* Information about text widget. */
     Tcl_Interp *interp,		/* Current interpreter. */
-    Tcl_Size objc,			/* Number of arguments. */
+    Tcl_Size objc,		/* Number of arguments. */
     Tcl_Obj *const objv[])	/* Argument objects. */
 {
-    Tcl_Size i, argsLeft;
-    int code;
-    SearchSpec searchSpec;
+    TkSharedText *sharedTextPtr = textPtr->sharedTextPtr;
+    TkTextBTree tree = sharedTextPtr->tree;
+    TkTextIndex index1, index2;
+    TkTextLoad *loadPtr;
+    TkText *tPtr;
+    Tcl_Channel chan = NULL;
+    Tcl_Obj *chunkPtr;
+    const char *string;
+    Tcl_Size length;
+    int idx, mode, oldModified, oldUndo, canUndo, canRedo;
+    int code = TCL_OK;
 
-    static const char *const switchStrings[] = {
-	"-hidden",
-	"--", "-all", "-backwards", "-count", "-elide", "-exact", "-forwards",
-	"-nocase", "-nolinestop", "-overlap", "-regexp", "-strictlimits", NULL
+    static const char *const loadOptionStrings[] = {
+	"-channel", "-data", NULL
     };
-    enum SearchSwitches {
-	TK_TEXT_SEARCH_HIDDEN,
-	TK_TEXT_SEARCH_END, TK_TEXT_SEARCH_ALL, TK_TEXT_SEARCH_BACK, TK_TEXT_SEARCH_COUNT, TK_TEXT_SEARCH_ELIDE,
-	TK_TEXT_SEARCH_EXACT, TK_TEXT_SEARCH_FWD, TK_TEXT_SEARCH_NOCASE,
-	TK_TEXT_SEARCH_NOLINESTOP, TK_TEXT_SEARCH_OVERLAP, TK_TEXT_SEARCH_REGEXP, TK_TEXT_SEARCH_STRICTLIMITS
+    enum loadOptions {
+	LOAD_CHANNEL, LOAD_DATA
     };
 
+    if (objc != 4) {
+	Tcl_WrongNumArgs(interp, 2, objv, "-channel|-data value");
+	return TCL_ERROR;
+    }
+    if (Tcl_GetIndexFromObjStruct(interp, objv[2], loadOptionStrings,
+	    sizeof(char *), "option", 0, &idx) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if ((enum loadOptions) idx == LOAD_CHANNEL) {
+	chan = Tcl_GetChannel(interp, Tcl_GetString(objv[3]), &mode);
+	if (chan == NULL) {
+	    return TCL_ERROR;
+	}
+	if (!(mode & TCL_READABLE)) {
+	    Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+		    "channel \"%s\" wasn't opened for reading",
+		    Tcl_GetString(objv[3])));
+	    Tcl_SetErrorCode(interp, "TK", "TEXT", "LOAD", "UNREADABLE",
+		    (char *)NULL);
+	    return TCL_ERROR;
+	}
+    }
+    if ((textPtr->start != NULL) || (textPtr->end != NULL)) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj("cannot load into a text "
+		"widget with -startline or -endline set", -1));
+	Tcl_SetErrorCode(interp, "TK", "TEXT", "LOAD", "RANGE", (char *)NULL);
+	return TCL_ERROR;
+    }
+    if (textPtr->state == TK_TEXT_STATE_DISABLED) {
+	return TCL_OK;
+    }
+
     /*
-     * Set up the search specification, including the last 4 fields which are
-     * text widget specific.
+     * Empty the widget first. The old text doesn't go onto the undo stack,
+     * which is cleared below, and doesn't count as a modification, since the
+     * modified flag is reset below too.
      */
 
-    searchSpec.exact = 1;
-    searchSpec.noCase = 0;
-    searchSpec.all = 0;
-    searchSpec.backwards = 0;
-    searchSpec.varPtr = NULL;
-    searchSpec.countPtr = NULL;
-    searchSpec.resPtr = NULL;
-    searchSpec.searchElide = 0;
-    searchSpec.noLineStop = 0;
-    searchSpec.overlap = 0;
-    searchSpec.strictLimits = 0;
-    searchSpec.numLines =
-	    TkBTreeNumLines(textPtr->sharedTextPtr->tree, textPtr);
-    searchSpec.clientData = textPtr;
-    searchSpec.addLineProc = &TextSearchAddNextLine;
-    searchSpec.foundMatchProc = &TextSearchFoundMatch;
-    searchSpec.lineIndexProc = &TextSearchGetLineIndex;
+    oldModified = sharedTextPtr->isDirty;
+    oldUndo = sharedTextPtr->undo;
+    sharedTextPtr->undo = 0;
+    sharedTextPtr->dirtyMode = TK_TEXT_DIRTY_FIXED;
+    TkTextMakeByteIndex(tree, textPtr, 0, 0, &index1);
+    TkTextMakeByteIndex(tree, textPtr, TkBTreeNumLines(tree, textPtr), 0,
+	    &index2);
+    DeleteIndexRange(sharedTextPtr, textPtr, &index1, &index2, 1);
+    sharedTextPtr->undo = oldUndo;
 
     /*
-     * Parse switches and other arguments.
+     * Now hand the new text to the B-tree, which builds it up in one go.
      */
 
-    for (i=2 ; i<objc ; i++) {
-	int index;
+    TkTextMakeByteIndex(tree, textPtr, 0, 0, &index1);
+    TkTextChanged(sharedTextPtr, NULL, &index1, &index1);
+    sharedTextPtr->stateEpoch++;
+    loadPtr = TkBTreeLoadBegin(tree);
+    if (chan == NULL) {
+	string = Tcl_GetStringFromObj(objv[3], &length);
+	TkBTreeLoadChars(loadPtr, string, length);
+    } else {
+	chunkPtr = Tcl_NewObj();
+	Tcl_IncrRefCount(chunkPtr);
+	while (1) {
+	    length = Tcl_ReadChars(chan, chunkPtr, LOAD_CHUNK_CHARS, 0);
+	    if (length < 0) {
+		Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+			"error reading \"%s\": %s", Tcl_GetString(objv[3]),
+			Tcl_PosixError(interp)));
+		code = TCL_ERROR;
+		break;
+	    }
+	    if (length == 0) {
+		/*
+		 * End of file, or no more data for now on a non-blocking
+		 * channel. Like [read], take what there is.
+		 */
+
+		break;
+	    }
+	    string = Tcl_GetStringFromObj(chunkPtr, &length);
+	    TkBTreeLoadChars(loadPtr, string, length);
+	}
+	Tcl_DecrRefCount(chunkPtr);
+    }
+    TkBTreeLoadEnd(loadPtr);
+
+    for (tPtr = sharedTextPtr->peers; tPtr != NULL ; tPtr = tPtr->next) {
+	TkTextMakeByteIndex(tree, tPtr, 0, 0, &index1);
+	TkTextSetYView(tPtr, &index1, 0);
+	tPtr->abortSelections = 1;
+    }
+
+    /*
+     * The loaded text is where undo starts from, and it is unmodified.
+     */
+
+    canUndo = TkUndoCanUndo(sharedTextPtr->undoStack);
+    canRedo = TkUndoCanRedo(sharedTextPtr->undoStack);
+    TkUndoClearStacks(sharedTextPtr->undoStack);
+    if (canUndo || canRedo) {
+	GenerateUndoStackEvent(textPtr);
+    }
+    sharedTextPtr->lastEditMode = TK_TEXT_EDIT_OTHER;
+    sharedTextPtr->isDirty = 0;
+    sharedTextPtr->dirtyMode = TK_TEXT_DIRTY_NORMAL;
+    if (oldModified) {
+	GenerateModifiedEvent(textPtr);
+    }
+    return code;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextSearchCmd --
+ *
+ *	This function is invoked to process the "search" widget command for
+ *	text widgets. See the user documentation for details on what it does.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	See the user documentation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextSearchCmd(
+    TkText *textPtr,		/* Information about text widget. */
+    Tcl_Interp *interp,		/* Current interpreter. */
+    Tcl_Size objc,			/* Number of arguments. */
+    Tcl_Obj *const objv[])	/* Argument objects. */
+{
+    Tcl_Size i, argsLeft;
+    int code;
+    SearchSpec searchSpec;
+
+    static const char *const switchStrings[] = {
+	"-hidden",
+	"--", "-all", "-backwards", "-count", "-countonly", "-elide", "-exact",
+	"-forwards", "-nocase", "-nolinestop", "-overlap", "-regexp",
+	"-strictlimits", NULL
+    };
+    enum SearchSwitches {
+	TK_TEXT_SEARCH_HIDDEN,
+	TK_TEXT_SEARCH_END, TK_TEXT_SEARCH_ALL, TK_TEXT_SEARCH_BACK, TK_TEXT_SEARCH_COUNT,
+	TK_TEXT_SEARCH_COUNTONLY, TK_TEXT_SEARCH_ELIDE,
+	TK_TEXT_SEARCH_EXACT, TK_TEXT_SEARCH_FWD, TK_TEXT_SEARCH_NOCASE,
+	TK_TEXT_SEARCH_NOLINESTOP, TK_TEXT_SEARCH_OVERLAP, TK_TEXT_SEARCH_REGEXP, TK_TEXT_SEARCH_STRICTLIMITS
+    };
+
+    /*
+     * Set up the search specification, including the last 4 fields which are
+     * text widget specific.
+     */
+
+    searchSpec.exact = 1;
+    searchSpec.noCase = 0;
+    searchSpec.all = 0;
+    searchSpec.backwards = 0;
+    searchSpec.varPtr = NULL;
+    searchSpec.countPtr = NULL;
+    searchSpec.resPtr = NULL;
+    searchSpec.searchElide = 0;
+    searchSpec.countOnly = 0;
+    searchSpec.numMatches = 0;
+    searchSpec.lineHint = NULL;
+    searchSpec.lineHintNum = -1;
+    searchSpec.noLineStop = 0;
+    searchSpec.overlap = 0;
+    searchSpec.strictLimits = 0;
+    searchSpec.numLines =
+	    TkBTreeNumLines(textPtr->sharedTextPtr->tree, textPtr);
+    searchSpec.clientData = textPtr;
+    searchSpec.addLineProc = &TextSearchAddNextLine;
+    searchSpec.foundMatchProc = &TextSearchFoundMatch;
+    searchSpec.lineIndexProc = &TextSearchGetLineIndex;
+
+    /*
+     * Parse switches and other arguments.
+     */
+
+    for (i=2 ; i<objc ; i++) {
+	int index;
 
 	if (Tcl_GetString(objv[i])[0] != '-') {
 	    break;
@@ -3943,6 +4519,9 @@ TextSearchCmd(
 
 	    searchSpec.varPtr = objv[i];
 	    break;
+	case TK_TEXT_SEARCH_COUNTONLY:
+	    searchSpec.countOnly = 1;
+	    break;
 	case TK_TEXT_SEARCH_ELIDE:
 	case TK_TEXT_SEARCH_HIDDEN:
 	    searchSpec.searchElide = 1;
@@ -3997,14 +4576,37 @@ TextSearchCmd(
 	return TCL_ERROR;
     }
 
+    if (searchSpec.countOnly && searchSpec.varPtr != NULL) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		"the \"-countonly\" and \"-count\" options cannot be used"
+		" together", TCL_INDEX_NONE));
+	Tcl_SetErrorCode(interp, "TK", "TEXT", "SEARCH_USAGE", (char *)NULL);
+	return TCL_ERROR;
+    }
+
+    /*
+     * Finding out whether a segment is elided is expensive, so when no tag
+     * can elide anything, search as if -elide was given: the result is the
+     * same.
+     */
+
+    if (!searchSpec.searchElide && !TextCanElide(textPtr)) {
+	searchSpec.searchElide = 1;
+    }
+
     /*
      * Scan through all of the lines of the text circularly, starting at the
      * given index. 'objv[i]' is the pattern which may be an exact string or a
      * regexp pattern depending on the flags set above.
      */
 
-    code = SearchPerform(interp, &searchSpec, objv[i], objv[i+1],
-	    (argsLeft == 1 ? objv[i+2] : NULL));
+    if (TextSearchCanScan(&searchSpec, objv[i])) {
+	code = TextSearchScan(interp, textPtr, &searchSpec, objv[i],
+		objv[i+1], (argsLeft == 1 ? objv[i+2] : NULL));
+    } else {
+	code = SearchPerform(interp, &searchSpec, objv[i], objv[i+1],
+		(argsLeft == 1 ? objv[i+2] : NULL));
+    }
     if (code != TCL_OK) {
 	goto cleanup;
     }
@@ -4026,7 +4628,9 @@ TextSearchCmd(
      * Set the result.
      */
 
-    if (searchSpec.resPtr != NULL) {
+    if (searchSpec.countOnly) {
+	Tcl_SetObjResult(interp, Tcl_NewWideIntObj(searchSpec.numMatches));
+    } else if (searchSpec.resPtr != NULL) {
 	Tcl_SetObjResult(interp, searchSpec.resPtr);
 	searchSpec.resPtr = NULL;
     }
@@ -4041,6 +4645,442 @@ TextSearchCmd(
     return code;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextCanElide --
+ *
+ *	Checks whether any tag of the widget (including the "sel" tags of all
+ *	its peers) hides the text it is applied to.
+ *
+ * Results:
+ *	1 if some text may be elided, 0 if none can be.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextCanElide(
+    const TkText *textPtr)	/* Information about text widget. */
+{
+    TkSharedText *sharedTextPtr = textPtr->sharedTextPtr;
+    Tcl_HashSearch search;
+    Tcl_HashEntry *hPtr;
+    TkText *peerPtr;
+
+    for (peerPtr = sharedTextPtr->peers; peerPtr != NULL;
+	    peerPtr = peerPtr->next) {
+	if (peerPtr->selTagPtr != NULL && peerPtr->selTagPtr->elide > 0) {
+	    return 1;
+	}
+    }
+    for (hPtr = Tcl_FirstHashEntry(&sharedTextPtr->tagTable, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	if (((TkTextTag *)Tcl_GetHashValue(hPtr))->elide > 0) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextScanSettle --
+ *
+ *	Moves a scan position forward to the next byte of searchable text: it
+ *	skips the rest of an exhausted character segment, any other segments
+ *	and, at the end of a line, moves to the next one.
+ *
+ * Results:
+ *	1 if posPtr refers to a byte of a character segment, 0 if the end of
+ *	the searchable lines was reached.
+ *
+ * Side effects:
+ *	The sizes of the non-character segments passed over are added to
+ *	*skippedPtr, if it isn't NULL.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextScanSettle(
+    const TkText *textPtr,	/* Information about text widget. */
+    int numLines,		/* Number of lines that may be scanned. */
+    TextScanPos *posPtr,	/* Position to move. */
+    Tcl_Size *skippedPtr)	/* If not NULL, counts skipped segments. */
+{
+    TkTextSegment *segPtr;
+
+    while (1) {
+	segPtr = posPtr->segPtr;
+	if (segPtr != NULL) {
+	    if (segPtr->typePtr == &tkTextCharType) {
+		if (posPtr->offset < segPtr->size) {
+		    return 1;
+		}
+	    } else if (skippedPtr != NULL) {
+		*skippedPtr += segPtr->size;
+	    }
+	    posPtr->segByte += segPtr->size;
+	    posPtr->segPtr = segPtr->nextPtr;
+	    posPtr->offset = 0;
+	    continue;
+	}
+	if (posPtr->lineNum + 1 >= numLines) {
+	    return 0;
+	}
+	posPtr->linePtr = TkBTreeNextLine(textPtr, posPtr->linePtr);
+	if (posPtr->linePtr == NULL) {
+	    return 0;
+	}
+	posPtr->lineNum++;
+	posPtr->segPtr = posPtr->linePtr->segPtr;
+	posPtr->segByte = 0;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextScanMatch --
+ *
+ *	Checks whether the pattern of an exact search occurs at a position,
+ *	following it across segment and line boundaries. Segments other than
+ *	characters are passed over, as the line-based search does.
+ *
+ * Results:
+ *	1 if the pattern matches, in which case *posPtr is moved just past
+ *	the match and *numCharsPtr holds its length in index characters; 0
+ *	otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextScanMatch(
+    const TkText *textPtr,	/* Information about text widget. */
+    const TextScan *scanPtr,	/* Pattern and search parameters. */
+    TextScanPos *posPtr,	/* Candidate start, on a searchable byte. */
+    Tcl_Size *numCharsPtr)	/* Returns the length of the match. */
+{
+    TextScanPos pos = *posPtr;
+    Tcl_Size i = 0, numChars = 0;
+
+    while (i < scanPtr->patLength) {
+	const char *p;
+	int ch;
+
+	if (!TextScanSettle(textPtr, scanPtr->numLines, &pos, &numChars)) {
+	    return 0;
+	}
+	p = pos.segPtr->body.chars + pos.offset;
+	if (!scanPtr->noCase) {
+	    if (*p != scanPtr->pattern[i]) {
+		return 0;
+	    }
+	    if ((*p & 0xC0) != 0x80) {
+		numChars++;
+	    }
+	    pos.offset++;
+	} else {
+	    Tcl_Size len = Tcl_UtfToUniChar(p, &ch);
+
+	    if (Tcl_UniCharToLower(ch) != UCHAR(scanPtr->pattern[i])) {
+		return 0;
+	    }
+	    numChars++;
+	    pos.offset += len;
+	}
+	i++;
+    }
+    *posPtr = pos;
+    *numCharsPtr = numChars;
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextScanRange --
+ *
+ *	Reports every match of an exact pattern that starts at or after
+ *	*posPtr and before a limit. If 'strict' is set, a match must also end
+ *	by the limit, and the first one that doesn't ends the scan.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Matches are stored in the fields of scanPtr->searchSpecPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TextScanRange(
+    TkText *textPtr,		/* Information about text widget. */
+    const TextScan *scanPtr,	/* Pattern and search parameters. */
+    const TextScanPos *posPtr,	/* Where to start. */
+    int limitLine,		/* Matches must start before this line... */
+    Tcl_Size limitByte,		/* ...or before this byte of it. */
+    int strict)			/* Whether matches must also end there. */
+{
+    SearchSpec *searchSpecPtr = scanPtr->searchSpecPtr;
+    unsigned char first = UCHAR(scanPtr->pattern[0]);
+    TextScanPos pos = *posPtr, end;
+    Tcl_Size numChars;
+
+    while (TextScanSettle(textPtr, scanPtr->numLines, &pos, NULL)) {
+	const char *chars = pos.segPtr->body.chars;
+	const char *p = chars + pos.offset;
+	const char *last = chars + pos.segPtr->size;
+
+	/*
+	 * Find the next byte that may start a match in this segment.
+	 */
+
+	if (!scanPtr->noCase) {
+	    p = (const char *)memchr(p, first, last - p);
+	} else {
+	    while (p < last && !scanPtr->candidate[UCHAR(*p)]) {
+		p++;
+	    }
+	    if (p == last) {
+		p = NULL;
+	    }
+	}
+	if (p == NULL) {
+	    pos.offset = pos.segPtr->size;
+	    continue;
+	}
+	pos.offset = p - chars;
+	if ((pos.lineNum > limitLine) || ((pos.lineNum == limitLine)
+		&& (pos.segByte + pos.offset >= limitByte))) {
+	    break;
+	}
+	end = pos;
+	if (!TextScanMatch(textPtr, scanPtr, &end, &numChars)) {
+	    pos.offset++;
+	    continue;
+	}
+	if (strict && ((end.lineNum > limitLine)
+		|| ((end.lineNum == limitLine)
+		&& (end.segByte + end.offset > limitByte)))) {
+	    return;
+	}
+
+	if (searchSpecPtr->countOnly) {
+	    searchSpecPtr->numMatches++;
+	} else {
+	    TkTextIndex index;
+
+	    index.tree = textPtr->sharedTextPtr->tree;
+	    index.linePtr = pos.linePtr;
+	    index.byteIndex = pos.segByte + pos.offset;
+	    index.textPtr = NULL;
+	    if (searchSpecPtr->resPtr == NULL) {
+		searchSpecPtr->resPtr = Tcl_NewObj();
+	    }
+	    Tcl_ListObjAppendElement(NULL, searchSpecPtr->resPtr,
+		    TkTextNewIndexObj(textPtr, &index));
+	    if (searchSpecPtr->varPtr != NULL) {
+		if (searchSpecPtr->countPtr == NULL) {
+		    searchSpecPtr->countPtr = Tcl_NewObj();
+		}
+		Tcl_ListObjAppendElement(NULL, searchSpecPtr->countPtr,
+			Tcl_NewWideIntObj(numChars));
+	    }
+	}
+	if (searchSpecPtr->overlap) {
+	    pos.offset++;
+	} else {
+	    pos = end;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextSearchCanScan --
+ *
+ *	Decides whether a search can be done by TextSearchScan: it must be a
+ *	forward exact search for all matches of a non-empty pattern, in text
+ *	where nothing is elided, and with -nocase the pattern must be ASCII.
+ *
+ * Results:
+ *	1 if TextSearchScan can be used, 0 if SearchPerform must be.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextSearchCanScan(
+    const SearchSpec *searchSpecPtr,
+				/* Search parameters. */
+    Tcl_Obj *patObj)		/* The pattern. */
+{
+    Tcl_Size i, length;
+    const char *pattern;
+
+    if (!searchSpecPtr->exact || !searchSpecPtr->all
+	    || searchSpecPtr->backwards || !searchSpecPtr->searchElide) {
+	return 0;
+    }
+    pattern = Tcl_GetStringFromObj(patObj, &length);
+    if (length == 0) {
+	return 0;
+    }
+
+    /*
+     * Without -nocase the bytes are compared as they are. With it, only
+     * ASCII patterns are handled, so that the lower case text can be
+     * compared a character at a time.
+     */
+
+    if (searchSpecPtr->noCase) {
+	for (i = 0; i < length; i++) {
+	    if (UCHAR(pattern[i]) >= 0x80) {
+		return 0;
+	    }
+	}
+    }
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextSearchScan --
+ *
+ *	Performs "search -all -exact" forwards by scanning the character
+ *	segments of the B-tree directly. Unlike SearchCore, no copy of each
+ *	line is made: the first byte of the pattern is located with memchr
+ *	and candidates are compared segment by segment, so matches may cross
+ *	segment and line boundaries. Without a stop index the search wraps
+ *	around to the start index, as SearchCore does.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Matches are stored in the fields of searchSpecPtr, as
+ *	TextSearchFoundMatch does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextSearchScan(
+    Tcl_Interp *interp,		/* For error messages. */
+    TkText *textPtr,		/* Information about text widget. */
+    SearchSpec *searchSpecPtr,	/* Search parameters. */
+    Tcl_Obj *patObj,		/* The pattern. */
+    Tcl_Obj *fromPtr,		/* Index to start at. */
+    Tcl_Obj *toPtr)		/* NULL or the index to stop at. */
+{
+    const TkTextIndex *indexPtr;
+    TkTextIndex fromIndex;
+    TextScan scan;
+    TextScanPos pos;
+    Tcl_Size offset;
+    int stopLine = -1, i;
+    Tcl_Size stopByte = 0;
+    char *lower = NULL;
+
+    indexPtr = TkTextGetIndexFromObj(interp, textPtr, fromPtr);
+    if (indexPtr == NULL) {
+	return TCL_ERROR;
+    }
+    fromIndex = *indexPtr;
+    if (toPtr != NULL) {
+	indexPtr = TkTextGetIndexFromObj(interp, textPtr, toPtr);
+	if (indexPtr == NULL) {
+	    return TCL_ERROR;
+	}
+	if (TkTextIndexCmp(&fromIndex, indexPtr) > 0) {
+	    return TCL_OK;
+	}
+	stopLine = TkBTreeLinesTo(textPtr, indexPtr->linePtr);
+	stopByte = indexPtr->byteIndex;
+	if (stopLine >= searchSpecPtr->numLines) {
+	    stopLine = searchSpecPtr->numLines;
+	    stopByte = 0;
+	}
+    }
+
+    scan.searchSpecPtr = searchSpecPtr;
+    scan.numLines = searchSpecPtr->numLines;
+    scan.noCase = searchSpecPtr->noCase;
+    scan.pattern = Tcl_GetStringFromObj(patObj, &scan.patLength);
+    if (scan.noCase) {
+	lower = (char *)ckalloc(scan.patLength + 1);
+	memcpy(lower, scan.pattern, scan.patLength + 1);
+	Tcl_UtfToLower(lower);
+	scan.pattern = lower;
+
+	/*
+	 * Bytes that can start a match: the ASCII letters that fold to the
+	 * first character of the pattern, and the first byte of any other
+	 * character, since a few of those fold to ASCII letters.
+	 */
+
+	for (i = 0; i < 256; i++) {
+	    scan.candidate[i] = (i >= 0xC0)
+		    || ((i < 0x80) && (tolower(i) == UCHAR(lower[0])));
+	}
+    }
+
+    pos.lineNum = TkBTreeLinesTo(textPtr, fromIndex.linePtr);
+    if (pos.lineNum < scan.numLines) {
+	pos.linePtr = fromIndex.linePtr;
+	pos.segPtr = TkTextIndexToSeg(&fromIndex, &offset);
+	pos.segByte = fromIndex.byteIndex - offset;
+	pos.offset = offset;
+    } else {
+	pos.segPtr = NULL;
+    }
+
+    if (stopLine >= 0) {
+	if (pos.segPtr != NULL) {
+	    TextScanRange(textPtr, &scan, &pos, stopLine, stopByte,
+		    searchSpecPtr->strictLimits);
+	}
+    } else {
+	int startLine = pos.lineNum;
+	Tcl_Size startByte = fromIndex.byteIndex;
+
+	if (pos.segPtr != NULL) {
+	    TextScanRange(textPtr, &scan, &pos, scan.numLines, 0, 0);
+	} else {
+	    startLine = scan.numLines;
+	    startByte = 0;
+	}
+	pos.linePtr = TkBTreeFindLine(textPtr->sharedTextPtr->tree, textPtr,
+		0);
+	pos.lineNum = 0;
+	pos.segPtr = pos.linePtr->segPtr;
+	pos.segByte = 0;
+	pos.offset = 0;
+	TextScanRange(textPtr, &scan, &pos, startLine, startByte, 0);
+    }
+
+    if (lower != NULL) {
+	ckfree(lower);
+    }
+    return TCL_OK;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -4218,10 +5258,21 @@ TextSearchAddNextLine(
     int nothingYet = 1;
 
     /*
-     * Extract the text from the line.
+     * Extract the text from the line. Searches mostly move from one line to
+     * the next, so try to get there from the line we were last asked for.
      */
 
-    linePtr = TkBTreeFindLine(textPtr->sharedTextPtr->tree, textPtr, lineNum);
+    linePtr = (TkTextLine *)searchSpecPtr->lineHint;
+    if (linePtr != NULL && lineNum == searchSpecPtr->lineHintNum + 1) {
+	linePtr = TkBTreeNextLine(textPtr, linePtr);
+    } else if (linePtr != NULL && lineNum == searchSpecPtr->lineHintNum - 1) {
+	linePtr = TkBTreePreviousLine(textPtr, linePtr);
+    } else if (linePtr == NULL || lineNum != searchSpecPtr->lineHintNum) {
+	linePtr = TkBTreeFindLine(textPtr->sharedTextPtr->tree, textPtr,
+		lineNum);
+    }
+    searchSpecPtr->lineHint = linePtr;
+    searchSpecPtr->lineHintNum = lineNum;
     if (linePtr == NULL) {
 	return NULL;
     }
@@ -4376,6 +5427,15 @@ TextSearchFoundMatch(
 	}
     }
 
+    /*
+     * When only counting there is no need to work out where the match is.
+     */
+
+    if (searchSpecPtr->countOnly) {
+	searchSpecPtr->numMatches++;
+	return 1;
+    }
+
     /*
      * The index information returned by the regular expression parser only
      * considers textual information: it doesn't account for embedded windows,
@@ -4723,6 +5783,7 @@ TextDumpCmd(
     int atEnd;			/* True if dumping up to logical end. */
     TkTextLine *linePtr;
     Tcl_Obj *command = NULL;	/* Script callback to apply to segments. */
+    Tcl_Channel chan = NULL;	/* Channel to write the result to. */
 #define TK_DUMP_TEXT	0x1
 #define TK_DUMP_MARK	0x2
 #define TK_DUMP_TAG	0x4
@@ -4731,19 +5792,29 @@ TextDumpCmd(
 #define TK_DUMP_ALL	(TK_DUMP_TEXT|TK_DUMP_MARK|TK_DUMP_TAG| \
 	TK_DUMP_WIN|TK_DUMP_IMG)
     static const char *const optStrings[] = {
-	"-all", "-command", "-image", "-mark", "-tag", "-text", "-window",
-	NULL
+	"-all", "-channel", "-command", "-image", "-mark", "-tag", "-text",
+	"-window", NULL
     };
     enum opts {
-	DUMP_ALL, DUMP_CMD, DUMP_IMG, DUMP_MARK, DUMP_TAG, DUMP_TXT, DUMP_WIN
+	DUMP_ALL, DUMP_CHAN, DUMP_CMD, DUMP_IMG, DUMP_MARK, DUMP_TAG,
+	DUMP_TXT, DUMP_WIN
     };
 
     for (arg=2 ; arg < objc ; arg++) {
 	int index;
-	if (Tcl_GetString(objv[arg])[0] != '-') {
+	const char *str = Tcl_GetString(objv[arg]);
+
+	if (str[0] != '-') {
 	    break;
 	}
-	if (Tcl_GetIndexFromObjStruct(interp, objv[arg], optStrings,
+
+	/*
+	 * "-c" meant -command before -channel was added; keep it that way.
+	 */
+
+	if (strcmp(str, "-c") == 0) {
+	    index = DUMP_CMD;
+	} else if (Tcl_GetIndexFromObjStruct(interp, objv[arg], optStrings,
 		sizeof(char *), "option", 0, &index) != TCL_OK) {
 	    return TCL_ERROR;
 	}
@@ -4766,6 +5837,16 @@ TextDumpCmd(
 	case DUMP_WIN:
 	    what |= TK_DUMP_WIN;
 	    break;
+	case DUMP_CHAN:
+	    arg++;
+	    if (arg >= objc) {
+		goto wrongArgs;
+	    }
+	    chan = TextGetWritableChannel(interp, objv[arg]);
+	    if (chan == NULL) {
+		return TCL_ERROR;
+	    }
+	    break;
 	case DUMP_CMD:
 	    arg++;
 	    if (arg >= objc) {
@@ -4781,10 +5862,18 @@ TextDumpCmd(
     wrongArgs:
 	Tcl_SetObjResult(interp, Tcl_ObjPrintf(
 		"Usage: %s dump ?-all -image -text -mark -tag -window? "
-		"?-command script? index ?index2?", Tcl_GetString(objv[0])));
+		"?-command script? ?-channel channelId? index ?index2?",
+		Tcl_GetString(objv[0])));
 	Tcl_SetErrorCode(interp, "TCL", "WRONGARGS", (char *)NULL);
 	return TCL_ERROR;
     }
+    if (command != NULL && chan != NULL) {
+	Tcl_SetObjResult(interp, Tcl_NewStringObj(
+		"the \"-channel\" and \"-command\" options cannot be used "
+		"together", -1));
+	Tcl_SetErrorCode(interp, "TK", "TEXT", "DUMP_CHANNEL", (char *)NULL);
+	return TCL_ERROR;
+    }
     if (what == 0) {
 	what = TK_DUMP_ALL;
     }
@@ -4821,6 +5910,9 @@ TextDumpCmd(
 
 	textChanged = DumpLine(interp, textPtr, what, index1.linePtr,
 		index1.byteIndex, 32000000, lineno, command);
+	if (DumpFlush(interp, chan, 0) != TCL_OK) {
+	    return TCL_ERROR;
+	}
 	if (textChanged) {
 	    if (textPtr->flags & DESTROYED) {
 		return TCL_OK;
@@ -4838,6 +5930,9 @@ TextDumpCmd(
 	    }
 	    textChanged = DumpLine(interp, textPtr, what, linePtr, 0,
 		    32000000, lineno, command);
+	    if (DumpFlush(interp, chan, 0) != TCL_OK) {
+		return TCL_ERROR;
+	    }
 	    if (textChanged) {
 		if (textPtr->flags & DESTROYED) {
 		    return TCL_OK;
@@ -4875,7 +5970,7 @@ TextDumpCmd(
 	DumpLine(interp, textPtr, what & ~TK_DUMP_TEXT, index2.linePtr,
 		0, 1, lineno, command);
     }
-    return TCL_OK;
+    return DumpFlush(interp, chan, 1);
 }
 
 /*
@@ -5139,6 +6234,72 @@ DumpSegment(
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * DumpFlush --
+ *
+ *	For "dump -channel": write the information collected in the result so
+ *	far to the channel, once there is enough of it or when forced to, so
+ *	that large dumps run in bounded memory.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The result is written to the channel and reset. Nothing happens if
+ *	chan is NULL.
+ *
+ *----------------------------------------------------------------------
+ */
+
+/*
+ * Number of list elements (three per segment) that "dump -channel" collects
+ * before writing them out.
+ */
+
+#define DUMP_BATCH_ELEMENTS (3 * 1024)
+
+static int
+DumpFlush(
+    Tcl_Interp *interp,		/* Interpreter holding the dump result. */
+    Tcl_Channel chan,		/* Channel to write to, or NULL. */
+    int force)			/* Write even a small batch. */
+{
+    Tcl_Obj *resultPtr;
+    Tcl_Size numElements;
+    int code;
+
+    if (chan == NULL) {
+	return TCL_OK;
+    }
+    resultPtr = Tcl_GetObjResult(interp);
+    if (Tcl_ListObjLength(NULL, resultPtr, &numElements) != TCL_OK
+	    || numElements == 0
+	    || (!force && numElements < DUMP_BATCH_ELEMENTS)) {
+	return TCL_OK;
+    }
+
+    /*
+     * Each batch is written as a list on a line of its own, so that what
+     * ends up in the channel is the list "dump" would have returned.
+     */
+
+    Tcl_IncrRefCount(resultPtr);
+    Tcl_ResetResult(interp);
+    code = Tcl_WriteObj(chan, resultPtr);
+    if (code >= 0) {
+	code = Tcl_WriteChars(chan, "\n", 1);
+    }
+    Tcl_DecrRefCount(resultPtr);
+    if (code < 0) {
+	Tcl_SetObjResult(interp, Tcl_ObjPrintf("error writing \"%s\": %s",
+		Tcl_GetChannelName(chan), Tcl_PosixError(interp)));
+	return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -5308,12 +6469,12 @@ TextEditCmd(
     int canUndo = 0;
 
     static const char *const editOptionStrings[] = {
-	"canundo", "canredo", "modified", "redo", "reset", "separator",
-	"undo", NULL
+	"canundo", "canredo", "info", "modified", "redo", "reset",
+	"separator", "undo", NULL
     };
     enum editOptions {
-	EDIT_CANUNDO, EDIT_CANREDO, EDIT_MODIFIED, EDIT_REDO, EDIT_RESET,
-	EDIT_SEPARATOR, EDIT_UNDO
+	EDIT_CANUNDO, EDIT_CANREDO, EDIT_INFO, EDIT_MODIFIED, EDIT_REDO,
+	EDIT_RESET, EDIT_SEPARATOR, EDIT_UNDO
     };
 
     if (objc < 3) {
@@ -5347,6 +6508,38 @@ TextEditCmd(
 	}
 	Tcl_SetObjResult(interp, Tcl_NewBooleanObj(canUndo));
 	break;
+    case EDIT_INFO: {
+	TkUndoRedoStack *stackPtr = textPtr->sharedTextPtr->undoStack;
+	TkUndoAtom *atomPtr;
+	Tcl_Size undoActions = 0, redoActions = 0;
+	Tcl_Obj *resultObj;
+
+	if (objc != 3) {
+	    Tcl_WrongNumArgs(interp, 3, objv, NULL);
+	    return TCL_ERROR;
+	}
+	for (atomPtr = stackPtr->undoStack; atomPtr != NULL;
+		atomPtr = atomPtr->next) {
+	    undoActions += (atomPtr->type == TK_UNDO_ACTION);
+	}
+	for (atomPtr = stackPtr->redoStack; atomPtr != NULL;
+		atomPtr = atomPtr->next) {
+	    redoActions += (atomPtr->type == TK_UNDO_ACTION);
+	}
+	resultObj = Tcl_NewObj();
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("undoactions", -1),
+		Tcl_NewWideIntObj(undoActions));
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("redoactions", -1),
+		Tcl_NewWideIntObj(redoActions));
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("undobytes", -1),
+		Tcl_NewWideIntObj(stackPtr->undoBytes));
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("redobytes", -1),
+		Tcl_NewWideIntObj(stackPtr->redoBytes));
+	Tcl_DictObjPut(NULL, resultObj, Tcl_NewStringObj("arenabytes", -1),
+		Tcl_NewWideIntObj(textPtr->sharedTextPtr->undoArenaBytes));
+	Tcl_SetObjResult(interp, resultObj);
+	break;
+    }
     case EDIT_MODIFIED:
 	if (objc == 3) {
 	    Tcl_SetObjResult(interp,
@@ -5515,6 +6708,103 @@ TextGetText(
     return resultPtr;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextGetWritableChannel --
+ *
+ *	Look up a channel given to the "-channel" option of "get" or "dump"
+ *	and check that it is open for writing.
+ *
+ * Results:
+ *	The channel, or NULL with an error message left in the interpreter.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Channel
+TextGetWritableChannel(
+    Tcl_Interp *interp,		/* Current interpreter. */
+    Tcl_Obj *nameObj)		/* Name of the channel. */
+{
+    int mode;
+    Tcl_Channel chan = Tcl_GetChannel(interp, Tcl_GetString(nameObj), &mode);
+
+    if (chan != NULL && !(mode & TCL_WRITABLE)) {
+	Tcl_SetObjResult(interp, Tcl_ObjPrintf(
+		"channel \"%s\" wasn't opened for writing",
+		Tcl_GetString(nameObj)));
+	Tcl_SetErrorCode(interp, "TK", "TEXT", "UNWRITABLE", (char *)NULL);
+	chan = NULL;
+    }
+    return chan;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextWriteText --
+ *
+ *	Write the text between two indices to a channel, for "get -channel".
+ *	The text is fetched by TextGetText a few lines at a time, so a range
+ *	of any size is written in bounded memory.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Characters are written to the channel.
+ *
+ *----------------------------------------------------------------------
+ */
+
+/*
+ * Number of lines that TextWriteText fetches at a time.
+ */
+
+#define WRITE_BATCH_LINES 256
+
+static int
+TextWriteText(
+    Tcl_Interp *interp,		/* Current interpreter. */
+    const TkText *textPtr,	/* Information about text widget. */
+    const TkTextIndex *indexPtr1,
+				/* Write text from this index... */
+    const TkTextIndex *indexPtr2,
+				/* ...to this index. */
+    int visibleOnly,		/* If non-zero, then only write non-elided
+				 * characters. */
+    Tcl_Channel chan)		/* Channel to write to. */
+{
+    TkTextIndex index, nextIndex;
+    Tcl_Obj *get;
+    int code;
+
+    index = *indexPtr1;
+    while (TkTextIndexCmp(&index, indexPtr2) < 0) {
+	TkTextMakeByteIndex(index.tree, textPtr,
+		TkBTreeLinesTo(textPtr, index.linePtr) + WRITE_BATCH_LINES, 0,
+		&nextIndex);
+	if (TkTextIndexCmp(&nextIndex, indexPtr2) > 0) {
+	    nextIndex = *indexPtr2;
+	}
+	get = TextGetText(textPtr, &index, &nextIndex, visibleOnly);
+	Tcl_IncrRefCount(get);
+	code = Tcl_WriteObj(chan, get);
+	Tcl_DecrRefCount(get);
+	if (code < 0) {
+	    Tcl_SetObjResult(interp, Tcl_ObjPrintf("error writing \"%s\": %s",
+		    Tcl_GetChannelName(chan), Tcl_PosixError(interp)));
+	    return TCL_ERROR;
+	}
+	index = nextIndex;
+    }
+    return TCL_OK;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -5761,6 +7051,50 @@ SearchPerform(
     return SearchCore(interp, searchSpecPtr, patObj);
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SearchExactBackwards --
+ *
+ *	Finds the last occurrence of an exact pattern in a string which starts
+ *	at or after firstOffset and at or before fromOffset, using the skip
+ *	table set up by SearchCore.
+ *
+ * Results:
+ *	A pointer to the start of the occurrence, or NULL if there is none.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static const char *
+SearchExactBackwards(
+    const char *string,		/* String to search in... */
+    Tcl_Size length,		/* ...and its length in bytes. */
+    Tcl_Size firstOffset,	/* Earliest offset a match may start at. */
+    Tcl_Size fromOffset,	/* Latest offset a match may start at. */
+    const char *pattern,	/* Pattern to look for... */
+    Tcl_Size patLength,		/* ...and its length, which is not 0. */
+    const Tcl_Size *skip)	/* Distance to move left, indexed by the byte
+				 * under the first character of the pattern. */
+{
+    Tcl_Size i = length - patLength;
+
+    if (fromOffset < i) {
+	i = fromOffset;
+    }
+    while (i >= firstOffset) {
+	if (string[i] == pattern[0]
+		&& memcmp(string + i, pattern, patLength) == 0) {
+	    return string + i;
+	}
+	i -= skip[(unsigned char)string[i]];
+    }
+    return NULL;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -5815,6 +7149,7 @@ SearchCore(
 
     const char *pattern = NULL;	/* For exact searches only. */
     int firstNewLine = -1;	/* For exact searches only. */
+    Tcl_Size backSkip[256];	/* For backward exact searches only. */
     Tcl_RegExp regexp = NULL;	/* For regexp searches only. */
 
     /*
@@ -5891,6 +7226,24 @@ SearchCore(
 	if (nl != NULL && nl[1] != '\0') {
 	    firstNewLine = (nl - pattern);
 	}
+
+	/*
+	 * Backward single line searches skip ahead (towards the start of the
+	 * line) with a reversed Boyer-Moore-Horspool table: by the distance
+	 * from the start of the pattern to the nearest later occurrence of
+	 * the character under its first position.
+	 */
+
+	if (searchSpecPtr->backwards && firstNewLine == -1) {
+	    Tcl_Size i;
+
+	    for (i = 0; i < 256; i++) {
+		backSkip[i] = matchLength;
+	    }
+	    for (i = matchLength - 1; i > 0; i--) {
+		backSkip[(unsigned char)pattern[i]] = i;
+	    }
+	}
     } else {
 	matchLength = 0;	/* Only needed to prevent compiler warnings. */
     }
@@ -6038,22 +7391,28 @@ SearchCore(
 			 * match.
 			 */
 
-			const char c = matchLength ? pattern[0] : '\0';
+			Tcl_Size from;
 
 			if (alreadySearchOffset >= 0) {
-			    p = startOfLine + alreadySearchOffset;
+			    from = alreadySearchOffset;
 			    alreadySearchOffset = -1;
 			} else {
-			    p = startOfLine + lastOffset -1;
+			    from = lastOffset - 1;
 			}
-			while (p >= startOfLine + firstOffset) {
-			    if (matchLength == 0 || (p[0] == c && !strncmp(
-				     p, pattern, matchLength))) {
-				goto backwardsMatch;
+			if (matchLength == 0) {
+			    if (from < firstOffset) {
+				break;
 			    }
-			    p--;
+			    p = startOfLine + from;
+			    goto backwardsMatch;
 			}
-			break;
+			p = SearchExactBackwards(startOfLine, theLine->length,
+				firstOffset, from, pattern, matchLength,
+				backSkip);
+			if (p == NULL) {
+			    break;
+			}
+			goto backwardsMatch;
 		    } else {
 			p = strstr(startOfLine + firstOffset, pattern);
 		    }
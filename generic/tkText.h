@@ -204,6 +204,13 @@ typedef struct TkTextIndex {
 				 * widget. */
 } TkTextIndex;
 
+/*
+ * Token for a bulk load of text into a B-tree, see TkBTreeLoadBegin. The
+ * structure is private to tkTextBTree.c.
+ */
+
+typedef struct TkTextLoad TkTextLoad;
+
 /*
  * Types for procedure pointers stored in TkTextDispChunk strutures:
  */
@@ -561,8 +568,16 @@ typedef struct TkSharedText {
     int maxUndo;		/* The maximum depth of the undo stack
 				 * expressed as the maximum number of compound
 				 * statements. */
+    int maxUndoBytes;		/* The maximum number of bytes the undo stack
+				 * may use, or 0 for no limit. */
     int autoSeparators;		/* Non-zero means the separators will be
 				 * inserted automatically. */
+    struct TkTextUndoChunk *undoChunkPtr;
+				/* Chunk of the undo string arena that new
+				 * undo records are currently appended to, or
+				 * NULL. */
+    Tcl_Size undoArenaBytes;	/* Total size of the live chunks of the undo
+				 * string arena. */
     int isDirty;		/* Flag indicating the 'dirtyness' of the
 				 * text widget. If the flag is not zero,
 				 * unsaved modifications have been applied to
@@ -685,6 +700,8 @@ typedef struct TkText {
     Tcl_Obj *heightObj;
     int setGrid;		/* Non-zero means pass gridding information to
 				 * window manager. */
+    int metricsThread;		/* Non-zero means the heights of plain lines
+				 * are computed on a worker thread. */
     int prevWidth, prevHeight;	/* Last known dimensions of window; used to
 				 * detect changes in size. */
     TkTextIndex topIndex;	/* Identifies first character in top display
@@ -782,8 +799,13 @@ typedef struct TkText {
     int maxUndo;		/* The maximum depth of the undo stack
 				 * expressed as the maximum number of compound
 				 * statements. */
+    int maxUndoBytes;		/* The maximum number of bytes the undo stack
+				 * may use, or 0 for no limit. */
     int autoSeparators;		/* Non-zero means the separators will be
 				 * inserted automatically. */
+    Tcl_Obj *undoPathObj;	/* Path name of the widget, shared by the
+				 * undo records of the edits made through it.
+				 * NULL until first needed. */
     Tcl_Obj *afterSyncCmd;	/* Command to be executed when lines are up to
 				 * date */
 } TkText;
@@ -1007,6 +1029,10 @@ MODULE_SCOPE void	TkBTreeInsertChars(TkTextBTree tree,
 			    TkTextIndex *indexPtr, const char *string);
 MODULE_SCOPE int	TkBTreeLinesTo(const TkText *textPtr,
 			    TkTextLine *linePtr);
+MODULE_SCOPE TkTextLoad *TkBTreeLoadBegin(TkTextBTree tree);
+MODULE_SCOPE void	TkBTreeLoadChars(TkTextLoad *loadPtr,
+			    const char *string, Tcl_Size length);
+MODULE_SCOPE void	TkBTreeLoadEnd(TkTextLoad *loadPtr);
 MODULE_SCOPE int	TkBTreePixelsTo(const TkText *textPtr,
 			    TkTextLine *linePtr);
 MODULE_SCOPE void	TkBTreeLinkSegment(TkTextSegment *segPtr,
@@ -94,6 +94,14 @@ typedef struct Node {
 #define MAX_CHILDREN 12
 #define MIN_CHILDREN 6
 
+/*
+ * Number of children given to each node when a tree is built bottom-up by
+ * TkBTreeLoadEnd: halfway between the limits, so that neither insertions nor
+ * deletions make the new nodes split or merge right away.
+ */
+
+#define LOAD_CHILDREN ((MIN_CHILDREN + MAX_CHILDREN) / 2)
+
 /*
  * The data structure below defines an entire B-tree. Since text widgets are
  * the only current B-tree clients, 'clients' and 'pixelReferences' are
@@ -130,6 +138,22 @@ typedef struct TagInfo {
 				 * tags. Malloc-ed. */
 } TagInfo;
 
+/*
+ * The structure below holds the lines read so far by a bulk load, between
+ * TkBTreeLoadBegin and TkBTreeLoadEnd:
+ */
+
+struct TkTextLoad {
+    BTree *treePtr;		/* Tree being loaded. */
+    TkTextLine *firstPtr;	/* First complete line read so far, or NULL.
+				 * The lines are linked through their nextPtr
+				 * fields and belong to no node yet. */
+    TkTextLine *lastPtr;	/* Last complete line read so far. */
+    int numLines;		/* Number of lines in that list. */
+    Tcl_DString partial;	/* Characters after the last newline read so
+				 * far. */
+};
+
 /*
  * Variable that indicates whether to enable consistency checks for debugging.
  */
@@ -172,6 +196,7 @@ static void		IncCount(TkTextTag *tagPtr, int inc,
 			    TagInfo *tagInfoPtr);
 static void		Rebalance(BTree *treePtr, Node *nodePtr);
 static void		RecomputeNodeCounts(BTree *treePtr, Node *nodePtr);
+static void		SumNodeCounts(BTree *treePtr, Node *nodePtr);
 static void		RemovePixelClient(BTree *treePtr, Node *nodePtr,
 			    int overwriteWithLast);
 static TkTextSegment *	SplitSeg(TkTextIndex *indexPtr);
@@ -1165,6 +1190,338 @@ TkBTreeInsertChars(
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeLoadBegin --
+ *
+ *	Start loading text into an empty B-tree. The text is handed over in
+ *	pieces with TkBTreeLoadChars and put into the tree by TkBTreeLoadEnd,
+ *	which builds the nodes bottom-up instead of inserting and rebalancing
+ *	one line at a time.
+ *
+ * Results:
+ *	A token to pass to TkBTreeLoadChars and TkBTreeLoadEnd.
+ *
+ * Side effects:
+ *	Memory is allocated. The tree must hold nothing but its two empty
+ *	lines when TkBTreeLoadEnd is called, and must not be changed in
+ *	between.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TkTextLoad *
+TkBTreeLoadBegin(
+    TkTextBTree tree)		/* Tree to load into. */
+{
+    TkTextLoad *loadPtr = (TkTextLoad *)ckalloc(sizeof(TkTextLoad));
+
+    loadPtr->treePtr = (BTree *) tree;
+    loadPtr->firstPtr = NULL;
+    loadPtr->lastPtr = NULL;
+    loadPtr->numLines = 0;
+    Tcl_DStringInit(&loadPtr->partial);
+    return loadPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeLoadChars --
+ *
+ *	Add the next piece of text to a load started by TkBTreeLoadBegin. The
+ *	pieces may be split anywhere, except within a UTF-8 sequence.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	A new line is made for every newline in the text; the characters after
+ *	the last newline are kept until more text or the end of the load.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkBTreeLoadChars(
+    TkTextLoad *loadPtr,	/* Load in progress. */
+    const char *string,		/* Characters to add; need not be
+				 * null-terminated. */
+    Tcl_Size length)		/* Number of bytes in string. */
+{
+    BTree *treePtr = loadPtr->treePtr;
+    TkTextLine *linePtr, *firstLinePtr;
+    TkTextSegment *segPtr;
+    const char *eol, *chars;
+    Tcl_Size chunkSize;
+    int ref;
+
+    firstLinePtr = treePtr->rootPtr->children.linePtr;
+    while (length > 0) {
+	eol = (const char *)memchr(string, '\n', length);
+	if (eol == NULL) {
+	    Tcl_DStringAppend(&loadPtr->partial, string, length);
+	    return;
+	}
+	eol++;
+	if (Tcl_DStringLength(&loadPtr->partial) > 0) {
+	    Tcl_DStringAppend(&loadPtr->partial, string, eol - string);
+	    chars = Tcl_DStringValue(&loadPtr->partial);
+	    chunkSize = Tcl_DStringLength(&loadPtr->partial);
+	} else {
+	    chars = string;
+	    chunkSize = eol - string;
+	}
+
+	segPtr = (TkTextSegment *)ckalloc(CSEG_SIZE(chunkSize));
+	segPtr->typePtr = &tkTextCharType;
+	segPtr->nextPtr = NULL;
+	segPtr->size = chunkSize;
+	memcpy(segPtr->body.chars, chars, chunkSize);
+	segPtr->body.chars[chunkSize] = 0;
+
+	/*
+	 * As for insertions, the new line starts out with the height of the
+	 * line the text goes into, until the display code measures it.
+	 */
+
+	linePtr = (TkTextLine *)ckalloc(sizeof(TkTextLine));
+	linePtr->pixels = (int *)
+		ckalloc(sizeof(int) * 2 * treePtr->pixelReferences);
+	for (ref = 0; ref < treePtr->pixelReferences; ref++) {
+	    linePtr->pixels[2 * ref] = firstLinePtr->pixels[2 * ref];
+	    linePtr->pixels[2 * ref + 1] = 0;
+	}
+	linePtr->parentPtr = NULL;
+	linePtr->nextPtr = NULL;
+	linePtr->segPtr = segPtr;
+	if (loadPtr->lastPtr == NULL) {
+	    loadPtr->firstPtr = linePtr;
+	} else {
+	    loadPtr->lastPtr->nextPtr = linePtr;
+	}
+	loadPtr->lastPtr = linePtr;
+	loadPtr->numLines++;
+
+	Tcl_DStringSetLength(&loadPtr->partial, 0);
+	length -= eol - string;
+	string = eol;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeLoadEnd --
+ *
+ *	Finish a load started by TkBTreeLoadBegin: the text is put into the
+ *	tree as if it had been inserted at the start of its first line, and
+ *	the nodes above the lines are built level by level with LOAD_CHILDREN
+ *	children each, so the tree needs no rebalancing.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The B-tree gets a new structure, the line metrics of the new lines
+ *	are invalidated and the token is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkBTreeLoadEnd(
+    TkTextLoad *loadPtr)	/* Load to finish. */
+{
+    BTree *treePtr = loadPtr->treePtr;
+    Node *rootPtr = treePtr->rootPtr;
+    Node *nodePtr, *nodePtr2, *childPtr, *firstNodePtr, *lastNodePtr;
+    Summary *summaryPtr, *summaryPtr2, **prevPtrPtr;
+    TkTextLine *firstLinePtr, *tailPtr, *dummyPtr, *linePtr, *nextLinePtr;
+    TkTextSegment *prevPtr, *restPtr, *segPtr;
+    TkTextTag *tagPtr;
+    TkTextIndex index;
+    const char *partial = Tcl_DStringValue(&loadPtr->partial);
+    Tcl_Size partialLength = Tcl_DStringLength(&loadPtr->partial);
+    int count, numNodes, numChildren, i, j;
+    Tcl_Size level;
+
+    if (rootPtr->level != 0 || rootPtr->numLines != 2) {
+	Tcl_Panic("TkBTreeLoadEnd: tree isn't empty");
+    }
+    treePtr->stateEpoch++;
+    firstLinePtr = rootPtr->children.linePtr;
+    index.tree = (TkTextBTree) treePtr;
+    index.linePtr = firstLinePtr;
+    index.byteIndex = 0;
+    index.textPtr = NULL;
+
+    if (loadPtr->firstPtr == NULL) {
+	/*
+	 * Not a single newline: this is an ordinary insertion.
+	 */
+
+	if (partialLength > 0) {
+	    TkBTreeInsertChars(index.tree, &index, partial);
+	}
+	goto done;
+    }
+
+    /*
+     * The first new line goes into the first line of the tree, behind any
+     * marks with left gravity. The rest of that line moves to the end of
+     * the new text, into the line record of the first new line, together
+     * with the characters after the last newline.
+     */
+
+    prevPtr = SplitSeg(&index);
+    tailPtr = loadPtr->firstPtr;
+    if (prevPtr == NULL) {
+	restPtr = firstLinePtr->segPtr;
+	firstLinePtr->segPtr = tailPtr->segPtr;
+    } else {
+	restPtr = prevPtr->nextPtr;
+	prevPtr->nextPtr = tailPtr->segPtr;
+    }
+    if (partialLength > 0) {
+	segPtr = (TkTextSegment *)ckalloc(CSEG_SIZE(partialLength));
+	segPtr->typePtr = &tkTextCharType;
+	segPtr->nextPtr = restPtr;
+	segPtr->size = partialLength;
+	memcpy(segPtr->body.chars, partial, partialLength);
+	segPtr->body.chars[partialLength] = 0;
+	restPtr = segPtr;
+    }
+    tailPtr->segPtr = restPtr;
+    dummyPtr = firstLinePtr->nextPtr;
+    if (tailPtr == loadPtr->lastPtr) {
+	firstLinePtr->nextPtr = tailPtr;
+    } else {
+	firstLinePtr->nextPtr = tailPtr->nextPtr;
+	loadPtr->lastPtr->nextPtr = tailPtr;
+    }
+    tailPtr->nextPtr = dummyPtr;
+    tailPtr->parentPtr = rootPtr;
+    CleanupLine(firstLinePtr);
+    CleanupLine(tailPtr);
+
+    /*
+     * Build the tree one level at a time, spreading the children evenly
+     * over as few nodes as LOAD_CHILDREN allows, until they fit into the
+     * root. The root node is kept, since tags may refer to it.
+     */
+
+    count = rootPtr->numLines + loadPtr->numLines;
+    level = 0;
+    linePtr = firstLinePtr;
+    childPtr = NULL;
+    while (count > MAX_CHILDREN) {
+	numNodes = (count + LOAD_CHILDREN - 1) / LOAD_CHILDREN;
+	firstNodePtr = lastNodePtr = NULL;
+	for (i = 0; i < numNodes; i++) {
+	    numChildren = count / numNodes + (i < count % numNodes);
+	    nodePtr = (Node *)ckalloc(sizeof(Node));
+	    nodePtr->parentPtr = NULL;
+	    nodePtr->nextPtr = NULL;
+	    nodePtr->summaryPtr = NULL;
+	    nodePtr->level = level;
+	    nodePtr->numPixels = (int *)
+		    ckalloc(sizeof(int) * treePtr->pixelReferences);
+	    if (level == 0) {
+		nodePtr->children.linePtr = linePtr;
+		for (j = 1; j < numChildren; j++) {
+		    linePtr = linePtr->nextPtr;
+		}
+		nextLinePtr = linePtr->nextPtr;
+		linePtr->nextPtr = NULL;
+		linePtr = nextLinePtr;
+	    } else {
+		nodePtr->children.nodePtr = childPtr;
+		for (j = 1; j < numChildren; j++) {
+		    childPtr = childPtr->nextPtr;
+		}
+		nodePtr2 = childPtr->nextPtr;
+		childPtr->nextPtr = NULL;
+		childPtr = nodePtr2;
+	    }
+	    SumNodeCounts(treePtr, nodePtr);
+	    if (firstNodePtr == NULL) {
+		firstNodePtr = nodePtr;
+	    } else {
+		lastNodePtr->nextPtr = nodePtr;
+	    }
+	    lastNodePtr = nodePtr;
+	}
+	childPtr = firstNodePtr;
+	count = numNodes;
+	level++;
+    }
+    rootPtr->level = level;
+    if (level == 0) {
+	rootPtr->children.linePtr = firstLinePtr;
+    } else {
+	rootPtr->children.nodePtr = childPtr;
+    }
+    SumNodeCounts(treePtr, rootPtr);
+
+    /*
+     * Tags toggled on the lines that were there before need their root
+     * node: the lowest node holding all their toggles. That node and the
+     * nodes above it keep no summary for the tag.
+     */
+
+    for (summaryPtr = rootPtr->summaryPtr; summaryPtr != NULL;
+	    summaryPtr = summaryPtr->nextPtr) {
+	tagPtr = summaryPtr->tagPtr;
+	if (summaryPtr->toggleCount == 0) {
+	    continue;
+	}
+	nodePtr = rootPtr;
+	while (nodePtr->level > 0) {
+	    for (nodePtr2 = nodePtr->children.nodePtr; nodePtr2 != NULL;
+		    nodePtr2 = nodePtr2->nextPtr) {
+		for (summaryPtr2 = nodePtr2->summaryPtr;
+			summaryPtr2 != NULL && summaryPtr2->tagPtr != tagPtr;
+			summaryPtr2 = summaryPtr2->nextPtr) {
+		    /* Empty loop body. */
+		}
+		if (summaryPtr2 != NULL
+			&& summaryPtr2->toggleCount == tagPtr->toggleCount) {
+		    break;
+		}
+	    }
+	    if (nodePtr2 == NULL) {
+		break;
+	    }
+	    nodePtr = nodePtr2;
+	}
+	tagPtr->tagRootPtr = nodePtr;
+	for ( ; nodePtr != rootPtr; nodePtr = nodePtr->parentPtr) {
+	    for (prevPtrPtr = &nodePtr->summaryPtr;
+		    (*prevPtrPtr)->tagPtr != tagPtr;
+		    prevPtrPtr = &(*prevPtrPtr)->nextPtr) {
+		/* Empty loop body. */
+	    }
+	    summaryPtr2 = *prevPtrPtr;
+	    *prevPtrPtr = summaryPtr2->nextPtr;
+	    ckfree(summaryPtr2);
+	}
+    }
+    DeleteSummaries(rootPtr->summaryPtr);
+    rootPtr->summaryPtr = NULL;
+
+    TkTextInvalidateLineMetrics(treePtr->sharedTextPtr, NULL, firstLinePtr,
+	    loadPtr->numLines, TK_TEXT_INVALIDATE_INSERT);
+
+  done:
+    Tcl_DStringFree(&loadPtr->partial);
+    ckfree(loadPtr);
+    if (tkBTreeDebug) {
+	TkBTreeCheck((TkTextBTree) treePtr);
+    }
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -4352,6 +4709,77 @@ RecomputeNodeCounts(
 				 * recomputed. */
 {
     Summary *summaryPtr, *summaryPtr2;
+
+    SumNodeCounts(treePtr, nodePtr);
+
+    /*
+     * Scan through the node's tag records again and delete any Summary
+     * records that still have a zero count, or that have all the toggles.
+     * The node with the children that account for all the tags toggles have
+     * no summary information, and they become the tagRootPtr for the tag.
+     */
+
+    summaryPtr2 = NULL;
+    for (summaryPtr = nodePtr->summaryPtr; summaryPtr != NULL; ) {
+	if (summaryPtr->toggleCount > 0 &&
+		summaryPtr->toggleCount < summaryPtr->tagPtr->toggleCount) {
+	    if (nodePtr->level == summaryPtr->tagPtr->tagRootPtr->level) {
+		/*
+		 * The tag's root node split and some toggles left. The tag
+		 * root must move up a level.
+		 */
+
+		summaryPtr->tagPtr->tagRootPtr = nodePtr->parentPtr;
+	    }
+	    summaryPtr2 = summaryPtr;
+	    summaryPtr = summaryPtr->nextPtr;
+	    continue;
+	}
+	if (summaryPtr->toggleCount == summaryPtr->tagPtr->toggleCount) {
+	    /*
+	     * A node merge has collected all the toggles under one node. Push
+	     * the root down to this level.
+	     */
+
+	    summaryPtr->tagPtr->tagRootPtr = nodePtr;
+	}
+	if (summaryPtr2 != NULL) {
+	    summaryPtr2->nextPtr = summaryPtr->nextPtr;
+	    ckfree(summaryPtr);
+	    summaryPtr = summaryPtr2->nextPtr;
+	} else {
+	    nodePtr->summaryPtr = summaryPtr->nextPtr;
+	    ckfree(summaryPtr);
+	    summaryPtr = nodePtr->summaryPtr;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SumNodeCounts --
+ *
+ *	Recompute the counts of a node from its children, like
+ *	RecomputeNodeCounts, but leave the tag summaries alone once summed:
+ *	records with no toggles are kept and no tag root is moved.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The counts of nodePtr are recomputed and the childrens' parentPtr
+ *	fields are made to point to nodePtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SumNodeCounts(
+    BTree *treePtr,	/* The whole B-tree. */
+    Node *nodePtr)	/* Node whose counts must be recomputed. */
+{
+    Summary *summaryPtr, *summaryPtr2;
     Node *childPtr;
     TkTextLine *linePtr;
     TkTextSegment *segPtr;
@@ -4441,48 +4869,6 @@ RecomputeNodeCounts(
 	    }
 	}
     }
-
-    /*
-     * Scan through the node's tag records again and delete any Summary
-     * records that still have a zero count, or that have all the toggles.
-     * The node with the children that account for all the tags toggles have
-     * no summary information, and they become the tagRootPtr for the tag.
-     */
-
-    summaryPtr2 = NULL;
-    for (summaryPtr = nodePtr->summaryPtr; summaryPtr != NULL; ) {
-	if (summaryPtr->toggleCount > 0 &&
-		summaryPtr->toggleCount < summaryPtr->tagPtr->toggleCount) {
-	    if (nodePtr->level == summaryPtr->tagPtr->tagRootPtr->level) {
-		/*
-		 * The tag's root node split and some toggles left. The tag
-		 * root must move up a level.
-		 */
-
-		summaryPtr->tagPtr->tagRootPtr = nodePtr->parentPtr;
-	    }
-	    summaryPtr2 = summaryPtr;
-	    summaryPtr = summaryPtr->nextPtr;
-	    continue;
-	}
-	if (summaryPtr->toggleCount == summaryPtr->tagPtr->toggleCount) {
-	    /*
-	     * A node merge has collected all the toggles under one node. Push
-	     * the root down to this level.
-	     */
-
-	    summaryPtr->tagPtr->tagRootPtr = nodePtr;
-	}
-	if (summaryPtr2 != NULL) {
-	    summaryPtr2->nextPtr = summaryPtr->nextPtr;
-	    ckfree(summaryPtr);
-	    summaryPtr = summaryPtr2->nextPtr;
-	} else {
-	    nodePtr->summaryPtr = summaryPtr->nextPtr;
-	    ckfree(summaryPtr);
-	    summaryPtr = nodePtr->summaryPtr;
-	}
-    }
 }
 
 /*
@@ -180,6 +180,92 @@ typedef struct TextStyle {
 				 * delete entry. */
 } TextStyle;
 
+/*
+ * GetStyle keeps the set of tags that apply at the position it was last
+ * called for in the structure below. Display lines are laid out from left to
+ * right and mostly one after the other, so the next position is usually
+ * close behind: the set is brought up to date by applying the tag toggles in
+ * between, rather than collected from the B-tree from scratch, and the style
+ * is reused as long as no toggle is passed.
+ */
+
+typedef struct TagRun {
+    Tcl_Size epoch;		/* B-tree epoch for which the run is valid. */
+    TkTextLine *linePtr;	/* Line of the position the tag set is for;
+				 * NULL means there is no tag set. */
+    Tcl_Size byteIndex;		/* Byte index of that position in linePtr. */
+    TkTextSegment *segPtr;	/* First segment of linePtr that ends after
+				 * byteIndex, whose toggles are not in the
+				 * set. Segments only keep still during one
+				 * call to LayoutDLine, so NULL means it must
+				 * be looked up again. */
+    Tcl_Size segOffset;		/* Byte offset of segPtr in linePtr. */
+    TkTextTag **tagPtrs;	/* The tags that apply, in no order. */
+    Tcl_Size numTags;		/* Number of tags in tagPtrs. */
+    Tcl_Size tagSpace;		/* Number of slots allocated for tagPtrs. */
+    TextStyle *stylePtr;	/* Style computed for the tag set, holding a
+				 * reference, or NULL. */
+    int focus;			/* GOT_FOCUS flag of the widget when
+				 * stylePtr was computed. */
+} TagRun;
+
+/*
+ * Beyond this many lines it is cheaper to look up the tags of a position in
+ * the B-tree than to walk the toggles from the last position.
+ */
+
+#define TAG_RUN_MAX_LINES 8
+
+/*
+ * When the -metricsthread option is set, the heights of plain lines (nothing
+ * but printable ASCII characters in the widget's own font, with no tag that
+ * changes the geometry) are computed on a worker thread. The main thread
+ * copies a batch of such lines into a MetricsJob together with everything
+ * the layout depends on; the worker fills in the heights and sends the job
+ * back as an event, and the heights are merged into the B-tree on the main
+ * thread. Lines that are not plain are left to the usual
+ * AsyncUpdateLineMetrics pass.
+ */
+
+#define METRICS_JOB_LINES	8192	/* Most lines in one job. */
+#define METRICS_JOB_BYTES	(1 << 20)
+					/* Most characters in one job. */
+#define METRICS_SCAN_LINES	32768	/* Most lines examined while building
+					 * one job. */
+#define METRICS_FIRST_CHAR	0x20
+#define METRICS_NUM_CHARS	(0x7F - METRICS_FIRST_CHAR)
+
+typedef struct MetricsJob {
+    Tcl_Event header;		/* Must be first: the finished job is queued
+				 * back to the widget's thread as an event. */
+    struct MetricsJob *nextPtr;	/* Next job waiting for the worker. */
+    TkText *textPtr;		/* Widget the job belongs to. The job holds a
+				 * reference to it. */
+    Tcl_ThreadId owner;		/* Thread the widget lives in. */
+    int cancelled;		/* Non-zero means the lines of the job have
+				 * changed since it was built, so its results
+				 * must be dropped. Only touched by the owner
+				 * thread. */
+    int firstLine, lastLine;	/* Range of line numbers the job covers. */
+    int numLines;		/* Number of lines in the job. */
+    TkTextLine **lines;		/* The lines measured. Only used by the owner
+				 * thread, when merging. */
+    int *starts;		/* Offset of each line in chars, plus one
+				 * extra entry for the end. */
+    char *chars;		/* Copy of the characters of all the lines,
+				 * each including its newline. */
+    int *heights;		/* Pixel height of each line, filled in by the
+				 * worker. */
+    int widths[METRICS_NUM_CHARS];
+				/* Width of each printable ASCII character in
+				 * the widget's font. */
+    int lineHeight;		/* Ascent plus descent of the font. */
+    int spacing1, spacing2, spacing3;
+				/* Spacing options of the widget. */
+    int maxX;			/* Width available for the line. */
+    TkWrapMode wrapMode;	/* Wrap mode of the widget. */
+} MetricsJob;
+
 /*
  * The following macro determines whether two styles have the same background
  * so that, for example, no beveled border should be drawn between them.
@@ -309,6 +395,8 @@ typedef struct DLine {
 typedef struct TextDInfo {
     Tcl_HashTable styleTable;	/* Hash table that maps from StyleValues to
 				 * TextStyles for this widget. */
+    TagRun tagRun;		/* Tags at the last position GetStyle was
+				 * called for. */
     DLine *dLinePtr;		/* First in list of all display lines for this
 				 * widget, in order from top to bottom. */
     int topPixelOffset;		/* Identifies first pixel in top display line
@@ -419,6 +507,11 @@ typedef struct TextDInfo {
     Tcl_TimerToken lineUpdateTimer;
 				/* A token pointing to the current line metric
 				 * update callback. */
+    MetricsJob *metricsJob;	/* Job handed to the metrics thread whose
+				 * results haven't come back yet, or NULL. */
+    int metricsScanLine;	/* Line at which the next metrics job starts,
+				 * or -1 to start at the current update
+				 * line. */
     Tcl_TimerToken scrollbarTimer;
 				/* A token pointing to the current scrollbar
 				 * update callback. */
@@ -568,7 +661,7 @@ static DLine *		FindDLine(TkText *textPtr, DLine *dlPtr,
 static void		FreeDLines(TkText *textPtr, DLine *firstPtr,
 			    DLine *lastPtr, int action);
 static void		FreeStyle(TkText *textPtr, TextStyle *stylePtr);
-static TextStyle *	GetStyle(const TkText *textPtr, const TkTextIndex *indexPtr);
+static TextStyle *	GetStyle(TkText *textPtr, const TkTextIndex *indexPtr);
 static void		GetXView(Tcl_Interp *interp, const TkText *textPtr,
 			    int report);
 static void		GetYView(Tcl_Interp *interp, TkText *textPtr,
@@ -596,6 +689,10 @@ static void		TextInvalidateRegion(TkText *textPtr, TkRegion region);
 static void		TextRedrawTag(TkText *textPtr,
 			    TkTextIndex *index1Ptr, TkTextIndex *index2Ptr,
 			    TkTextTag *tagPtr, int withTag);
+static void		TagRunReset(TkText *textPtr);
+static void		TagRunSeek(TkText *textPtr,
+			    const TkTextIndex *indexPtr);
+static void		TagRunToggle(TkText *textPtr, TkTextTag *tagPtr);
 static void		TextInvalidateLineMetrics(TkText *textPtr,
 			    TkTextLine *linePtr, int lineCount, TkTextInvalidateAction action);
 static int		CalculateDisplayLineHeight(TkText *textPtr,
@@ -610,6 +707,16 @@ static int		TextGetScrollInfoObj(Tcl_Interp *interp,
 			    Tcl_Obj *const objv[], double *dblPtr,
 			    int *intPtr);
 static void		AsyncUpdateLineMetrics(void *clientData);
+static void		CancelMetricsJob(TkText *textPtr);
+static int		MetricsJobDone(Tcl_Event *evPtr, int flags);
+static int		MetricsLineIsPlain(TkText *textPtr,
+			    TkTextLine *linePtr, TkTextTag **tagPtrs,
+			    int numTags);
+static void		MetricsMeasureLines(MetricsJob *jobPtr);
+static Tcl_ThreadCreateType MetricsThreadProc(void *clientData);
+static void		MetricsWorkerExitProc(void *clientData);
+static int		StartMetricsJob(TkText *textPtr, int fromLine,
+			    int toLine);
 static void		GenerateWidgetViewSyncEvent(TkText *textPtr, Bool InSync);
 static void		AsyncUpdateYScrollbar(void *clientData);
 static int              IsStartOfNotMergedLine(const TkText *textPtr,
@@ -652,6 +759,7 @@ TkTextCreateDInfo(
 
     dInfoPtr = (TextDInfo *)ckalloc(sizeof(TextDInfo));
     Tcl_InitHashTable(&dInfoPtr->styleTable, sizeof(StyleValues)/sizeof(int));
+    memset(&dInfoPtr->tagRun, 0, sizeof(TagRun));
     dInfoPtr->dLinePtr = NULL;
     dInfoPtr->copyGC = NULL;
     gcValues.graphics_exposures = True;
@@ -680,6 +788,8 @@ TkTextCreateDInfo(
     dInfoPtr->metricIndex.textPtr = NULL;
     dInfoPtr->metricIndex.linePtr = NULL;
     dInfoPtr->lineUpdateTimer = NULL;
+    dInfoPtr->metricsJob = NULL;
+    dInfoPtr->metricsScanLine = -1;
     dInfoPtr->scrollbarTimer = NULL;
 
     textPtr->dInfoPtr = dInfoPtr;
@@ -716,6 +826,10 @@ TkTextFreeDInfo(
      */
 
     FreeDLines(textPtr, dInfoPtr->dLinePtr, NULL, DLINE_UNLINK);
+    TagRunReset(textPtr);
+    if (dInfoPtr->tagRun.tagPtrs != NULL) {
+	ckfree(dInfoPtr->tagRun.tagPtrs);
+    }
     Tcl_DeleteHashTable(&dInfoPtr->styleTable);
     if (dInfoPtr->copyGC != NULL) {
 	Tk_FreeGC(textPtr->display, dInfoPtr->copyGC);
@@ -729,6 +843,7 @@ TkTextFreeDInfo(
 	textPtr->refCount--;
 	dInfoPtr->lineUpdateTimer = NULL;
     }
+    CancelMetricsJob(textPtr);
     if (dInfoPtr->scrollbarTimer != NULL) {
 	Tcl_DeleteTimerHandler(dInfoPtr->scrollbarTimer);
 	textPtr->refCount--;
@@ -750,17 +865,19 @@ TkTextFreeDInfo(
  *	corresponds to *sValuePtr.
  *
  * Side effects:
- *	A new entry may be created in the style table for the widget.
+ *	A new entry may be created in the style table for the widget. The tag
+ *	run of the widget moves to the given index.
  *
  *----------------------------------------------------------------------
  */
 
 static TextStyle *
 GetStyle(
-    const TkText *textPtr,		/* Overall information about text widget. */
+    TkText *textPtr,		/* Overall information about text widget. */
     const TkTextIndex *indexPtr)/* The character in the text for which display
 				 * information is wanted. */
 {
+    TagRun *runPtr = &textPtr->dInfoPtr->tagRun;
     TkTextTag **tagPtrs;
     TkTextTag *tagPtr;
     StyleValues styleValues;
@@ -784,12 +901,27 @@ GetStyle(
     Tcl_Size overstrikePrio, tabPrio, tabStylePrio, wrapPrio;
 
     /*
-     * Find out what tags are present for the character, then compute a
-     * StyleValues structure corresponding to those tags (scan through all of
-     * the tags, saving information for the highest-priority tag).
+     * Find out what tags are present for the character. If they are the ones
+     * the last style was computed for, that style still applies.
+     */
+
+    TagRunSeek(textPtr, indexPtr);
+    if (runPtr->stylePtr != NULL) {
+	if (runPtr->focus == (textPtr->flags & GOT_FOCUS)) {
+	    runPtr->stylePtr->refCount++;
+	    return runPtr->stylePtr;
+	}
+	FreeStyle(textPtr, runPtr->stylePtr);
+	runPtr->stylePtr = NULL;
+    }
+    tagPtrs = runPtr->tagPtrs;
+    numTags = runPtr->numTags;
+
+    /*
+     * Compute a StyleValues structure corresponding to the tags (scan through
+     * all of the tags, saving information for the highest-priority tag).
      */
 
-    tagPtrs = TkBTreeGetTags(indexPtr, textPtr, &numTags);
     borderPrio = borderWidthPrio = reliefPrio = bgStipplePrio = -1;
     fgPrio = fontPrio = fgStipplePrio = -1;
     underlinePrio = elidePrio = justifyPrio = offsetPrio = -1;
@@ -982,19 +1114,19 @@ GetStyle(
 	    wrapPrio = tagPtr->priority;
 	}
     }
-    if (tagPtrs != NULL) {
-	ckfree(tagPtrs);
-    }
 
     /*
-     * Use an existing style if there's one around that matches.
+     * Use an existing style if there's one around that matches. The tag run
+     * holds a reference of its own.
      */
 
     hPtr = Tcl_CreateHashEntry(&textPtr->dInfoPtr->styleTable,
 	    (char *) &styleValues, &isNew);
     if (!isNew) {
 	stylePtr = (TextStyle *)Tcl_GetHashValue(hPtr);
-	stylePtr->refCount++;
+	stylePtr->refCount += 2;
+	runPtr->stylePtr = stylePtr;
+	runPtr->focus = textPtr->flags & GOT_FOCUS;
 	return stylePtr;
     }
 
@@ -1003,7 +1135,7 @@ GetStyle(
      */
 
     stylePtr = (TextStyle *)ckalloc(sizeof(TextStyle));
-    stylePtr->refCount = 1;
+    stylePtr->refCount = 2;
     if (styleValues.border != NULL) {
 	gcValues.foreground = Tk_3DBorderColor(styleValues.border)->pixel;
 	mask = GCForeground;
@@ -1035,8 +1167,198 @@ GetStyle(
 	    Tcl_GetHashKey(&textPtr->dInfoPtr->styleTable, hPtr);
     stylePtr->hPtr = hPtr;
     Tcl_SetHashValue(hPtr, stylePtr);
+    runPtr->stylePtr = stylePtr;
+    runPtr->focus = textPtr->flags & GOT_FOCUS;
     return stylePtr;
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TagRunSeek --
+ *
+ *	Bring the tag run of a text widget to the given index, so that its tag
+ *	set holds the tags that apply to the character there. This is cheap
+ *	when the index is at or a little after the last one: only the toggles
+ *	in between are applied. Otherwise the tags are looked up in the
+ *	B-tree.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The tag run is updated; its style is dropped if the tag set changed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TagRunSeek(
+    TkText *textPtr,		/* Overall information about text widget. */
+    const TkTextIndex *indexPtr)/* Position to move the tag run to. */
+{
+    TagRun *runPtr = &textPtr->dInfoPtr->tagRun;
+    TkTextLine *linePtr;
+    TkTextSegment *segPtr;
+    Tcl_Size offset;
+    int count;
+
+    if (runPtr->linePtr == NULL
+	    || runPtr->epoch != TkBTreeEpoch(textPtr->sharedTextPtr->tree)) {
+	goto lookup;
+    }
+    if (runPtr->linePtr == indexPtr->linePtr) {
+	if (indexPtr->byteIndex < runPtr->byteIndex) {
+	    goto lookup;
+	}
+    } else {
+	linePtr = runPtr->linePtr;
+	for (count = 0; count < TAG_RUN_MAX_LINES; count++) {
+	    linePtr = TkBTreeNextLine(NULL, linePtr);
+	    if (linePtr == NULL || linePtr == indexPtr->linePtr) {
+		break;
+	    }
+	}
+	if (linePtr != indexPtr->linePtr) {
+	    goto lookup;
+	}
+    }
+
+    linePtr = runPtr->linePtr;
+    segPtr = runPtr->segPtr;
+    offset = runPtr->segOffset;
+    if (segPtr == NULL) {
+	for (segPtr = linePtr->segPtr, offset = 0; (segPtr != NULL)
+		&& (offset + segPtr->size <= runPtr->byteIndex);
+		segPtr = segPtr->nextPtr) {
+	    offset += segPtr->size;
+	}
+    }
+
+    /*
+     * Apply the toggles between the two positions. The ones at the new
+     * position itself count, as in TkBTreeGetTags.
+     */
+
+    while (linePtr != indexPtr->linePtr) {
+	for (; segPtr != NULL; segPtr = segPtr->nextPtr) {
+	    if ((segPtr->typePtr == &tkTextToggleOnType)
+		    || (segPtr->typePtr == &tkTextToggleOffType)) {
+		TagRunToggle(textPtr, segPtr->body.toggle.tagPtr);
+	    }
+	}
+	linePtr = TkBTreeNextLine(NULL, linePtr);
+	segPtr = linePtr->segPtr;
+	offset = 0;
+    }
+    for (; (segPtr != NULL) && (offset + segPtr->size <= indexPtr->byteIndex);
+	    segPtr = segPtr->nextPtr) {
+	if ((segPtr->typePtr == &tkTextToggleOnType)
+		|| (segPtr->typePtr == &tkTextToggleOffType)) {
+	    TagRunToggle(textPtr, segPtr->body.toggle.tagPtr);
+	}
+	offset += segPtr->size;
+    }
+    runPtr->linePtr = linePtr;
+    runPtr->byteIndex = indexPtr->byteIndex;
+    runPtr->segPtr = segPtr;
+    runPtr->segOffset = offset;
+    return;
+
+  lookup:
+    TagRunReset(textPtr);
+    if (runPtr->tagPtrs != NULL) {
+	ckfree(runPtr->tagPtrs);
+    }
+    runPtr->tagPtrs = TkBTreeGetTags(indexPtr, textPtr, &runPtr->numTags);
+    runPtr->tagSpace = runPtr->numTags;
+    runPtr->epoch = TkBTreeEpoch(textPtr->sharedTextPtr->tree);
+    runPtr->linePtr = indexPtr->linePtr;
+    runPtr->byteIndex = indexPtr->byteIndex;
+    runPtr->segPtr = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TagRunToggle --
+ *
+ *	Add a tag to the tag set of the tag run of a text widget, or remove it
+ *	if it is there already. Tags that belong to another peer widget are
+ *	ignored, as in TkBTreeGetTags.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The tag set changes and the style of the tag run is dropped.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TagRunToggle(
+    TkText *textPtr,		/* Overall information about text widget. */
+    TkTextTag *tagPtr)		/* Tag that was toggled. */
+{
+    TagRun *runPtr = &textPtr->dInfoPtr->tagRun;
+    Tcl_Size i;
+
+    if ((tagPtr->textPtr != NULL) && (tagPtr->textPtr != textPtr)) {
+	return;
+    }
+    for (i = 0; i < runPtr->numTags; i++) {
+	if (runPtr->tagPtrs[i] == tagPtr) {
+	    break;
+	}
+    }
+    if (i < runPtr->numTags) {
+	runPtr->tagPtrs[i] = runPtr->tagPtrs[--runPtr->numTags];
+    } else {
+	if (runPtr->numTags == runPtr->tagSpace) {
+	    runPtr->tagSpace = 2 * runPtr->tagSpace + 8;
+	    runPtr->tagPtrs = (TkTextTag **)ckrealloc(runPtr->tagPtrs,
+		    runPtr->tagSpace * sizeof(TkTextTag *));
+	}
+	runPtr->tagPtrs[runPtr->numTags++] = tagPtr;
+    }
+    if (runPtr->stylePtr != NULL) {
+	FreeStyle(textPtr, runPtr->stylePtr);
+	runPtr->stylePtr = NULL;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TagRunReset --
+ *
+ *	Forget the tag run of a text widget. This is called when the widget or
+ *	tag configuration changes, since the style of the run may no longer
+ *	be right.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The style of the tag run is released.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TagRunReset(
+    TkText *textPtr)		/* Overall information about text widget. */
+{
+    TagRun *runPtr = &textPtr->dInfoPtr->tagRun;
+
+    if (runPtr->stylePtr != NULL) {
+	FreeStyle(textPtr, runPtr->stylePtr);
+	runPtr->stylePtr = NULL;
+    }
+    runPtr->linePtr = NULL;
+    runPtr->segPtr = NULL;
+}
 
 /*
  *----------------------------------------------------------------------
@@ -1309,6 +1631,7 @@ LayoutDLine(
     lastChunkPtr = NULL;
     chunkPtr = NULL;
     noCharsYet = 1;
+    textPtr->dInfoPtr->tagRun.segPtr = NULL;
     elide = 0;
     breakChunkPtr = NULL;
     breakByteOffset = 0;
@@ -1540,6 +1863,15 @@ LayoutDLine(
 	    code = segPtr->typePtr->layoutProc(textPtr, &curIndex, segPtr,
 		    byteOffset, maxX-tabSize, maxBytes, noCharsYet, wrapMode,
 		    chunkPtr);
+
+	    /*
+	     * Creating an embedded window runs a script, which may move
+	     * segments around.
+	     */
+
+	    if (segPtr->typePtr == &tkTextEmbWindowType) {
+		textPtr->dInfoPtr->tagRun.segPtr = NULL;
+	    }
 	}
 	if (code <= 0) {
 	    FreeStyle(textPtr, chunkPtr->stylePtr);
@@ -2515,8 +2847,14 @@ DisplayDLine(
      * foreground information. Note: we have to call the displayProc even for
      * chunks that are off-screen. This is needed, for example, so that
      * embedded windows can be unmapped in this case.
+     *
+     * With Xft, the text of consecutive character chunks is sent to the
+     * server in one batch; it must be flushed before anything else is drawn.
      */
 
+#ifdef HAVE_XFT
+    TkUnixBeginXftBatch();
+#endif
     for (chunkPtr = dlPtr->chunkPtr; (chunkPtr != NULL);
 	    chunkPtr = chunkPtr->nextPtr) {
 	if (chunkPtr->displayProc == TkTextInsertDisplayProc) {
@@ -2549,6 +2887,11 @@ DisplayDLine(
 
 		x = -chunkPtr->width;
 	    }
+#ifdef HAVE_XFT
+	    if (chunkPtr->displayProc != CharDisplayProc) {
+		TkUnixFlushXftBatch();
+	    }
+#endif
 	    chunkPtr->displayProc(textPtr, chunkPtr, x,
 		    y + dlPtr->spaceAbove, dlPtr->height - dlPtr->spaceAbove -
 		    dlPtr->spaceBelow, dlPtr->baseline - dlPtr->spaceAbove,
@@ -2560,12 +2903,21 @@ DisplayDLine(
 	     * A displayProc called in the loop above invoked a binding
 	     * that caused the widget to be deleted. Don't do anything.
 	     */
+#ifdef HAVE_XFT
+	    TkUnixEndXftBatch();
+#endif
 	    return;
 	}
 	if (dInfoPtr->dLinesInvalidated) {
+#ifdef HAVE_XFT
+	    TkUnixEndXftBatch();
+#endif
 	    return;
 	}
     }
+#ifdef HAVE_XFT
+    TkUnixEndXftBatch();
+#endif
 
 #ifndef TK_NO_DOUBLE_BUFFERING
     /*
@@ -2987,10 +3339,12 @@ DisplayLineBackground(
  *	height calculations of individual lines in an asychronous manner.
  *
  *	Currently a timer-handler is used for this purpose, which continuously
- *	reschedules itself. It may well be better to use some other approach
- *	(e.g., a background thread). We can't use an idle-callback because of
- *	a known bug in Tcl/Tk in which idle callbacks are not allowed to
- *	re-schedule themselves. This just causes an effective infinite loop.
+ *	reschedules itself. We can't use an idle-callback because of a known
+ *	bug in Tcl/Tk in which idle callbacks are not allowed to re-schedule
+ *	themselves. This just causes an effective infinite loop. If the
+ *	-metricsthread option is set, the plain lines are handed to a worker
+ *	thread instead (see StartMetricsJob) and only the others are measured
+ *	here.
  *
  * Results:
  *	None.
@@ -3007,7 +3361,7 @@ AsyncUpdateLineMetrics(
 {
     TkText *textPtr = (TkText *)clientData;
     TextDInfo *dInfoPtr = textPtr->dInfoPtr;
-    int lineNum;
+    int lineNum, endLine, stopLine;
 
     dInfoPtr->lineUpdateTimer = NULL;
 
@@ -3039,15 +3393,67 @@ AsyncUpdateLineMetrics(
 	dInfoPtr->lastMetricUpdateLine =
 		TkBTreeNumLines(textPtr->sharedTextPtr->tree, textPtr);
     }
+    endLine = dInfoPtr->lastMetricUpdateLine;
+    stopLine = endLine;
+
+    /*
+     * With -metricsthread, keep the metrics thread busy with the plain lines
+     * ahead of us. We must not measure the lines of the job in flight
+     * ourselves, so either stop just before them or, if we have already got
+     * there, wait for the job to come back.
+     */
+
+    if (textPtr->metricsThread) {
+	MetricsJob *jobPtr;
+
+	if (dInfoPtr->metricsJob == NULL) {
+	    int fromLine = lineNum + 1;
+	    int toLine = endLine;
+
+	    if (dInfoPtr->metricsScanLine > fromLine) {
+		fromLine = dInfoPtr->metricsScanLine;
+	    }
+	    if (toLine <= lineNum) {
+		toLine = TkBTreeNumLines(textPtr->sharedTextPtr->tree, textPtr);
+	    }
+	    StartMetricsJob(textPtr, fromLine, toLine);
+	}
+	jobPtr = dInfoPtr->metricsJob;
+	if (jobPtr != NULL) {
+	    if (lineNum + 1 >= jobPtr->firstLine
+		    && lineNum + 1 <= jobPtr->lastLine) {
+		dInfoPtr->lineUpdateTimer = Tcl_CreateTimerHandler(10,
+			AsyncUpdateLineMetrics, clientData);
+		return;
+	    }
+	    if (lineNum + 1 < jobPtr->firstLine) {
+		stopLine = jobPtr->firstLine;
+	    }
+	}
+    }
 
     /*
      * Update the lines in blocks of about 24 recalculations, or 250+ lines
      * examined, so we pass in 256 for 'doThisMuch'.
      */
 
-    lineNum = TkTextUpdateLineMetrics(textPtr, lineNum,
-	    dInfoPtr->lastMetricUpdateLine, 256);
+    lineNum = TkTextUpdateLineMetrics(textPtr, lineNum, stopLine, 256);
+
+    if (stopLine != endLine && lineNum == stopLine) {
+	/*
+	 * We stopped in front of the metrics job, without examining its first
+	 * line.
+	 */
+
+	lineNum = stopLine - 1;
+    } else if (lineNum < dInfoPtr->currentMetricUpdateLine) {
+	/*
+	 * We wrapped around to the first line, so the metrics jobs have to
+	 * start over from there too.
+	 */
 
+	dInfoPtr->metricsScanLine = -1;
+    }
     dInfoPtr->currentMetricUpdateLine = lineNum;
 
     if (tkTextDebug) {
@@ -3062,7 +3468,7 @@ AsyncUpdateLineMetrics(
      * and we've reached the last line, then we're done.
      */
 
-    if (dInfoPtr->metricEpoch == -1
+    if (dInfoPtr->metricEpoch == -1 && dInfoPtr->metricsJob == NULL
 	    && lineNum == dInfoPtr->lastMetricUpdateLine) {
 	/*
 	 * We have looped over all lines, so we're done. We must release our
@@ -3109,6 +3515,561 @@ AsyncUpdateLineMetrics(
 	    AsyncUpdateLineMetrics, textPtr);
 }
 
+/*
+ * The thread that measures lines for text widgets with the -metricsthread
+ * option set. There is a single one, shared by all widgets in all threads,
+ * and started the first time it is needed. Everything here is protected by
+ * metricsMutex.
+ */
+
+TCL_DECLARE_MUTEX(metricsMutex)
+static Tcl_Condition metricsCond = NULL;
+static MetricsJob *metricsQueue = NULL;	/* Jobs waiting for the worker. */
+static MetricsJob *metricsQueueTail = NULL;
+static Tcl_ThreadId metricsThread;	/* The worker, if it was started. */
+static int metricsWorkerState = 0;	/* 0 means the worker hasn't been
+					 * started yet, 1 that it is running
+					 * and -1 that it couldn't be started
+					 * or has been told to quit. */
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StartMetricsJob --
+ *
+ *	Collects the plain lines with out of date metrics from the range
+ *	fromLine to toLine (exclusive) and hands them to the metrics thread.
+ *	At most METRICS_SCAN_LINES lines are examined, and a job is limited to
+ *	METRICS_JOB_LINES lines and about METRICS_JOB_BYTES characters.
+ *
+ * Results:
+ *	Returns 1 if a job was queued, 0 if there was nothing to hand over (or
+ *	the metrics thread could not be started).
+ *
+ * Side effects:
+ *	The metrics thread may be started. The job becomes the widget's
+ *	metricsJob and holds a reference to the widget until it comes back.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+StartMetricsJob(
+    TkText *textPtr,		/* Information about widget. */
+    int fromLine,		/* First line to consider. */
+    int toLine)			/* Line after the last one to consider. */
+{
+    TextDInfo *dInfoPtr = textPtr->dInfoPtr;
+    TkSharedText *sharedTextPtr = textPtr->sharedTextPtr;
+    Tcl_HashSearch search;
+    Tcl_HashEntry *hPtr;
+    TkTextTag **tagPtrs;
+    TkTextSegment *segPtr;
+    TkTextLine *linePtr;
+    MetricsJob *jobPtr;
+    Tk_FontMetrics fm;
+    int i, numTags, lineNum, numBytes, lineBytes, linesSpace, bytesSpace;
+    int totalLines;
+    char ch;
+
+    totalLines = TkBTreeNumLines(sharedTextPtr->tree, textPtr);
+    if (toLine > totalLines) {
+	toLine = totalLines;
+    }
+    if ((fromLine >= toLine) || (dInfoPtr->maxX <= dInfoPtr->x)) {
+	return 0;
+    }
+
+    Tcl_MutexLock(&metricsMutex);
+    if (metricsWorkerState == 0) {
+	if (Tcl_CreateThread(&metricsThread, MetricsThreadProc, NULL,
+		TCL_THREAD_STACK_DEFAULT, TCL_THREAD_JOINABLE) == TCL_OK) {
+	    metricsWorkerState = 1;
+	    Tcl_CreateExitHandler(MetricsWorkerExitProc, NULL);
+	} else {
+	    metricsWorkerState = -1;
+	}
+    }
+    Tcl_MutexUnlock(&metricsMutex);
+    if (metricsWorkerState != 1) {
+	return 0;
+    }
+
+    /*
+     * Gather the tags that change the geometry of what they are applied to.
+     * A line any of these is applied to isn't plain.
+     */
+
+    tagPtrs = (TkTextTag **)ckalloc(sizeof(TkTextTag *)
+	    * (sharedTextPtr->tagTable.numEntries + 1));
+    numTags = 0;
+    if (textPtr->selTagPtr->affectsDisplayGeometry) {
+	tagPtrs[numTags++] = textPtr->selTagPtr;
+    }
+    for (hPtr = Tcl_FirstHashEntry(&sharedTextPtr->tagTable, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	TkTextTag *tagPtr = (TkTextTag *)Tcl_GetHashValue(hPtr);
+
+	if (tagPtr->affectsDisplayGeometry && (tagPtr != textPtr->selTagPtr)
+		&& ((tagPtr->textPtr == NULL) || (tagPtr->textPtr == textPtr))) {
+	    tagPtrs[numTags++] = tagPtr;
+	}
+    }
+
+    linesSpace = 256;
+    bytesSpace = 16384;
+    jobPtr = (MetricsJob *)ckalloc(sizeof(MetricsJob));
+    jobPtr->lines = (TkTextLine **)ckalloc(linesSpace * sizeof(TkTextLine *));
+    jobPtr->starts = (int *)ckalloc((linesSpace + 1) * sizeof(int));
+    jobPtr->chars = (char *)ckalloc(bytesSpace);
+    jobPtr->numLines = 0;
+    numBytes = 0;
+
+    lineNum = fromLine;
+    linePtr = TkBTreeFindLine(sharedTextPtr->tree, textPtr, lineNum);
+    while ((linePtr != NULL) && (lineNum < toLine)
+	    && (lineNum < fromLine + METRICS_SCAN_LINES)
+	    && (jobPtr->numLines < METRICS_JOB_LINES)
+	    && (numBytes < METRICS_JOB_BYTES)) {
+	if ((TkBTreeLinePixelEpoch(textPtr, linePtr)
+		!= dInfoPtr->lineMetricUpdateEpoch)
+		&& (lineBytes = MetricsLineIsPlain(textPtr, linePtr, tagPtrs,
+		numTags)) > 0) {
+	    if (jobPtr->numLines == linesSpace) {
+		linesSpace *= 2;
+		jobPtr->lines = (TkTextLine **)ckrealloc(jobPtr->lines,
+			linesSpace * sizeof(TkTextLine *));
+		jobPtr->starts = (int *)ckrealloc(jobPtr->starts,
+			(linesSpace + 1) * sizeof(int));
+	    }
+	    while (numBytes + lineBytes > bytesSpace) {
+		bytesSpace *= 2;
+		jobPtr->chars = (char *)ckrealloc(jobPtr->chars, bytesSpace);
+	    }
+	    if (jobPtr->numLines == 0) {
+		jobPtr->firstLine = lineNum;
+	    }
+	    jobPtr->lastLine = lineNum;
+	    jobPtr->lines[jobPtr->numLines] = linePtr;
+	    jobPtr->starts[jobPtr->numLines] = numBytes;
+	    for (segPtr = linePtr->segPtr; segPtr != NULL;
+		    segPtr = segPtr->nextPtr) {
+		if (segPtr->typePtr == &tkTextCharType) {
+		    memcpy(jobPtr->chars + numBytes, segPtr->body.chars,
+			    segPtr->size);
+		    numBytes += segPtr->size;
+		}
+	    }
+	    jobPtr->numLines++;
+	}
+	lineNum++;
+	linePtr = TkBTreeNextLine(textPtr, linePtr);
+    }
+    ckfree(tagPtrs);
+    dInfoPtr->metricsScanLine = lineNum;
+
+    if (jobPtr->numLines == 0) {
+	ckfree(jobPtr->lines);
+	ckfree(jobPtr->starts);
+	ckfree(jobPtr->chars);
+	ckfree(jobPtr);
+	return 0;
+    }
+    jobPtr->starts[jobPtr->numLines] = numBytes;
+    jobPtr->heights = (int *)ckalloc(jobPtr->numLines * sizeof(int));
+
+    /*
+     * Everything the worker needs to lay the lines out, in the same way
+     * GetStyle and LayoutDLine would for untagged text.
+     */
+
+    Tk_GetFontMetrics(textPtr->tkfont, &fm);
+    jobPtr->lineHeight = fm.ascent + fm.descent;
+    for (i = 0; i < METRICS_NUM_CHARS; i++) {
+	ch = (char)(METRICS_FIRST_CHAR + i);
+	jobPtr->widths[i] = Tk_TextWidth(textPtr->tkfont, &ch, 1);
+    }
+    Tk_GetPixelsFromObj(NULL, textPtr->tkwin, textPtr->spacing1Obj,
+	    &jobPtr->spacing1);
+    Tk_GetPixelsFromObj(NULL, textPtr->tkwin, textPtr->spacing2Obj,
+	    &jobPtr->spacing2);
+    Tk_GetPixelsFromObj(NULL, textPtr->tkwin, textPtr->spacing3Obj,
+	    &jobPtr->spacing3);
+    jobPtr->maxX = dInfoPtr->maxX - dInfoPtr->x;
+    jobPtr->wrapMode = textPtr->wrapMode;
+
+    jobPtr->header.proc = MetricsJobDone;
+    jobPtr->header.nextPtr = NULL;
+    jobPtr->nextPtr = NULL;
+    jobPtr->textPtr = textPtr;
+    jobPtr->owner = Tcl_GetCurrentThread();
+    jobPtr->cancelled = 0;
+    textPtr->refCount++;
+    dInfoPtr->metricsJob = jobPtr;
+
+    Tcl_MutexLock(&metricsMutex);
+    if (metricsQueueTail == NULL) {
+	metricsQueue = jobPtr;
+    } else {
+	metricsQueueTail->nextPtr = jobPtr;
+    }
+    metricsQueueTail = jobPtr;
+    Tcl_ConditionNotify(&metricsCond);
+    Tcl_MutexUnlock(&metricsMutex);
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MetricsLineIsPlain --
+ *
+ *	Decides whether the metrics thread can measure a line: it may only
+ *	contain printable ASCII characters (and its newline), marks other than
+ *	the insertion cursor and toggles of tags that don't change the
+ *	geometry, and none of the given geometry tags may apply to it.
+ *
+ * Results:
+ *	The number of characters in the line if it is plain, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+MetricsLineIsPlain(
+    TkText *textPtr,		/* Information about widget. */
+    TkTextLine *linePtr,	/* Line to check. */
+    TkTextTag **tagPtrs,	/* Tags that change the geometry... */
+    int numTags)		/* ...and how many of them there are. */
+{
+    TkTextSegment *segPtr;
+    TkTextIndex index;
+    int i, numBytes = 0;
+
+    for (segPtr = linePtr->segPtr; segPtr != NULL; segPtr = segPtr->nextPtr) {
+	if (segPtr->typePtr == &tkTextCharType) {
+	    const unsigned char *p = (const unsigned char *)segPtr->body.chars;
+	    const unsigned char *end = p + segPtr->size;
+
+	    for ( ; p < end; p++) {
+		if (((*p < METRICS_FIRST_CHAR)
+			|| (*p >= METRICS_FIRST_CHAR + METRICS_NUM_CHARS))
+			&& (*p != '\n')) {
+		    return 0;
+		}
+	    }
+	    numBytes += segPtr->size;
+	} else if ((segPtr->typePtr == &tkTextToggleOnType)
+		|| (segPtr->typePtr == &tkTextToggleOffType)) {
+	    TkTextTag *tagPtr = segPtr->body.toggle.tagPtr;
+
+	    if (tagPtr->affectsDisplayGeometry && ((tagPtr->textPtr == NULL)
+		    || (tagPtr->textPtr == textPtr))) {
+		return 0;
+	    }
+	} else if ((segPtr->typePtr == &tkTextRightMarkType)
+		|| (segPtr->typePtr == &tkTextLeftMarkType)) {
+	    if (segPtr == textPtr->insertMarkPtr) {
+		return 0;
+	    }
+	} else {
+	    return 0;
+	}
+    }
+
+    /*
+     * There are no geometry toggles in the line, so a tag applies to all of
+     * it or not at all.
+     */
+
+    index.tree = textPtr->sharedTextPtr->tree;
+    index.linePtr = linePtr;
+    index.byteIndex = 0;
+    index.textPtr = NULL;
+    for (i = 0; i < numTags; i++) {
+	if (TkBTreeCharTagged(&index, tagPtrs[i])) {
+	    return 0;
+	}
+    }
+    return numBytes;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MetricsThreadProc --
+ *
+ *	The body of the metrics thread: takes jobs off the queue, measures
+ *	their lines and sends each one back to the thread of its widget.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Events are queued for other threads.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_ThreadCreateType
+MetricsThreadProc(
+    TCL_UNUSED(void *))
+{
+    MetricsJob *jobPtr;
+
+    Tcl_MutexLock(&metricsMutex);
+    while (1) {
+	while ((metricsQueue == NULL) && (metricsWorkerState == 1)) {
+	    Tcl_ConditionWait(&metricsCond, &metricsMutex, NULL);
+	}
+	if (metricsWorkerState != 1) {
+	    break;
+	}
+	jobPtr = metricsQueue;
+	metricsQueue = jobPtr->nextPtr;
+	if (metricsQueue == NULL) {
+	    metricsQueueTail = NULL;
+	}
+	Tcl_MutexUnlock(&metricsMutex);
+
+	MetricsMeasureLines(jobPtr);
+	Tcl_ThreadQueueEvent(jobPtr->owner, &jobPtr->header, TCL_QUEUE_TAIL);
+	Tcl_ThreadAlert(jobPtr->owner);
+
+	Tcl_MutexLock(&metricsMutex);
+    }
+    Tcl_MutexUnlock(&metricsMutex);
+    TCL_THREAD_CREATE_RETURN;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MetricsWorkerExitProc --
+ *
+ *	Tells the metrics thread to quit and waits for it, so that it isn't
+ *	left waiting on a condition while Tcl is finalized. Jobs still in the
+ *	queue are abandoned.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The metrics thread exits.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+MetricsWorkerExitProc(
+    TCL_UNUSED(void *))
+{
+    int result;
+
+    Tcl_MutexLock(&metricsMutex);
+    metricsWorkerState = -1;
+    Tcl_ConditionNotify(&metricsCond);
+    Tcl_MutexUnlock(&metricsMutex);
+    Tcl_JoinThread(metricsThread, &result);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MetricsMeasureLines --
+ *
+ *	Computes the pixel height of each line of a metrics job. This runs in
+ *	the metrics thread, so it may only look at the job itself. The lines
+ *	are broken as TkTextCharLayoutProc and LayoutDLine would break them,
+ *	with the character widths of the job standing in for Tk_MeasureChars.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Fills in the heights of the job.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+MetricsMeasureLines(
+    MetricsJob *jobPtr)		/* Job to measure. */
+{
+    int i;
+
+    for (i = 0; i < jobPtr->numLines; i++) {
+	const char *chars = jobPtr->chars + jobPtr->starts[i];
+	int numBytes = jobPtr->starts[i + 1] - jobPtr->starts[i];
+	int pos = 0, displayLines = 0;
+
+	while (1) {
+	    int x = 0, fit = pos, next;
+
+	    displayLines++;
+	    if (jobPtr->wrapMode == TEXT_WRAPMODE_NONE) {
+		break;
+	    }
+
+	    /*
+	     * Take as many characters as fit completely; at least one,
+	     * because each display line must hold a character. A space
+	     * fits if a pixel of it is visible and, when wrapping words, so
+	     * do all the spaces after it.
+	     */
+
+	    while (chars[fit] != '\n') {
+		int width = jobPtr->widths[
+			(unsigned char)chars[fit] - METRICS_FIRST_CHAR];
+
+		if (x + width > jobPtr->maxX) {
+		    break;
+		}
+		x += width;
+		fit++;
+	    }
+	    if ((fit == pos) && (chars[fit] != '\n')) {
+		x = jobPtr->widths[
+			(unsigned char)chars[fit] - METRICS_FIRST_CHAR];
+		fit++;
+	    }
+	    if ((x < jobPtr->maxX) && (chars[fit] == ' ')) {
+		fit++;
+	    }
+	    if (jobPtr->wrapMode == TEXT_WRAPMODE_WORD) {
+		while (chars[fit] == ' ') {
+		    fit++;
+		}
+	    }
+	    if (chars[fit] == '\n') {
+		fit++;
+	    }
+	    if (fit >= numBytes) {
+		break;
+	    }
+
+	    /*
+	     * The display line ends inside the text line. With word wrapping
+	     * it is cut back to just after its last space, if it has one.
+	     */
+
+	    next = fit;
+	    if (jobPtr->wrapMode == TEXT_WRAPMODE_WORD) {
+		int j;
+
+		for (j = fit; j > pos; j--) {
+		    if (chars[j - 1] == ' ') {
+			next = j;
+			break;
+		    }
+		}
+	    }
+	    pos = next;
+	}
+	jobPtr->heights[i] = displayLines * jobPtr->lineHeight
+		+ jobPtr->spacing1 + jobPtr->spacing3
+		+ (displayLines - 1) * jobPtr->spacing2;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MetricsJobDone --
+ *
+ *	This function is invoked by the event loop when the metrics thread
+ *	sends a job back. Unless the job was cancelled in the meantime, the
+ *	heights it computed are stored in the B-tree.
+ *
+ * Results:
+ *	Always 1, the event has been handled.
+ *
+ * Side effects:
+ *	Line heights may change and a scrollbar update may be scheduled. The
+ *	job's reference to the widget is released.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+MetricsJobDone(
+    Tcl_Event *evPtr,		/* The job. */
+    TCL_UNUSED(int))		/* Flags passed to the event loop. */
+{
+    MetricsJob *jobPtr = (MetricsJob *)evPtr;
+    TkText *textPtr = jobPtr->textPtr;
+
+    if (!jobPtr->cancelled) {
+	TextDInfo *dInfoPtr = textPtr->dInfoPtr;
+	int i;
+
+	dInfoPtr->metricsJob = NULL;
+	for (i = 0; i < jobPtr->numLines; i++) {
+	    TkTextLine *linePtr = jobPtr->lines[i];
+
+	    /*
+	     * Lines which got measured in the meantime (e.g. because they
+	     * were displayed) are left alone.
+	     */
+
+	    if (TkBTreeLinePixelEpoch(textPtr, linePtr)
+		    != dInfoPtr->lineMetricUpdateEpoch) {
+		TkBTreeLinePixelEpoch(textPtr, linePtr)
+			= dInfoPtr->lineMetricUpdateEpoch;
+		TkBTreeAdjustPixelHeight(textPtr, linePtr, jobPtr->heights[i],
+			0);
+	    }
+	}
+	if (dInfoPtr->scrollbarTimer == NULL) {
+	    textPtr->refCount++;
+	    dInfoPtr->scrollbarTimer = Tcl_CreateTimerHandler(200,
+		    AsyncUpdateYScrollbar, textPtr);
+	}
+    }
+
+    ckfree(jobPtr->lines);
+    ckfree(jobPtr->starts);
+    ckfree(jobPtr->chars);
+    ckfree(jobPtr->heights);
+    if (textPtr->refCount-- <= 1) {
+	ckfree(textPtr);
+    }
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CancelMetricsJob --
+ *
+ *	Forgets about the metrics job of a widget, if it has one in flight:
+ *	when it comes back, its results will be dropped.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The next metrics job will start at the current update line.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CancelMetricsJob(
+    TkText *textPtr)		/* Information about widget. */
+{
+    TextDInfo *dInfoPtr = textPtr->dInfoPtr;
+
+    if (dInfoPtr->metricsJob != NULL) {
+	dInfoPtr->metricsJob->cancelled = 1;
+	dInfoPtr->metricsJob = NULL;
+    }
+    dInfoPtr->metricsScanLine = -1;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -3447,12 +4408,27 @@ TextInvalidateLineMetrics(
 {
     int fromLine;
     TextDInfo *dInfoPtr = textPtr->dInfoPtr;
+    MetricsJob *jobPtr = dInfoPtr->metricsJob;
 
     if (linePtr != NULL) {
 	int counter = lineCount;
 
 	fromLine = TkBTreeLinesTo(textPtr, linePtr);
 
+	/*
+	 * Drop a metrics job in flight if its lines may have changed or moved,
+	 * and build the next one from scratch if lines before it did.
+	 */
+
+	if ((jobPtr != NULL) && (fromLine <= jobPtr->lastLine)
+		&& ((action != TK_TEXT_INVALIDATE_ONLY)
+		|| (fromLine + lineCount >= jobPtr->firstLine))) {
+	    CancelMetricsJob(textPtr);
+	}
+	if (fromLine < dInfoPtr->metricsScanLine) {
+	    dInfoPtr->metricsScanLine = -1;
+	}
+
 	/*
 	 * Invalidate the height calculations of each line in the given range.
 	 */
@@ -3535,6 +4511,7 @@ TextInvalidateLineMetrics(
 	 * This invalidates the height of all lines in the widget.
 	 */
 
+	CancelMetricsJob(textPtr);
 	if ((++dInfoPtr->lineMetricUpdateEpoch) == 0) {
 	    dInfoPtr->lineMetricUpdateEpoch++;
 	}
@@ -4471,9 +5448,8 @@ DisplayText(
 
     if (maxHeight > 0) {
 #ifndef TK_NO_DOUBLE_BUFFERING
-	pixmap = Tk_GetPixmap(Tk_Display(textPtr->tkwin),
-		Tk_WindowId(textPtr->tkwin), Tk_Width(textPtr->tkwin),
-		maxHeight, Tk_Depth(textPtr->tkwin));
+	pixmap = TkGetBufferPixmap(textPtr->tkwin, Tk_Width(textPtr->tkwin),
+		maxHeight);
 #else
 	pixmap = Tk_WindowId(textPtr->tkwin);
 #endif /* TK_NO_DOUBLE_BUFFERING */
@@ -4500,7 +5476,7 @@ DisplayText(
 		}
 		if (dInfoPtr->dLinesInvalidated) {
 #ifndef TK_NO_DOUBLE_BUFFERING
-		    Tk_FreePixmap(Tk_Display(textPtr->tkwin), pixmap);
+		    TkFreeBufferPixmap(textPtr->tkwin, pixmap);
 #endif /* TK_NO_DOUBLE_BUFFERING */
 		    goto end;
 		}
@@ -4598,7 +5574,7 @@ DisplayText(
 	    }
 	}
 #ifndef TK_NO_DOUBLE_BUFFERING
-	Tk_FreePixmap(Tk_Display(textPtr->tkwin), pixmap);
+	TkFreeBufferPixmap(textPtr->tkwin, pixmap);
 #endif /* TK_NO_DOUBLE_BUFFERING */
     }
 
@@ -5035,6 +6011,13 @@ TextRedrawTag(
     TkTextIndex *curIndexPtr;
     TkTextIndex endOfText, *endIndexPtr;
 
+    /*
+     * The tag may look different now, so the style of the tag run may be
+     * out of date.
+     */
+
+    TagRunReset(textPtr);
+
     /*
      * Invalidate the pixel calculation of all lines in the given range. This
      * may be a bit over-aggressive, so we could consider more subtle
@@ -5220,6 +6203,8 @@ TkTextRelayoutWindow(
     int padX, padY;
     int borderWidth, highlightWidth;
 
+    TagRunReset(textPtr);
+
     /*
      * Schedule the window redisplay. See TkTextChanged for the reason why
      * this has to be done before any calls to FreeDLines.
@@ -8070,6 +9055,11 @@ CharDisplayProc(
 		string, numBytes, start, len,
 		ciPtr->baseChunkPtr->x + xDisplacement,
 		y + baseline - sValuePtr->offset);
+#ifdef HAVE_XFT
+	if (sValuePtr->underline || sValuePtr->overstrike) {
+	    TkUnixFlushXftBatch();
+	}
+#endif
 
 	if (sValuePtr->underline) {
 	    Tk_UnderlineCharsInContext(display, dst, stylePtr->ulGC,
@@ -8098,6 +9088,11 @@ CharDisplayProc(
 	}
 	Tk_DrawChars(display, dst, stylePtr->fgGC, sValuePtr->tkfont, string,
 		numBytes, offsetX, y + baseline - sValuePtr->offset);
+#ifdef HAVE_XFT
+	if (sValuePtr->underline || sValuePtr->overstrike) {
+	    TkUnixFlushXftBatch();
+	}
+#endif
 	if (sValuePtr->underline) {
 	    Tk_UnderlineChars(display, dst, stylePtr->ulGC, sValuePtr->tkfont,
 		    string, offsetX,
@@ -15,6 +15,10 @@
 
 static int		EvaluateActionList(Tcl_Interp *interp,
 			    TkUndoSubAtom *action);
+static Tcl_Size		FreeAtomList(TkUndoAtom *elem, int *sepCountPtr);
+static void		FreeSubAtomList(TkUndoSubAtom *sub);
+static Tcl_Size		SubAtomListSize(TkUndoSubAtom *sub);
+static void		TrimUndoStack(TkUndoRedoStack *stack);
 
 /*
  *----------------------------------------------------------------------
@@ -96,6 +100,7 @@ TkUndoInsertSeparator(
     if (*stack!=NULL && (*stack)->type!=TK_UNDO_SEPARATOR) {
 	separator = (TkUndoAtom *)ckalloc(sizeof(TkUndoAtom));
 	separator->type = TK_UNDO_SEPARATOR;
+	separator->size = 0;
 	TkUndoPushStack(stack,separator);
 	return 1;
     }
@@ -122,37 +127,121 @@ void
 TkUndoClearStack(
     TkUndoAtom **stack)		/* An Undo or Redo stack */
 {
-    TkUndoAtom *elem;
+    FreeAtomList(*stack, NULL);
+    *stack = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeAtomList, FreeSubAtomList --
+ *
+ *	Free a chain of atoms linked through their 'next' fields, or a chain
+ *	of sub-atoms, together with everything they refer to.
+ *
+ * Results:
+ *	FreeAtomList returns the number of bytes that were accounted to the
+ *	freed atoms, and stores the number of separators among them in
+ *	*sepCountPtr if that is not NULL.
+ *
+ * Side effects:
+ *	Memory is freed, and the freeProc of record sub-atoms is called.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    while ((elem = TkUndoPopStack(stack)) != NULL) {
-	if (elem->type != TK_UNDO_SEPARATOR) {
-	    TkUndoSubAtom *sub;
+static Tcl_Size
+FreeAtomList(
+    TkUndoAtom *elem,		/* First atom of the chain to free. */
+    int *sepCountPtr)		/* Where to count the separators, or
+				 * NULL. */
+{
+    Tcl_Size bytes = 0;
+    int sepCount = 0;
 
-	    sub = elem->apply;
-	    while (sub != NULL) {
-		TkUndoSubAtom *next = sub->next;
+    while (elem != NULL) {
+	TkUndoAtom *next = elem->next;
 
-		if (sub->action != NULL) {
-		    Tcl_DecrRefCount(sub->action);
-		}
-		ckfree(sub);
-		sub = next;
-	    }
+	if (elem->type == TK_UNDO_SEPARATOR) {
+	    sepCount++;
+	} else {
+	    FreeSubAtomList(elem->apply);
+	    FreeSubAtomList(elem->revert);
+	}
+	bytes += elem->size;
+	ckfree(elem);
+	elem = next;
+    }
+    if (sepCountPtr != NULL) {
+	*sepCountPtr = sepCount;
+    }
+    return bytes;
+}
 
-	    sub = elem->revert;
-	    while (sub != NULL) {
-		TkUndoSubAtom *next = sub->next;
+static void
+FreeSubAtomList(
+    TkUndoSubAtom *sub)		/* First sub-atom of the chain to free. */
+{
+    while (sub != NULL) {
+	TkUndoSubAtom *next = sub->next;
 
-		if (sub->action != NULL) {
-		    Tcl_DecrRefCount(sub->action);
+	if (sub->action != NULL) {
+	    Tcl_DecrRefCount(sub->action);
+	}
+	if (sub->freeProc != NULL) {
+	    sub->freeProc(sub->clientData);
+	}
+	ckfree(sub);
+	sub = next;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SubAtomListSize --
+ *
+ *	Estimate the memory used by a chain of sub-atoms: the sub-atoms
+ *	themselves, the bytes their creators reported for the client data,
+ *	and the action scripts. For scripts that are lists, each element is
+ *	charged a Tcl_Obj plus its string representation.
+ *
+ * Results:
+ *	The estimated number of bytes.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Size
+SubAtomListSize(
+    TkUndoSubAtom *sub)		/* First sub-atom of the chain. */
+{
+    Tcl_Size bytes = 0;
+
+    for (; sub != NULL; sub = sub->next) {
+	bytes += sizeof(TkUndoSubAtom) + sub->size;
+	if (sub->action != NULL) {
+	    Tcl_Size i, objc;
+	    Tcl_Obj **objv;
+
+	    bytes += sizeof(Tcl_Obj);
+	    if (Tcl_ListObjGetElements(NULL, sub->action, &objc,
+		    &objv) == TCL_OK) {
+		for (i = 0; i < objc; i++) {
+		    bytes += sizeof(Tcl_Obj) + sizeof(Tcl_Obj *);
+		    if (objv[i]->bytes != NULL) {
+			bytes += objv[i]->length;
+		    }
 		}
-		ckfree(sub);
-		sub = next;
+	    } else if (sub->action->bytes != NULL) {
+		bytes += sub->action->length;
 	    }
 	}
-	ckfree(elem);
     }
-    *stack = NULL;
+    return bytes;
 }
 
 /*
@@ -185,9 +274,75 @@ TkUndoPushAction(
     atom->type = TK_UNDO_ACTION;
     atom->apply = apply;
     atom->revert = revert;
+    atom->size = sizeof(TkUndoAtom) + SubAtomListSize(apply)
+	    + SubAtomListSize(revert);
 
     TkUndoPushStack(&stack->undoStack, atom);
+    stack->undoBytes += atom->size;
     TkUndoClearStack(&stack->redoStack);
+    stack->redoBytes = 0;
+    TrimUndoStack(stack);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkUndoGetTopRecord --
+ *
+ *	Look for an action that a new edit may be merged into: the top of the
+ *	undo stack must be an action (not a separator) whose first 'apply'
+ *	sub-atom calls funcPtr, and there must be nothing to redo.
+ *
+ * Results:
+ *	The clientData of that sub-atom, or NULL if there is no such action.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void *
+TkUndoGetTopRecord(
+    TkUndoRedoStack *stack,	/* An Undo/Redo stack */
+    TkUndoProc *funcPtr)	/* Callback the action must use. */
+{
+    TkUndoAtom *atom = stack->undoStack;
+
+    if (atom == NULL || atom->type != TK_UNDO_ACTION
+	    || stack->redoStack != NULL || atom->apply == NULL
+	    || atom->apply->funcPtr != funcPtr) {
+	return NULL;
+    }
+    return atom->apply->clientData;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkUndoResizeTopAction --
+ *
+ *	Record that the action on top of the undo stack, as returned by
+ *	TkUndoGetTopRecord, grew or shrank by delta bytes.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	May delete the oldest compound actions from the stack if the byte
+ *	budget is now exceeded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkUndoResizeTopAction(
+    TkUndoRedoStack *stack,	/* An Undo/Redo stack */
+    Tcl_Size delta)		/* Change of the size of the top action. */
+{
+    stack->undoStack->size += delta;
+    stack->undoBytes += delta;
+    TrimUndoStack(stack);
 }
 
 /*
@@ -241,6 +396,8 @@ TkUndoMakeCmdSubAtom(
     atom->command = command;
     atom->funcPtr = NULL;
     atom->clientData = NULL;
+    atom->freeProc = NULL;
+    atom->size = 0;
     atom->next = NULL;
     atom->action = actionScript;
     if (atom->action != NULL) {
@@ -303,6 +460,8 @@ TkUndoMakeSubAtom(
     atom->command = NULL;
     atom->funcPtr = funcPtr;
     atom->clientData = clientData;
+    atom->freeProc = NULL;
+    atom->size = 0;
     atom->next = NULL;
     atom->action = actionScript;
     if (atom->action != NULL) {
@@ -318,6 +477,45 @@ TkUndoMakeSubAtom(
     return atom;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkUndoMakeRecordSubAtom --
+ *
+ *	Create a new undo/redo step that is described entirely by a C
+ *	structure owned by the caller, rather than by a Tcl script. When
+ *	evaluated it calls funcPtr with the undo stack's 'interp', the
+ *	'clientData' given and a NULL script. When the atom is discarded,
+ *	freeProc (if non-NULL) is called with 'clientData'. The 'size' is the
+ *	number of bytes held by 'clientData', which is charged against the
+ *	byte budget of the stack.
+ *
+ * Results:
+ *	The newly created subAtom is returned. It must be passed to
+ *	TkUndoPushAction otherwise a memory leak will result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TkUndoSubAtom *
+TkUndoMakeRecordSubAtom(
+    TkUndoProc *funcPtr,	/* Callback function to perform the
+				 * undo/redo. */
+    TkUndoFreeProc *freeProc,	/* Function to release clientData, or
+				 * NULL. */
+    void *clientData,		/* Data to pass to the callback function. */
+    Tcl_Size size)		/* Bytes held by clientData. */
+{
+    TkUndoSubAtom *atom = TkUndoMakeSubAtom(funcPtr, clientData, NULL, NULL);
+
+    atom->freeProc = freeProc;
+    atom->size = size;
+    return atom;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -347,6 +545,9 @@ TkUndoInitStack(
     stack->interp = interp;
     stack->maxdepth = maxdepth;
     stack->depth = 0;
+    stack->maxbytes = 0;
+    stack->undoBytes = 0;
+    stack->redoBytes = 0;
     return stack;
 }
 
@@ -394,34 +595,94 @@ TkUndoSetMaxDepth(
 	}
 	CLANG_ASSERT(prevelem);
 	prevelem->next = NULL;
-	while (elem != NULL) {
-	    prevelem = elem;
-	    if (elem->type != TK_UNDO_SEPARATOR) {
-		TkUndoSubAtom *sub = elem->apply;
-		while (sub != NULL) {
-		    TkUndoSubAtom *next = sub->next;
+	stack->undoBytes -= FreeAtomList(elem, NULL);
+	stack->depth = stack->maxdepth;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkUndoSetMaxBytes --
+ *
+ *	Set the maximum number of bytes the undo stack may use.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	May delete the oldest compound actions from the stack if they no
+ *	longer fit in the new budget.
+ *
+ *----------------------------------------------------------------------
+ */
 
-		    if (sub->action != NULL) {
-			Tcl_DecrRefCount(sub->action);
-		    }
-		    ckfree(sub);
-		    sub = next;
-		}
-		sub = elem->revert;
-		while (sub != NULL) {
-		    TkUndoSubAtom *next = sub->next;
+void
+TkUndoSetMaxBytes(
+    TkUndoRedoStack *stack,	/* An Undo/Redo stack */
+    Tcl_Size maxbytes)		/* The maximum number of bytes */
+{
+    stack->maxbytes = maxbytes;
+    TrimUndoStack(stack);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TrimUndoStack --
+ *
+ *	Enforce the byte budget of the undo stack by dropping its oldest
+ *	compound actions. The newest compound action is always kept, even if
+ *	it alone exceeds the budget, and compound actions are only removed as
+ *	a whole.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	May delete elements from the bottom of the undo stack.
+ *
+ *----------------------------------------------------------------------
+ */
 
-		    if (sub->action != NULL) {
-			Tcl_DecrRefCount(sub->action);
-		    }
-		    ckfree(sub);
-		    sub = next;
+static void
+TrimUndoStack(
+    TkUndoRedoStack *stack)	/* An Undo/Redo stack */
+{
+    TkUndoAtom *elem, *cutPtr = NULL;
+    Tcl_Size bytes = 0;
+    int seenAction = 0, sepCount;
+
+    if (stack->maxbytes <= 0 || stack->undoBytes <= stack->maxbytes) {
+	return;
+    }
+
+    /*
+     * Find the deepest separator such that everything above it fits in the
+     * budget, but not one above the newest compound action.
+     */
+
+    for (elem = stack->undoStack; elem != NULL; elem = elem->next) {
+	if (elem->type == TK_UNDO_SEPARATOR) {
+	    if (seenAction) {
+		if (cutPtr != NULL && bytes > stack->maxbytes) {
+		    break;
 		}
+		cutPtr = elem;
 	    }
-	    elem = elem->next;
-	    ckfree(prevelem);
+	} else {
+	    seenAction = 1;
+	}
+	bytes += elem->size;
+    }
+
+    if (cutPtr != NULL && cutPtr->next != NULL) {
+	stack->undoBytes -= FreeAtomList(cutPtr->next, &sepCount);
+	cutPtr->next = NULL;
+	stack->depth -= sepCount;
+	if (stack->depth < 0) {
+	    stack->depth = 0;
 	}
-	stack->depth = stack->maxdepth;
     }
 }
 
@@ -448,6 +709,8 @@ TkUndoClearStacks(
     TkUndoClearStack(&stack->undoStack);
     TkUndoClearStack(&stack->redoStack);
     stack->depth = 0;
+    stack->undoBytes = 0;
+    stack->redoBytes = 0;
 }
 
 /*
@@ -598,6 +861,8 @@ TkUndoRevert(
 
 	EvaluateActionList(stack->interp, elem->revert);
 
+	stack->undoBytes -= elem->size;
+	stack->redoBytes += elem->size;
 	TkUndoPushStack(&stack->redoStack, elem);
 	elem = TkUndoPopStack(&stack->undoStack);
     }
@@ -660,6 +925,8 @@ TkUndoApply(
 
 	EvaluateActionList(stack->interp, elem->apply);
 
+	stack->redoBytes -= elem->size;
+	stack->undoBytes += elem->size;
 	TkUndoPushStack(&stack->undoStack, elem);
 	elem = TkUndoPopStack(&stack->redoStack);
     }
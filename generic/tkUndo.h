@@ -33,6 +33,13 @@ typedef enum {
 typedef int (TkUndoProc)(Tcl_Interp *interp, void *clientData,
 			Tcl_Obj *objPtr);
 
+/*
+ * Callback proc type to release the clientData of a sub-atom when the atom
+ * it belongs to is discarded.
+ */
+
+typedef void (TkUndoFreeProc)(void *clientData);
+
 /*
  * Struct defining a single action, one or more of which may be defined (and
  * stored in a linked list) separately for each undo and redo action of an
@@ -48,6 +55,10 @@ typedef struct TkUndoSubAtom {
     TkUndoProc *funcPtr;	/* Function pointer for callback to perform
 				 * undo/redo actions. */
     void *clientData;	/* Data for 'funcPtr'. */
+    TkUndoFreeProc *freeProc;	/* Called with 'clientData' when the sub-atom
+				 * is freed, or NULL. */
+    Tcl_Size size;		/* Number of bytes held by 'clientData', as
+				 * reported by the creator of the sub-atom. */
     Tcl_Obj *action;		/* Command to apply the action that was
 				 * taken. */
     struct TkUndoSubAtom *next;	/* Pointer to the next element in the linked
@@ -65,6 +76,9 @@ typedef struct TkUndoAtom {
 				 * for this operation. */
     TkUndoSubAtom *revert;	/* Linked list of 'revert' actions to perform
 				 * for this operation. */
+    Tcl_Size size;		/* Approximate number of bytes used by this
+				 * atom and its sub-atoms. Zero for
+				 * separators. */
     struct TkUndoAtom *next;	/* Pointer to the next element in the
 				 * stack. */
 } TkUndoAtom;
@@ -80,6 +94,12 @@ typedef struct TkUndoRedoStack {
 				 * revert and apply scripts. */
     int maxdepth;
     int depth;
+    Tcl_Size maxbytes;		/* The maximum number of bytes the undo stack
+				 * may use, or 0 for no limit. */
+    Tcl_Size undoBytes;		/* Bytes used by the atoms on the undo
+				 * stack. */
+    Tcl_Size redoBytes;		/* Bytes used by the atoms on the redo
+				 * stack. */
 } TkUndoRedoStack;
 
 /*
@@ -97,6 +117,8 @@ MODULE_SCOPE void	TkUndoClearStack(TkUndoAtom **stack);
 
 MODULE_SCOPE TkUndoRedoStack *TkUndoInitStack(Tcl_Interp *interp, int maxdepth);
 MODULE_SCOPE void	TkUndoSetMaxDepth(TkUndoRedoStack *stack, int maxdepth);
+MODULE_SCOPE void	TkUndoSetMaxBytes(TkUndoRedoStack *stack,
+			    Tcl_Size maxbytes);
 MODULE_SCOPE void	TkUndoClearStacks(TkUndoRedoStack *stack);
 MODULE_SCOPE void	TkUndoFreeStack(TkUndoRedoStack *stack);
 MODULE_SCOPE int	TkUndoCanRedo(TkUndoRedoStack *stack);
@@ -107,8 +129,15 @@ MODULE_SCOPE TkUndoSubAtom *TkUndoMakeCmdSubAtom(Tcl_Command command,
 MODULE_SCOPE TkUndoSubAtom *TkUndoMakeSubAtom(TkUndoProc *funcPtr,
 			    void *clientData, Tcl_Obj *actionScript,
 			    TkUndoSubAtom *subAtomList);
+MODULE_SCOPE TkUndoSubAtom *TkUndoMakeRecordSubAtom(TkUndoProc *funcPtr,
+			    TkUndoFreeProc *freeProc, void *clientData,
+			    Tcl_Size size);
 MODULE_SCOPE void	TkUndoPushAction(TkUndoRedoStack *stack,
 			    TkUndoSubAtom *apply, TkUndoSubAtom *revert);
+MODULE_SCOPE void *	TkUndoGetTopRecord(TkUndoRedoStack *stack,
+			    TkUndoProc *funcPtr);
+MODULE_SCOPE void	TkUndoResizeTopAction(TkUndoRedoStack *stack,
+			    Tcl_Size delta);
 MODULE_SCOPE int	TkUndoRevert(TkUndoRedoStack *stack);
 MODULE_SCOPE int	TkUndoApply(TkUndoRedoStack *stack);
 
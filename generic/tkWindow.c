@@ -274,6 +274,7 @@ TkCloseDisplay(
 	}
     }
 
+    TkPixmapPoolCleanup(dispPtr);
     TkGCCleanup(dispPtr);
 
     TkpCloseDisplay(dispPtr);
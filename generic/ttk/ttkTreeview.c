@@ -38,6 +38,7 @@ static const int HALO	= 4;	/* heading separator */
  */
 
 typedef struct TreeItemRec TreeItem;
+typedef struct RowBlock RowBlock;
 struct TreeItemRec {
     Tcl_HashEntry *entryPtr;	/* Back-pointer to hash table entry */
     TreeItem	*parent;	/* Parent item */
@@ -68,8 +69,30 @@ struct TreeItemRec {
     Ttk_TagSet	tagset;
     Ttk_ImageSpec *imagespec;
     int itemPos;		/* Counting items */
-    int visiblePos;		/* Counting visible items */
-    int rowPos;			/* Counting rows (visible physical space) */
+    RowBlock *rowBlock;		/* Row block holding the item, or NULL if
+				 * it is not viewable */
+    int visiblePos;		/* Counting visible items, from the start of
+				 * rowBlock */
+    int rowPos;			/* Counting rows (visible physical space),
+				 * from the start of rowBlock */
+};
+
+/*
+ * The viewable items are kept in display order in a list of row blocks.
+ * Opening, closing, inserting or deleting an item only repacks the blocks
+ * around it and shifts the start of the blocks after it, and looking up the
+ * item at a given row is a binary search over the blocks.
+ */
+
+#define ROW_BLOCK_SIZE	256
+
+struct RowBlock {
+    int first;			/* Position of the first item among the
+				 * viewable items */
+    int rowPos;			/* Row of the first item */
+    int nItems;			/* #entries in items */
+    int nRows;			/* Height of the items, in rows */
+    TreeItem *items[ROW_BLOCK_SIZE];
 };
 
 #define ITEM_OPTION_TAGS_CHANGED	0x100
@@ -133,6 +156,7 @@ static TreeItem *NewItem(void)
 
     item->tagset = NULL;
     item->imagespec = NULL;
+    item->rowBlock = NULL;
 
     return item;
 }
@@ -495,6 +519,11 @@ typedef struct {
     int titleRows;		/* Height of non-scrolled items, in rows */
     int totalRows;		/* Height of non-hidden items, in rows */
     int rowPosNeedsUpdate;	/* Internal rowPos data needs update */
+    int itemPosNeedsUpdate;	/* Internal itemPos data needs update */
+    RowBlock **rowBlocks;	/* Viewable items, in display order */
+    int nRowBlocks;		/* #entries in rowBlocks */
+    int rowBlocksSpace;		/* Allocated size of rowBlocks */
+    int nRowItems;		/* #viewable items */
     Ttk_Box headingArea;	/* Display area for column headings */
     Ttk_Box treeArea;	/* Display area for tree */
     int slack;			/* Slack space (see Resizing section) */
@@ -506,6 +535,11 @@ typedef struct {
     TreePart tree;
 } Treeview;
 
+/* Forward declarations */
+static void ClearRowBlocks(Treeview *);
+static void InvalidateRows(Treeview *);
+static void UpdateSubtreeRows(Treeview *, TreeItem *, int);
+
 #define USER_MASK		0x0100
 #define COLUMNS_CHANGED	(USER_MASK)
 #define DCOLUMNS_CHANGED	(USER_MASK<<1)
@@ -1289,6 +1323,10 @@ static void TreeviewInitialize(Tcl_Interp *interp, void *recordPtr)
     tv->tree.titleRows = 0;
     tv->tree.totalRows = 0;
     tv->tree.rowPosNeedsUpdate = 1;
+    tv->tree.itemPosNeedsUpdate = 1;
+    tv->tree.rowBlocks = NULL;
+    tv->tree.nRowBlocks = tv->tree.rowBlocksSpace = 0;
+    tv->tree.nRowItems = 0;
     tv->tree.striped = 0;
     tv->tree.columns = NULL;
     tv->tree.displayColumns = NULL;
@@ -1349,6 +1387,9 @@ static void TreeviewCleanup(void *recordPtr)
 
     if (tv->tree.displayColumns)
 	ckfree(tv->tree.displayColumns);
+    ClearRowBlocks(tv);
+    if (tv->tree.rowBlocks)
+	ckfree(tv->tree.rowBlocks);
 
     foreachHashEntry(&tv->tree.items, FreeItemCB);
     Tcl_DeleteHashTable(&tv->tree.items);
@@ -1409,7 +1450,7 @@ TreeviewConfigure(Tcl_Interp *interp, void *recordPtr, int mask)
 	return TCL_ERROR;
     }
 
-    tv->tree.rowPosNeedsUpdate = 1;
+    InvalidateRows(tv);
     tv->tree.showFlags = showFlags;
 
     if (mask & (SHOW_CHANGED | DCOLUMNS_CHANGED)) {
@@ -1429,6 +1470,8 @@ static int ConfigureItem(
     int mask;
     Ttk_ImageSpec *newImageSpec = NULL;
     Ttk_TagSet newTagSet = NULL;
+    int wasOpen = item->state & TTK_STATE_OPEN;
+    int wasHidden = item->hidden, oldHeight = item->height;
 
     if (Tk_SetOptions(interp, item, tv->tree.itemOptionTable,
 		objc, objv, tv->core.tkwin, &savedOptions, &mask)
@@ -1499,7 +1542,10 @@ static int ConfigureItem(
 	if (item->imagespec) { TtkFreeImageSpec(item->imagespec); }
 	item->imagespec = newImageSpec;
     }
-    tv->tree.rowPosNeedsUpdate = 1;
+    if ((item->state & TTK_STATE_OPEN) != wasOpen
+	    || item->hidden != wasHidden || item->height != oldHeight) {
+	UpdateSubtreeRows(tv, item, 0);
+    }
     TtkRedisplayWidget(&tv->core);
     return TCL_OK;
 
@@ -1600,57 +1646,366 @@ error:
  * +++ Geometry routines.
  */
 
-/* + UpdatePositionItem --
- *	Update position data for all visible items.
+/* + RowList --
+ *	Growable array of items, used to collect viewable items.
  */
-static void UpdatePositionItem(
-    Treeview *tv, TreeItem *item, int hidden,
-    int *rowPos, int *itemPos, int *visiblePos)
+typedef struct {
+    TreeItem **items;
+    int nItems;
+    int space;
+} RowList;
+
+/* + CollectRows --
+ *	Append item and its viewable descendants, in display order, to list.
+ *	The ancestors of item must be viewable.
+ */
+static void CollectRows(Treeview *tv, TreeItem *item, RowList *list)
 {
-    TreeItem *child = item->children;
-    item->itemPos = *itemPos;
-    *itemPos += 1;
+    TreeItem *child;
 
     if (item->hidden) {
-	hidden = 1;
+	return;
+    }
+    if (item != tv->tree.root) {
+	if (list->nItems >= list->space) {
+	    list->space = list->space ? 2 * list->space : 64;
+	    list->items = (TreeItem **)ckrealloc(list->items,
+		    list->space * sizeof(TreeItem *));
+	}
+	list->items[list->nItems++] = item;
+    }
+    if (item->state & TTK_STATE_OPEN) {
+	for (child = item->children; child; child = child->next) {
+	    CollectRows(tv, child, list);
+	}
     }
+}
 
-    if (hidden) {
-	item->rowPos = -1;
-	item->visiblePos = -1;
-    } else {
-	item->rowPos = *rowPos;
-	item->visiblePos = *visiblePos;
-	if (*visiblePos == tv->tree.nTitleItems) {
-	    tv->tree.titleRows = *rowPos;
+/* + ItemRowPos, ItemVisiblePos --
+ *	Return the row of a viewable item, or its position among the
+ *	viewable items; -1 if the item is not viewable.
+ */
+static int ItemRowPos(TreeItem *item)
+{
+    return item->rowBlock ? item->rowBlock->rowPos + item->rowPos : -1;
+}
+
+static int ItemVisiblePos(TreeItem *item)
+{
+    return item->rowBlock ? item->rowBlock->first + item->visiblePos : -1;
+}
+
+/* + FindRowBlock --
+ *	Return the index of the row block holding the viewable item at the
+ *	specified position, or of the last block if the position is the
+ *	number of viewable items; -1 if there are no blocks.
+ */
+static int FindRowBlock(Treeview *tv, int index)
+{
+    int lo = 0, hi = tv->tree.nRowBlocks;
+
+    while (lo < hi) {
+	int mid = lo + (hi - lo) / 2;
+	if (tv->tree.rowBlocks[mid]->first <= index) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
 	}
+    }
+    return lo - 1;
+}
+
+/* + RowItem --
+ *	Return the viewable item at the specified position.
+ */
+static TreeItem *RowItem(Treeview *tv, int index)
+{
+    RowBlock *blockPtr = tv->tree.rowBlocks[FindRowBlock(tv, index)];
+
+    return blockPtr->items[index - blockPtr->first];
+}
+
+/* + UpdateTitleRows --
+ *	Recompute the height of the non-scrolled items.
+ */
+static void UpdateTitleRows(Treeview *tv)
+{
+    tv->tree.titleRows = 0;
+    if (tv->tree.nTitleItems < tv->tree.nRowItems) {
+	tv->tree.titleRows =
+		ItemRowPos(RowItem(tv, (int) tv->tree.nTitleItems));
+    }
+}
+
+/* + ReplaceRows --
+ *	Replace the viewable items from position start up to (not including)
+ *	end with the nItems items in items. The blocks holding the replaced
+ *	items are repacked, together with a neighbour if the result would be
+ *	small, and the blocks after them are shifted.
+ */
+static void ReplaceRows(
+    Treeview *tv, int start, int end, TreeItem **items, int nItems)
+{
+    RowBlock **blocks = tv->tree.rowBlocks;
+    TreeItem **merged;
+    int b0 = 0, b1 = -1, nOld, nNew, n, i, j, k;
+    int first = 0, rowPos = 0, oldRows = 0, deltaItems, deltaRows;
+
+    if (start == end && nItems == 0) {
+	return;
+    }
+    n = nItems - (end - start);
+    if (tv->tree.nRowBlocks > 0) {
+	b0 = FindRowBlock(tv, start);
+	b1 = FindRowBlock(tv, end);
+	if (blocks[b1]->first + blocks[b1]->nItems - blocks[b0]->first + n
+		< ROW_BLOCK_SIZE / 2) {
+	    if (b1 + 1 < tv->tree.nRowBlocks) {
+		++b1;
+	    } else if (b0 > 0) {
+		--b0;
+	    }
+	}
+	first = blocks[b0]->first;
+	rowPos = blocks[b0]->rowPos;
+	n += blocks[b1]->first + blocks[b1]->nItems - first;
+    }
+    nOld = b1 - b0 + 1;
+
+    /* Merge the items that are kept with the new ones.
+     */
+    merged = (TreeItem **)ckalloc((n ? n : 1) * sizeof(TreeItem *));
+    n = 0;
+    for (k = b0; k <= b1; ++k) {
+	RowBlock *blockPtr = blocks[k];
+	oldRows += blockPtr->nRows;
+	for (i = 0; i < blockPtr->nItems; ++i) {
+	    j = blockPtr->first + i;
+	    if (j == start && nItems > 0) {
+		memcpy(merged + n, items, nItems * sizeof(TreeItem *));
+		n += nItems;
+	    }
+	    if (j >= start && j < end) {
+		blockPtr->items[i]->rowBlock = NULL;
+	    } else {
+		merged[n++] = blockPtr->items[i];
+	    }
+	}
+	ckfree(blockPtr);
+    }
+    if (start == tv->tree.nRowItems && nItems > 0) {
+	memcpy(merged + n, items, nItems * sizeof(TreeItem *));
+	n += nItems;
+    }
+
+    /* Make room for the new blocks and fill them evenly.
+     */
+    nNew = (n + ROW_BLOCK_SIZE - 1) / ROW_BLOCK_SIZE;
+    if (tv->tree.nRowBlocks - nOld + nNew > tv->tree.rowBlocksSpace) {
+	tv->tree.rowBlocksSpace = 2 * (tv->tree.nRowBlocks - nOld + nNew);
+	tv->tree.rowBlocks = (RowBlock **)ckrealloc(tv->tree.rowBlocks,
+		tv->tree.rowBlocksSpace * sizeof(RowBlock *));
+	blocks = tv->tree.rowBlocks;
+    }
+    memmove(blocks + b0 + nNew, blocks + b0 + nOld,
+	    (tv->tree.nRowBlocks - b0 - nOld) * sizeof(RowBlock *));
+    tv->tree.nRowBlocks += nNew - nOld;
+
+    deltaRows = -rowPos - oldRows;
+    for (k = 0, i = 0; k < nNew; ++k) {
+	RowBlock *blockPtr = (RowBlock *)ckalloc(sizeof(RowBlock));
+	blockPtr->first = first;
+	blockPtr->rowPos = rowPos;
+	blockPtr->nItems = n / nNew + (k < n % nNew);
+	blockPtr->nRows = 0;
+	for (j = 0; j < blockPtr->nItems; ++j, ++i) {
+	    TreeItem *item = merged[i];
+	    blockPtr->items[j] = item;
+	    item->rowBlock = blockPtr;
+	    item->visiblePos = j;
+	    item->rowPos = blockPtr->nRows;
+	    blockPtr->nRows += item->height;
+	}
+	first += blockPtr->nItems;
+	rowPos += blockPtr->nRows;
+	blocks[b0 + k] = blockPtr;
+    }
+    ckfree(merged);
+
+    /* Shift the blocks after the new ones.
+     */
+    deltaItems = nItems - (end - start);
+    deltaRows += rowPos;
+    for (k = b0 + nNew; k < tv->tree.nRowBlocks; ++k) {
+	blocks[k]->first += deltaItems;
+	blocks[k]->rowPos += deltaRows;
+    }
+    tv->tree.nRowItems += deltaItems;
+    tv->tree.totalRows += deltaRows;
+    UpdateTitleRows(tv);
+}
+
+/* + ClearRowBlocks --
+ *	Empty the row index.
+ */
+static void ClearRowBlocks(Treeview *tv)
+{
+    int i, k;
+
+    for (k = 0; k < tv->tree.nRowBlocks; ++k) {
+	RowBlock *blockPtr = tv->tree.rowBlocks[k];
+	for (i = 0; i < blockPtr->nItems; ++i) {
+	    blockPtr->items[i]->rowBlock = NULL;
+	}
+	ckfree(blockPtr);
+    }
+    tv->tree.nRowBlocks = 0;
+    tv->tree.nRowItems = 0;
+    tv->tree.totalRows = 0;
+    tv->tree.titleRows = 0;
+}
+
+/* + InvalidateRows --
+ *	Drop the row index, to be rebuilt from scratch when next needed.
+ *	Used for changes that affect the whole tree.
+ */
+static void InvalidateRows(Treeview *tv)
+{
+    if (!tv->tree.rowPosNeedsUpdate) {
+	ClearRowBlocks(tv);
+    }
+    tv->tree.rowPosNeedsUpdate = 1;
+    tv->tree.itemPosNeedsUpdate = 1;
+}
+
+/* + UpdateSubtreeRows --
+ *	Bring the row index up to date after a change that can only affect
+ *	which items of the subtree of item are viewable, or their heights:
+ *	item was inserted or attached, or its -open, -hidden or -height
+ *	option changed. With remove set, take the subtree out of the index
+ *	instead; this must be done before item is detached or deleted.
+ */
+static void UpdateSubtreeRows(Treeview *tv, TreeItem *item, int remove)
+{
+    RowList list = {NULL, 0, 0};
+    TreeItem *parent, *sibling;
+    int start, end = -1;
 
-	*visiblePos += 1;
-	*rowPos += item->height;
+    tv->tree.itemPosNeedsUpdate = 1;
+    if (tv->tree.rowPosNeedsUpdate) {
+	return;
+    }
+    if (item == tv->tree.root) {
+	InvalidateRows(tv);
+	return;
     }
 
-    if (!(item->state & TTK_STATE_OPEN)) {
-	hidden = 1;
+    /* The viewable items of the subtree are those between item itself,
+     * if it is viewable, and the first viewable item after the subtree.
+     * An item that is not viewable has no viewable descendants.
+     */
+    for (parent = item; parent && end < 0; parent = parent->parent) {
+	for (sibling = parent->next; sibling; sibling = sibling->next) {
+	    if (sibling->rowBlock) {
+		end = ItemVisiblePos(sibling);
+		break;
+	    }
+	}
+    }
+    if (end < 0) {
+	end = tv->tree.nRowItems;
+    }
+    start = item->rowBlock ? ItemVisiblePos(item) : end;
+
+    if (!remove) {
+	for (parent = item->parent; parent && parent != tv->tree.root
+		&& !parent->hidden && (parent->state & TTK_STATE_OPEN);
+		parent = parent->parent) {
+	    /* empty */
+	}
+	if (parent == tv->tree.root && !parent->hidden
+		&& (parent->state & TTK_STATE_OPEN)) {
+	    CollectRows(tv, item, &list);
+	}
     }
-    while (child) {
-	UpdatePositionItem(tv, child, hidden, rowPos, itemPos, visiblePos);
-	child = child->next;
+    ReplaceRows(tv, start, end, list.items, list.nItems);
+    if (list.items) {
+	ckfree(list.items);
     }
 }
 
 /* + UpdatePositionTree --
- *	Update position data for all visible items.
+ *	Rebuild the row index from scratch.
+ *
+ *	This is only needed after changes that affect the whole tree, as
+ *	flagged by rowPosNeedsUpdate. Inserting, deleting, moving, detaching,
+ *	opening, closing, hiding or resizing an item patch the index through
+ *	UpdateSubtreeRows instead.
  */
 static void UpdatePositionTree(Treeview *tv)
 {
-    /* -1 for the invisible root */
-    int rowPos = -1, itemPos = -1, visiblePos = -1;
-    tv->tree.titleRows = 0;
-    UpdatePositionItem(tv, tv->tree.root, 0, &rowPos, &itemPos, &visiblePos);
-    tv->tree.totalRows = rowPos;
+    RowList list = {NULL, 0, 0};
+
+    ClearRowBlocks(tv);
+    CollectRows(tv, tv->tree.root, &list);
+    ReplaceRows(tv, 0, 0, list.items, list.nItems);
+    if (list.items) {
+	ckfree(list.items);
+    }
     tv->tree.rowPosNeedsUpdate = 0;
 }
 
+/* + UpdateItemPositions --
+ *	Number all attached items in preorder, for cell selection ranges.
+ */
+static void UpdateItemPositions(Treeview *tv)
+{
+    TreeItem *item;
+    int itemPos = 0;
+
+    tv->tree.root->itemPos = -1;
+    for (item = tv->tree.root->children; item; item = NextPreorder(item)) {
+	item->itemPos = itemPos++;
+    }
+    tv->tree.itemPosNeedsUpdate = 0;
+}
+
+/* + FindRowIndex --
+ *	Binary search of the row index. Returns the position of the last
+ *	viewable item starting at or before the specified row, or -1 if
+ *	there is none. Position data must be up to date.
+ */
+static int FindRowIndex(Treeview *tv, int row)
+{
+    RowBlock *blockPtr;
+    int lo = 0, hi = tv->tree.nRowBlocks;
+
+    while (lo < hi) {
+	int mid = lo + (hi - lo) / 2;
+	if (tv->tree.rowBlocks[mid]->rowPos <= row) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    if (lo == 0) {
+	return -1;
+    }
+    blockPtr = tv->tree.rowBlocks[lo - 1];
+    row -= blockPtr->rowPos;
+    lo = 0;
+    hi = blockPtr->nItems;
+    while (lo < hi) {
+	int mid = lo + (hi - lo) / 2;
+	if (blockPtr->items[mid]->rowPos <= row) {
+	    lo = mid + 1;
+	} else {
+	    hi = mid;
+	}
+    }
+    return blockPtr->first + lo - 1;
+}
+
 /* + IdentifyItem --
  *	Locate the item at the specified y position, if any.
  */
@@ -1659,7 +2014,7 @@ static TreeItem *IdentifyItem(Treeview *tv, int y)
     TreeItem *item;
     int rowHeight = tv->tree.rowHeight;
     int ypos = tv->tree.treeArea.y;
-    int nextRow, row;
+    int index, row;
     if (y < ypos) {
 	return NULL;
     }
@@ -1670,9 +2025,13 @@ static TreeItem *IdentifyItem(Treeview *tv, int y)
     if (row >= tv->tree.titleRows) {
 	row += tv->tree.yscroll.first;
     }
-    for (item = tv->tree.root->children; item; item = NextPreorder(item)) {
-	nextRow = item->rowPos + item->height;
-	if (item->rowPos <= row && row < nextRow) break;
+    index = FindRowIndex(tv, row);
+    if (index < 0) {
+	return NULL;
+    }
+    item = RowItem(tv, index);
+    if (row >= ItemRowPos(item) + item->height) {
+	return NULL;
     }
     return item;
 }
@@ -1782,7 +2141,7 @@ static int BoundingBox(
     if (tv->tree.rowPosNeedsUpdate) {
 	UpdatePositionTree(tv);
     }
-    dispRow = DisplayRow(item->rowPos, tv);
+    dispRow = DisplayRow(ItemRowPos(item), tv);
     if (dispRow < 0) {
 	/* not viewable, or off-screen */
 	return 0;
@@ -1999,8 +2358,13 @@ static void TreeviewDoLayout(void *clientData)
     }
 
     visibleRows = tv->tree.treeArea.height / tv->tree.rowHeight;
-    tv->tree.root->state |= TTK_STATE_OPEN;
-    UpdatePositionTree(tv);
+    if (!(tv->tree.root->state & TTK_STATE_OPEN)) {
+	tv->tree.root->state |= TTK_STATE_OPEN;
+	InvalidateRows(tv);
+    }
+    if (tv->tree.rowPosNeedsUpdate) {
+	UpdatePositionTree(tv);
+    }
     first = tv->tree.yscroll.first;
     last = tv->tree.yscroll.first + visibleRows - tv->tree.titleRows;
     total = tv->tree.totalRows - tv->tree.titleRows;
@@ -2125,7 +2489,7 @@ static void DrawSeparators(Treeview *tv, Drawable d)
  static void OverrideStriped(
     Treeview *tv, TreeItem *item, DisplayItem *displayItem)
 {
-    int striped = item->visiblePos % 2 && tv->tree.striped;
+    int striped = ItemVisiblePos(item) % 2 && tv->tree.striped;
     if (striped && displayItem->stripedBgObj) {
 	displayItem->backgroundObj = displayItem->stripedBgObj;
 	displayItem->stripedBgObj = NULL;
@@ -2292,7 +2656,7 @@ static void DrawItem(
     DisplayItem displayItem, displayItemSel, displayItemLocal;
     int x, y, h, xTitle, dispRow, rowHeight;
 
-    dispRow = DisplayRow(item->rowPos, tv);
+    dispRow = DisplayRow(ItemRowPos(item), tv);
     h = tv->tree.rowHeight * dispRow;
     if (h >= tv->tree.treeArea.height) {
 	/* The item is outside the visible area */
@@ -2329,6 +2693,9 @@ static void DrawItem(
     /* Draw row background for non-scrolled area:
      */
     if (tv->tree.nTitleColumns >= 1) {
+#ifdef HAVE_XFT
+	TkUnixFlushXftBatch();
+#endif
 	Ttk_Box rowBox = Ttk_MakeBox(tv->tree.treeArea.x, y,
 		tv->tree.titleWidth, rowHeight);
 	DisplayLayout(tv->tree.rowLayout, &displayItem, state, rowBox, d);
@@ -2397,36 +2764,58 @@ static void DrawItem(
     }
 }
 
-/* + DrawSubtree --
- *	Draw an item and all of its (viewable) descendants.
+/* + DrawRows --
+ *	Draw the non-scrolled items and the items in the scrolled window.
+ *	Only the items that are actually on screen are visited, so the cost
+ *	does not depend on the size of the tree.
  */
-
-static void DrawForest(	/* forward */
-    Treeview *tv, TreeItem *item, Drawable d, int depth);
-
-static void DrawSubtree(
-    Treeview *tv, TreeItem *item, Drawable d, int depth)
+static void DrawRows(Treeview *tv, Drawable d)
 {
-    int dispRow = DisplayRow(item->rowPos, tv);
-    if (dispRow >= 0) {
-	DrawItem(tv, item, d, depth);
+    TreeItem *item;
+    int firstRow, lastRow, i, j;
+
+    if (tv->tree.rowPosNeedsUpdate) {
+	UpdatePositionTree(tv);
     }
 
-    if (item->state & TTK_STATE_OPEN) {
-	DrawForest(tv, item->children, d, depth + 1);
+    /* With Xft, the text of each row is sent to the server in one batch.
+     */
+#ifdef HAVE_XFT
+    TkUnixBeginXftBatch();
+#endif
+    for (i = 0; i < tv->tree.nRowItems; ++i) {
+	item = RowItem(tv, i);
+	if (ItemRowPos(item) >= tv->tree.titleRows) {
+	    break;
+	}
+	DrawItem(tv, item, d, ItemDepth(item));
+#ifdef HAVE_XFT
+	TkUnixFlushXftBatch();
+#endif
     }
-}
 
-/* + DrawForest --
- *	Draw a sequence of items and their visible descendants.
- */
-static void DrawForest(
-    Treeview *tv, TreeItem *item, Drawable d, int depth)
-{
-    while (item) {
-	DrawSubtree(tv, item, d, depth);
-	item = item->next;
+    /* See DisplayRow() for the range of rows that are on screen.
+     */
+    firstRow = tv->tree.titleRows + tv->tree.yscroll.first;
+    lastRow = tv->tree.yscroll.first
+	    + tv->tree.treeArea.height / tv->tree.rowHeight;
+    j = FindRowIndex(tv, firstRow);
+    if (j < 0 || ItemRowPos(RowItem(tv, j)) < firstRow) {
+	++j;
+    }
+    for (i = (j > i) ? j : i; i < tv->tree.nRowItems; ++i) {
+	item = RowItem(tv, i);
+	if (ItemRowPos(item) > lastRow) {
+	    break;
+	}
+	DrawItem(tv, item, d, ItemDepth(item));
+#ifdef HAVE_XFT
+	TkUnixFlushXftBatch();
+#endif
     }
+#ifdef HAVE_XFT
+    TkUnixEndXftBatch();
+#endif
 }
 
 /* + DrawTreeArea --
@@ -2436,7 +2825,7 @@ static void DrawTreeArea(Treeview *tv, Drawable d) {
     if (tv->tree.showFlags & SHOW_HEADINGS) {
 	DrawHeadings(tv, d);
     }
-    DrawForest(tv, tv->tree.root->children, d, 0);
+    DrawRows(tv, d);
     DrawSeparators(tv, d);
 }
 
@@ -2487,8 +2876,7 @@ static void TreeviewDisplay(void *clientData, Drawable d)
 	GC gc;
 
 	/* Create a temporary helper drawable */
-	p = Tk_GetPixmap(Tk_Display(tkwin), Tk_WindowId(tkwin),
-	  winWidth, winHeight, Tk_Depth(tkwin));
+	p = TkGetBufferPixmap(tkwin, winWidth, winHeight);
 
 	/* Get a graphics context for copying the drawable content */
 	gcValues.function = GXcopy;
@@ -2507,7 +2895,7 @@ static void TreeviewDisplay(void *clientData, Drawable d)
 	  (unsigned) width, (unsigned) height, x, y);
 
 	/* Clean up the temporary resources */
-	Tk_FreePixmap(Tk_Display(tkwin), p);
+	TkFreeBufferPixmap(tkwin, p);
 	Tk_FreeGC(Tk_Display(tkwin), gc);
 #else
 	Ttk_Theme currentTheme = Ttk_GetCurrentTheme(tv->core.interp);
@@ -2697,7 +3085,7 @@ static int TreeviewChildrenCommand(
 	}
 
 	ckfree(newChildren);
-	tv->tree.rowPosNeedsUpdate = 1;
+	InvalidateRows(tv);
 	TtkRedisplayWidget(&tv->core);
     }
 
@@ -3324,7 +3712,7 @@ static int TreeviewInsertCommand(
     Tcl_SetHashValue(entryPtr, newItem);
     newItem->entryPtr = entryPtr;
     InsertItem(parent, sibling, newItem);
-    tv->tree.rowPosNeedsUpdate = 1;
+    UpdateSubtreeRows(tv, newItem, 0);
     TtkRedisplayWidget(&tv->core);
 
     Tcl_SetObjResult(interp, ItemID(tv, newItem));
@@ -3361,10 +3749,10 @@ static int TreeviewDetachCommand(
     }
 
     for (i = 0; items[i]; ++i) {
+	UpdateSubtreeRows(tv, items[i], 1);
 	DetachItem(items[i]);
     }
 
-    tv->tree.rowPosNeedsUpdate = 1;
     TtkRedisplayWidget(&tv->core);
     ckfree(items);
     return TCL_OK;
@@ -3461,6 +3849,9 @@ static int TreeviewDeleteCommand(
 		selChange = 1;
 	    }
 	}
+	if (items[i]->entryPtr) {
+	    UpdateSubtreeRows(tv, items[i], 1);
+	}
 	delq = DeleteItems(items[i], delq);
     }
 
@@ -3480,7 +3871,6 @@ static int TreeviewDeleteCommand(
     if (selChange) {
 	Tk_SendVirtualEvent(tv->core.tkwin, "TreeviewSelect", NULL);
     }
-    tv->tree.rowPosNeedsUpdate = 1;
     TtkRedisplayWidget(&tv->core);
     return TCL_OK;
 }
@@ -3539,10 +3929,11 @@ static int TreeviewMoveCommand(
 
     /* Move item:
      */
+    UpdateSubtreeRows(tv, item, 1);
     DetachItem(item);
     InsertItem(parent, sibling, item);
+    UpdateSubtreeRows(tv, item, 0);
 
-    tv->tree.rowPosNeedsUpdate = 1;
     TtkRedisplayWidget(&tv->core);
     return TCL_OK;
 }
@@ -3596,7 +3987,7 @@ static int TreeviewSeeCommand(
 	    parent->openObj = unshareObj(parent->openObj);
 	    Tcl_SetBooleanObj(parent->openObj, 1);
 	    parent->state |= TTK_STATE_OPEN;
-	    tv->tree.rowPosNeedsUpdate = 1;
+	    UpdateSubtreeRows(tv, parent, 0);
 	    TtkRedisplayWidget(&tv->core);
 	}
     }
@@ -3609,12 +4000,12 @@ static int TreeviewSeeCommand(
 
     /* Make sure item is visible:
      */
-    if (item->rowPos < tv->tree.titleRows) {
+    if (ItemRowPos(item) < tv->tree.titleRows) {
 	return TCL_OK;
     }
     visibleRows = tv->tree.treeArea.height / tv->tree.rowHeight
 	    - tv->tree.titleRows;
-    scrollRow1 = item->rowPos - tv->tree.titleRows;
+    scrollRow1 = ItemRowPos(item) - tv->tree.titleRows;
     scrollRow2 = scrollRow1 + item->height - 1;
 
     if (scrollRow2 >= tv->tree.yscroll.first + visibleRows) {
@@ -3894,8 +4285,8 @@ static int CellSelectionRange(
 
     /* Correct order.
      */
-    if (tv->tree.rowPosNeedsUpdate) {
-	UpdatePositionTree(tv);
+    if (tv->tree.itemPosNeedsUpdate) {
+	UpdateItemPositions(tv);
     }
     if (cellFrom.item->itemPos > cellTo.item->itemPos) {
 	item = cellFrom.item;
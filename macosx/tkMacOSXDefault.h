@@ -132,6 +132,7 @@
 #define DEF_CANVAS_INSERT_OFF_TIME	"300"
 #define DEF_CANVAS_INSERT_ON_TIME	"600"
 #define DEF_CANVAS_INSERT_WIDTH		"2"
+#define DEF_CANVAS_LAYER_TAG		""
 #define DEF_CANVAS_RELIEF		"flat"
 #define DEF_CANVAS_SCROLL_REGION	""
 #define DEF_CANVAS_SELECT_COLOR		SELECT_BG
@@ -514,6 +515,8 @@
 #define DEF_TEXT_INSERT_UNFOCUSSED	"none"
 #define DEF_TEXT_INSERT_WIDTH		"1"
 #define DEF_TEXT_MAX_UNDO		"0"
+#define DEF_TEXT_MAX_UNDO_BYTES		"0"
+#define DEF_TEXT_METRICS_THREAD	"0"
 #define DEF_TEXT_PADX			"1"
 #define DEF_TEXT_PADY			"1"
 #define DEF_TEXT_RELIEF			"flat"
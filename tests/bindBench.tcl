@@ -0,0 +1,44 @@
+# This file measures how many events per second a binding can handle for the
+# different shapes of binding script: scripts without % sequences, scripts
+# whose % sequences are whole words, and scripts that need a full textual
+# substitution. It is not part of the test suite; run it with wish:
+#
+#	wish bindBench.tcl ?events?
+
+package require tk
+wm withdraw .
+
+lassign $argv events
+if {$events eq ""} {
+    set events 100000
+}
+
+toplevel .b
+frame .b.f -width 100 -height 100
+pack .b.f
+update
+
+set scripts {
+    static	{incr ::n}
+    words	{set ::n %x; set ::m %y}
+    expand	{set ::n [expr {%x + %y}]}
+}
+
+puts [format "%-8s %12s %14s" script usec/event events/sec]
+foreach {name script} $scripts {
+    bind .b.f <Motion> $script
+    set n 0
+    event generate .b.f <Motion> -x 1 -y 1
+    set t [lindex [time {
+	event generate .b.f <Motion> -x 10 -y 20
+    } $events] 0]
+    puts [format "%-8s %12.3f %14.0f" $name $t [expr {1e6 / $t}]]
+}
+
+destroy .b
+exit
+
+# Local Variables:
+# mode: tcl
+# fill-column: 78
+# End:
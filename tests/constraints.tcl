@@ -304,6 +304,10 @@ testConstraint testmenubar     [llength [info commands testmenubar]]
 testConstraint testmetrics     [llength [info commands testmetrics]]
 testConstraint testmovemouse   [llength [info commands testmovemouse]]
 testConstraint testobjconfig   [llength [info commands testobjconfig]]
+testConstraint testphotoputblock [llength [info commands testphotoputblock]]
+testConstraint testxrequests [llength [info commands testxrequests]]
+testConstraint testlistboxvar [llength [info commands testlistboxvar]]
+testConstraint testpngsimd [llength [info commands testpngsimd]]
 testConstraint testpressbutton [llength [info commands testpressbutton]]
 testConstraint testsend        [llength [info commands testsend]]
 testConstraint testtext        [llength [info commands testtext]]
@@ -0,0 +1,57 @@
+# This file measures how fast the png photo image format writes images, and
+# how large the results are, for each compression level and filter type. It
+# is not part of the test suite; run it with wish, optionally giving an image
+# file to encode instead of the generated one:
+#
+#	wish imgPNGBench.tcl ?imageFile? ?iterations?
+
+package require tk
+wm withdraw .
+
+lassign $argv fileName iterations
+if {$iterations eq ""} {
+    set iterations 5
+}
+
+if {$fileName ne ""} {
+    set img [image create photo -file $fileName]
+} else {
+    # Something like a screenshot: flat areas, text-like detail and a
+    # smooth gradient.
+
+    set img [image create photo -width 800 -height 600]
+    $img put #ececec -to 0 0 800 600
+    for {set y 0} {$y < 200} {incr y} {
+	set c [format #%02x%02x%02x $y [expr {$y / 2}] [expr {255 - $y}]]
+	$img put $c -to 0 [expr {400 + $y}] 800 [expr {401 + $y}]
+    }
+    for {set i 0} {$i < 2000} {incr i} {
+	set x [expr {($i * 37) % 780}]
+	set y [expr {40 + ($i * 13) % 340}]
+	$img put black -to $x $y [expr {$x + 1 + $i % 7}] [expr {$y + 2}]
+    }
+}
+
+set pixels [expr {[image width $img] * [image height $img]}]
+puts [format "%dx%d image, %d iterations" \
+	[image width $img] [image height $img] $iterations]
+puts [format "%-9s %5s %12s %10s" filter level bytes MPix/s]
+
+foreach filter {none sub up average paeth adaptive} {
+    foreach level {1 6 9} {
+	set format [list png -compression $level -filter $filter]
+	set usec [lindex [time {
+	    set data [$img data -format $format]
+	} $iterations] 0]
+	puts [format "%-9s %5d %12d %10.2f" $filter $level \
+		[string length $data] [expr {$pixels / double($usec)}]]
+    }
+}
+
+image delete $img
+exit
+
+# Local Variables:
+# mode: tcl
+# fill-column: 78
+# End:
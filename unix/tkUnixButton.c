@@ -515,8 +515,7 @@ TkpDisplayButton(
      * been cleared.
      */
 
-    pixmap = Tk_GetPixmap(butPtr->display, Tk_WindowId(tkwin),
-	    Tk_Width(tkwin), Tk_Height(tkwin), Tk_Depth(tkwin));
+    pixmap = TkGetBufferPixmap(tkwin, Tk_Width(tkwin), Tk_Height(tkwin));
     Tk_Fill3DRectangle(tkwin, pixmap, border, 0, 0, Tk_Width(tkwin),
 	    Tk_Height(tkwin), 0, TK_RELIEF_FLAT);
 
@@ -865,7 +864,7 @@ TkpDisplayButton(
     XCopyArea(butPtr->display, pixmap, Tk_WindowId(tkwin),
 	    butPtr->copyGC, 0, 0, (unsigned) Tk_Width(tkwin),
 	    (unsigned) Tk_Height(tkwin), 0, 0);
-    Tk_FreePixmap(butPtr->display, pixmap);
+    TkFreeBufferPixmap(tkwin, pixmap);
 }
 
 /*
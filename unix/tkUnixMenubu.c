@@ -113,8 +113,7 @@ TkpDisplayMenuButton(
      * image has been cleared.
      */
 
-    pixmap = Tk_GetPixmap(mbPtr->display, Tk_WindowId(tkwin),
-	    Tk_Width(tkwin), Tk_Height(tkwin), Tk_Depth(tkwin));
+    pixmap = TkGetBufferPixmap(tkwin, Tk_Width(tkwin), Tk_Height(tkwin));
     Tk_Fill3DRectangle(tkwin, pixmap, border, 0, 0, Tk_Width(tkwin),
 	    Tk_Height(tkwin), 0, TK_RELIEF_FLAT);
 
@@ -302,7 +301,7 @@ TkpDisplayMenuButton(
     XCopyArea(mbPtr->display, pixmap, Tk_WindowId(tkwin),
 	    mbPtr->normalTextGC, 0, 0, (unsigned) Tk_Width(tkwin),
 	    (unsigned) Tk_Height(tkwin), 0, 0);
-    Tk_FreePixmap(mbPtr->display, pixmap);
+    TkFreeBufferPixmap(tkwin, pixmap);
 }
 
 /*
@@ -38,6 +38,27 @@ typedef struct {
     int next;
 } UnixFtColorList;
 
+/*
+ * Per-font cache of the face selected for a character, its glyph index in
+ * that face and its metrics in the unrotated font. Looking these up through
+ * Xft and fontconfig for every character dominates the cost of measuring
+ * and drawing long strings. Characters in the BMP are kept in pages of a
+ * dense table, allocated on first use; the others in a hash table.
+ */
+
+typedef struct {
+    int face;			/* Index into faces, or -1 if this entry is
+				 * not filled in yet. */
+    FT_UInt glyph;		/* Glyph index in the face's font. */
+    short xOff, yOff;		/* Advance, in the unrotated font. */
+    unsigned short width, height;
+				/* Ink size, in the unrotated font. */
+} UnixFtGlyph;
+
+#define GLYPH_PAGE_BITS	8
+#define GLYPH_PAGE_SIZE	(1 << GLYPH_PAGE_BITS)
+#define GLYPH_PAGES	(0x10000 >> GLYPH_PAGE_BITS)
+
 typedef struct {
     TkFont font;		/* Stuff used by generic font package. Must be
 				 * first in structure. */
@@ -52,21 +73,77 @@ typedef struct {
     int ncolors;
     int firstColor;
     UnixFtColorList colors[MAX_CACHED_COLORS];
+    UnixFtGlyph **glyphPages;	/* GLYPH_PAGES pages for the BMP, or NULL. */
+    Tcl_HashTable *glyphTable;	/* Characters beyond the BMP, or NULL. */
 } UnixFtFont;
 
 /*
  * Used to describe the current clipping box. Can't be passed normally because
  * the information isn't retrievable from the GC.
+ *
+ * Between TkUnixBeginXftBatch and TkUnixEndXftBatch, Tk_DrawChars does not
+ * draw right away but collects its glyphs, so that consecutive calls for the
+ * same drawable and color are sent to the server as one request. The batch
+ * is drawn through the XftDraw of the font that started it.
  */
 
+#define NUM_BATCH   1024
+
 typedef struct {
     Region clipRegion;		/* The clipping region, or None. */
+    int batchLevel;		/* Nesting level of TkUnixBeginXftBatch. */
+    int nBatch;			/* Number of glyphs waiting in batchSpecs. */
+    UnixFtFont *batchFontPtr;	/* Font whose ftDraw draws the batch. */
+    Drawable batchDrawable;	/* Drawable the batch is for. */
+    XftColor batchColor;	/* Color the batch is drawn in. */
+    XftGlyphFontSpec batchSpecs[NUM_BATCH];
 } ThreadSpecificData;
 static Tcl_ThreadDataKey dataKey;
 
 TCL_DECLARE_MUTEX(xftMutex);
 #define LOCK Tcl_MutexLock(&xftMutex)
 #define UNLOCK Tcl_MutexUnlock(&xftMutex)
+
+/*
+ *-------------------------------------------------------------------------
+ *
+ * FlushBatch --
+ *
+ *	Draw the glyphs collected by Tk_DrawChars since the batch was last
+ *	flushed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The batch is emptied.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+static void
+FlushBatch(
+    ThreadSpecificData *tsdPtr)
+{
+    XftDraw *ftDraw;
+
+    if (tsdPtr->nBatch == 0) {
+	return;
+    }
+    ftDraw = tsdPtr->batchFontPtr->ftDraw;
+    XftDrawChange(ftDraw, tsdPtr->batchDrawable);
+    if (tsdPtr->clipRegion != NULL) {
+	XftDrawSetClip(ftDraw, tsdPtr->clipRegion);
+    }
+    LOCK;
+    XftDrawGlyphFontSpec(ftDraw, &tsdPtr->batchColor, tsdPtr->batchSpecs,
+	    tsdPtr->nBatch);
+    UNLOCK;
+    if (tsdPtr->clipRegion != NULL) {
+	XftDrawSetClip(ftDraw, NULL);
+    }
+    tsdPtr->nBatch = 0;
+}
 
 /*
  *-------------------------------------------------------------------------
@@ -101,11 +178,10 @@ TkpFontPkgInit(
 {
 }
 
-static XftFont *
-GetFont(
+static int
+GetFace(
     UnixFtFont *fontPtr,
-    FcChar32 ucs4,
-    double angle)
+    FcChar32 ucs4)
 {
     int i;
 
@@ -123,6 +199,15 @@ GetFont(
     } else {
 	i = 0;
     }
+    return i;
+}
+
+static XftFont *
+GetFaceFont(
+    UnixFtFont *fontPtr,
+    int i,
+    double angle)
+{
     if ((angle == 0.0 && !fontPtr->faces[i].ft0Font) || (angle != 0.0 &&
 	    (!fontPtr->faces[i].ftFont || fontPtr->faces[i].angle != angle))){
 	FcPattern *pat = FcFontRenderPrepare(0, fontPtr->pattern,
@@ -185,6 +270,136 @@ GetFont(
     }
     return (angle==0.0? fontPtr->faces[i].ft0Font : fontPtr->faces[i].ftFont);
 }
+
+static XftFont *
+GetFont(
+    UnixFtFont *fontPtr,
+    FcChar32 ucs4,
+    double angle)
+{
+    return GetFaceFont(fontPtr, GetFace(fontPtr, ucs4), angle);
+}
+
+/*
+ *---------------------------------------------------------------------------
+ *
+ * GetGlyph --
+ *
+ *	Look up the face, glyph index and unrotated metrics of a character,
+ *	consulting Xft only the first time the character is seen in this font.
+ *
+ * Results:
+ *	A pointer to the font's cache entry for the character.
+ *
+ * Side effects:
+ *	The cache entry, and the page or hash table holding it, may be
+ *	allocated.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+static UnixFtGlyph *
+GetGlyph(
+    UnixFtFont *fontPtr,
+    FcChar32 ucs4)
+{
+    UnixFtGlyph *glyphPtr;
+
+    if (ucs4 < 0x10000) {
+	UnixFtGlyph **pagePtr;
+
+	if (!fontPtr->glyphPages) {
+	    fontPtr->glyphPages = (UnixFtGlyph **)
+		    ckalloc(GLYPH_PAGES * sizeof(UnixFtGlyph *));
+	    memset(fontPtr->glyphPages, 0, GLYPH_PAGES * sizeof(UnixFtGlyph *));
+	}
+	pagePtr = &fontPtr->glyphPages[ucs4 >> GLYPH_PAGE_BITS];
+	if (!*pagePtr) {
+	    int i;
+
+	    *pagePtr = (UnixFtGlyph *)
+		    ckalloc(GLYPH_PAGE_SIZE * sizeof(UnixFtGlyph));
+	    for (i = 0; i < GLYPH_PAGE_SIZE; i++) {
+		(*pagePtr)[i].face = -1;
+	    }
+	}
+	glyphPtr = &(*pagePtr)[ucs4 & (GLYPH_PAGE_SIZE - 1)];
+    } else {
+	Tcl_HashEntry *hPtr;
+	int isNew;
+
+	if (!fontPtr->glyphTable) {
+	    fontPtr->glyphTable = (Tcl_HashTable *)
+		    ckalloc(sizeof(Tcl_HashTable));
+	    Tcl_InitHashTable(fontPtr->glyphTable, TCL_ONE_WORD_KEYS);
+	}
+	hPtr = Tcl_CreateHashEntry(fontPtr->glyphTable, INT2PTR(ucs4), &isNew);
+	if (isNew) {
+	    glyphPtr = (UnixFtGlyph *)ckalloc(sizeof(UnixFtGlyph));
+	    glyphPtr->face = -1;
+	    Tcl_SetHashValue(hPtr, glyphPtr);
+	} else {
+	    glyphPtr = (UnixFtGlyph *)Tcl_GetHashValue(hPtr);
+	}
+    }
+
+    if (glyphPtr->face < 0) {
+	int face = GetFace(fontPtr, ucs4);
+	XftFont *ftFont = GetFaceFont(fontPtr, face, 0.0);
+	XGlyphInfo metrics;
+
+	glyphPtr->glyph = XftCharIndex(fontPtr->display, ftFont, ucs4);
+	LOCK;
+	XftGlyphExtents(fontPtr->display, ftFont, &glyphPtr->glyph, 1,
+		&metrics);
+	UNLOCK;
+	glyphPtr->xOff = metrics.xOff;
+	glyphPtr->yOff = metrics.yOff;
+	glyphPtr->width = metrics.width;
+	glyphPtr->height = metrics.height;
+	glyphPtr->face = face;
+    }
+    return glyphPtr;
+}
+
+/*
+ *---------------------------------------------------------------------------
+ *
+ * FreeGlyphCache --
+ *
+ *	Release the glyph cache of a font.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+static void
+FreeGlyphCache(
+    UnixFtFont *fontPtr)
+{
+    if (fontPtr->glyphPages) {
+	int i;
+
+	for (i = 0; i < GLYPH_PAGES; i++) {
+	    if (fontPtr->glyphPages[i]) {
+		ckfree(fontPtr->glyphPages[i]);
+	    }
+	}
+	ckfree(fontPtr->glyphPages);
+	fontPtr->glyphPages = NULL;
+    }
+    if (fontPtr->glyphTable) {
+	Tcl_HashSearch search;
+	Tcl_HashEntry *hPtr;
+
+	for (hPtr = Tcl_FirstHashEntry(fontPtr->glyphTable, &search);
+		hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	    ckfree(Tcl_GetHashValue(hPtr));
+	}
+	Tcl_DeleteHashTable(fontPtr->glyphTable);
+	ckfree(fontPtr->glyphTable);
+	fontPtr->glyphTable = NULL;
+    }
+}
 
 /*
  *---------------------------------------------------------------------------
@@ -331,6 +546,8 @@ InitFont(
     fontPtr->pattern = pattern;
     fontPtr->faces = (UnixFtFace *)ckalloc(set->nfont * sizeof(UnixFtFace));
     fontPtr->nfaces = set->nfont;
+    fontPtr->glyphPages = NULL;
+    fontPtr->glyphTable = NULL;
 
     /*
      * Fill in information about each returned font
@@ -436,6 +653,15 @@ FinishedWithFont(
     int i;
     Tk_ErrorHandler handler =
 	    Tk_CreateErrorHandler(display, -1, -1, -1, NULL, NULL);
+    ThreadSpecificData *tsdPtr = (ThreadSpecificData *)
+	    Tcl_GetThreadData(&dataKey, sizeof(ThreadSpecificData));
+
+    /*
+     * Pending glyphs may refer to this font's faces or be drawn through its
+     * XftDraw.
+     */
+
+    FlushBatch(tsdPtr);
 
     for (i = 0; i < fontPtr->nfaces; i++) {
 	if (fontPtr->faces[i].ftFont) {
@@ -455,6 +681,7 @@ FinishedWithFont(
     if (fontPtr->faces) {
 	ckfree(fontPtr->faces);
     }
+    FreeGlyphCache(fontPtr);
     if (fontPtr->pattern) {
 	FcPatternDestroy(fontPtr->pattern);
     }
@@ -734,11 +961,10 @@ Tk_MeasureChars(
 				 * terminating character. */
 {
     UnixFtFont *fontPtr = (UnixFtFont *) tkfont;
-    XftFont *ftFont;
+    UnixFtGlyph *glyphPtr;
     FcChar32 c;
-    XGlyphInfo extents;
     Tcl_Size clen;
-    int curX, newX, curByte, newByte, sawNonSpace;
+    int curX, newX, curByte, newByte, sawNonSpace, xOff;
     int termByte = 0, termX = 0, errorFlag = 0;
     Tk_ErrorHandler handler;
 #if DEBUG_FONTSEL
@@ -754,7 +980,12 @@ Tk_MeasureChars(
     while (numBytes > 0) {
 	int unichar;
 
-	clen = Tcl_UtfToUniChar(source, &unichar);
+	if (UCHAR(*source) < 0x80) {
+	    unichar = UCHAR(*source);
+	    clen = 1;
+	} else {
+	    clen = Tcl_UtfToUniChar(source, &unichar);
+	}
 	c = (FcChar32) unichar;
 
 	if (clen <= 0) {
@@ -780,19 +1011,20 @@ Tk_MeasureChars(
 #if DEBUG_FONTSEL
 	string[len++] = (char) c;
 #endif /* DEBUG_FONTSEL */
-	ftFont = GetFont(fontPtr, c, 0.0);
-
-	if (!errorFlag) {
-	    LOCK;
-	    XftTextExtents32(fontPtr->display, ftFont, &c, 1, &extents);
-	    UNLOCK;
-	}
+	glyphPtr = GetGlyph(fontPtr, c);
 	if (errorFlag) {
-	    extents.xOff = 0;
+	    /*
+	     * Don't remember metrics obtained while an X error was raised.
+	     */
+
+	    glyphPtr->face = -1;
+	    xOff = 0;
 	    errorFlag = 0;
+	} else {
+	    xOff = glyphPtr->xOff;
 	}
 
-	newX = curX + extents.xOff;
+	newX = curX + xOff;
 	newByte = curByte + clen;
 	if (maxLength >= 0 && newX > maxLength) {
 	    if (flags & TK_PARTIAL_OK ||
@@ -927,7 +1159,7 @@ LookUpColor(Display *display,      /* Display to lookup colors on */
     return &fontPtr->colors[last].color;
 }
 
-#define NUM_SPEC    1024
+#define NUM_SPEC    NUM_BATCH
 
 void
 Tk_DrawChars(
@@ -952,12 +1184,18 @@ Tk_DrawChars(
     UnixFtFont *fontPtr = (UnixFtFont *) tkfont;
     XGCValues values;
     XftColor *xftcolor;
-    int clen, nspec, xStart = x;
-    XftGlyphFontSpec specs[NUM_SPEC];
-    XGlyphInfo metrics;
+    int clen, nspec, xStart = x, batch;
+    XftGlyphFontSpec localSpecs[NUM_SPEC], *specs;
     ThreadSpecificData *tsdPtr = (ThreadSpecificData *)
 	    Tcl_GetThreadData(&dataKey, sizeof(ThreadSpecificData));
 
+    XGetGCValues(display, gc, GCForeground, &values);
+    batch = (tsdPtr->batchLevel > 0);
+    if (tsdPtr->nBatch > 0 && (!batch || tsdPtr->batchDrawable != drawable
+	    || tsdPtr->batchColor.pixel != values.foreground)) {
+	FlushBatch(tsdPtr);
+    }
+
     if (fontPtr->ftDraw == 0) {
 	DEBUG(("Switch to drawable 0x%lx\n", drawable));
 	fontPtr->ftDraw = XftDrawCreate(display, drawable,
@@ -970,14 +1208,29 @@ Tk_DrawChars(
 	XftDrawChange(fontPtr->ftDraw, drawable);
 	Tk_DeleteErrorHandler(handler);
     }
-    XGetGCValues(display, gc, GCForeground, &values);
-    xftcolor = LookUpColor(display, fontPtr, values.foreground);
-    if (tsdPtr->clipRegion != NULL) {
-	XftDrawSetClip(fontPtr->ftDraw, tsdPtr->clipRegion);
+    if (batch && tsdPtr->nBatch > 0) {
+	xftcolor = &tsdPtr->batchColor;
+    } else {
+	xftcolor = LookUpColor(display, fontPtr, values.foreground);
+    }
+    if (batch) {
+	if (tsdPtr->nBatch == 0) {
+	    tsdPtr->batchFontPtr = fontPtr;
+	    tsdPtr->batchDrawable = drawable;
+	    tsdPtr->batchColor = *xftcolor;
+	}
+	specs = tsdPtr->batchSpecs;
+	nspec = tsdPtr->nBatch;
+    } else {
+	if (tsdPtr->clipRegion != NULL) {
+	    XftDrawSetClip(fontPtr->ftDraw, tsdPtr->clipRegion);
+	}
+	specs = localSpecs;
+	nspec = 0;
     }
-    nspec = 0;
     while (numBytes > 0) {
 	XftFont *ftFont;
+	UnixFtGlyph *glyphPtr;
 	FcChar32 c;
 
 	clen = utf8ToUcs4(source, &c, numBytes);
@@ -991,45 +1244,53 @@ Tk_DrawChars(
 	source += clen;
 	numBytes -= clen;
 
-	ftFont = GetFont(fontPtr, c, 0.0);
+	glyphPtr = GetGlyph(fontPtr, c);
+	ftFont = GetFaceFont(fontPtr, glyphPtr->face, 0.0);
 	if (ftFont) {
-	    specs[nspec].glyph = XftCharIndex(fontPtr->display, ftFont, c);
-	    LOCK;
-	    XftGlyphExtents(fontPtr->display, ftFont, &specs[nspec].glyph, 1,
-		    &metrics);
-	    UNLOCK;
-
 	    /*
 	     * Draw glyph only when it fits entirely into 16 bit coords.
 	     */
 
 	    if (x >= minCoord && y >= minCoord &&
-		x <= maxCoord - metrics.width &&
-		y <= maxCoord - metrics.height) {
+		x <= maxCoord - glyphPtr->width &&
+		y <= maxCoord - glyphPtr->height) {
+		specs[nspec].glyph = glyphPtr->glyph;
 		specs[nspec].font = ftFont;
 		specs[nspec].x = x;
 		specs[nspec].y = y;
 		if (++nspec == NUM_SPEC) {
-		    LOCK;
-		    XftDrawGlyphFontSpec(fontPtr->ftDraw, xftcolor,
-			    specs, nspec);
-		    UNLOCK;
+		    if (batch) {
+			tsdPtr->nBatch = nspec;
+			FlushBatch(tsdPtr);
+		    } else {
+			LOCK;
+			XftDrawGlyphFontSpec(fontPtr->ftDraw, xftcolor,
+				specs, nspec);
+			UNLOCK;
+		    }
 		    nspec = 0;
 		}
 	    }
-	    x += metrics.xOff;
-	    y += metrics.yOff;
+	    x += glyphPtr->xOff;
+	    y += glyphPtr->yOff;
 	}
     }
-    if (nspec) {
-	LOCK;
-	XftDrawGlyphFontSpec(fontPtr->ftDraw, xftcolor, specs, nspec);
-	UNLOCK;
-    }
 
   doUnderlineStrikeout:
-    if (tsdPtr->clipRegion != NULL) {
-	XftDrawSetClip(fontPtr->ftDraw, NULL);
+    if (batch) {
+	tsdPtr->nBatch = nspec;
+	if (fontPtr->font.fa.underline || fontPtr->font.fa.overstrike) {
+	    FlushBatch(tsdPtr);
+	}
+    } else {
+	if (nspec) {
+	    LOCK;
+	    XftDrawGlyphFontSpec(fontPtr->ftDraw, xftcolor, specs, nspec);
+	    UNLOCK;
+	}
+	if (tsdPtr->clipRegion != NULL) {
+	    XftDrawSetClip(fontPtr->ftDraw, NULL);
+	}
     }
     if (fontPtr->font.fa.underline != 0) {
 	XFillRectangle(display, drawable, gc, xStart,
@@ -1097,6 +1358,7 @@ TkDrawAngledChars(
     XftFont *currentFtFont;
     int originX, originY;
 
+    FlushBatch(tsdPtr);
     if (fontPtr->ftDraw == 0) {
 	DEBUG(("Switch to drawable 0x%x\n", drawable));
 	fontPtr->ftDraw = XftDrawCreate(display, drawable,
@@ -1122,6 +1384,7 @@ TkDrawAngledChars(
 
     while (numBytes > 0) {
 	XftFont *ftFont;
+	UnixFtGlyph *glyphPtr;
 	FcChar32 c;
 
 	clen = utf8ToUcs4(source, &c, numBytes);
@@ -1135,7 +1398,8 @@ TkDrawAngledChars(
 	source += clen;
 	numBytes -= clen;
 
-	ftFont = GetFont(fontPtr, c, angle);
+	glyphPtr = GetGlyph(fontPtr, c);
+	ftFont = GetFaceFont(fontPtr, glyphPtr->face, angle);
 	if (!ftFont) {
 	    continue;
 	}
@@ -1186,7 +1450,7 @@ TkDrawAngledChars(
 	    originY = ROUND16(y);
 	    currentFtFont = ftFont;
 	}
-	glyphs[nglyph++] = XftCharIndex(fontPtr->display, ftFont, c);
+	glyphs[nglyph++] = glyphPtr->glyph;
     }
     if (nglyph) {
 	LOCK;
@@ -1211,9 +1475,9 @@ TkDrawAngledChars(
     Tcl_Size clen;
     int nspec;
     XftGlyphFontSpec specs[NUM_SPEC];
-    XGlyphInfo metrics;
     double sinA = sin(angle * PI/180.0), cosA = cos(angle * PI/180.0);
 
+    FlushBatch(tsdPtr);
     if (fontPtr->ftDraw == 0) {
 	DEBUG(("Switch to drawable 0x%lx\n", drawable));
 	fontPtr->ftDraw = XftDrawCreate(display, drawable,
@@ -1233,7 +1497,8 @@ TkDrawAngledChars(
     }
     nspec = 0;
     while (numBytes > 0) {
-	XftFont *ftFont, *ft0Font;
+	XftFont *ftFont;
+	UnixFtGlyph *glyphPtr;
 	FcChar32 c;
 
 	clen = utf8ToUcs4(source, &c, numBytes);
@@ -1247,22 +1512,17 @@ TkDrawAngledChars(
 	source += clen;
 	numBytes -= clen;
 
-	ftFont = GetFont(fontPtr, c, angle);
-	ft0Font = GetFont(fontPtr, c, 0.0);
-	if (ftFont && ft0Font) {
-	    specs[nspec].glyph = XftCharIndex(fontPtr->display, ftFont, c);
-	    LOCK;
-	    XftGlyphExtents(fontPtr->display, ft0Font, &specs[nspec].glyph, 1,
-		    &metrics);
-	    UNLOCK;
-
+	glyphPtr = GetGlyph(fontPtr, c);
+	ftFont = GetFaceFont(fontPtr, glyphPtr->face, angle);
+	if (ftFont) {
 	    /*
 	     * Draw glyph only when it fits entirely into 16 bit coords.
 	     */
 
 	    if (x >= minCoord && y >= minCoord &&
-		x <= maxCoord - metrics.width &&
-		y <= maxCoord - metrics.height) {
+		x <= maxCoord - glyphPtr->width &&
+		y <= maxCoord - glyphPtr->height) {
+		specs[nspec].glyph = glyphPtr->glyph;
 		specs[nspec].font = ftFont;
 		specs[nspec].x = ROUND16(x);
 		specs[nspec].y = ROUND16(y);
@@ -1274,8 +1534,8 @@ TkDrawAngledChars(
 		    nspec = 0;
 		}
 	    }
-	    x += metrics.xOff*cosA + metrics.yOff*sinA;
-	    y += metrics.yOff*cosA - metrics.xOff*sinA;
+	    x += glyphPtr->xOff*cosA + glyphPtr->yOff*sinA;
+	    y += glyphPtr->yOff*cosA - glyphPtr->xOff*sinA;
 	}
     }
     if (nspec) {
@@ -1431,8 +1691,62 @@ TkUnixSetXftClipRegion(
     ThreadSpecificData *tsdPtr = (ThreadSpecificData *)
 	    Tcl_GetThreadData(&dataKey, sizeof(ThreadSpecificData));
 
+    if (tsdPtr->clipRegion != clipRegion) {
+	FlushBatch(tsdPtr);
+    }
     tsdPtr->clipRegion = clipRegion;
 }
+
+/*
+ *---------------------------------------------------------------------------
+ *
+ * TkUnixBeginXftBatch, TkUnixEndXftBatch, TkUnixFlushXftBatch --
+ *
+ *	Widget display procedures that draw many strings into the same
+ *	drawable bracket that drawing with TkUnixBeginXftBatch and
+ *	TkUnixEndXftBatch. In between, Tk_DrawChars collects the glyphs of
+ *	consecutive calls with the same drawable and color, and sends them
+ *	as a single request. The caller must use TkUnixFlushXftBatch before
+ *	drawing anything else that may overlap the text already drawn.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	TkUnixEndXftBatch, at the outermost level, and TkUnixFlushXftBatch
+ *	draw the pending glyphs.
+ *
+ *---------------------------------------------------------------------------
+ */
+
+void
+TkUnixBeginXftBatch(void)
+{
+    ThreadSpecificData *tsdPtr = (ThreadSpecificData *)
+	    Tcl_GetThreadData(&dataKey, sizeof(ThreadSpecificData));
+
+    tsdPtr->batchLevel++;
+}
+
+void
+TkUnixEndXftBatch(void)
+{
+    ThreadSpecificData *tsdPtr = (ThreadSpecificData *)
+	    Tcl_GetThreadData(&dataKey, sizeof(ThreadSpecificData));
+
+    if (tsdPtr->batchLevel > 0 && --tsdPtr->batchLevel == 0) {
+	FlushBatch(tsdPtr);
+    }
+}
+
+void
+TkUnixFlushXftBatch(void)
+{
+    ThreadSpecificData *tsdPtr = (ThreadSpecificData *)
+	    Tcl_GetThreadData(&dataKey, sizeof(ThreadSpecificData));
+
+    FlushBatch(tsdPtr);
+}
 
 /*
  * Local Variables:
@@ -609,8 +609,7 @@ TkpDisplayScale(
      * been cleared.
      */
 
-    pixmap = Tk_GetPixmap(scalePtr->display, Tk_WindowId(tkwin),
-	    Tk_Width(tkwin), Tk_Height(tkwin), Tk_Depth(tkwin));
+    pixmap = TkGetBufferPixmap(tkwin, Tk_Width(tkwin), Tk_Height(tkwin));
 #else
     pixmap = Tk_WindowId(tkwin);
 #endif /* TK_NO_DOUBLE_BUFFERING */
@@ -667,7 +666,7 @@ TkpDisplayScale(
     XCopyArea(scalePtr->display, pixmap, Tk_WindowId(tkwin),
 	    scalePtr->copyGC, drawnArea.x, drawnArea.y, drawnArea.width,
 	    drawnArea.height, drawnArea.x, drawnArea.y);
-    Tk_FreePixmap(scalePtr->display, pixmap);
+    TkFreeBufferPixmap(tkwin, pixmap);
 #endif /* TK_NO_DOUBLE_BUFFERING */
 
   done: